@@ -0,0 +1,33 @@
+# Compares getting a summary of a query with PgQuery.analyze against calling
+# PgQuery.normalize and parsing the query for its fingerprint, tables and params.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/analyze.rb
+
+require 'benchmark'
+require 'pg_query'
+
+SMALL = "SELECT a, b FROM x JOIN y ON x.id = y.x_id WHERE y.z = 'foo' AND x.w = $1".freeze
+LARGE = ('WITH c AS (SELECT * FROM base) SELECT ' + (1..200).map { |i| "t#{i % 10}.col_#{i}" }.join(', ') +
+         ' FROM ' + (0...10).map { |i| "tbl_#{i} t#{i}" }.join(', ') + ', c WHERE id IN (' +
+         (1..1000).map(&:to_s).join(', ') + ')').freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i
+
+def separate(query)
+  parsed = PgQuery.parse(query)
+  [PgQuery.normalize(query), parsed.fingerprint, parsed.tables_with_types, parsed.aliases, parsed.param_refs]
+end
+
+{ 'small' => [SMALL, ITERATIONS * 200], 'large' => [LARGE, ITERATIONS] }.each do |name, (query, iterations)|
+  analysis = PgQuery.analyze(query)
+  expected = separate(query)
+  raise 'results differ' unless [analysis.normalized, analysis.fingerprint, analysis.tables_with_types,
+                                 analysis.aliases, analysis.param_refs] == expected
+
+  puts "#{name} query (#{query.bytesize} bytes, #{iterations} iterations)"
+  Benchmark.bm(10) do |x|
+    x.report('separate') { iterations.times { separate(query) } }
+    x.report('analyze') { iterations.times { PgQuery.analyze(query) } }
+  end
+  puts
+end
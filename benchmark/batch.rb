@@ -0,0 +1,32 @@
+# Compares parsing a list of queries one by one with the batch API, which
+# processes the whole list on a pool of native threads in one call.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/batch.rb
+
+require 'benchmark'
+require 'pg_query'
+
+QUERIES = Array.new(10_000) do |i|
+  "SELECT a.id, a.name, b.value FROM accounts_#{i % 100} a " \
+  'JOIN balances b ON b.account_id = a.id ' \
+  "WHERE a.created_at > $1 AND b.value IN (#{i}, 2, 3) ORDER BY a.name LIMIT 100"
+end.freeze
+
+THREADS = (ENV['THREADS'] || '1,2,4,8').split(',').map(&:to_i)
+
+Benchmark.bm(28) do |x|
+  x.report('parse (loop)') { QUERIES.each { |q| PgQuery.parse(q) } }
+  THREADS.each do |threads|
+    x.report("parse_many threads=#{threads}") { PgQuery.parse_many(QUERIES, threads: threads) }
+  end
+
+  x.report('fingerprint (loop)') { QUERIES.each { |q| PgQuery.fingerprint(q) } }
+  THREADS.each do |threads|
+    x.report("fingerprint_many threads=#{threads}") { PgQuery.fingerprint_many(QUERIES, threads: threads) }
+  end
+
+  x.report('normalize (loop)') { QUERIES.each { |q| PgQuery.normalize(q) } }
+  THREADS.each do |threads|
+    x.report("normalize_many threads=#{threads}") { PgQuery.normalize_many(QUERIES, threads: threads) }
+  end
+end
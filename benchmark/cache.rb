@@ -0,0 +1,31 @@
+# Compares parsing, normalizing and fingerprinting a small set of repeating
+# queries (like ORM-generated SQL) with and without PgQuery.cache.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/cache.rb
+
+require 'benchmark'
+require 'pg_query'
+
+QUERIES = (1..50).map do |i|
+  "SELECT u.id, u.name, p.title FROM users u JOIN posts p ON p.user_id = u.id WHERE u.org_id = $1 AND p.state_#{i} = 'x'"
+end.freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i * 100
+
+def run
+  ITERATIONS.times do |i|
+    query = QUERIES[i % QUERIES.size]
+    PgQuery.parse(query).tables
+    PgQuery.normalize(query)
+    PgQuery.fingerprint(query)
+  end
+end
+
+puts "#{QUERIES.size} distinct queries, #{ITERATIONS} iterations"
+Benchmark.bm(10) do |x|
+  x.report('uncached') { run }
+
+  PgQuery.cache = PgQuery::Cache.new(max_bytes: 16 * 1024 * 1024)
+  x.report('cached') { run }
+end
+p PgQuery.cache.stats
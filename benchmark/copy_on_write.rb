@@ -0,0 +1,45 @@
+# Measures PgQuery#truncate and PgQuery#parsetree (the legacy tree format) on
+# large trees. Both used to start with a deep copy of the whole tree
+# (PgQuery#deep_dup), which is reported alongside them for comparison - they
+# now only copy the Hashes and Arrays on the path to the parts they change.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/copy_on_write.rb
+
+require 'benchmark'
+require 'pg_query'
+
+TARGETS = (1..500).map { |i| "t#{i % 10}.col_#{i}" }.join(', ')
+QUERIES = {
+  'select' => "SELECT #{TARGETS} FROM tbl t0 WHERE t0.id IN (#{(1..2000).to_a.join(', ')}) AND t0.state = 'active'",
+  'insert' => "INSERT INTO items (id, name, price) VALUES #{(1..1000).map { |i| "(#{i}, 'name #{i}', #{i * 1.5})" }.join(', ')}",
+  'cte' => "WITH #{(1..50).map { |i| "cte_#{i} AS (SELECT #{TARGETS} FROM x_#{i} WHERE c = $#{i})" }.join(', ')} " \
+           "SELECT * FROM #{(1..50).map { |i| "cte_#{i}" }.join(', ')}"
+}.freeze
+
+TRUNCATE_LENGTH = 80
+ITERATIONS = (ENV['ITERATIONS'] || 10).to_i
+
+def allocations
+  before = GC.stat(:total_allocated_objects)
+  yield
+  GC.stat(:total_allocated_objects) - before
+end
+
+QUERIES.each do |name, query|
+  parsed = PgQuery.parse(query)
+
+  # Fresh objects for every call, since #parsetree is memoized
+  deep_dup = -> { parsed.deep_dup(parsed.tree) }
+  truncate = -> { PgQuery.new(query, parsed.tree).truncate(TRUNCATE_LENGTH) }
+  parsetree = -> { PgQuery.new(query, parsed.tree).parsetree }
+
+  puts "#{name} query (#{query.bytesize} bytes, #{ITERATIONS} iterations)"
+  Benchmark.bm(10) do |x|
+    x.report('deep_dup') { ITERATIONS.times { deep_dup.call } }
+    x.report('truncate') { ITERATIONS.times { truncate.call } }
+    x.report('parsetree') { ITERATIONS.times { parsetree.call } }
+  end
+  puts format('allocations per call: deep_dup %d, truncate %d, parsetree %d',
+              allocations(&deep_dup), allocations(&truncate), allocations(&parsetree))
+  puts
+end
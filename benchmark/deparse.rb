@@ -0,0 +1,42 @@
+# Compares deparsing an already parsed tree in Ruby (the fallback
+# implementation of PgQuery#deparse) with the native implementation, and with
+# deparsing a lazily parsed (native) tree, by time and Ruby objects allocated
+# per call.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/deparse.rb
+
+require 'benchmark'
+require 'pg_query'
+
+SMALL = 'SELECT a, b FROM x WHERE y = $1'.freeze
+LARGE = ('SELECT ' + (1..500).map { |i| "col_#{i}" }.join(', ') + ' FROM tbl WHERE id IN (' +
+         (1..2000).map(&:to_s).join(', ') + ')').freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i
+
+{ 'small' => [SMALL, ITERATIONS * 500], 'large' => [LARGE, ITERATIONS] }.each do |name, (query, iterations)|
+  q = PgQuery.parse(query)
+  lazy = PgQuery.parse(query, lazy: true)
+
+  raise 'deparsed queries differ' unless q.deparse == q.send(:ruby_deparse, q.tree)
+  raise 'deparsed queries differ' unless lazy.deparse == q.deparse
+
+  implementations = {
+    'ruby' => -> { q.send(:ruby_deparse, q.tree) },
+    'native' => -> { q.deparse },
+    'native lazy' => -> { lazy.deparse }
+  }
+
+  puts "#{name} query (#{query.bytesize} bytes, #{iterations} iterations)"
+  Benchmark.bm(14) do |x|
+    implementations.each do |label, implementation|
+      x.report(label) { iterations.times { implementation.call } }
+    end
+  end
+  implementations.each do |label, implementation|
+    allocated_before = GC.stat(:total_allocated_objects)
+    implementation.call
+    puts format('%-14s %d objects allocated per call', label, GC.stat(:total_allocated_objects) - allocated_before)
+  end
+  puts
+end
@@ -0,0 +1,44 @@
+# Compares the hex fingerprints returned by PgQuery.fingerprint with
+# PgQuery.fingerprint_int and PgQuery.fingerprint_binary: time and Ruby
+# objects allocated per call, and the memory used by a Hash keyed by the
+# fingerprints of distinct queries (as in an aggregator counting queries).
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/fingerprint_int.rb
+
+require 'benchmark'
+require 'objspace'
+require 'pg_query'
+
+QUERY = 'SELECT * FROM users WHERE id = $1 AND state = $2'.freeze
+DISTINCT = (ENV['DISTINCT'] || 100_000).to_i
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i * 1000
+
+# Distinct queries, so that the fingerprints differ
+QUERIES = Array.new(DISTINCT) { |i| "SELECT * FROM table_#{i} WHERE id = $1" }.freeze
+
+CALLS = {
+  'fingerprint' => ->(query) { PgQuery.fingerprint(query) },
+  'fingerprint_binary' => ->(query) { PgQuery.fingerprint_binary(query) },
+  'fingerprint_int' => ->(query) { PgQuery.fingerprint_int(query) },
+  'fingerprint_int v3' => ->(query) { PgQuery.fingerprint_int(query, version: 3) }
+}.freeze
+
+def run(call)
+  call.call(QUERY) # Warm up
+  allocated = GC.stat(:total_allocated_objects)
+  time = Benchmark.realtime { ITERATIONS.times { call.call(QUERY) } }
+  [time * 1_000_000 / ITERATIONS, (GC.stat(:total_allocated_objects) - allocated).to_f / ITERATIONS]
+end
+
+# Size of the Hash and its keys (Integers in the Fixnum range take up no memory)
+def table_bytes(call)
+  counts = Hash.new(0)
+  QUERIES.each { |query| counts[call.call(query)] += 1 }
+  ObjectSpace.memsize_of(counts) + counts.keys.inject(0) { |sum, key| sum + ObjectSpace.memsize_of(key) }
+end
+
+puts "#{ITERATIONS} calls, table of #{DISTINCT} distinct fingerprints"
+CALLS.each do |name, call|
+  us, allocations = run(call)
+  puts format('%-20s %8.2f us/call (%4.1f objects), table %8.1f KB', name, us, allocations, table_bytes(call) / 1024.0)
+end
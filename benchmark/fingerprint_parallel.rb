@@ -0,0 +1,32 @@
+# Measures how PgQuery.fingerprint_parallel scales with the number of Ractors,
+# compared to calling PgQuery.fingerprint in a loop (Ruby 3.0+).
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/fingerprint_parallel.rb
+
+require 'benchmark'
+require 'etc'
+require 'pg_query'
+
+Warning[:experimental] = false if Warning.respond_to?(:[]=)
+
+QUERIES = Array.new(20_000) do |i|
+  "SELECT a.id, a.name, b.value FROM accounts_#{i % 100} a " \
+  'JOIN balances b ON b.account_id = a.id ' \
+  "WHERE a.created_at > $1 AND b.value IN (#{i}, 2, 3) ORDER BY a.name LIMIT 100"
+end.freeze
+
+RACTORS = (ENV['RACTORS'] || [1, 2, 4, 8, Etc.nprocessors].uniq.sort.join(',')).split(',').map(&:to_i)
+
+# Warm up, this also starts the first Ractor (which prints a warning on some Rubies)
+PgQuery.fingerprint_parallel(QUERIES.first(100), ractors: 2)
+
+loop_time = Benchmark.realtime { QUERIES.each { |q| PgQuery.fingerprint(q) } }
+puts format('%-28s %8.3fs', 'fingerprint (loop)', loop_time)
+
+base = nil
+RACTORS.each do |ractors|
+  time = Benchmark.realtime { PgQuery.fingerprint_parallel(QUERIES, ractors: ractors) }
+  base ||= time * ractors
+  puts format('%-28s %8.3fs  %5.2fx speedup vs. loop, %3.0f%% of linear scaling',
+              "fingerprint_parallel(#{ractors})", time, loop_time / time, 100 * base / ractors / time)
+end
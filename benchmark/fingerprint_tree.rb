@@ -0,0 +1,33 @@
+# Compares fingerprinting an already parsed tree in Ruby (the previous
+# implementation of PgQuery#fingerprint) with the native implementation, and
+# version 2 (SHA-1) with version 3 (XXH64) fingerprints.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/fingerprint_tree.rb
+
+require 'benchmark'
+require 'pg_query'
+
+SMALL = 'SELECT a, b FROM x WHERE y = $1'.freeze
+LARGE = ('SELECT ' + (1..500).map { |i| "col_#{i}" }.join(', ') + ' FROM tbl WHERE id IN (' +
+         (1..2000).map(&:to_s).join(', ') + ')').freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i
+
+{ 'small' => [SMALL, ITERATIONS * 500], 'large' => [LARGE, ITERATIONS] }.each do |name, (query, iterations)|
+  q = PgQuery.parse(query)
+
+  raise 'fingerprints differ' unless q.fingerprint == q.send(:ruby_fingerprint)
+  raise 'fingerprints differ' unless q.fingerprint(version: 3) == q.send(:ruby_fingerprint, 3)
+  raise 'fingerprints differ' unless PgQuery.fingerprint(query, version: 3) == q.fingerprint(version: 3)
+
+  puts "#{name} query (#{query.bytesize} bytes, #{iterations} iterations)"
+  Benchmark.bm(14) do |x|
+    x.report('ruby') { iterations.times { q.send(:ruby_fingerprint) } }
+    x.report('ruby v3') { iterations.times { q.send(:ruby_fingerprint, 3) } }
+    x.report('native') { iterations.times { q.fingerprint } }
+    x.report('native v3') { iterations.times { q.fingerprint(version: 3) } }
+    x.report('text') { iterations.times { PgQuery.fingerprint(query) } }
+    x.report('text v3') { iterations.times { PgQuery.fingerprint(query, version: 3) } }
+  end
+  puts
+end
@@ -0,0 +1,38 @@
+# Compares PgQuery.parse with PgQuery.parse(query, lazy: true) for callers that
+# only need the tables and fingerprint of a query.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/lazy_parse.rb
+
+require 'benchmark'
+require 'objspace'
+require 'pg_query'
+
+SMALL = 'SELECT a, b FROM x JOIN y ON x.id = y.x_id WHERE y.z = $1'.freeze
+LARGE = ('SELECT ' + (1..1000).map { |i| "t#{i % 20}.col_#{i}" }.join(', ') + ' FROM ' +
+         (0...20).map { |i| "tbl_#{i} t#{i}" }.join(', ') + ' WHERE id IN (' +
+         (1..5000).map(&:to_s).join(', ') + ')').freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i
+
+def allocations
+  before = GC.stat(:total_allocated_objects)
+  yield
+  GC.stat(:total_allocated_objects) - before
+end
+
+{ 'small' => [SMALL, ITERATIONS * 500], 'large' => [LARGE, ITERATIONS] }.each do |name, (query, iterations)|
+  eager = -> { q = PgQuery.parse(query); [q.tables, q.fingerprint] }
+  lazy = -> { q = PgQuery.parse(query, lazy: true); [q.tables, q.fingerprint] }
+
+  raise 'results differ' unless eager.call == lazy.call
+
+  puts "#{name} query (#{query.bytesize} bytes, #{iterations} iterations)"
+  Benchmark.bm(10) do |x|
+    x.report('eager') { iterations.times { eager.call } }
+    x.report('lazy') { iterations.times { lazy.call } }
+  end
+  puts format('allocations per call: eager %d, lazy %d', allocations(&eager), allocations(&lazy))
+  puts format('native tree memsize: %d bytes',
+              ObjectSpace.memsize_of(PgQuery.parse(query, lazy: true).instance_variable_get(:@native_tree)))
+  puts
+end
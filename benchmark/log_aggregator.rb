@@ -0,0 +1,50 @@
+# Measures the throughput of PgQuery.aggregate_log on a generated sample log,
+# in lines per second, compared to reading each line in Ruby and calling
+# PgQuery.fingerprint for it.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/log_aggregator.rb
+
+require 'benchmark'
+require 'stringio'
+require 'pg_query'
+
+LINES = (ENV['LINES'] || 100_000).to_i
+
+QUERIES = [
+  'SELECT * FROM users WHERE id = %d',
+  "SELECT a.id, b.name FROM accounts a JOIN owners b ON a.owner_id = b.id WHERE a.state = 'active' AND b.id = %d",
+  'UPDATE jobs SET state = $1, updated_at = now() WHERE id = %d',
+  'INSERT INTO events (account_id, kind, payload) VALUES (%d, $1, $2)',
+  'SELECT count(*) FROM orders WHERE created_at > now() - interval \'1 day\' GROUP BY status LIMIT %d'
+].freeze
+
+# A mix of repeated statement texts and ones that differ only in their constants
+log = StringIO.new
+LINES.times do |i|
+  query = format(QUERIES[i % QUERIES.size], i % 7 == 0 ? i : 1)
+  log << format("2018-01-01 12:00:00.%03d UTC [%d] LOG:  duration: %.3f ms  statement: %s\n", i % 1000, 1000 + i % 50, rand * 100, query)
+end
+LOG = log.string.freeze
+
+def ruby_aggregate(io)
+  entries = Hash.new { |h, k| h[k] = [0, 0.0, 0.0] }
+  io.each_line do |line|
+    next unless line =~ /LOG:  duration: ([\d.]+) ms  statement: (.*)$/
+    duration = Regexp.last_match(1).to_f
+    entry = entries[PgQuery.fingerprint(Regexp.last_match(2))]
+    entry[0] += 1
+    entry[1] += duration
+    entry[2] = duration if duration > entry[2]
+  end
+  entries
+end
+
+puts "#{LINES} lines, #{LOG.bytesize / 1024} KB"
+results = Benchmark.bm(20) do |x|
+  x.report('ruby + fingerprint') { ruby_aggregate(StringIO.new(LOG)) }
+  x.report('aggregate_log') { PgQuery.aggregate_log(StringIO.new(LOG), threads: 1) }
+  x.report("aggregate_log (#{PgQuery.batch_threads})") { PgQuery.aggregate_log(StringIO.new(LOG)) }
+end
+results.each do |result|
+  puts format('%-20s %12d lines/s', result.label, LINES / result.real)
+end
@@ -0,0 +1,45 @@
+# Measures parse throughput with an increasing number of Ruby threads.
+#
+# The parser runs without holding the GVL, so throughput should grow with the
+# number of threads (up to the number of available cores).
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/parse_threads.rb
+
+require 'pg_query'
+
+QUERY = 'SELECT a.id, a.name, b.value FROM accounts a ' \
+        'JOIN balances b ON b.account_id = a.id ' \
+        'WHERE a.created_at > $1 AND b.value IN (1, 2, 3, 4, 5) ' \
+        'ORDER BY a.name LIMIT 100'.freeze
+
+DURATION = (ENV['DURATION'] || 2).to_f
+THREADS = (ENV['THREADS'] || '1,2,4,8').split(',').map(&:to_i)
+
+def run(method, thread_count)
+  count = 0
+  mutex = Mutex.new
+  deadline = Process.clock_gettime(Process::CLOCK_MONOTONIC) + DURATION
+
+  threads = Array.new(thread_count) do
+    Thread.new do
+      local = 0
+      while Process.clock_gettime(Process::CLOCK_MONOTONIC) < deadline
+        PgQuery.send(method, QUERY)
+        local += 1
+      end
+      mutex.synchronize { count += local }
+    end
+  end
+  threads.each(&:join)
+
+  count / DURATION
+end
+
+%i[_raw_parse normalize fingerprint].each do |method|
+  baseline = nil
+  THREADS.each do |thread_count|
+    ops = run(method, thread_count)
+    baseline ||= ops
+    puts format('%-12s threads=%-3d %10.0f ops/sec  (%.2fx)', method, thread_count, ops, ops / baseline)
+  end
+end
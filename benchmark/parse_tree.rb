@@ -0,0 +1,36 @@
+# Compares building the parse tree natively (PgQuery._raw_parse_tree) with the
+# previous approach of returning JSON text and running JSON.parse on it.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/parse_tree.rb
+
+require 'benchmark'
+require 'json'
+require 'pg_query'
+
+SMALL = 'SELECT a, b FROM x WHERE y = $1'.freeze
+LARGE = ('SELECT ' + (1..500).map { |i| "col_#{i}" }.join(', ') + ' FROM tbl WHERE id IN (' +
+         (1..2000).map(&:to_s).join(', ') + ')').freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 200).to_i
+
+def allocations
+  before = GC.stat(:total_allocated_objects)
+  yield
+  GC.stat(:total_allocated_objects) - before
+end
+
+{ 'small' => [SMALL, ITERATIONS * 50], 'large' => [LARGE, ITERATIONS] }.each do |name, (query, iterations)|
+  json_parse = -> { JSON.parse(PgQuery._raw_parse(query)[0], max_nesting: 1000) }
+  native = -> { PgQuery._raw_parse_tree(query)[0] }
+
+  raise 'trees differ' unless json_parse.call == native.call
+
+  puts "#{name} query (#{query.bytesize} bytes, #{iterations} iterations)"
+  Benchmark.bm(14) do |x|
+    x.report('JSON.parse') { iterations.times { json_parse.call } }
+    x.report('_raw_parse_tree') { iterations.times { native.call } }
+  end
+  puts format('allocations per call: JSON.parse %d, _raw_parse_tree %d',
+              allocations(&json_parse), allocations(&native))
+  puts
+end
@@ -0,0 +1,25 @@
+# Compares the throughput of PgQuery.scan (tokens only) with PgQuery._raw_parse
+# (full parse tree, as JSON text).
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/scan.rb
+
+require 'benchmark'
+require 'pg_query'
+
+SMALL = "SELECT a, b FROM x WHERE y = $1 AND z = 'foo' -- comment".freeze
+LARGE = ('SELECT ' + (1..500).map { |i| "col_#{i}" }.join(', ') + ' FROM tbl WHERE id IN (' +
+         (1..2000).map(&:to_s).join(', ') + ')').freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 200).to_i
+
+{ 'small' => [SMALL, ITERATIONS * 50], 'large' => [LARGE, ITERATIONS] }.each do |name, (query, iterations)|
+  puts "#{name} query (#{query.bytesize} bytes, #{PgQuery.scan(query).size} tokens, #{iterations} iterations)"
+  results = Benchmark.bm(10) do |x|
+    x.report('_raw_parse') { iterations.times { PgQuery._raw_parse(query) } }
+    x.report('scan') { iterations.times { PgQuery.scan(query) } }
+  end
+  results.each do |result|
+    puts format('%-10s %10.1f MB/s', result.label, query.bytesize * iterations / result.real / 1024 / 1024)
+  end
+  puts
+end
@@ -0,0 +1,190 @@
+# Measures every public operation over the libpg_query test corpus (copied to
+# spec/files when compiling) and over a few synthetic large queries, and
+# prints the results as JSON, for comparing them across commits:
+#
+#   bundle exec rake bench
+#   BENCH_OUTPUT=before.json bundle exec rake bench
+#
+# For each operation and corpus this reports the calls per second, the p50
+# and p99 latency of a single call in microseconds, and the number of Ruby
+# objects allocated per call. Queries an operation fails on (e.g. statements
+# the deparser doesn't support) are left out for that operation, and counted
+# as "skipped".
+#
+# Set DURATION to the minimum number of seconds to run each operation for
+# (default 1), and OPERATIONS / CORPORA to a comma-separated subset.
+
+require 'json'
+require 'time'
+require 'pg_query'
+
+module PgQueryBenchmark
+  DURATION = (ENV['DURATION'] || 1).to_f
+  TRUNCATE_LENGTH = 40
+
+  OPERATIONS = {
+    'parse' => [:text, ->(query) { PgQuery.parse(query) }],
+    'parse_lazy' => [:text, ->(query) { PgQuery.parse(query, lazy: true) }],
+    'normalize' => [:text, ->(query) { PgQuery.normalize(query) }],
+    'fingerprint' => [:text, ->(query) { PgQuery.fingerprint(query) }],
+    'fingerprint_int' => [:text, ->(query) { PgQuery.fingerprint_int(query) }],
+    'analyze' => [:text, ->(query) { PgQuery.analyze(query) }],
+    'statements' => [:text, ->(query) { PgQuery.statements(query) }],
+    'scan' => [:text, ->(query) { PgQuery.scan(query) }],
+    '#fingerprint' => [:parsed, ->(parsed) { parsed.fingerprint }],
+    '#deparse' => [:parsed, ->(parsed) { parsed.deparse }],
+    '#tables' => [:parsed, ->(parsed) { parsed.tables }],
+    '#filter_columns' => [:parsed, ->(parsed) { parsed.filter_columns }],
+    '#param_refs' => [:parsed, ->(parsed) { parsed.param_refs }],
+    '#truncate' => [:parsed, ->(parsed) { parsed.truncate(TRUNCATE_LENGTH) }]
+  }.freeze
+
+  def self.corpus_queries
+    queries = []
+
+    fingerprint_file = File.join(__dir__, '../spec/files/fingerprint.json')
+    if File.exist?(fingerprint_file)
+      queries.concat(JSON.parse(File.read(fingerprint_file)).map { |testdef| testdef['input'] })
+    end
+
+    Dir.glob(File.join(__dir__, '../spec/files/*.sql')).sort.each do |file|
+      queries.concat(File.read(file).split(/;\s*\n/).map(&:strip))
+    end
+
+    queries.uniq.reject(&:empty?).select do |query|
+      begin
+        PgQuery.parse(query)
+      rescue PgQuery::ParseError
+        false
+      end
+    end
+  end
+
+  def self.large_queries
+    columns = (1..300).map { |i| "t#{i % 10}.col_#{i}" }.join(', ')
+    joins = (1..9).map { |i| "JOIN table_#{i} t#{i} ON t#{i}.id = t0.ref_#{i}" }.join(' ')
+    values = (1..1000).map { |i| "(#{i}, 'name #{i}', #{i * 1.5}, now())" }.join(', ')
+
+    [
+      "SELECT #{columns} FROM table_0 t0 #{joins} WHERE t0.id IN (#{(1..2000).to_a.join(', ')}) " \
+      "AND t0.state = 'active' ORDER BY t0.created_at DESC LIMIT 100",
+      "INSERT INTO items (id, name, price, created_at) VALUES #{values}",
+      "WITH #{(1..50).map { |i| "cte_#{i} AS (SELECT a, b FROM x_#{i} WHERE c = $#{i})" }.join(', ')} " \
+      "SELECT * FROM #{(1..50).map { |i| "cte_#{i}" }.join(', ')}",
+      (1..200).map { |i| "UPDATE accounts SET balance = balance + #{i} WHERE id = #{i}" }.join('; ')
+    ]
+  end
+
+  def self.corpora
+    corpora = { 'corpus' => corpus_queries, 'large' => large_queries }
+    corpora.select! { |name, _| ENV['CORPORA'].split(',').include?(name) } if ENV['CORPORA']
+    corpora
+  end
+
+  def self.operations
+    operations = OPERATIONS
+    operations = operations.select { |name, _| ENV['OPERATIONS'].split(',').include?(name) } if ENV['OPERATIONS']
+    operations
+  end
+
+  # Instance methods memoize some of their results, so they get a fresh
+  # PgQuery object (sharing the parse tree) for every call
+  def self.inputs(kind, queries, parsed)
+    return queries if kind == :text
+    parsed.map { |query| PgQuery.new(query.query, query.tree, query.warnings) }
+  end
+
+  def self.usable_queries(kind, operation, queries, parsed)
+    usable = []
+    inputs(kind, queries, parsed).each_with_index do |input, i|
+      begin
+        operation.call(input)
+        usable << i
+      rescue StandardError
+        next
+      end
+    end
+    usable
+  end
+
+  def self.percentile(sorted, fraction)
+    sorted[[(sorted.size * fraction).ceil - 1, 0].max]
+  end
+
+  def self.measure(kind, operation, queries, parsed)
+    latencies = []
+    allocations = 0
+    calls = 0
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+    # Timing doesn't allocate (clock_gettime returns flonums on 64-bit platforms)
+    loop do
+      inputs = inputs(kind, queries, parsed)
+
+      allocated_before = GC.stat(:total_allocated_objects)
+      inputs.each do |input|
+        start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        operation.call(input)
+        latencies << Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+      end
+      allocations += GC.stat(:total_allocated_objects) - allocated_before
+      calls += inputs.size
+
+      break if Process.clock_gettime(Process::CLOCK_MONOTONIC) - started >= DURATION
+    end
+
+    latencies.sort!
+    total = latencies.inject(0.0, :+)
+    {
+      calls: calls,
+      ops_per_sec: (calls / total).round(1),
+      p50_us: (percentile(latencies, 0.5) * 1_000_000).round(2),
+      p99_us: (percentile(latencies, 0.99) * 1_000_000).round(2),
+      allocations_per_call: (allocations.to_f / calls).round(1)
+    }
+  end
+
+  def self.run
+    PgQuery.cache = nil
+    results = []
+
+    corpora.each do |corpus, corpus_queries|
+      corpus_parsed = corpus_queries.map { |query| PgQuery.parse(query) }
+
+      operations.each do |name, (kind, operation)|
+        usable = usable_queries(kind, operation, corpus_queries, corpus_parsed)
+        next if usable.empty?
+
+        queries = corpus_queries.values_at(*usable)
+        parsed = corpus_parsed.values_at(*usable)
+
+        result = { corpus: corpus, operation: name, queries: usable.size, skipped: corpus_queries.size - usable.size }
+        results << result.merge(measure(kind, operation, queries, parsed))
+        warn format('%-8s %-16s %12.1f ops/s', corpus, name, results.last[:ops_per_sec])
+      end
+    end
+
+    {
+      version: PgQuery::VERSION,
+      ruby: RUBY_DESCRIPTION,
+      commit: git_commit,
+      time: Time.now.utc.iso8601,
+      duration: DURATION,
+      results: results
+    }
+  end
+
+  def self.git_commit
+    commit = `git -C #{File.join(__dir__, '..')} rev-parse HEAD 2>/dev/null`.strip
+    commit.empty? ? nil : commit
+  rescue SystemCallError
+    nil
+  end
+end
+
+output = JSON.pretty_generate(PgQueryBenchmark.run)
+if ENV['BENCH_OUTPUT']
+  File.write(ENV['BENCH_OUTPUT'], output + "\n")
+else
+  puts output
+end
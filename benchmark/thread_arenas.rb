@@ -0,0 +1,47 @@
+# Compares the latency of single calls on short queries (where creating and
+# deleting memory contexts is a large part of the work) with and without
+# PgQuery.thread_arenas, also from several threads at once.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/thread_arenas.rb
+
+require 'benchmark'
+require 'pg_query'
+
+QUERIES = [
+  'SELECT 1',
+  'SELECT * FROM users WHERE id = $1',
+  "UPDATE posts SET state = 'published', updated_at = now() WHERE id = 42"
+].freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i * 1000
+THREADS = (ENV['THREADS'] || 4).to_i
+
+CALLS = {
+  '_raw_parse' => ->(query) { PgQuery._raw_parse(query) },
+  'normalize' => ->(query) { PgQuery.normalize(query) },
+  'analyze' => ->(query) { PgQuery.analyze(query) }
+}.freeze
+
+def run(call, threads)
+  Array.new(threads) do
+    Thread.new { (ITERATIONS / threads).times { |i| call.call(QUERIES[i % QUERIES.size]) } }
+  end.each(&:join)
+end
+
+[1, THREADS].uniq.each do |threads|
+  puts "#{ITERATIONS} calls on #{threads} thread(s)"
+  CALLS.each do |name, call|
+    run(call, threads) # Warm up
+
+    times = [false, true].map do |enabled|
+      PgQuery.thread_arenas = enabled
+      Benchmark.realtime { run(call, threads) }
+    end
+
+    puts format('%-12s %8.2f us/call without arenas, %8.2f us/call with arenas (%.2fx)',
+                name, times[0] * 1_000_000 / ITERATIONS, times[1] * 1_000_000 / ITERATIONS, times[0] / times[1])
+  end
+  puts
+end
+
+PgQuery.thread_arenas = false
@@ -0,0 +1,67 @@
+# Measures walking large trees with PgQuery#treewalker! (which PgQuery#param_refs
+# and PgQuery#truncate use), by time and Ruby objects allocated per call. The
+# walker used to build the location of every value as a new Array, and to
+# copy its whole queue for every Array in the tree - that implementation is
+# reported alongside it for comparison.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/tree_walker.rb
+
+require 'benchmark'
+require 'pg_query'
+
+SIZE = (ENV['SIZE'] || 10_000).to_i
+QUERIES = {
+  'IN list' => "SELECT * FROM tbl WHERE id IN (#{(1..SIZE).to_a.join(', ')})",
+  'VALUES list' => "INSERT INTO items (id, name) VALUES #{(1..SIZE).map { |i| "(#{i}, $#{i})" }.join(', ')}"
+}.freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 5).to_i
+
+def previous_treewalker(tree)
+  exprs = tree.dup.map { |e| [e, []] }
+
+  loop do
+    expr, parent_location = exprs.shift
+
+    if expr.is_a?(Hash)
+      expr.each do |k, v|
+        location = parent_location + [k]
+        yield(expr, k, v, location)
+        exprs << [v, location] unless v.nil?
+      end
+    elsif expr.is_a?(Array)
+      exprs += expr.map.with_index { |e, idx| [e, parent_location + [idx]] }
+    end
+
+    break if exprs.empty?
+  end
+end
+
+def allocations
+  before = GC.stat(:total_allocated_objects)
+  yield
+  GC.stat(:total_allocated_objects) - before
+end
+
+QUERIES.each do |name, query|
+  parsed = PgQuery.parse(query)
+  tree = parsed.tree
+
+  implementations = {
+    'previous walker' => -> { previous_treewalker(tree) {} },
+    'walker' => -> { parsed.send(:treewalker!, tree) {} },
+    'param_refs' => -> { parsed.param_refs },
+    'truncate' => -> { parsed.truncate(80) }
+  }
+
+  puts "#{name} (#{SIZE} elements, #{query.bytesize} bytes, #{ITERATIONS} iterations)"
+  Benchmark.bm(16) do |x|
+    implementations.each do |label, implementation|
+      x.report(label) { ITERATIONS.times { implementation.call } }
+    end
+  end
+  implementations.each do |label, implementation|
+    puts format('%-16s %d objects allocated per call', label, allocations(&implementation))
+  end
+  puts
+end
@@ -0,0 +1,80 @@
+# Compares rescuing ParseError with the try_* methods on input where most
+# statements fail to parse (e.g. truncated statements from a log), by error
+# rate, along with the Ruby objects allocated per call.
+#
+#   bundle exec rake compile && ruby -Ilib benchmark/try_parse.rb
+
+require 'benchmark'
+require 'pg_query'
+
+VALID = [
+  'SELECT * FROM users WHERE id = $1',
+  "UPDATE posts SET state = 'published', updated_at = now() WHERE id = 42"
+].freeze
+
+INVALID = [
+  'SELECT * FROM users WHERE id =',
+  "UPDATE posts SET state = 'publ",
+  'SELECT a, b, FROM x',
+  'INSERT INTO t (a, b) VALUES (1,'
+].freeze
+
+ITERATIONS = (ENV['ITERATIONS'] || 20).to_i * 1000
+
+def queries(error_rate)
+  Array.new(100) { |i| i < error_rate * 100 ? INVALID[i % INVALID.size] : VALID[i % VALID.size] }.shuffle(random: Random.new(1))
+end
+
+CALLS = {
+  'parse' => [
+    lambda do |query|
+      begin
+        PgQuery.parse(query)
+      rescue PgQuery::ParseError => e
+        e
+      end
+    end,
+    ->(query) { PgQuery.try_parse(query) }
+  ],
+  'normalize' => [
+    lambda do |query|
+      begin
+        PgQuery.normalize(query)
+      rescue PgQuery::ParseError => e
+        e
+      end
+    end,
+    ->(query) { PgQuery.try_normalize(query) }
+  ],
+  'fingerprint' => [
+    lambda do |query|
+      begin
+        PgQuery.fingerprint(query)
+      rescue PgQuery::ParseError => e
+        e
+      end
+    end,
+    ->(query) { PgQuery.try_fingerprint(query) }
+  ]
+}.freeze
+
+def run(call, queries)
+  allocated = GC.stat(:total_allocated_objects)
+  time = Benchmark.realtime { ITERATIONS.times { |i| call.call(queries[i % queries.size]) } }
+  [time * 1_000_000 / ITERATIONS, (GC.stat(:total_allocated_objects) - allocated).to_f / ITERATIONS]
+end
+
+[0.0, 0.5, 0.9, 1.0].each do |error_rate|
+  input = queries(error_rate)
+  puts "#{ITERATIONS} calls, #{(error_rate * 100).round}% failing"
+
+  CALLS.each do |name, (rescuing, trying)|
+    run(rescuing, input) # Warm up
+
+    (rescue_us, rescue_allocs), (try_us, try_allocs) = [rescuing, trying].map { |call| run(call, input) }
+
+    puts format('%-12s %8.2f us/call (%5.1f objects) with rescue, %8.2f us/call (%5.1f objects) with try_* (%.2fx)',
+                name, rescue_us, rescue_allocs, try_us, try_allocs, rescue_us / try_us)
+  end
+  puts
+end
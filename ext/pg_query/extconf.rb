@@ -30,11 +30,20 @@ end
 # Copy test files (this intentionally overwrites existing files!)
 system("cp #{libdir}/testdata/* #{gemdir}/spec/files/")
 
-$objs = ['pg_query_ruby.o']
+$objs = ['pg_query_ruby.o', 'pg_query_ruby_tree.o', 'pg_query_ruby_batch.o', 'pg_query_ruby_pool.o',
+         'pg_query_ruby_fingerprint.o', 'pg_query_ruby_sha1.o', 'pg_query_ruby_xxh64.o', 'pg_query_ruby_parser.o',
+         'pg_query_ruby_analyze.o', 'pg_query_ruby_native_tree.o', 'pg_query_ruby_scan.o', 'pg_query_ruby_log.o',
+         'pg_query_ruby_statements.o', 'pg_query_ruby_deparse.o']
+
+have_header 'ruby/thread.h'
+have_func 'rb_thread_call_without_gvl', 'ruby/thread.h'
+have_func 'rb_enc_interned_str', 'ruby/encoding.h'
+have_func 'rb_ext_ractor_safe', 'ruby.h'
+have_library 'pthread'
 
 $LOCAL_LIBS << '-lpg_query'
 $LIBPATH << libdir
-$CFLAGS << " -I #{libdir} -O3 -Wall -fno-strict-aliasing -fwrapv -g"
+$CFLAGS << " -I #{libdir} -I #{libdir}/src -I #{libdir}/src/postgres/include -O3 -Wall -fno-strict-aliasing -fwrapv -g"
 
 SYMFILE = File.join(__dir__, 'pg_query_ruby.sym')
 if RUBY_PLATFORM =~ /darwin/
@@ -1,43 +1,164 @@
 #include "pg_query_ruby.h"
 
-void raise_ruby_parse_error(PgQueryParseResult result);
-void raise_ruby_normalize_error(PgQueryNormalizeResult result);
+#include <stdlib.h>
+#include <string.h>
+
+void raise_ruby_parse_error(PgQueryParserResult result);
 void raise_ruby_fingerprint_error(PgQueryFingerprintResult result);
+void raise_ruby_tree_error(void);
 
 VALUE pg_query_ruby_parse(VALUE self, VALUE input);
+VALUE pg_query_ruby_parse_tree(VALUE self, VALUE input);
 VALUE pg_query_ruby_normalize(VALUE self, VALUE input);
-VALUE pg_query_ruby_fingerprint(VALUE self, VALUE input);
+VALUE pg_query_ruby_fingerprint(VALUE self, VALUE input, VALUE version);
+VALUE pg_query_ruby_fingerprint_tree(int argc, VALUE *argv, VALUE self);
+VALUE pg_query_ruby_deparse_tree(VALUE self, VALUE tree);
+VALUE pg_query_ruby_set_thread_arenas(VALUE self, VALUE enabled);
+VALUE pg_query_ruby_thread_arenas(VALUE self);
+VALUE pg_query_ruby_set_collect_warnings(VALUE self, VALUE enabled);
+VALUE pg_query_ruby_collect_warnings(VALUE self);
+VALUE pg_query_ruby_set_instrumenting(VALUE self, VALUE enabled);
+VALUE pg_query_ruby_instrumenting(VALUE self);
+
+VALUE pg_query_ruby_normalize_with_constants(VALUE self, VALUE input);
+VALUE pg_query_ruby_try_parse_tree(VALUE self, VALUE input);
+VALUE pg_query_ruby_try_normalize(VALUE self, VALUE input);
+VALUE pg_query_ruby_try_fingerprint(VALUE self, VALUE input, VALUE version);
+VALUE pg_query_ruby_fingerprint_int_call(VALUE self, VALUE input, VALUE version);
+VALUE pg_query_ruby_fingerprint_binary(VALUE self, VALUE input);
+VALUE pg_query_ruby_truncation_spans(VALUE self, VALUE input);
+
+static VALUE cResult;
+static VALUE cConstant;
+static ID constant_types[PG_QUERY_PARSER_CONST_NULL + 1];
+static ID span_types[PG_QUERY_PARSER_SPAN_COLS + 1];
+
+static volatile int collect_warnings = 1;
+static volatile int instrumenting = 0;
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+static VALUE cRactor;
+static VALUE main_ractor;
+static ID id_current;
+#endif
+
+static ID id_native_stats;
+static ID id_parse, id_output, id_native_memory, id_bytes_out;
 
 void Init_pg_query(void)
 {
 	VALUE cPgQuery;
 
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+	/*
+	 * Global tables are only written here, during initialization, and thread
+	 * arenas belong to a single native thread. The only other global state are
+	 * the process-wide settings (thread_arenas=, collect_warnings= and
+	 * _instrumenting=), which can only be changed from the main Ractor, so
+	 * everything else can run in any Ractor.
+	 */
+	rb_ext_ractor_safe(true);
+
+	// The extension is loaded by the main Ractor
+	cRactor = rb_const_get(rb_cObject, rb_intern("Ractor"));
+	id_current = rb_intern("current");
+	main_ractor = rb_funcall(cRactor, id_current, 0);
+	rb_gc_register_mark_object(main_ractor);
+#endif
+
 	cPgQuery = rb_const_get(rb_cObject, rb_intern("PgQuery"));
 
 	rb_define_singleton_method(cPgQuery, "_raw_parse", pg_query_ruby_parse, 1);
-	rb_define_singleton_method(cPgQuery, "normalize", pg_query_ruby_normalize, 1);
-	rb_define_singleton_method(cPgQuery, "fingerprint", pg_query_ruby_fingerprint, 1);
+	rb_define_singleton_method(cPgQuery, "_raw_parse_tree", pg_query_ruby_parse_tree, 1);
+	rb_define_singleton_method(cPgQuery, "_raw_normalize", pg_query_ruby_normalize, 1);
+	rb_define_singleton_method(cPgQuery, "_normalize_with_constants", pg_query_ruby_normalize_with_constants, 1);
+	rb_define_singleton_method(cPgQuery, "_raw_fingerprint", pg_query_ruby_fingerprint, 2);
+	rb_define_singleton_method(cPgQuery, "_fingerprint_tree", pg_query_ruby_fingerprint_tree, -1);
+	rb_define_singleton_method(cPgQuery, "_deparse_tree", pg_query_ruby_deparse_tree, 1);
+	rb_define_singleton_method(cPgQuery, "_try_parse_tree", pg_query_ruby_try_parse_tree, 1);
+	rb_define_singleton_method(cPgQuery, "_try_normalize", pg_query_ruby_try_normalize, 1);
+	rb_define_singleton_method(cPgQuery, "_try_fingerprint", pg_query_ruby_try_fingerprint, 2);
+	rb_define_singleton_method(cPgQuery, "_fingerprint_int", pg_query_ruby_fingerprint_int_call, 2);
+	rb_define_singleton_method(cPgQuery, "_fingerprint_binary", pg_query_ruby_fingerprint_binary, 1);
+	rb_define_singleton_method(cPgQuery, "_truncation_spans", pg_query_ruby_truncation_spans, 1);
+	rb_define_singleton_method(cPgQuery, "thread_arenas=", pg_query_ruby_set_thread_arenas, 1);
+	rb_define_singleton_method(cPgQuery, "thread_arenas", pg_query_ruby_thread_arenas, 0);
+	rb_define_singleton_method(cPgQuery, "collect_warnings=", pg_query_ruby_set_collect_warnings, 1);
+	rb_define_singleton_method(cPgQuery, "collect_warnings", pg_query_ruby_collect_warnings, 0);
+	rb_define_singleton_method(cPgQuery, "_instrumenting=", pg_query_ruby_set_instrumenting, 1);
+	rb_define_singleton_method(cPgQuery, "instrumenting?", pg_query_ruby_instrumenting, 0);
+
+	// Methods are added in lib/pg_query/result.rb
+	cResult = rb_struct_define_under(cPgQuery, "Result", "value", "message", "cursorpos", "source_file", "source_line", NULL);
+	cConstant = rb_struct_define_under(cPgQuery, "Constant", "text", "location", "length", "param", "type", NULL);
+
+	constant_types[PG_QUERY_PARSER_CONST_INTEGER] = rb_intern("integer");
+	constant_types[PG_QUERY_PARSER_CONST_FLOAT] = rb_intern("float");
+	constant_types[PG_QUERY_PARSER_CONST_STRING] = rb_intern("string");
+	constant_types[PG_QUERY_PARSER_CONST_BITSTRING] = rb_intern("bitstring");
+	constant_types[PG_QUERY_PARSER_CONST_NULL] = rb_intern("null");
+
+	// Named like the fields in the parse tree
+	span_types[PG_QUERY_PARSER_SPAN_TARGET_LIST] = rb_intern("targetList");
+	span_types[PG_QUERY_PARSER_SPAN_WHERE_CLAUSE] = rb_intern("whereClause");
+	span_types[PG_QUERY_PARSER_SPAN_CTE_QUERY] = rb_intern("ctequery");
+	span_types[PG_QUERY_PARSER_SPAN_COLS] = rb_intern("cols");
+
+	id_native_stats = rb_intern("pg_query_native_stats");
+	id_parse = rb_intern("parse");
+	id_output = rb_intern("output");
+	id_native_memory = rb_intern("native_memory");
+	id_bytes_out = rb_intern("bytes_out");
+
+	Init_pg_query_batch(cPgQuery);
+	Init_pg_query_analyze(cPgQuery);
+	Init_pg_query_native_tree(cPgQuery);
+	Init_pg_query_scan(cPgQuery);
+	Init_pg_query_log(cPgQuery);
+	Init_pg_query_statements(cPgQuery);
 }
 
-void raise_ruby_parse_error(PgQueryParseResult result)
+/*
+ * Copies the query text out of the Ruby heap, so the parser can work on it
+ * while other threads run (and potentially modify or move the String).
+ */
+char *pg_query_ruby_input_dup(VALUE input)
 {
-	VALUE cPgQuery, cParseError;
-	VALUE args[4];
+	const char *str;
+	char *copy;
+	long len;
 
-	cPgQuery    = rb_const_get(rb_cObject, rb_intern("PgQuery"));
-	cParseError = rb_const_get_at(cPgQuery, rb_intern("ParseError"));
+	Check_Type(input, T_STRING);
 
-	args[0] = rb_str_new2(result.error->message);
-	args[1] = rb_str_new2(result.error->filename);
-	args[2] = INT2NUM(result.error->lineno);
-	args[3] = INT2NUM(result.error->cursorpos);
+	str = StringValueCStr(input);
+	len = RSTRING_LEN(input);
 
-	pg_query_free_parse_result(result);
+	copy = ALLOC_N(char, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	return copy;
+}
 
-	rb_exc_raise(rb_class_new_instance(4, args, cParseError));
+/*
+ * Runs func without holding the GVL. func must not touch any Ruby objects,
+ * and there is no way to interrupt it - parser calls are short-lived and
+ * always run to completion.
+ *
+ * Only for code that is safe to run on several threads at once: libpg_query's
+ * own pg_query_parse/normalize/fingerprint redirect the process' stderr while
+ * they run, so they must keep the GVL.
+ */
+void pg_query_ruby_without_gvl(void *(*func)(void *), void *arg)
+{
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+	rb_thread_call_without_gvl(func, arg, NULL, NULL);
+#else
+	func(arg);
+#endif
 }
 
-void raise_ruby_normalize_error(PgQueryNormalizeResult result)
+VALUE new_ruby_parse_error(PgQueryError *error)
 {
 	VALUE cPgQuery, cParseError;
 	VALUE args[4];
@@ -45,17 +166,15 @@ void raise_ruby_normalize_error(PgQueryNormalizeResult result)
 	cPgQuery    = rb_const_get(rb_cObject, rb_intern("PgQuery"));
 	cParseError = rb_const_get_at(cPgQuery, rb_intern("ParseError"));
 
-	args[0] = rb_str_new2(result.error->message);
-	args[1] = rb_str_new2(result.error->filename);
-	args[2] = INT2NUM(result.error->lineno);
-	args[3] = INT2NUM(result.error->cursorpos);
-
-	pg_query_free_normalize_result(result);
+	args[0] = rb_str_new2(error->message);
+	args[1] = rb_str_new2(error->filename);
+	args[2] = INT2NUM(error->lineno);
+	args[3] = INT2NUM(error->cursorpos);
 
-	rb_exc_raise(rb_class_new_instance(4, args, cParseError));
+	return rb_class_new_instance(4, args, cParseError);
 }
 
-void raise_ruby_fingerprint_error(PgQueryFingerprintResult result)
+VALUE new_ruby_tree_error(void)
 {
 	VALUE cPgQuery, cParseError;
 	VALUE args[4];
@@ -63,67 +182,810 @@ void raise_ruby_fingerprint_error(PgQueryFingerprintResult result)
 	cPgQuery    = rb_const_get(rb_cObject, rb_intern("PgQuery"));
 	cParseError = rb_const_get_at(cPgQuery, rb_intern("ParseError"));
 
-	args[0] = rb_str_new2(result.error->message);
-	args[1] = rb_str_new2(result.error->filename);
-	args[2] = INT2NUM(result.error->lineno);
-	args[3] = INT2NUM(result.error->cursorpos);
+	args[0] = rb_str_new2("Failed to parse JSON");
+	args[1] = rb_str_new2(__FILE__);
+	args[2] = INT2NUM(__LINE__);
+	args[3] = INT2NUM(-1);
+
+	return rb_class_new_instance(4, args, cParseError);
+}
+
+/*
+ * Failed PgQuery::Result for the _try_* methods, which carries the same
+ * details as a ParseError, without creating (and raising) one.
+ */
+VALUE new_ruby_parse_result(PgQueryError *error)
+{
+	return rb_struct_new(cResult, Qnil, rb_str_new2(error->message), INT2NUM(error->cursorpos),
+						 rb_str_new2(error->filename), INT2NUM(error->lineno));
+}
+
+VALUE new_ruby_tree_result(void)
+{
+	return rb_struct_new(cResult, Qnil, rb_str_new2("Failed to parse JSON"), INT2NUM(-1),
+						 rb_str_new2(__FILE__), INT2NUM(__LINE__));
+}
+
+void raise_ruby_parse_error(PgQueryParserResult result)
+{
+	VALUE error = new_ruby_parse_error(result.error);
+
+	pg_query_parser_free_result(result);
+
+	rb_exc_raise(error);
+}
+
+void raise_ruby_fingerprint_error(PgQueryFingerprintResult result)
+{
+	VALUE error = new_ruby_parse_error(result.error);
 
 	pg_query_free_fingerprint_result(result);
 
-	rb_exc_raise(rb_class_new_instance(4, args, cParseError));
+	rb_exc_raise(error);
 }
 
-VALUE pg_query_ruby_parse(VALUE self, VALUE input)
+void raise_ruby_tree_error(void)
 {
-	Check_Type(input, T_STRING);
+	rb_exc_raise(new_ruby_tree_error());
+}
+
+int pg_query_ruby_fingerprint_version(VALUE version)
+{
+	int v = NUM2INT(version);
+
+	if (v != PG_QUERY_FINGERPRINT_VERSION && v != PG_QUERY_FINGERPRINT_VERSION_XXH64)
+		rb_raise(rb_eArgError, "unsupported fingerprint version: %d", v);
+
+	return v;
+}
+
+/*
+ * Version 3 fingerprints are returned as signed 64-bit Integers (like the
+ * queryid of pg_stat_statements), so that they fit into a bigint column
+ */
+VALUE pg_query_ruby_fingerprint_int(uint64_t hash)
+{
+	return LL2NUM((int64_t) hash);
+}
+
+// The first 8 bytes of a raw digest, as a big-endian integer
+static uint64_t pg_query_ruby_digest_uint64(const unsigned char *digest)
+{
+	uint64_t value = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		value = (value << 8) | digest[i];
+
+	return value;
+}
 
+/*
+ * Object keys are a small, fixed set of node and field names - they are only
+ * created once per tree, and shared as frozen (and on newer Rubies, interned)
+ * Strings between all Hashes.
+ */
+VALUE pg_query_ruby_tree_key(PgQueryRubyTreeBuilder *builder, int key)
+{
+	VALUE str = rb_ary_entry(builder->keys, key);
+
+	if (NIL_P(str)) {
+		PgQueryTreeKey *tree_key = &builder->tree->keys[key];
+#ifdef HAVE_RB_ENC_INTERNED_STR
+		str = rb_enc_interned_str(tree_key->str, tree_key->len, rb_utf8_encoding());
+#else
+		str = rb_funcall(rb_enc_str_new(tree_key->str, tree_key->len, rb_utf8_encoding()), rb_intern("-@"), 0);
+#endif
+		rb_ary_store(builder->keys, key, str);
+	}
+
+	return str;
+}
+
+void pg_query_ruby_tree_builder_init(PgQueryRubyTreeBuilder *builder, PgQueryTree *tree)
+{
+	builder->tree = tree;
+	builder->keys = rb_ary_new_capa(tree->keys_count);
+}
+
+VALUE pg_query_ruby_tree_value_to_ruby(PgQueryRubyTreeBuilder *builder, PgQueryTreeValue *value)
+{
 	VALUE output;
-	PgQueryParseResult result = pg_query_parse(StringValueCStr(input));
+	size_t i;
+
+	switch (value->type) {
+		case PG_QUERY_TREE_NULL:
+			return Qnil;
+		case PG_QUERY_TREE_BOOL:
+			return value->u.boolean ? Qtrue : Qfalse;
+		case PG_QUERY_TREE_INTEGER:
+			return LL2NUM(value->u.integer);
+		case PG_QUERY_TREE_FLOAT:
+			return DBL2NUM(value->u.fl);
+		case PG_QUERY_TREE_STRING:
+			return rb_enc_str_new(value->u.str, value->len, rb_utf8_encoding());
+		case PG_QUERY_TREE_ARRAY:
+			output = rb_ary_new_capa(value->len);
+			for (i = 0; i < value->len; i++)
+				rb_ary_push(output, pg_query_ruby_tree_value_to_ruby(builder, &value->u.items[i]));
+			return output;
+		case PG_QUERY_TREE_OBJECT:
+			output = rb_hash_new();
+			for (i = 0; i < value->len; i++)
+				rb_hash_aset(output,
+							 pg_query_ruby_tree_key(builder, value->u.members[i].key),
+							 pg_query_ruby_tree_value_to_ruby(builder, &value->u.members[i].value));
+			return output;
+	}
+
+	return Qnil;
+}
+
+typedef struct {
+	PgQueryTree *tree;
+	PgQueryTreeMember *members;
+	size_t index;
+	int depth;
+	int error;
+} PgQueryRubyTreeHashIterator;
+
+static int pg_query_ruby_tree_from_ruby_member(VALUE key, VALUE value, VALUE arg)
+{
+	PgQueryRubyTreeHashIterator *iter = (PgQueryRubyTreeHashIterator *) arg;
+	PgQueryTreeMember *member = &iter->members[iter->index++];
+
+	if (!RB_TYPE_P(key, T_STRING)) {
+		iter->error = 1;
+		return ST_STOP;
+	}
+
+	member->key = pg_query_tree_intern_key(iter->tree, RSTRING_PTR(key), RSTRING_LEN(key));
+	if (member->key < 0 || pg_query_ruby_tree_from_ruby(iter->tree, value, &member->value, iter->depth) != 0) {
+		iter->error = 1;
+		return ST_STOP;
+	}
+
+	return ST_CONTINUE;
+}
+
+/*
+ * Converts a Ruby parse tree (or part of it) into a native tree, copying all
+ * Strings. Only the types that a parse tree consists of are supported (Hashes
+ * with String keys, Arrays, Strings, Integers, Floats, true, false and nil),
+ * returns -1 if anything else is encountered.
+ */
+int pg_query_ruby_tree_from_ruby(PgQueryTree *tree, VALUE value, PgQueryTreeValue *out, int depth)
+{
+	size_t i;
+	char *str;
+
+	memset(out, 0, sizeof(PgQueryTreeValue));
+
+	if (NIL_P(value)) {
+		out->type = PG_QUERY_TREE_NULL;
+	} else if (value == Qtrue || value == Qfalse) {
+		out->type = PG_QUERY_TREE_BOOL;
+		out->u.boolean = value == Qtrue;
+	} else if (FIXNUM_P(value)) {
+		out->type = PG_QUERY_TREE_INTEGER;
+		out->u.integer = FIX2LONG(value);
+	} else if (RB_FLOAT_TYPE_P(value)) {
+		out->type = PG_QUERY_TREE_FLOAT;
+		out->u.fl = RFLOAT_VALUE(value);
+	} else if (RB_TYPE_P(value, T_STRING) || RB_TYPE_P(value, T_BIGNUM)) {
+		// Bignums are not 0, so they behave just like their decimal String representation
+		if (RB_TYPE_P(value, T_BIGNUM)) value = rb_big2str(value, 10);
+		str = pg_query_tree_alloc(tree, RSTRING_LEN(value) + 1);
+		if (str == NULL) return -1;
+		memcpy(str, RSTRING_PTR(value), RSTRING_LEN(value));
+		str[RSTRING_LEN(value)] = '\0';
+		out->type = PG_QUERY_TREE_STRING;
+		out->u.str = str;
+		out->len = RSTRING_LEN(value);
+	} else if (depth >= PG_QUERY_TREE_MAX_NESTING) {
+		return -1;
+	} else if (RB_TYPE_P(value, T_ARRAY)) {
+		out->type = PG_QUERY_TREE_ARRAY;
+		out->len = RARRAY_LEN(value);
+		out->u.items = pg_query_tree_alloc(tree, sizeof(PgQueryTreeValue) * out->len);
+		if (out->u.items == NULL) return -1;
+		for (i = 0; i < out->len; i++)
+			if (pg_query_ruby_tree_from_ruby(tree, rb_ary_entry(value, i), &out->u.items[i], depth + 1) != 0)
+				return -1;
+	} else if (RB_TYPE_P(value, T_HASH)) {
+		PgQueryRubyTreeHashIterator iter;
+
+		out->type = PG_QUERY_TREE_OBJECT;
+		out->len = RHASH_SIZE(value);
+		out->u.members = pg_query_tree_alloc(tree, sizeof(PgQueryTreeMember) * out->len);
+		if (out->u.members == NULL) return -1;
+
+		iter.tree = tree;
+		iter.members = out->u.members;
+		iter.index = 0;
+		iter.depth = depth + 1;
+		iter.error = 0;
+		rb_hash_foreach(value, pg_query_ruby_tree_from_ruby_member, (VALUE) &iter);
+		if (iter.error) return -1;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+typedef struct {
+	VALUE input;
+	int version;
+	PgQueryTree tree;
+} PgQueryRubyFingerprintTreeCall;
+
+static VALUE pg_query_ruby_fingerprint_tree_build(VALUE arg)
+{
+	PgQueryRubyFingerprintTreeCall *call = (PgQueryRubyFingerprintTreeCall *) arg;
+	char fingerprint[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1];
+	uint64_t hash;
+
+	if (pg_query_ruby_tree_from_ruby(&call->tree, call->input, &call->tree.root, 0) != 0)
+		return Qnil;
+
+	if (call->version == PG_QUERY_FINGERPRINT_VERSION_XXH64) {
+		if (pg_query_tree_fingerprint_xxh64(&call->tree, &hash) != 0)
+			return Qnil;
+		return pg_query_ruby_fingerprint_int(hash);
+	}
+
+	if (pg_query_tree_fingerprint(&call->tree, fingerprint) != 0)
+		return Qnil;
+
+	return rb_str_new2(fingerprint);
+}
+
+static VALUE pg_query_ruby_fingerprint_tree_cleanup(VALUE arg)
+{
+	PgQueryRubyFingerprintTreeCall *call = (PgQueryRubyFingerprintTreeCall *) arg;
+
+	pg_query_tree_free(&call->tree);
+
+	return Qnil;
+}
+
+/*
+ * Fingerprints a Ruby parse tree, like PgQuery#fingerprint (with the optional
+ * fingerprint version). Returns nil if the tree can't be handled natively,
+ * callers should fall back to the Ruby implementation in that case.
+ */
+VALUE pg_query_ruby_fingerprint_tree(int argc, VALUE *argv, VALUE self)
+{
+	PgQueryRubyFingerprintTreeCall call;
+	VALUE tree, version;
+
+	rb_scan_args(argc, argv, "11", &tree, &version);
+
+	call.input = tree;
+	call.version = NIL_P(version) ? PG_QUERY_FINGERPRINT_VERSION : pg_query_ruby_fingerprint_version(version);
+	pg_query_tree_init(&call.tree);
+
+	return rb_ensure(pg_query_ruby_fingerprint_tree_build, (VALUE) &call, pg_query_ruby_fingerprint_tree_cleanup, (VALUE) &call);
+}
+
+typedef struct {
+	VALUE input;
+	PgQueryTree tree;
+	char *output;
+	size_t output_len;
+} PgQueryRubyDeparseTreeCall;
+
+static VALUE pg_query_ruby_deparse_tree_build(VALUE arg)
+{
+	PgQueryRubyDeparseTreeCall *call = (PgQueryRubyDeparseTreeCall *) arg;
+
+	if (pg_query_ruby_tree_from_ruby(&call->tree, call->input, &call->tree.root, 0) != 0)
+		return Qnil;
+
+	if (pg_query_tree_deparse(&call->tree, &call->tree.root, &call->output, &call->output_len) != 0)
+		return Qnil;
+
+	return rb_enc_str_new(call->output, call->output_len, rb_utf8_encoding());
+}
+
+static VALUE pg_query_ruby_deparse_tree_cleanup(VALUE arg)
+{
+	PgQueryRubyDeparseTreeCall *call = (PgQueryRubyDeparseTreeCall *) arg;
+
+	free(call->output);
+	pg_query_tree_free(&call->tree);
+
+	return Qnil;
+}
+
+/*
+ * Deparses a Ruby parse tree (an Array of statements), like PgQuery#deparse.
+ * Returns nil if the tree can't be handled natively, callers should fall back
+ * to the Ruby implementation in that case.
+ */
+VALUE pg_query_ruby_deparse_tree(VALUE self, VALUE tree)
+{
+	PgQueryRubyDeparseTreeCall call;
 
-	if (result.error) raise_ruby_parse_error(result);
+	call.input = tree;
+	call.output = NULL;
+	call.output_len = 0;
+	pg_query_tree_init(&call.tree);
+
+	return rb_ensure(pg_query_ruby_deparse_tree_build, (VALUE) &call, pg_query_ruby_deparse_tree_cleanup, (VALUE) &call);
+}
+
+typedef struct {
+	char *input;
+	PgQueryParserResult result;
+} PgQueryRubyParseCall;
+
+static void *pg_query_ruby_parse_without_gvl(void *arg)
+{
+	PgQueryRubyParseCall *call = (PgQueryRubyParseCall *) arg;
+	call->result = pg_query_parser_parse(call->input, PG_QUERY_PARSER_JSON | PG_QUERY_PARSER_REUSE_BUFFERS | pg_query_ruby_parser_flags());
+	return NULL;
+}
+
+VALUE pg_query_ruby_parse(VALUE self, VALUE input)
+{
+	VALUE output, parse_tree;
+	PgQueryRubyParseCall call;
+
+	call.input = pg_query_ruby_input_dup(input);
+	pg_query_ruby_without_gvl(pg_query_ruby_parse_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error) raise_ruby_parse_error(call.result);
 
 	output = rb_ary_new();
 
-	rb_ary_push(output, rb_str_new2(result.parse_tree));
-	rb_ary_push(output, rb_str_new2(result.stderr_buffer));
+	parse_tree = rb_str_new2(call.result.parse_tree);
+	rb_ary_push(output, parse_tree);
+	rb_ary_push(output, pg_query_ruby_warnings(&call.result));
+
+	pg_query_ruby_record_stats(&call.result.stats, NULL, 0, RSTRING_LEN(parse_tree));
 
-	pg_query_free_parse_result(result);
+	pg_query_parser_free_result(call.result);
 
 	return output;
 }
 
-VALUE pg_query_ruby_normalize(VALUE self, VALUE input)
+void *pg_query_ruby_normalize_without_gvl(void *arg)
 {
-	Check_Type(input, T_STRING);
+	PgQueryRubyNormalizeCall *call = (PgQueryRubyNormalizeCall *) arg;
+	int flags = PG_QUERY_PARSER_NORMALIZE | PG_QUERY_PARSER_SKIP_WARNINGS | pg_query_ruby_parser_flags();
 
+	if (call->reuse_buffers) flags |= PG_QUERY_PARSER_REUSE_BUFFERS;
+	if (call->constants) flags |= PG_QUERY_PARSER_CONSTANTS;
+
+	call->result = pg_query_parser_parse(call->input, flags);
+	return NULL;
+}
+
+/*
+ * Normalizes the query - on errors, raises a ParseError, or with try set,
+ * returns a failed PgQuery::Result instead (likewise for the other calls).
+ */
+static VALUE pg_query_ruby_normalize_call(VALUE input, int try)
+{
 	VALUE output;
-	PgQueryNormalizeResult result = pg_query_normalize(StringValueCStr(input));
+	PgQueryRubyNormalizeCall call = {0};
 
-	if (result.error) raise_ruby_normalize_error(result);
+	call.input = pg_query_ruby_input_dup(input);
+	call.reuse_buffers = 1;
+	pg_query_ruby_without_gvl(pg_query_ruby_normalize_without_gvl, &call);
+	xfree(call.input);
 
-	output = rb_str_new2(result.normalized_query);
+	if (call.result.error && try) {
+		output = new_ruby_parse_result(call.result.error);
+		pg_query_parser_free_result(call.result);
+		return output;
+	}
+
+	if (call.result.error) raise_ruby_parse_error(call.result);
+
+	output = rb_str_new2(call.result.normalized_query);
 
-	pg_query_free_normalize_result(result);
+	pg_query_ruby_record_stats(&call.result.stats, NULL, 0, RSTRING_LEN(output));
+
+	pg_query_parser_free_result(call.result);
 
 	return output;
 }
 
-VALUE pg_query_ruby_fingerprint(VALUE self, VALUE input)
+VALUE pg_query_ruby_normalize(VALUE self, VALUE input)
 {
-	Check_Type(input, T_STRING);
+	return pg_query_ruby_normalize_call(input, 0);
+}
 
+VALUE pg_query_ruby_try_normalize(VALUE self, VALUE input)
+{
+	return pg_query_ruby_normalize_call(input, 1);
+}
+
+static VALUE pg_query_ruby_normalize_with_constants_build(VALUE arg)
+{
+	PgQueryRubyNormalizeCall *call = (PgQueryRubyNormalizeCall *) arg;
+	VALUE output, constants;
+	int i;
+
+	constants = rb_ary_new_capa(call->result.constants_count);
+	for (i = 0; i < call->result.constants_count; i++) {
+		PgQueryParserConstant *constant = &call->result.constants[i];
+
+		rb_ary_push(constants, rb_struct_new(cConstant,
+											 rb_enc_str_new(call->input + constant->location, constant->length, rb_utf8_encoding()),
+											 INT2NUM(constant->location), INT2NUM(constant->length), INT2NUM(constant->param),
+											 ID2SYM(constant_types[constant->type])));
+	}
+
+	output = rb_ary_new_from_args(2, rb_str_new2(call->result.normalized_query), constants);
+
+	pg_query_ruby_record_stats(&call->result.stats, NULL, 0, RSTRING_LEN(rb_ary_entry(output, 0)));
+
+	return output;
+}
+
+static VALUE pg_query_ruby_normalize_with_constants_cleanup(VALUE arg)
+{
+	PgQueryRubyNormalizeCall *call = (PgQueryRubyNormalizeCall *) arg;
+
+	xfree(call->input);
+	pg_query_parser_free_result(call->result);
+
+	return Qnil;
+}
+
+/*
+ * Returns [normalized query, constants], with a PgQuery::Constant for each
+ * constant that was replaced - see PgQuery.normalize_with_constants.
+ */
+VALUE pg_query_ruby_normalize_with_constants(VALUE self, VALUE input)
+{
+	PgQueryRubyNormalizeCall call = {0};
+
+	call.input = pg_query_ruby_input_dup(input);
+	call.reuse_buffers = 1;
+	call.constants = 1;
+	pg_query_ruby_without_gvl(pg_query_ruby_normalize_without_gvl, &call);
+
+	if (call.result.error) {
+		xfree(call.input);
+		raise_ruby_parse_error(call.result);
+	}
+
+	// The constants' text is copied from the input, so it's only freed (along
+	// with the result) once they were built
+	return rb_ensure(pg_query_ruby_normalize_with_constants_build, (VALUE) &call,
+					 pg_query_ruby_normalize_with_constants_cleanup, (VALUE) &call);
+}
+
+static void *pg_query_ruby_truncation_spans_without_gvl(void *arg)
+{
+	PgQueryRubyParseCall *call = (PgQueryRubyParseCall *) arg;
+	call->result = pg_query_parser_parse(call->input, PG_QUERY_PARSER_SPANS | PG_QUERY_PARSER_SKIP_WARNINGS | pg_query_ruby_parser_flags());
+	return NULL;
+}
+
+static VALUE pg_query_ruby_truncation_spans_build(VALUE arg)
+{
+	PgQueryParserResult *result = (PgQueryParserResult *) arg;
+	VALUE output;
+	int i;
+
+	output = rb_ary_new_capa(result->spans_count);
+	for (i = 0; i < result->spans_count; i++) {
+		PgQueryParserSpan *span = &result->spans[i];
+
+		rb_ary_push(output, rb_ary_new_from_args(4, ID2SYM(span_types[span->type]), INT2NUM(span->depth),
+												 INT2NUM(span->location), INT2NUM(span->length)));
+	}
+
+	return output;
+}
+
+static VALUE pg_query_ruby_truncation_spans_cleanup(VALUE arg)
+{
+	pg_query_parser_free_result(*(PgQueryParserResult *) arg);
+
+	return Qnil;
+}
+
+/*
+ * Returns [type, depth, location, length] for each part of the query's
+ * statements that truncation can omit, with byte offsets into the query - see
+ * PgQuery#truncate.
+ */
+VALUE pg_query_ruby_truncation_spans(VALUE self, VALUE input)
+{
+	PgQueryRubyParseCall call;
+
+	call.input = pg_query_ruby_input_dup(input);
+	pg_query_ruby_without_gvl(pg_query_ruby_truncation_spans_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error) raise_ruby_parse_error(call.result);
+
+	return rb_ensure(pg_query_ruby_truncation_spans_build, (VALUE) &call.result,
+					 pg_query_ruby_truncation_spans_cleanup, (VALUE) &call.result);
+}
+
+void *pg_query_ruby_fingerprint_without_gvl(void *arg)
+{
+	PgQueryRubyFingerprintCall *call = (PgQueryRubyFingerprintCall *) arg;
+	int raw = call->raw || call->version == PG_QUERY_FINGERPRINT_VERSION_XXH64;
+
+	call->result = pg_query_tree_fingerprint_query(call->input, pg_query_ruby_parser_flags(), call->version,
+												   raw ? call->digest : NULL, &call->stats, &call->fingerprint_ns);
+	return NULL;
+}
+
+typedef enum {
+	PG_QUERY_RUBY_FINGERPRINT_DEFAULT, // A hex String for version 2, an Integer for version 3
+	PG_QUERY_RUBY_FINGERPRINT_INT,	   // The first 64 bits of the digest as an Integer
+	PG_QUERY_RUBY_FINGERPRINT_BINARY   // The version byte followed by the digest, as a binary String
+} PgQueryRubyFingerprintFormat;
+
+static VALUE pg_query_ruby_fingerprint_call(VALUE input, VALUE version, PgQueryRubyFingerprintFormat format, int try)
+{
 	VALUE output;
-	PgQueryFingerprintResult result = pg_query_fingerprint(StringValueCStr(input));
+	PgQueryRubyFingerprintCall call = {0};
+	char binary[1 + PG_QUERY_FINGERPRINT_DIGEST_LENGTH];
+
+	call.version = pg_query_ruby_fingerprint_version(version);
+	call.raw = format != PG_QUERY_RUBY_FINGERPRINT_DEFAULT;
+	call.input = pg_query_ruby_input_dup(input);
+	pg_query_ruby_without_gvl(pg_query_ruby_fingerprint_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error && try) {
+		output = new_ruby_parse_result(call.result.error);
+		pg_query_free_fingerprint_result(call.result);
+		return output;
+	}
 
-	if (result.error) raise_ruby_fingerprint_error(result);
+	if (call.result.error) raise_ruby_fingerprint_error(call.result);
 
-	if (result.hexdigest) {
-		output = rb_str_new2(result.hexdigest);
+	if (format == PG_QUERY_RUBY_FINGERPRINT_BINARY) {
+		binary[0] = (char) call.version;
+		memcpy(binary + 1, call.digest, PG_QUERY_FINGERPRINT_DIGEST_LENGTH);
+		output = rb_str_new(binary, sizeof(binary));
+	} else if (format == PG_QUERY_RUBY_FINGERPRINT_INT || call.version == PG_QUERY_FINGERPRINT_VERSION_XXH64) {
+		output = pg_query_ruby_fingerprint_int(pg_query_ruby_digest_uint64(call.digest));
+	} else if (call.result.hexdigest) {
+		output = rb_str_new2(call.result.hexdigest);
 	} else {
 		output = Qnil;
 	}
 
-	pg_query_free_fingerprint_result(result);
+	pg_query_ruby_record_stats(&call.stats, "fingerprint", call.fingerprint_ns,
+							   NIL_P(output) ? 0 : RB_TYPE_P(output, T_STRING) ? RSTRING_LEN(output) : sizeof(uint64_t));
+
+	pg_query_free_fingerprint_result(call.result);
 
 	return output;
 }
+
+VALUE pg_query_ruby_fingerprint(VALUE self, VALUE input, VALUE version)
+{
+	return pg_query_ruby_fingerprint_call(input, version, PG_QUERY_RUBY_FINGERPRINT_DEFAULT, 0);
+}
+
+VALUE pg_query_ruby_try_fingerprint(VALUE self, VALUE input, VALUE version)
+{
+	return pg_query_ruby_fingerprint_call(input, version, PG_QUERY_RUBY_FINGERPRINT_DEFAULT, 1);
+}
+
+VALUE pg_query_ruby_fingerprint_int_call(VALUE self, VALUE input, VALUE version)
+{
+	return pg_query_ruby_fingerprint_call(input, version, PG_QUERY_RUBY_FINGERPRINT_INT, 0);
+}
+
+// Only for version 2, where the digest is too large for an Integer
+VALUE pg_query_ruby_fingerprint_binary(VALUE self, VALUE input)
+{
+	return pg_query_ruby_fingerprint_call(input, INT2FIX(PG_QUERY_FINGERPRINT_VERSION), PG_QUERY_RUBY_FINGERPRINT_BINARY, 0);
+}
+
+void *pg_query_ruby_parse_tree_without_gvl(void *arg)
+{
+	PgQueryRubyParseTreeCall *call = (PgQueryRubyParseTreeCall *) arg;
+	int flags = PG_QUERY_PARSER_JSON | pg_query_ruby_parser_flags();
+
+	if (call->reuse_buffers) flags |= PG_QUERY_PARSER_REUSE_BUFFERS;
+
+	call->result = pg_query_parser_parse(call->input, flags);
+
+	if (call->result.error == NULL) {
+		uint64_t start = (flags & PG_QUERY_PARSER_STATS) ? pg_query_parser_clock_ns() : 0;
+
+		// The tree takes ownership of the JSON buffer
+		call->tree_error = pg_query_tree_parse_json(&call->tree, call->result.parse_tree, PG_QUERY_TREE_MAX_NESTING);
+		call->result.parse_tree = NULL;
+
+		if (flags & PG_QUERY_PARSER_STATS) call->tree_ns = pg_query_parser_clock_ns() - start;
+	}
+
+	return NULL;
+}
+
+VALUE pg_query_ruby_parse_tree_build(VALUE arg)
+{
+	PgQueryRubyParseTreeCall *call = (PgQueryRubyParseTreeCall *) arg;
+	PgQueryRubyTreeBuilder builder;
+	VALUE output;
+
+	pg_query_ruby_tree_builder_init(&builder, &call->tree);
+
+	output = rb_ary_new();
+
+	rb_ary_push(output, pg_query_ruby_tree_value_to_ruby(&builder, &call->tree.root));
+	rb_ary_push(output, pg_query_ruby_warnings(&call->result));
+
+	RB_GC_GUARD(builder.keys);
+
+	return output;
+}
+
+VALUE pg_query_ruby_parse_tree_cleanup(VALUE arg)
+{
+	PgQueryRubyParseTreeCall *call = (PgQueryRubyParseTreeCall *) arg;
+
+	// The tree owns the JSON buffer, unless it is to be reused
+	if (call->result.reused_buffers) {
+		pg_query_parser_release_buffer(call->tree.buffer);
+		call->tree.buffer = NULL;
+	}
+
+	pg_query_tree_free(&call->tree);
+	pg_query_parser_free_result(call->result);
+
+	return Qnil;
+}
+
+static VALUE pg_query_ruby_parse_tree_call(VALUE input, int try)
+{
+	PgQueryRubyParseTreeCall call = {0};
+
+	pg_query_tree_init(&call.tree);
+
+	call.input = pg_query_ruby_input_dup(input);
+	call.reuse_buffers = 1;
+	pg_query_ruby_without_gvl(pg_query_ruby_parse_tree_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error && try) {
+		VALUE output = new_ruby_parse_result(call.result.error);
+		pg_query_ruby_parse_tree_cleanup((VALUE) &call);
+		return output;
+	}
+
+	if (call.result.error) raise_ruby_parse_error(call.result);
+
+	if (call.tree_error) {
+		pg_query_ruby_parse_tree_cleanup((VALUE) &call);
+		if (try) return new_ruby_tree_result();
+		raise_ruby_tree_error();
+	}
+
+	pg_query_ruby_record_stats(&call.result.stats, "tree", call.tree_ns, call.tree.buffer_len);
+
+	return rb_ensure(pg_query_ruby_parse_tree_build, (VALUE) &call, pg_query_ruby_parse_tree_cleanup, (VALUE) &call);
+}
+
+/*
+ * Same as pg_query_ruby_parse, but returns the parse tree as Ruby objects
+ * instead of JSON text, skipping the extra copy and JSON.parse round-trip.
+ */
+VALUE pg_query_ruby_parse_tree(VALUE self, VALUE input)
+{
+	return pg_query_ruby_parse_tree_call(input, 0);
+}
+
+VALUE pg_query_ruby_try_parse_tree(VALUE self, VALUE input)
+{
+	return pg_query_ruby_parse_tree_call(input, 1);
+}
+
+/*
+ * Settings apply to the whole process, so other Ractors may only read them
+ * (like they can't change the constants of the main Ractor)
+ */
+static void pg_query_ruby_check_main_ractor(const char *setting)
+{
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+	if (rb_funcall(cRactor, id_current, 0) != main_ractor)
+		rb_raise(rb_path2class("Ractor::UnsafeError"), "%s can only be changed from the main Ractor", setting);
+#endif
+}
+
+/*
+ * Enables or disables per-thread arenas for all threads (see
+ * pg_query_parser_set_arenas), takes effect with the next call on each thread.
+ */
+VALUE pg_query_ruby_set_thread_arenas(VALUE self, VALUE enabled)
+{
+	pg_query_ruby_check_main_ractor("PgQuery.thread_arenas");
+	pg_query_parser_set_arenas(RTEST(enabled));
+	return enabled;
+}
+
+VALUE pg_query_ruby_thread_arenas(VALUE self)
+{
+	return pg_query_parser_arenas() ? Qtrue : Qfalse;
+}
+
+// Whether parsing collects warnings (see PgQuery#warnings), enabled by default
+VALUE pg_query_ruby_set_collect_warnings(VALUE self, VALUE enabled)
+{
+	pg_query_ruby_check_main_ractor("PgQuery.collect_warnings");
+	collect_warnings = RTEST(enabled);
+	return enabled;
+}
+
+VALUE pg_query_ruby_collect_warnings(VALUE self)
+{
+	return collect_warnings ? Qtrue : Qfalse;
+}
+
+/*
+ * Whether calls record native stats for PgQuery.instrument - set by
+ * PgQuery.instrument and PgQuery.uninstrument
+ */
+VALUE pg_query_ruby_set_instrumenting(VALUE self, VALUE enabled)
+{
+	pg_query_ruby_check_main_ractor("Instrumentation");
+	instrumenting = RTEST(enabled);
+	return enabled;
+}
+
+VALUE pg_query_ruby_instrumenting(VALUE self)
+{
+	return instrumenting ? Qtrue : Qfalse;
+}
+
+// Parser flags for the current settings, may be called without holding the GVL
+int pg_query_ruby_parser_flags(void)
+{
+	int flags = 0;
+
+	if (!collect_warnings) flags |= PG_QUERY_PARSER_SKIP_WARNINGS;
+	if (instrumenting) flags |= PG_QUERY_PARSER_STATS;
+
+	return flags;
+}
+
+/*
+ * When instrumenting, stores the native stats of the current call in a
+ * fiber-local Hash (with times in seconds), where PgQuery.instrument picks
+ * them up. phase is the name of an additional phase after parsing, or NULL.
+ */
+void pg_query_ruby_record_stats(PgQueryParserStats *stats, const char *phase, uint64_t phase_ns, size_t bytes_out)
+{
+	VALUE hash;
+
+	if (!instrumenting) return;
+
+	hash = rb_hash_new();
+	rb_hash_aset(hash, ID2SYM(id_parse), DBL2NUM(stats->parse_ns / 1e9));
+	rb_hash_aset(hash, ID2SYM(id_output), DBL2NUM(stats->output_ns / 1e9));
+	if (phase != NULL) rb_hash_aset(hash, ID2SYM(rb_intern(phase)), DBL2NUM(phase_ns / 1e9));
+	rb_hash_aset(hash, ID2SYM(id_native_memory), SIZET2NUM(stats->memory));
+	rb_hash_aset(hash, ID2SYM(id_bytes_out), SIZET2NUM(bytes_out));
+
+	rb_thread_local_aset(rb_thread_current(), id_native_stats, hash);
+}
+
+// Returns the warnings of a parse as an Array of Strings
+VALUE pg_query_ruby_warnings(PgQueryParserResult *result)
+{
+	VALUE warnings = rb_ary_new_capa(result->warnings_count);
+	int i;
+
+	for (i = 0; i < result->warnings_count; i++)
+		rb_ary_push(warnings, rb_str_new2(result->warnings[i]));
+
+	return warnings;
+}
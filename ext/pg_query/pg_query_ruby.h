@@ -3,8 +3,123 @@
 
 #include "pg_query.h"
 
+#include "pg_query_ruby_tree.h"
+#include "pg_query_ruby_fingerprint.h"
+#include "pg_query_ruby_deparse.h"
+#include "pg_query_ruby_parser.h"
+
 #include <ruby.h>
+#include <ruby/encoding.h>
+#ifdef HAVE_RUBY_THREAD_H
+#include <ruby/thread.h>
+#endif
 
 void Init_pg_query(void);
 
+char *pg_query_ruby_input_dup(VALUE input);
+void pg_query_ruby_without_gvl(void *(*func)(void *), void *arg);
+
+typedef struct {
+	PgQueryTree *tree;
+	VALUE keys;
+} PgQueryRubyTreeBuilder;
+
+void pg_query_ruby_tree_builder_init(PgQueryRubyTreeBuilder *builder, PgQueryTree *tree);
+VALUE pg_query_ruby_tree_key(PgQueryRubyTreeBuilder *builder, int key);
+VALUE pg_query_ruby_tree_value_to_ruby(PgQueryRubyTreeBuilder *builder, PgQueryTreeValue *value);
+int pg_query_ruby_tree_from_ruby(PgQueryTree *tree, VALUE value, PgQueryTreeValue *out, int depth);
+
+/*
+ * Walks over a native tree that mirror PgQuery#load_tables_and_aliases! (and
+ * PgQuery#param_refs, for PgQuery.analyze), collecting their results as Ruby
+ * objects. The walk doesn't own the tree or the builder.
+ */
+
+typedef enum {
+	PG_QUERY_RUBY_TABLE_SELECT,
+	PG_QUERY_RUBY_TABLE_DML,
+	PG_QUERY_RUBY_TABLE_DDL
+} PgQueryRubyTableType;
+
+// Queue of tree values (which may be NULL, like nil in the Ruby Arrays)
+typedef struct {
+	PgQueryTreeValue **values;
+	PgQueryRubyTableType *types;
+	size_t head;
+	size_t len;
+	size_t capacity;
+} PgQueryRubyAnalyzeQueue;
+
+typedef struct {
+	PgQueryTree *tree;
+	PgQueryRubyTreeBuilder builder;
+	PgQueryRubyAnalyzeQueue statements;
+	PgQueryRubyAnalyzeQueue from_clause_items;
+	PgQueryRubyAnalyzeQueue subselect_items;
+	VALUE tables;
+	VALUE cte_names;
+	VALUE aliases;
+	VALUE param_refs;
+} PgQueryRubyAnalyzeWalk;
+
+void pg_query_ruby_analyze_walk_init(PgQueryRubyAnalyzeWalk *walk, PgQueryRubyTreeBuilder builder);
+void pg_query_ruby_analyze_walk_free(PgQueryRubyAnalyzeWalk *walk);
+void pg_query_ruby_analyze_tables(PgQueryRubyAnalyzeWalk *walk);
+
+VALUE new_ruby_parse_error(PgQueryError *error);
+VALUE new_ruby_tree_error(void);
+VALUE new_ruby_parse_result(PgQueryError *error);
+VALUE new_ruby_tree_result(void);
+
+int pg_query_ruby_parser_flags(void);
+int pg_query_ruby_fingerprint_version(VALUE version);
+VALUE pg_query_ruby_fingerprint_int(uint64_t hash);
+VALUE pg_query_ruby_warnings(PgQueryParserResult *result);
+void pg_query_ruby_record_stats(PgQueryParserStats *stats, const char *phase, uint64_t phase_ns, size_t bytes_out);
+
+/*
+ * State of a single parser call. The *_without_gvl functions only read the
+ * input and write the result, so they can run on any thread.
+ */
+
+typedef struct {
+	char *input;
+	int reuse_buffers; // Only for results that are freed right after building them
+	PgQueryParserResult result;
+	PgQueryTree tree;
+	int tree_error;
+	uint64_t tree_ns; // With PG_QUERY_PARSER_STATS
+} PgQueryRubyParseTreeCall;
+
+typedef struct {
+	char *input;
+	int reuse_buffers;
+	int constants; // Also return the replaced constants
+	PgQueryParserResult result;
+} PgQueryRubyNormalizeCall;
+
+typedef struct {
+	char *input;
+	int version; // PG_QUERY_FINGERPRINT_VERSION(_XXH64)
+	int raw; // Return the raw digest instead of the hexdigest (always the case for version 3)
+	PgQueryFingerprintResult result;
+	unsigned char digest[PG_QUERY_FINGERPRINT_DIGEST_LENGTH];
+	PgQueryParserStats stats;
+	uint64_t fingerprint_ns;
+} PgQueryRubyFingerprintCall;
+
+void *pg_query_ruby_parse_tree_without_gvl(void *arg);
+VALUE pg_query_ruby_parse_tree_build(VALUE arg);
+VALUE pg_query_ruby_parse_tree_cleanup(VALUE arg);
+
+void *pg_query_ruby_normalize_without_gvl(void *arg);
+void *pg_query_ruby_fingerprint_without_gvl(void *arg);
+
+void Init_pg_query_batch(VALUE cPgQuery);
+void Init_pg_query_analyze(VALUE cPgQuery);
+void Init_pg_query_native_tree(VALUE cPgQuery);
+void Init_pg_query_scan(VALUE cPgQuery);
+void Init_pg_query_log(VALUE cPgQuery);
+void Init_pg_query_statements(VALUE cPgQuery);
+
 #endif
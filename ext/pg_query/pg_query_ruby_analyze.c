@@ -0,0 +1,601 @@
+#include "pg_query_ruby.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * PgQuery.analyze - parses the query once, and extracts everything we usually
+ * need to know about a query from the native tree, without turning the tree
+ * into Ruby objects.
+ *
+ * Tables, CTE names and aliases follow PgQuery#load_tables_and_aliases!, and
+ * param refs follow PgQuery#param_refs, step by step - the order in which the
+ * Ruby code visits nodes determines the order of the results.
+ */
+
+typedef struct {
+	char *input;
+	PgQueryParserResult result;
+	PgQueryTree tree;
+	int tree_error;
+	char fingerprint[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1];
+	int fingerprint_error;
+	uint64_t tree_ns; // Building and fingerprinting the tree, with PG_QUERY_PARSER_STATS
+	PgQueryRubyAnalyzeWalk walk;
+} PgQueryRubyAnalyzeCall;
+
+#define GET(object, key) pg_query_tree_object_get(walk->tree, (object), (key))
+#define NODE_IS(name, str) pg_query_tree_key_equals((name), (str))
+
+static void pg_query_ruby_analyze_push(PgQueryRubyAnalyzeQueue *queue, PgQueryTreeValue *value, PgQueryRubyTableType type)
+{
+	if (queue->len == queue->capacity) {
+		queue->capacity = queue->capacity ? queue->capacity * 2 : 32;
+		REALLOC_N(queue->values, PgQueryTreeValue *, queue->capacity);
+		REALLOC_N(queue->types, PgQueryRubyTableType, queue->capacity);
+	}
+
+	queue->values[queue->len] = value;
+	queue->types[queue->len] = type;
+	queue->len++;
+}
+
+static int pg_query_ruby_analyze_shift(PgQueryRubyAnalyzeQueue *queue, PgQueryTreeValue **value, PgQueryRubyTableType *type)
+{
+	if (queue->head == queue->len) return 0;
+
+	*value = queue->values[queue->head];
+	if (type) *type = queue->types[queue->head];
+	queue->head++;
+
+	return 1;
+}
+
+static int pg_query_ruby_analyze_empty(PgQueryRubyAnalyzeQueue *queue)
+{
+	return queue->head == queue->len;
+}
+
+static void pg_query_ruby_analyze_push_all(PgQueryRubyAnalyzeQueue *queue, PgQueryTreeValue *list, PgQueryRubyTableType type)
+{
+	size_t i;
+
+	if (list == NULL || list->type != PG_QUERY_TREE_ARRAY) return;
+
+	for (i = 0; i < list->len; i++)
+		pg_query_ruby_analyze_push(queue, &list->u.items[i], type);
+}
+
+static void pg_query_ruby_analyze_queue_free(PgQueryRubyAnalyzeQueue *queue)
+{
+	xfree(queue->values);
+	xfree(queue->types);
+}
+
+void pg_query_ruby_analyze_walk_init(PgQueryRubyAnalyzeWalk *walk, PgQueryRubyTreeBuilder builder)
+{
+	memset(walk, 0, sizeof(PgQueryRubyAnalyzeWalk));
+
+	walk->tree = builder.tree;
+	walk->builder = builder;
+	walk->tables = rb_ary_new();
+	walk->cte_names = rb_ary_new();
+	walk->aliases = rb_hash_new();
+	walk->param_refs = rb_ary_new();
+}
+
+void pg_query_ruby_analyze_walk_free(PgQueryRubyAnalyzeWalk *walk)
+{
+	pg_query_ruby_analyze_queue_free(&walk->statements);
+	pg_query_ruby_analyze_queue_free(&walk->from_clause_items);
+	pg_query_ruby_analyze_queue_free(&walk->subselect_items);
+}
+
+// Ruby truthiness - missing members and null are nil
+static int pg_query_ruby_analyze_truthy(PgQueryTreeValue *value)
+{
+	return value != NULL && value->type != PG_QUERY_TREE_NULL &&
+		   !(value->type == PG_QUERY_TREE_BOOL && !value->u.boolean);
+}
+
+static int pg_query_ruby_analyze_integer_equals(PgQueryTreeValue *value, long long integer)
+{
+	return value != NULL && value->type == PG_QUERY_TREE_INTEGER && value->u.integer == integer;
+}
+
+static VALUE pg_query_ruby_analyze_to_ruby(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *value)
+{
+	if (value == NULL) return Qnil;
+
+	return pg_query_ruby_tree_value_to_ruby(&walk->builder, value);
+}
+
+static VALUE pg_query_ruby_analyze_table_type(PgQueryRubyTableType type)
+{
+	switch (type) {
+		case PG_QUERY_RUBY_TABLE_SELECT:
+			return ID2SYM(rb_intern("select"));
+		case PG_QUERY_RUBY_TABLE_DML:
+			return ID2SYM(rb_intern("dml"));
+		case PG_QUERY_RUBY_TABLE_DDL:
+			return ID2SYM(rb_intern("ddl"));
+	}
+
+	return Qnil;
+}
+
+static void pg_query_ruby_analyze_add_table(PgQueryRubyAnalyzeWalk *walk, VALUE table, PgQueryRubyTableType type)
+{
+	VALUE entry = rb_hash_new();
+
+	rb_hash_aset(entry, ID2SYM(rb_intern("table")), table);
+	rb_hash_aset(entry, ID2SYM(rb_intern("type")), pg_query_ruby_analyze_table_type(type));
+
+	rb_ary_push(walk->tables, entry);
+}
+
+static void pg_query_ruby_analyze_with_clause(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *with_clause)
+{
+	PgQueryTreeValue *ctes = GET(GET(with_clause, "WithClause"), "ctes");
+	size_t i;
+
+	if (ctes == NULL || ctes->type != PG_QUERY_TREE_ARRAY) return;
+
+	for (i = 0; i < ctes->len; i++) {
+		PgQueryTreeValue *cte = GET(&ctes->u.items[i], "CommonTableExpr");
+		if (!pg_query_ruby_analyze_truthy(cte)) continue;
+
+		rb_ary_push(walk->cte_names, pg_query_ruby_analyze_to_ruby(walk, GET(cte, "ctename")));
+		pg_query_ruby_analyze_push(&walk->statements, GET(cte, "ctequery"), PG_QUERY_RUBY_TABLE_SELECT);
+	}
+}
+
+// Joins the String values of a list of String nodes with ".", like the DropStmt case in Ruby
+static VALUE pg_query_ruby_analyze_join_names(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *names, size_t count)
+{
+	VALUE parts = rb_ary_new_capa(count);
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		rb_ary_push(parts, pg_query_ruby_analyze_to_ruby(walk, GET(GET(&names->u.items[i], "String"), "str")));
+
+	return rb_ary_join(parts, rb_str_new_cstr("."));
+}
+
+static void pg_query_ruby_analyze_drop_stmt(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *fields)
+{
+	PgQueryTreeValue *objects = GET(fields, "objects");
+	PgQueryTreeValue *remove_type = GET(fields, "removeType");
+	size_t i;
+
+	if (objects == NULL || objects->type != PG_QUERY_TREE_ARRAY) return;
+
+	for (i = 0; i < objects->len; i++) {
+		PgQueryTreeValue *object = &objects->u.items[i];
+
+		if (object->type != PG_QUERY_TREE_ARRAY) continue;
+
+		if (pg_query_ruby_analyze_integer_equals(remove_type, 37)) { // OBJECT_TYPE_TABLE
+			pg_query_ruby_analyze_add_table(walk, pg_query_ruby_analyze_join_names(walk, object, object->len), PG_QUERY_RUBY_TABLE_DDL);
+		} else if (pg_query_ruby_analyze_integer_equals(remove_type, 31) || // OBJECT_TYPE_RULE
+				   pg_query_ruby_analyze_integer_equals(remove_type, 40)) { // OBJECT_TYPE_TRIGGER
+			pg_query_ruby_analyze_add_table(walk, pg_query_ruby_analyze_join_names(walk, object, object->len > 0 ? object->len - 1 : 0), PG_QUERY_RUBY_TABLE_DDL);
+		}
+	}
+}
+
+static void pg_query_ruby_analyze_statement(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *statement)
+{
+	PgQueryTreeKey *name = pg_query_tree_node_name(walk->tree, statement);
+	PgQueryTreeValue *fields = pg_query_tree_node_fields(statement);
+	PgQueryTreeValue *value;
+	size_t i;
+
+	if (NODE_IS(name, "RawStmt")) {
+		pg_query_ruby_analyze_push(&walk->statements, GET(fields, "stmt"), PG_QUERY_RUBY_TABLE_SELECT);
+	} else if (NODE_IS(name, "SelectStmt")) {
+		// The following statement types do not modify tables
+		PgQueryTreeValue *op = GET(fields, "op");
+
+		if (pg_query_ruby_analyze_integer_equals(op, 0)) {
+			PgQueryTreeValue *from_clause = GET(fields, "fromClause");
+			if (from_clause && from_clause->type == PG_QUERY_TREE_ARRAY) {
+				for (i = 0; i < from_clause->len; i++) {
+					PgQueryTreeValue *item = &from_clause->u.items[i];
+					PgQueryTreeValue *range_subselect = GET(item, "RangeSubselect");
+					if (pg_query_ruby_analyze_truthy(range_subselect))
+						pg_query_ruby_analyze_push(&walk->statements, GET(range_subselect, "subquery"), PG_QUERY_RUBY_TABLE_SELECT);
+					else
+						pg_query_ruby_analyze_push(&walk->from_clause_items, item, PG_QUERY_RUBY_TABLE_SELECT);
+				}
+			}
+		} else if (pg_query_ruby_analyze_integer_equals(op, 1)) {
+			if (pg_query_ruby_analyze_truthy(value = GET(fields, "larg")))
+				pg_query_ruby_analyze_push(&walk->statements, value, PG_QUERY_RUBY_TABLE_SELECT);
+			if (pg_query_ruby_analyze_truthy(value = GET(fields, "rarg")))
+				pg_query_ruby_analyze_push(&walk->statements, value, PG_QUERY_RUBY_TABLE_SELECT);
+		}
+
+		if (pg_query_ruby_analyze_truthy(value = GET(fields, "withClause")))
+			pg_query_ruby_analyze_with_clause(walk, value);
+	} else if (NODE_IS(name, "InsertStmt") || NODE_IS(name, "UpdateStmt") || NODE_IS(name, "DeleteStmt")) {
+		// The following statements modify the contents of a table
+		pg_query_ruby_analyze_push(&walk->from_clause_items, GET(fields, "relation"), PG_QUERY_RUBY_TABLE_DML);
+		if ((value = GET(fields, "selectStmt")) != NULL)
+			pg_query_ruby_analyze_push(&walk->statements, value, PG_QUERY_RUBY_TABLE_SELECT);
+		if ((value = GET(fields, "withClause")) != NULL)
+			pg_query_ruby_analyze_push(&walk->statements, value, PG_QUERY_RUBY_TABLE_SELECT);
+
+		if (pg_query_ruby_analyze_truthy(value = GET(fields, "withClause")))
+			pg_query_ruby_analyze_with_clause(walk, value);
+	} else if (NODE_IS(name, "CopyStmt")) {
+		if (pg_query_ruby_analyze_truthy(value = GET(fields, "relation")))
+			pg_query_ruby_analyze_push(&walk->from_clause_items, value, PG_QUERY_RUBY_TABLE_DML);
+		pg_query_ruby_analyze_push(&walk->statements, GET(fields, "query"), PG_QUERY_RUBY_TABLE_SELECT);
+	} else if (NODE_IS(name, "AlterTableStmt") || NODE_IS(name, "CreateStmt")) {
+		// The following statement types are DDL (changing table structure)
+		pg_query_ruby_analyze_push(&walk->from_clause_items, GET(fields, "relation"), PG_QUERY_RUBY_TABLE_DDL);
+	} else if (NODE_IS(name, "CreateTableAsStmt")) {
+		PgQueryTreeValue *into = GET(fields, "into");
+		if (pg_query_ruby_analyze_truthy(into) && pg_query_ruby_analyze_truthy(value = GET(GET(into, "IntoClause"), "rel")))
+			pg_query_ruby_analyze_push(&walk->from_clause_items, value, PG_QUERY_RUBY_TABLE_DDL);
+	} else if (NODE_IS(name, "TruncateStmt")) {
+		pg_query_ruby_analyze_push_all(&walk->from_clause_items, GET(fields, "relations"), PG_QUERY_RUBY_TABLE_DDL);
+	} else if (NODE_IS(name, "ViewStmt")) {
+		pg_query_ruby_analyze_push(&walk->from_clause_items, GET(fields, "view"), PG_QUERY_RUBY_TABLE_DDL);
+		pg_query_ruby_analyze_push(&walk->statements, GET(fields, "query"), PG_QUERY_RUBY_TABLE_SELECT);
+	} else if (NODE_IS(name, "VacuumStmt") || NODE_IS(name, "IndexStmt") || NODE_IS(name, "CreateTrigStmt") ||
+			   NODE_IS(name, "RuleStmt") || NODE_IS(name, "RefreshMatViewStmt")) {
+		pg_query_ruby_analyze_push(&walk->from_clause_items, GET(fields, "relation"), PG_QUERY_RUBY_TABLE_DDL);
+	} else if (NODE_IS(name, "DropStmt")) {
+		pg_query_ruby_analyze_drop_stmt(walk, fields);
+	} else if (NODE_IS(name, "GrantStmt")) {
+		if (pg_query_ruby_analyze_integer_equals(GET(fields, "objtype"), 1)) // Table
+			pg_query_ruby_analyze_push_all(&walk->from_clause_items, GET(fields, "objects"), PG_QUERY_RUBY_TABLE_DDL);
+	} else if (NODE_IS(name, "LockStmt")) {
+		pg_query_ruby_analyze_push_all(&walk->from_clause_items, GET(fields, "relations"), PG_QUERY_RUBY_TABLE_DDL);
+	} else if (NODE_IS(name, "ExplainStmt")) {
+		// The following are other statements that don't fit into query/DML/DDL
+		pg_query_ruby_analyze_push(&walk->statements, GET(fields, "query"), PG_QUERY_RUBY_TABLE_SELECT);
+	}
+
+	if (fields == NULL || fields->type != PG_QUERY_TREE_OBJECT) return;
+
+	if (pg_query_ruby_analyze_truthy(value = GET(fields, "targetList")))
+		pg_query_ruby_analyze_push_all(&walk->subselect_items, value, PG_QUERY_RUBY_TABLE_SELECT);
+	if (pg_query_ruby_analyze_truthy(value = GET(fields, "whereClause")))
+		pg_query_ruby_analyze_push(&walk->subselect_items, value, PG_QUERY_RUBY_TABLE_SELECT);
+	if (pg_query_ruby_analyze_truthy(value = GET(fields, "sortClause")) && value->type == PG_QUERY_TREE_ARRAY)
+		for (i = 0; i < value->len; i++)
+			pg_query_ruby_analyze_push(&walk->subselect_items, GET(GET(&value->u.items[i], "SortBy"), "node"), PG_QUERY_RUBY_TABLE_SELECT);
+	if (pg_query_ruby_analyze_truthy(value = GET(fields, "groupClause")))
+		pg_query_ruby_analyze_push_all(&walk->subselect_items, value, PG_QUERY_RUBY_TABLE_SELECT);
+	if (pg_query_ruby_analyze_truthy(value = GET(fields, "havingClause")))
+		pg_query_ruby_analyze_push(&walk->subselect_items, value, PG_QUERY_RUBY_TABLE_SELECT);
+}
+
+static void pg_query_ruby_analyze_subselect_item(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *item)
+{
+	PgQueryTreeKey *name = pg_query_tree_node_name(walk->tree, item);
+	PgQueryTreeValue *fields = pg_query_tree_node_fields(item);
+	PgQueryTreeValue *value;
+
+	if (NODE_IS(name, "A_Expr")) {
+		const char *sides[] = { "lexpr", "rexpr" };
+		int i;
+
+		for (i = 0; i < 2; i++) {
+			value = GET(fields, sides[i]);
+			if (!pg_query_ruby_analyze_truthy(value)) continue;
+			if (value->type == PG_QUERY_TREE_ARRAY)
+				pg_query_ruby_analyze_push_all(&walk->subselect_items, value, PG_QUERY_RUBY_TABLE_SELECT);
+			else
+				pg_query_ruby_analyze_push(&walk->subselect_items, value, PG_QUERY_RUBY_TABLE_SELECT);
+		}
+	} else if (NODE_IS(name, "BoolExpr")) {
+		pg_query_ruby_analyze_push_all(&walk->subselect_items, GET(fields, "args"), PG_QUERY_RUBY_TABLE_SELECT);
+	} else if (NODE_IS(name, "ResTarget")) {
+		pg_query_ruby_analyze_push(&walk->subselect_items, GET(fields, "val"), PG_QUERY_RUBY_TABLE_SELECT);
+	} else if (NODE_IS(name, "SubLink")) {
+		pg_query_ruby_analyze_push(&walk->statements, GET(fields, "subselect"), PG_QUERY_RUBY_TABLE_SELECT);
+	}
+}
+
+static void pg_query_ruby_analyze_range_var(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *fields, PgQueryRubyTableType type)
+{
+	VALUE schemaname = pg_query_ruby_analyze_to_ruby(walk, GET(fields, "schemaname"));
+	VALUE relname = pg_query_ruby_analyze_to_ruby(walk, GET(fields, "relname"));
+	PgQueryTreeValue *alias;
+	VALUE table;
+
+	if (!RTEST(schemaname) && RTEST(rb_ary_includes(walk->cte_names, relname))) return;
+
+	table = rb_ary_new();
+	if (!NIL_P(schemaname)) rb_ary_push(table, schemaname);
+	if (!NIL_P(relname)) rb_ary_push(table, relname);
+	table = rb_ary_join(table, rb_str_new_cstr("."));
+
+	pg_query_ruby_analyze_add_table(walk, table, type);
+
+	if (pg_query_ruby_analyze_truthy(alias = GET(fields, "alias")))
+		rb_hash_aset(walk->aliases, pg_query_ruby_analyze_to_ruby(walk, GET(GET(alias, "Alias"), "aliasname")), table);
+}
+
+void pg_query_ruby_analyze_tables(PgQueryRubyAnalyzeWalk *walk)
+{
+	PgQueryTreeValue *value;
+	PgQueryRubyTableType type;
+
+	pg_query_ruby_analyze_push_all(&walk->statements, &walk->tree->root, PG_QUERY_RUBY_TABLE_SELECT);
+
+	for (;;) {
+		if (pg_query_ruby_analyze_shift(&walk->statements, &value, NULL) && pg_query_ruby_analyze_truthy(value))
+			pg_query_ruby_analyze_statement(walk, value);
+
+		if (pg_query_ruby_analyze_shift(&walk->subselect_items, &value, NULL) && pg_query_ruby_analyze_truthy(value))
+			pg_query_ruby_analyze_subselect_item(walk, value);
+
+		if (pg_query_ruby_analyze_empty(&walk->subselect_items) && pg_query_ruby_analyze_empty(&walk->statements))
+			break;
+	}
+
+	while (pg_query_ruby_analyze_shift(&walk->from_clause_items, &value, &type) && pg_query_ruby_analyze_truthy(value)) {
+		PgQueryTreeKey *name = pg_query_tree_node_name(walk->tree, value);
+		PgQueryTreeValue *fields = pg_query_tree_node_fields(value);
+
+		if (NODE_IS(name, "JoinExpr")) {
+			pg_query_ruby_analyze_push(&walk->from_clause_items, GET(fields, "larg"), type);
+			pg_query_ruby_analyze_push(&walk->from_clause_items, GET(fields, "rarg"), type);
+		} else if (NODE_IS(name, "RowExpr")) {
+			pg_query_ruby_analyze_push_all(&walk->from_clause_items, GET(fields, "args"), type);
+		} else if (NODE_IS(name, "RangeVar")) {
+			pg_query_ruby_analyze_range_var(walk, fields, type);
+		} else if (NODE_IS(name, "RangeSubselect")) {
+			pg_query_ruby_analyze_push(&walk->from_clause_items, GET(fields, "subquery"), type);
+		} else if (NODE_IS(name, "SelectStmt")) {
+			if (pg_query_ruby_analyze_truthy(value = GET(fields, "fromClause")))
+				pg_query_ruby_analyze_push_all(&walk->from_clause_items, value, type);
+		}
+	}
+
+	rb_funcall(walk->tables, rb_intern("uniq!"), 0);
+	rb_funcall(walk->cte_names, rb_intern("uniq!"), 0);
+}
+
+// "?" replacement characters have number 0, which isn't included in the JSON
+static long pg_query_ruby_analyze_param_ref_length(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *param_ref)
+{
+	PgQueryTreeValue *number = GET(param_ref, "number");
+	long long n;
+	long length = 1;
+
+	if (number == NULL || number->type != PG_QUERY_TREE_INTEGER || number->u.integer == 0) return 1;
+
+	for (n = number->u.integer; n != 0; n /= 10)
+		length++;
+
+	return length + (number->u.integer < 0 ? 1 : 0);
+}
+
+static void pg_query_ruby_analyze_add_param_ref(PgQueryRubyAnalyzeWalk *walk, VALUE location, long length, VALUE typename)
+{
+	VALUE entry = rb_hash_new();
+
+	rb_hash_aset(entry, rb_str_new_cstr("location"), location);
+	rb_hash_aset(entry, rb_str_new_cstr("length"), LONG2NUM(length));
+	if (typename != Qundef) rb_hash_aset(entry, rb_str_new_cstr("typename"), typename);
+
+	rb_ary_push(walk->param_refs, entry);
+}
+
+static void pg_query_ruby_analyze_type_cast(PgQueryRubyAnalyzeWalk *walk, PgQueryTreeValue *fields)
+{
+	PgQueryTreeValue *arg = GET(fields, "arg");
+	PgQueryTreeValue *type_name = GET(fields, "typeName");
+	PgQueryTreeValue *value;
+	PgQueryTreeValue p, t;
+	int has_p = 0, has_t = 0;
+	PgQueryTreeValue *location, *typeloc;
+	VALUE location_value, typename;
+	long length;
+
+	if (!pg_query_ruby_analyze_truthy(arg) || !pg_query_ruby_analyze_truthy(type_name)) return;
+
+	// Like Hash#delete, both are removed from the tree (and thus not walked into) either way
+	if ((value = GET(arg, "ParamRef")) != NULL) {
+		p = *value;
+		has_p = 1;
+		pg_query_tree_object_delete(walk->tree, arg, "ParamRef");
+	}
+	if ((value = GET(type_name, "TypeName")) != NULL) {
+		t = *value;
+		has_t = 1;
+		pg_query_tree_object_delete(walk->tree, type_name, "TypeName");
+	}
+
+	if (!has_p || !pg_query_ruby_analyze_truthy(&p) || !has_t || !pg_query_ruby_analyze_truthy(&t)) return;
+
+	location = GET(&p, "location");
+	typeloc = GET(&t, "location");
+	typename = pg_query_ruby_analyze_to_ruby(walk, GET(&t, "names"));
+	length = pg_query_ruby_analyze_param_ref_length(walk, &p);
+	location_value = pg_query_ruby_analyze_to_ruby(walk, location);
+
+	if (location && typeloc && location->type == PG_QUERY_TREE_INTEGER && typeloc->type == PG_QUERY_TREE_INTEGER &&
+		typeloc->u.integer < location->u.integer) {
+		length += (long) (location->u.integer - typeloc->u.integer);
+		location_value = LL2NUM(typeloc->u.integer);
+	}
+
+	pg_query_ruby_analyze_add_param_ref(walk, location_value, length, typename);
+}
+
+/*
+ * Same as PgQuery#param_refs: every object member whose value is a ParamRef
+ * or TypeCast node is looked at before anything below it. This modifies the
+ * tree (casted param refs are removed), so it has to run last.
+ */
+static void pg_query_ruby_analyze_param_refs(PgQueryRubyAnalyzeWalk *walk)
+{
+	PgQueryRubyAnalyzeQueue *stack = &walk->statements;
+	size_t i;
+
+	stack->head = stack->len = 0;
+	pg_query_ruby_analyze_push_all(stack, &walk->tree->root, PG_QUERY_RUBY_TABLE_SELECT);
+
+	while (stack->len > 0) {
+		PgQueryTreeValue *expr = stack->values[--stack->len];
+
+		if (expr->type == PG_QUERY_TREE_OBJECT) {
+			for (i = 0; i < expr->len; i++) {
+				PgQueryTreeValue *v = &expr->u.members[i].value;
+				PgQueryTreeValue *node;
+
+				if (v->type == PG_QUERY_TREE_OBJECT) {
+					if (pg_query_ruby_analyze_truthy(node = GET(v, "ParamRef"))) {
+						pg_query_ruby_analyze_add_param_ref(walk, pg_query_ruby_analyze_to_ruby(walk, GET(node, "location")),
+															pg_query_ruby_analyze_param_ref_length(walk, node), Qundef);
+					} else if (pg_query_ruby_analyze_truthy(node = GET(v, "TypeCast"))) {
+						pg_query_ruby_analyze_type_cast(walk, node);
+					}
+				}
+			}
+
+			for (i = 0; i < expr->len; i++)
+				if (expr->u.members[i].value.type != PG_QUERY_TREE_NULL)
+					pg_query_ruby_analyze_push(stack, &expr->u.members[i].value, PG_QUERY_RUBY_TABLE_SELECT);
+		} else if (expr->type == PG_QUERY_TREE_ARRAY) {
+			pg_query_ruby_analyze_push_all(stack, expr, PG_QUERY_RUBY_TABLE_SELECT);
+		}
+	}
+}
+
+static VALUE pg_query_ruby_analyze_statement_types(PgQueryRubyAnalyzeWalk *walk)
+{
+	VALUE statement_types = rb_ary_new();
+	PgQueryTreeValue *root = &walk->tree->root;
+	size_t i;
+
+	if (root->type != PG_QUERY_TREE_ARRAY) return statement_types;
+
+	for (i = 0; i < root->len; i++) {
+		PgQueryTreeValue *stmt = GET(GET(&root->u.items[i], "RawStmt"), "stmt");
+
+		if (stmt == NULL || stmt->type != PG_QUERY_TREE_OBJECT || stmt->len == 0) continue;
+
+		rb_ary_push(statement_types, pg_query_ruby_tree_key(&walk->builder, stmt->u.members[0].key));
+	}
+
+	return statement_types;
+}
+
+static void *pg_query_ruby_analyze_without_gvl(void *arg)
+{
+	PgQueryRubyAnalyzeCall *call = (PgQueryRubyAnalyzeCall *) arg;
+	int flags = PG_QUERY_PARSER_JSON | PG_QUERY_PARSER_NORMALIZE | PG_QUERY_PARSER_REUSE_BUFFERS | pg_query_ruby_parser_flags();
+
+	call->result = pg_query_parser_parse(call->input, flags);
+
+	if (call->result.error == NULL) {
+		uint64_t start = (flags & PG_QUERY_PARSER_STATS) ? pg_query_parser_clock_ns() : 0;
+
+		// The tree takes ownership of the JSON buffer
+		call->tree_error = pg_query_tree_parse_json(&call->tree, call->result.parse_tree, PG_QUERY_TREE_MAX_NESTING);
+		call->result.parse_tree = NULL;
+
+		if (!call->tree_error)
+			call->fingerprint_error = pg_query_tree_fingerprint(&call->tree, call->fingerprint);
+
+		if (flags & PG_QUERY_PARSER_STATS) call->tree_ns = pg_query_parser_clock_ns() - start;
+	}
+
+	return NULL;
+}
+
+static VALUE pg_query_ruby_analyze_build(VALUE arg)
+{
+	PgQueryRubyAnalyzeCall *call = (PgQueryRubyAnalyzeCall *) arg;
+	PgQueryRubyAnalyzeWalk *walk = &call->walk;
+	PgQueryRubyTreeBuilder builder;
+	VALUE output;
+
+	pg_query_ruby_tree_builder_init(&builder, &call->tree);
+	pg_query_ruby_analyze_walk_init(walk, builder);
+
+	output = rb_ary_new_capa(8);
+
+	rb_ary_push(output, rb_str_new2(call->result.normalized_query));
+	rb_ary_push(output, call->fingerprint_error ? Qnil : rb_str_new2(call->fingerprint));
+	rb_ary_push(output, pg_query_ruby_analyze_statement_types(walk));
+
+	pg_query_ruby_analyze_tables(walk);
+	rb_ary_push(output, walk->tables);
+	rb_ary_push(output, walk->cte_names);
+	rb_ary_push(output, walk->aliases);
+
+	pg_query_ruby_analyze_param_refs(walk);
+	rb_ary_push(output, walk->param_refs);
+
+	rb_ary_push(output, pg_query_ruby_warnings(&call->result));
+
+	RB_GC_GUARD(walk->builder.keys);
+	RB_GC_GUARD(walk->tables);
+	RB_GC_GUARD(walk->cte_names);
+	RB_GC_GUARD(walk->aliases);
+	RB_GC_GUARD(walk->param_refs);
+
+	return output;
+}
+
+static VALUE pg_query_ruby_analyze_cleanup(VALUE arg)
+{
+	PgQueryRubyAnalyzeCall *call = (PgQueryRubyAnalyzeCall *) arg;
+
+	pg_query_ruby_analyze_walk_free(&call->walk);
+
+	// The tree owns the JSON buffer, unless it is to be reused
+	if (call->result.reused_buffers) {
+		pg_query_parser_release_buffer(call->tree.buffer);
+		call->tree.buffer = NULL;
+	}
+
+	pg_query_tree_free(&call->tree);
+	pg_query_parser_free_result(call->result);
+
+	return Qnil;
+}
+
+/*
+ * Returns [normalized query, fingerprint, statement types, tables with types,
+ * CTE names, aliases, param refs, warnings] - see PgQuery.analyze.
+ */
+static VALUE pg_query_ruby_analyze(VALUE self, VALUE input)
+{
+	PgQueryRubyAnalyzeCall call = {0};
+
+	pg_query_tree_init(&call.tree);
+
+	call.input = pg_query_ruby_input_dup(input);
+	pg_query_ruby_without_gvl(pg_query_ruby_analyze_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error) {
+		VALUE error = new_ruby_parse_error(call.result.error);
+		pg_query_ruby_analyze_cleanup((VALUE) &call);
+		rb_exc_raise(error);
+	}
+
+	if (call.tree_error) {
+		pg_query_ruby_analyze_cleanup((VALUE) &call);
+		rb_exc_raise(new_ruby_tree_error());
+	}
+
+	pg_query_ruby_record_stats(&call.result.stats, "tree", call.tree_ns, call.tree.buffer_len);
+
+	return rb_ensure(pg_query_ruby_analyze_build, (VALUE) &call, pg_query_ruby_analyze_cleanup, (VALUE) &call);
+}
+
+void Init_pg_query_analyze(VALUE cPgQuery)
+{
+	rb_define_singleton_method(cPgQuery, "_analyze", pg_query_ruby_analyze, 1);
+}
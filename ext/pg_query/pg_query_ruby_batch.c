@@ -0,0 +1,206 @@
+#include "pg_query_ruby.h"
+#include "pg_query_ruby_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Batch variants of _raw_parse_tree, normalize and fingerprint.
+ *
+ * All queries are copied out of the Ruby heap up front, then processed on the
+ * native worker pool in a single GVL-free section. Errors don't abort the
+ * batch, the ParseError for a failed query is returned in its place instead.
+ */
+
+typedef struct {
+	size_t item_size;  // every item struct starts with the "char *input" member
+	void *(*work)(void *item);  // runs without the GVL
+	VALUE (*result)(void *item);
+	void (*cleanup)(void *item);
+} PgQueryRubyBatchType;
+
+typedef struct {
+	const PgQueryRubyBatchType *type;
+	VALUE queries;
+	int threads;
+	char *items;
+	size_t count;
+} PgQueryRubyBatch;
+
+#define PG_QUERY_RUBY_BATCH_ITEM(batch, i) ((void *) ((batch)->items + (i) * (batch)->type->item_size))
+
+static void pg_query_ruby_batch_work(void *arg, size_t index)
+{
+	PgQueryRubyBatch *batch = (PgQueryRubyBatch *) arg;
+	batch->type->work(PG_QUERY_RUBY_BATCH_ITEM(batch, index));
+}
+
+static void *pg_query_ruby_batch_run_without_gvl(void *arg)
+{
+	PgQueryRubyBatch *batch = (PgQueryRubyBatch *) arg;
+	pg_query_pool_run(pg_query_ruby_batch_work, batch, batch->count, batch->threads);
+	return NULL;
+}
+
+static VALUE pg_query_ruby_batch_process(VALUE arg)
+{
+	PgQueryRubyBatch *batch = (PgQueryRubyBatch *) arg;
+	VALUE output;
+	size_t i;
+
+	// Validate everything before doing any work, so a bad element raises right away
+	for (i = 0; i < batch->count; i++) {
+		VALUE query = rb_ary_entry(batch->queries, i);
+		Check_Type(query, T_STRING);
+		StringValueCStr(query);
+	}
+
+	for (i = 0; i < batch->count; i++)
+		*(char **) PG_QUERY_RUBY_BATCH_ITEM(batch, i) = pg_query_ruby_input_dup(rb_ary_entry(batch->queries, i));
+
+	pg_query_ruby_without_gvl(pg_query_ruby_batch_run_without_gvl, batch);
+
+	output = rb_ary_new_capa(batch->count);
+	for (i = 0; i < batch->count; i++)
+		rb_ary_push(output, batch->type->result(PG_QUERY_RUBY_BATCH_ITEM(batch, i)));
+
+	return output;
+}
+
+static VALUE pg_query_ruby_batch_cleanup(VALUE arg)
+{
+	PgQueryRubyBatch *batch = (PgQueryRubyBatch *) arg;
+	size_t i;
+
+	for (i = 0; i < batch->count; i++) {
+		void *item = PG_QUERY_RUBY_BATCH_ITEM(batch, i);
+		xfree(*(char **) item);
+		batch->type->cleanup(item);
+	}
+
+	xfree(batch->items);
+
+	return Qnil;
+}
+
+static VALUE pg_query_ruby_batch(const PgQueryRubyBatchType *type, VALUE queries, VALUE threads)
+{
+	PgQueryRubyBatch batch;
+	VALUE output;
+
+	Check_Type(queries, T_ARRAY);
+
+	batch.type = type;
+	batch.queries = rb_ary_dup(queries); // guards against the caller modifying the Array
+	batch.threads = NUM2INT(threads);
+	batch.count = RARRAY_LEN(batch.queries);
+	batch.items = (char *) ruby_xcalloc(batch.count > 0 ? batch.count : 1, type->item_size);
+
+	if (batch.threads < 1) batch.threads = 1;
+
+	output = rb_ensure(pg_query_ruby_batch_process, (VALUE) &batch, pg_query_ruby_batch_cleanup, (VALUE) &batch);
+
+	RB_GC_GUARD(batch.queries);
+
+	return output;
+}
+
+static void *pg_query_ruby_parse_tree_batch_work(void *arg)
+{
+	PgQueryRubyParseTreeCall *call = (PgQueryRubyParseTreeCall *) arg;
+
+	pg_query_tree_init(&call->tree);
+
+	return pg_query_ruby_parse_tree_without_gvl(call);
+}
+
+static VALUE pg_query_ruby_parse_tree_batch_result(void *arg)
+{
+	PgQueryRubyParseTreeCall *call = (PgQueryRubyParseTreeCall *) arg;
+
+	if (call->result.error) return new_ruby_parse_error(call->result.error);
+	if (call->tree_error) return new_ruby_tree_error();
+
+	return pg_query_ruby_parse_tree_build((VALUE) call);
+}
+
+// Items start out zeroed, which is safe to free even if the work never ran
+static void pg_query_ruby_parse_tree_batch_cleanup(void *arg)
+{
+	pg_query_ruby_parse_tree_cleanup((VALUE) arg);
+}
+
+static const PgQueryRubyBatchType pg_query_ruby_parse_tree_batch = {
+	sizeof(PgQueryRubyParseTreeCall),
+	pg_query_ruby_parse_tree_batch_work,
+	pg_query_ruby_parse_tree_batch_result,
+	pg_query_ruby_parse_tree_batch_cleanup
+};
+
+static VALUE pg_query_ruby_normalize_batch_result(void *arg)
+{
+	PgQueryRubyNormalizeCall *call = (PgQueryRubyNormalizeCall *) arg;
+
+	if (call->result.error) return new_ruby_parse_error(call->result.error);
+
+	return rb_str_new2(call->result.normalized_query);
+}
+
+static void pg_query_ruby_normalize_batch_cleanup(void *arg)
+{
+	PgQueryRubyNormalizeCall *call = (PgQueryRubyNormalizeCall *) arg;
+	pg_query_parser_free_result(call->result);
+}
+
+static const PgQueryRubyBatchType pg_query_ruby_normalize_batch = {
+	sizeof(PgQueryRubyNormalizeCall),
+	pg_query_ruby_normalize_without_gvl,
+	pg_query_ruby_normalize_batch_result,
+	pg_query_ruby_normalize_batch_cleanup
+};
+
+static VALUE pg_query_ruby_fingerprint_batch_result(void *arg)
+{
+	PgQueryRubyFingerprintCall *call = (PgQueryRubyFingerprintCall *) arg;
+
+	if (call->result.error) return new_ruby_parse_error(call->result.error);
+
+	if (call->result.hexdigest) return rb_str_new2(call->result.hexdigest);
+
+	return Qnil;
+}
+
+static void pg_query_ruby_fingerprint_batch_cleanup(void *arg)
+{
+	PgQueryRubyFingerprintCall *call = (PgQueryRubyFingerprintCall *) arg;
+	pg_query_free_fingerprint_result(call->result);
+}
+
+static const PgQueryRubyBatchType pg_query_ruby_fingerprint_batch = {
+	sizeof(PgQueryRubyFingerprintCall),
+	pg_query_ruby_fingerprint_without_gvl,
+	pg_query_ruby_fingerprint_batch_result,
+	pg_query_ruby_fingerprint_batch_cleanup
+};
+
+VALUE pg_query_ruby_parse_many(VALUE self, VALUE queries, VALUE threads)
+{
+	return pg_query_ruby_batch(&pg_query_ruby_parse_tree_batch, queries, threads);
+}
+
+VALUE pg_query_ruby_normalize_many(VALUE self, VALUE queries, VALUE threads)
+{
+	return pg_query_ruby_batch(&pg_query_ruby_normalize_batch, queries, threads);
+}
+
+VALUE pg_query_ruby_fingerprint_many(VALUE self, VALUE queries, VALUE threads)
+{
+	return pg_query_ruby_batch(&pg_query_ruby_fingerprint_batch, queries, threads);
+}
+
+void Init_pg_query_batch(VALUE cPgQuery)
+{
+	rb_define_singleton_method(cPgQuery, "_raw_parse_tree_many", pg_query_ruby_parse_many, 2);
+	rb_define_singleton_method(cPgQuery, "_normalize_many", pg_query_ruby_normalize_many, 2);
+	rb_define_singleton_method(cPgQuery, "_fingerprint_many", pg_query_ruby_fingerprint_many, 2);
+}
@@ -0,0 +1,2986 @@
+#include "pg_query_ruby_deparse.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Note: Everything in this file may run without the GVL, and must therefore
+ * only use malloc/free (never xmalloc) and not touch any Ruby objects.
+ *
+ * This is a port of PgQuery::Deparse, with a function for each of its
+ * deparse_* methods. Instead of building an Array of Strings for every node
+ * and joining it, everything is written into a single buffer, and joins only
+ * keep track of where their separators go.
+ *
+ * The output has to be identical to the Ruby implementation's, for modified
+ * trees as well, so the functions below also do what the Ruby code does with
+ * values that are missing or of an unexpected type: nil elements of a joined
+ * Array turn into empty strings, Hash#[] on a value that isn't a Hash raises,
+ * and so on. Whenever the Ruby implementation would raise an error, or do
+ * something that isn't replicated here, deparsing stops with
+ * PG_QUERY_DEPARSE_UNSUPPORTED, and the whole tree is left to the Ruby
+ * implementation (which then raises the same errors as it always did).
+ */
+
+// What the deparse functions return, mirroring the return values of the Ruby methods
+#define PG_QUERY_DEPARSE_UNSUPPORTED -1
+#define PG_QUERY_DEPARSE_NIL 0 // Nothing was written
+#define PG_QUERY_DEPARSE_STRING 1
+#define PG_QUERY_DEPARSE_INTEGER 2 // An Integer item, written in decimal
+
+#define PG_QUERY_DEPARSE_TRY(expr) \
+	do { \
+		if ((expr) < 0) return PG_QUERY_DEPARSE_UNSUPPORTED; \
+	} while (0)
+
+// The context argument of deparse_item
+typedef enum {
+	PG_QUERY_DEPARSE_CONTEXT_NONE,
+	PG_QUERY_DEPARSE_CONTEXT_TRUE, // Operands of nested A_Expr nodes (context || true)
+	PG_QUERY_DEPARSE_CONTEXT_A_CONST,
+	PG_QUERY_DEPARSE_CONTEXT_FUNC_CALL,
+	PG_QUERY_DEPARSE_CONTEXT_TYPE_NAME,
+	PG_QUERY_DEPARSE_CONTEXT_OPERATOR,
+	PG_QUERY_DEPARSE_CONTEXT_DEFNAME_AS,
+	PG_QUERY_DEPARSE_CONTEXT_SELECT,
+	PG_QUERY_DEPARSE_CONTEXT_UPDATE
+} PgQueryDeparseItemContext;
+
+typedef struct PgQueryDeparseNodeType PgQueryDeparseNodeType;
+
+typedef struct {
+	PgQueryTree *tree;
+
+	char *buf;
+	size_t len;
+	size_t capacity;
+
+	// Node type of each of the tree's keys, looked up as they are needed
+	const PgQueryDeparseNodeType **node_types;
+} PgQueryDeparseContext;
+
+typedef int (*PgQueryDeparseFunction)(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context);
+
+struct PgQueryDeparseNodeType {
+	const char *name;
+	PgQueryDeparseFunction deparse;
+	int any_fields; // The node's fields aren't used, and don't have to be an object
+};
+
+// Looked up keys that aren't a node type
+static const PgQueryDeparseNodeType pg_query_deparse_unknown_node_type = {NULL, NULL, 0};
+
+static int pg_query_deparse_reserve(PgQueryDeparseContext *ctx, size_t len)
+{
+	size_t new_capacity;
+	char *new_buf;
+
+	if (ctx->capacity - ctx->len >= len) return 0;
+
+	new_capacity = ctx->capacity ? ctx->capacity : 256;
+	while (new_capacity - ctx->len < len) new_capacity *= 2;
+
+	new_buf = realloc(ctx->buf, new_capacity);
+	if (new_buf == NULL) return -1;
+	ctx->buf = new_buf;
+	ctx->capacity = new_capacity;
+
+	return 0;
+}
+
+static int pg_query_deparse_append(PgQueryDeparseContext *ctx, const char *str, size_t len)
+{
+	if (pg_query_deparse_reserve(ctx, len) != 0) return -1;
+
+	memcpy(ctx->buf + ctx->len, str, len);
+	ctx->len += len;
+
+	return 0;
+}
+
+#define PG_QUERY_DEPARSE_APPEND(ctx, literal) pg_query_deparse_append(ctx, literal, sizeof(literal) - 1)
+
+static int pg_query_deparse_append_integer(PgQueryDeparseContext *ctx, long long value)
+{
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "%lld", value);
+
+	return pg_query_deparse_append(ctx, buf, len);
+}
+
+// Appends a copy of what was already written at offset (e.g. to reorder parts of the output)
+static int pg_query_deparse_append_written(PgQueryDeparseContext *ctx, size_t offset, size_t len)
+{
+	if (pg_query_deparse_reserve(ctx, len) != 0) return -1;
+
+	memcpy(ctx->buf + ctx->len, ctx->buf + offset, len);
+	ctx->len += len;
+
+	return 0;
+}
+
+// Replaces everything written from start on with what was written from offset on
+static void pg_query_deparse_move_back(PgQueryDeparseContext *ctx, size_t start, size_t offset)
+{
+	size_t len = ctx->len - offset;
+
+	memmove(ctx->buf + start, ctx->buf + offset, len);
+	ctx->len = start + len;
+}
+
+// Appends str with every occurrence of quote doubled (String#gsub("'", "''"))
+static int pg_query_deparse_append_escaped(PgQueryDeparseContext *ctx, const char *str, size_t len, char quote)
+{
+	size_t i, start = 0;
+
+	for (i = 0; i < len; i++) {
+		if (str[i] != quote) continue;
+		if (pg_query_deparse_append(ctx, str + start, i + 1 - start) != 0) return -1;
+		start = i;
+	}
+
+	return pg_query_deparse_append(ctx, str + start, len - start);
+}
+
+static int pg_query_deparse_written_equals(PgQueryDeparseContext *ctx, size_t start, const char *str)
+{
+	size_t len = strlen(str);
+
+	return ctx->len - start == len && memcmp(ctx->buf + start, str, len) == 0;
+}
+
+/*
+ * Array#join, one element at a time: pg_query_deparse_join_next writes the
+ * separator for the element that is about to be written.
+ */
+typedef struct {
+	const char *sep;
+	size_t sep_len;
+	size_t count;
+	size_t mark; // Where the last element (including its separator) starts
+} PgQueryDeparseJoin;
+
+static void pg_query_deparse_join_init(PgQueryDeparseJoin *join, const char *sep)
+{
+	join->sep = sep;
+	join->sep_len = strlen(sep);
+	join->count = 0;
+	join->mark = 0;
+}
+
+static int pg_query_deparse_join_next(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join)
+{
+	join->mark = ctx->len;
+	if (join->count++ == 0) return 0;
+
+	return pg_query_deparse_append(ctx, join->sep, join->sep_len);
+}
+
+// Takes the last element back out, like Array#compact for nil elements
+static void pg_query_deparse_join_drop(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join)
+{
+	ctx->len = join->mark;
+	join->count--;
+}
+
+static int pg_query_deparse_join_literal(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, const char *str)
+{
+	if (pg_query_deparse_join_next(ctx, join) != 0) return -1;
+
+	return pg_query_deparse_append(ctx, str, strlen(str));
+}
+
+static int pg_query_deparse_is_nil(const PgQueryTreeValue *value)
+{
+	return value == NULL || value->type == PG_QUERY_TREE_NULL;
+}
+
+static int pg_query_deparse_truthy(const PgQueryTreeValue *value)
+{
+	return !pg_query_deparse_is_nil(value) && !(value->type == PG_QUERY_TREE_BOOL && !value->u.boolean);
+}
+
+// node[key], NULL if there is no such key (node.key?(key) is false)
+static PgQueryTreeValue *pg_query_deparse_get(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char *key)
+{
+	return pg_query_tree_object_get(ctx->tree, node, key);
+}
+
+// node[key][nested], NULL unless both are objects
+static PgQueryTreeValue *pg_query_deparse_get_object(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char *key)
+{
+	PgQueryTreeValue *value = pg_query_deparse_get(ctx, node, key);
+
+	return value != NULL && value->type == PG_QUERY_TREE_OBJECT ? value : NULL;
+}
+
+static int pg_query_deparse_string_equals(const PgQueryTreeValue *value, const char *str)
+{
+	size_t len = strlen(str);
+
+	return value != NULL && value->type == PG_QUERY_TREE_STRING && value->len == len && memcmp(value->u.str, str, len) == 0;
+}
+
+#define PG_QUERY_DEPARSE_NOT_AN_INTEGER LLONG_MIN
+
+/*
+ * Reads a value that is compared with Integer constants (with ==, case/when
+ * or as a Hash key), anything but an Integer reads as
+ * PG_QUERY_DEPARSE_NOT_AN_INTEGER, which equals none of them. Floats could be
+ * equal to an Integer, and are left to the Ruby implementation.
+ */
+static int pg_query_deparse_enum(const PgQueryTreeValue *value, long long *out)
+{
+	*out = PG_QUERY_DEPARSE_NOT_AN_INTEGER;
+
+	if (value == NULL) return 0;
+	if (value->type == PG_QUERY_TREE_FLOAT) return -1;
+	if (value->type == PG_QUERY_TREE_INTEGER) *out = value->u.integer;
+
+	return 0;
+}
+
+// Reads a value that has to be an Integer (e.g. for Integer#zero?)
+static int pg_query_deparse_integer(const PgQueryTreeValue *value, long long *out)
+{
+	if (value == NULL || value->type != PG_QUERY_TREE_INTEGER) return -1;
+
+	*out = value->u.integer;
+
+	return 0;
+}
+
+// value[0], for values that are expected to be an Array (always nil for a Hash, whose keys are Strings)
+static int pg_query_deparse_first(PgQueryTreeValue *value, PgQueryTreeValue **out)
+{
+	*out = NULL;
+
+	if (value == NULL) return -1;
+	if (value->type == PG_QUERY_TREE_ARRAY) {
+		if (value->len > 0) *out = &value->u.items[0];
+		return 0;
+	}
+
+	return value->type == PG_QUERY_TREE_OBJECT ? 0 : -1;
+}
+
+// A value as it ends up in the output when it is joined or interpolated (value.to_s)
+static int pg_query_deparse_scalar(PgQueryDeparseContext *ctx, const PgQueryTreeValue *value)
+{
+	if (pg_query_deparse_is_nil(value)) return PG_QUERY_DEPARSE_NIL;
+
+	switch (value->type) {
+		case PG_QUERY_TREE_STRING:
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, value->u.str, value->len));
+			return PG_QUERY_DEPARSE_STRING;
+		case PG_QUERY_TREE_INTEGER:
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_integer(ctx, value->u.integer));
+			return PG_QUERY_DEPARSE_INTEGER;
+		default:
+			return PG_QUERY_DEPARSE_UNSUPPORTED;
+	}
+}
+
+// Appends an ASCII String in upper case (String#upcase), Strings with other characters are left to Ruby
+static int pg_query_deparse_append_upcase(PgQueryDeparseContext *ctx, const PgQueryTreeValue *value)
+{
+	size_t i;
+
+	if (value == NULL || value->type != PG_QUERY_TREE_STRING) return -1;
+
+	for (i = 0; i < value->len; i++)
+		if ((unsigned char) value->u.str[i] >= 0x80) return -1;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_reserve(ctx, value->len));
+	for (i = 0; i < value->len; i++) {
+		char c = value->u.str[i];
+		ctx->buf[ctx->len++] = c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+	}
+
+	return 0;
+}
+
+static int pg_query_deparse_item(PgQueryDeparseContext *ctx, PgQueryTreeValue *item, PgQueryDeparseItemContext context);
+
+// Appends the deparsed items of a list to a join (nodes.map { |n| deparse_item(n, context) })
+static int pg_query_deparse_join_items(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *list, PgQueryDeparseItemContext context)
+{
+	size_t i;
+
+	if (list == NULL || list->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	for (i = 0; i < list->len; i++) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, &list->u.items[i], context));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+// deparse_item_list(nodes, context).join(sep)
+static int pg_query_deparse_list(PgQueryDeparseContext *ctx, PgQueryTreeValue *list, const char *sep, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, sep);
+
+	return pg_query_deparse_join_items(ctx, &join, list, context);
+}
+
+// Array(value).map { |n| deparse_item(n) } appended to a join, i.e. nil is an empty list
+static int pg_query_deparse_join_array(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *value)
+{
+	if (pg_query_deparse_is_nil(value)) return PG_QUERY_DEPARSE_STRING;
+
+	// Array(5) is [5], Array({}) is []
+	if (value->type == PG_QUERY_TREE_INTEGER) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, join));
+		return pg_query_deparse_item(ctx, value, PG_QUERY_DEPARSE_CONTEXT_NONE);
+	}
+	if (value->type == PG_QUERY_TREE_OBJECT && value->len == 0) return PG_QUERY_DEPARSE_STRING;
+
+	return pg_query_deparse_join_items(ctx, join, value, PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+// Appends an element to a join that is compacted (nil elements are left out)
+static int pg_query_deparse_join_compact_item(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *item, PgQueryDeparseItemContext context)
+{
+	int result;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, join));
+	result = pg_query_deparse_item(ctx, item, context);
+	if (result == PG_QUERY_DEPARSE_NIL) pg_query_deparse_join_drop(ctx, join);
+
+	return result;
+}
+
+static int pg_query_deparse_join_compact_scalar(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *value)
+{
+	int result;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, join));
+	result = pg_query_deparse_scalar(ctx, value);
+	if (result == PG_QUERY_DEPARSE_NIL) pg_query_deparse_join_drop(ctx, join);
+
+	return result;
+}
+
+/*
+ * Deparses an item only to compare the output with a String, e.g.
+ * deparse_item(node['typeName']) == 'boolean'. Returns 1 if it is equal, 0
+ * if it isn't, without writing anything.
+ */
+static int pg_query_deparse_item_equals(PgQueryDeparseContext *ctx, PgQueryTreeValue *item, PgQueryDeparseItemContext context, const char *str)
+{
+	size_t start = ctx->len;
+	int result, equal;
+
+	result = pg_query_deparse_item(ctx, item, context);
+	PG_QUERY_DEPARSE_TRY(result);
+
+	equal = result == PG_QUERY_DEPARSE_STRING && pg_query_deparse_written_equals(ctx, start, str);
+	ctx->len = start;
+
+	return equal;
+}
+
+// Same as pg_query_deparse_item_equals for a list of operator names (node['name'].map { ... } == [str])
+static int pg_query_deparse_operator_equals(PgQueryDeparseContext *ctx, PgQueryTreeValue *name, const char *str)
+{
+	size_t i;
+	int equal = 0;
+
+	if (name == NULL || name->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	for (i = 0; i < name->len; i++) {
+		int result = pg_query_deparse_item_equals(ctx, &name->u.items[i], PG_QUERY_DEPARSE_CONTEXT_OPERATOR, str);
+		PG_QUERY_DEPARSE_TRY(result);
+		equal = result && name->len == 1;
+	}
+
+	return equal;
+}
+
+// Copy of PgQuery::Deparse::KEYWORDS (lib/pg_query/deparse/keywords.rb), in the same (sorted) order
+static const char *pg_query_deparse_keywords[] = {
+	"A", "ABORT", "ABS", "ABSENT", "ABSOLUTE", "ACCESS", "ACCORDING", "ACTION", "ADA", "ADD", "ADMIN", "AFTER",
+	"AGGREGATE", "ALL", "ALLOCATE", "ALSO", "ALTER", "ALWAYS", "ANALYSE", "ANALYZE", "AND", "ANY", "ARE",
+	"ARRAY", "ARRAY_AGG", "ARRAY_MAX_CARDINALITY", "AS", "ASC", "ASENSITIVE", "ASSERTION", "ASSIGNMENT",
+	"ASYMMETRIC", "AT", "ATOMIC", "ATTRIBUTE", "ATTRIBUTES", "AUTHORIZATION", "AVG", "BACKWARD", "BASE64",
+	"BEFORE", "BEGIN", "BEGIN_FRAME", "BEGIN_PARTITION", "BERNOULLI", "BETWEEN", "BIGINT", "BINARY", "BIT",
+	"BIT_LENGTH", "BLOB", "BLOCKED", "BOM", "BOOLEAN", "BOTH", "BREADTH", "BY", "C", "CACHE", "CALL", "CALLED",
+	"CARDINALITY", "CASCADE", "CASCADED", "CASE", "CAST", "CATALOG", "CATALOG_NAME", "CEIL", "CEILING", "CHAIN",
+	"CHAR", "CHARACTER", "CHARACTERISTICS", "CHARACTERS", "CHARACTER_LENGTH", "CHARACTER_SET_CATALOG",
+	"CHARACTER_SET_NAME", "CHARACTER_SET_SCHEMA", "CHAR_LENGTH", "CHECK", "CHECKPOINT", "CLASS", "CLASS_ORIGIN",
+	"CLOB", "CLOSE", "CLUSTER", "COALESCE", "COBOL", "COLLATE", "COLLATION", "COLLATION_CATALOG",
+	"COLLATION_NAME", "COLLATION_SCHEMA", "COLLECT", "COLUMN", "COLUMNS", "COLUMN_NAME", "COMMAND_FUNCTION",
+	"COMMAND_FUNCTION_CODE", "COMMENT", "COMMENTS", "COMMIT", "COMMITTED", "CONCURRENTLY", "CONDITION",
+	"CONDITION_NUMBER", "CONFIGURATION", "CONFLICT", "CONNECT", "CONNECTION", "CONNECTION_NAME", "CONSTRAINT",
+	"CONSTRAINTS", "CONSTRAINT_CATALOG", "CONSTRAINT_NAME", "CONSTRAINT_SCHEMA", "CONSTRUCTOR", "CONTAINS",
+	"CONTENT", "CONTINUE", "CONTROL", "CONVERSION", "CONVERT", "COPY", "CORR", "CORRESPONDING", "COST", "COUNT",
+	"COVAR_POP", "COVAR_SAMP", "CREATE", "CROSS", "CSV", "CUBE", "CUME_DIST", "CURRENT", "CURRENT_CATALOG",
+	"CURRENT_DATE", "CURRENT_DEFAULT_TRANSFORM_GROUP", "CURRENT_PATH", "CURRENT_ROLE", "CURRENT_ROW",
+	"CURRENT_SCHEMA", "CURRENT_TIME", "CURRENT_TIMESTAMP", "CURRENT_TRANSFORM_GROUP_FOR_TYPE", "CURRENT_USER",
+	"CURSOR", "CURSOR_NAME", "CYCLE", "DATA", "DATABASE", "DATALINK", "DATE", "DATETIME_INTERVAL_CODE",
+	"DATETIME_INTERVAL_PRECISION", "DAY", "DB", "DEALLOCATE", "DEC", "DECIMAL", "DECLARE", "DEFAULT",
+	"DEFAULTS", "DEFERRABLE", "DEFERRED", "DEFINED", "DEFINER", "DEGREE", "DELETE", "DELIMITER", "DELIMITERS",
+	"DENSE_RANK", "DEPENDS", "DEPTH", "DEREF", "DERIVED", "DESC", "DESCRIBE", "DESCRIPTOR", "DETERMINISTIC",
+	"DIAGNOSTICS", "DICTIONARY", "DISABLE", "DISCARD", "DISCONNECT", "DISPATCH", "DISTINCT", "DLNEWCOPY",
+	"DLPREVIOUSCOPY", "DLURLCOMPLETE", "DLURLCOMPLETEONLY", "DLURLCOMPLETEWRITE", "DLURLPATH", "DLURLPATHONLY",
+	"DLURLPATHWRITE", "DLURLSCHEME", "DLURLSERVER", "DLVALUE", "DO", "DOCUMENT", "DOMAIN", "DOUBLE", "DROP",
+	"DYNAMIC", "DYNAMIC_FUNCTION", "DYNAMIC_FUNCTION_CODE", "EACH", "ELEMENT", "ELSE", "EMPTY", "ENABLE",
+	"ENCODING", "ENCRYPTED", "END", "END-EXEC", "END_FRAME", "END_PARTITION", "ENFORCED", "ENUM", "EQUALS",
+	"ESCAPE", "EVENT", "EVERY", "EXCEPT", "EXCEPTION", "EXCLUDE", "EXCLUDING", "EXCLUSIVE", "EXEC", "EXECUTE",
+	"EXISTS", "EXP", "EXPLAIN", "EXPRESSION", "EXTENSION", "EXTERNAL", "EXTRACT", "FALSE", "FAMILY", "FETCH",
+	"FILE", "FILTER", "FINAL", "FIRST", "FIRST_VALUE", "FLAG", "FLOAT", "FLOOR", "FOLLOWING", "FOR", "FORCE",
+	"FOREIGN", "FORTRAN", "FORWARD", "FOUND", "FRAME_ROW", "FREE", "FREEZE", "FROM", "FS", "FULL", "FUNCTION",
+	"FUNCTIONS", "FUSION", "G", "GENERAL", "GENERATED", "GET", "GLOBAL", "GO", "GOTO", "GRANT", "GRANTED",
+	"GREATEST", "GROUP", "GROUPING", "GROUPS", "HANDLER", "HAVING", "HEADER", "HEX", "HIERARCHY", "HOLD",
+	"HOUR", "ID", "IDENTITY", "IF", "IGNORE", "ILIKE", "IMMEDIATE", "IMMEDIATELY", "IMMUTABLE",
+	"IMPLEMENTATION", "IMPLICIT", "IMPORT", "IN", "INCLUDING", "INCREMENT", "INDENT", "INDEX", "INDEXES",
+	"INDICATOR", "INHERIT", "INHERITS", "INITIALLY", "INLINE", "INNER", "INOUT", "INPUT", "INSENSITIVE",
+	"INSERT", "INSTANCE", "INSTANTIABLE", "INSTEAD", "INT", "INTEGER", "INTEGRITY", "INTERSECT", "INTERSECTION",
+	"INTERVAL", "INTO", "INVOKER", "IS", "ISNULL", "ISOLATION", "JOIN", "K", "KEY", "KEY_MEMBER", "KEY_TYPE",
+	"LABEL", "LAG", "LANGUAGE", "LARGE", "LAST", "LAST_VALUE", "LATERAL", "LEAD", "LEADING", "LEAKPROOF",
+	"LEAST", "LEFT", "LENGTH", "LEVEL", "LIBRARY", "LIKE", "LIKE_REGEX", "LIMIT", "LINK", "LISTEN", "LN",
+	"LOAD", "LOCAL", "LOCALTIME", "LOCALTIMESTAMP", "LOCATION", "LOCATOR", "LOCK", "LOCKED", "LOGGED", "LOWER",
+	"M", "MAP", "MAPPING", "MATCH", "MATCHED", "MATERIALIZED", "MAX", "MAXVALUE", "MAX_CARDINALITY", "MEMBER",
+	"MERGE", "MESSAGE_LENGTH", "MESSAGE_OCTET_LENGTH", "MESSAGE_TEXT", "METHOD", "MIN", "MINUTE", "MINVALUE",
+	"MOD", "MODE", "MODIFIES", "MODULE", "MONTH", "MORE", "MOVE", "MULTISET", "MUMPS", "NAME", "NAMES",
+	"NAMESPACE", "NATIONAL", "NATURAL", "NCHAR", "NCLOB", "NESTING", "NEW", "NEXT", "NFC", "NFD", "NFKC",
+	"NFKD", "NIL", "NO", "NONE", "NORMALIZE", "NORMALIZED", "NOT", "NOTHING", "NOTIFY", "NOTNULL", "NOWAIT",
+	"NTH_VALUE", "NTILE", "NULL", "NULLABLE", "NULLIF", "NULLS", "NUMBER", "NUMERIC", "OBJECT",
+	"OCCURRENCES_REGEX", "OCTETS", "OCTET_LENGTH", "OF", "OFF", "OFFSET", "OIDS", "OLD", "ON", "ONLY", "OPEN",
+	"OPERATOR", "OPTION", "OPTIONS", "OR", "ORDER", "ORDERING", "ORDINALITY", "OTHERS", "OUT", "OUTER",
+	"OUTPUT", "OVER", "OVERLAPS", "OVERLAY", "OVERRIDING", "OWNED", "OWNER", "P", "PAD", "PARALLEL",
+	"PARAMETER", "PARAMETER_MODE", "PARAMETER_NAME", "PARAMETER_ORDINAL_POSITION", "PARAMETER_SPECIFIC_CATALOG",
+	"PARAMETER_SPECIFIC_NAME", "PARAMETER_SPECIFIC_SCHEMA", "PARSER", "PARTIAL", "PARTITION", "PASCAL",
+	"PASSING", "PASSTHROUGH", "PASSWORD", "PATH", "PERCENT", "PERCENTILE_CONT", "PERCENTILE_DISC",
+	"PERCENT_RANK", "PERIOD", "PERMISSION", "PLACING", "PLANS", "PLI", "POLICY", "PORTION", "POSITION",
+	"POSITION_REGEX", "POWER", "PRECEDES", "PRECEDING", "PRECISION", "PREPARE", "PREPARED", "PRESERVE",
+	"PRIMARY", "PRIOR", "PRIVILEGES", "PROCEDURAL", "PROCEDURE", "PROGRAM", "PUBLIC", "QUOTE", "RANGE", "RANK",
+	"READ", "READS", "REAL", "REASSIGN", "RECHECK", "RECOVERY", "RECURSIVE", "REF", "REFERENCES", "REFERENCING",
+	"REFRESH", "REGR_AVGX", "REGR_AVGY", "REGR_COUNT", "REGR_INTERCEPT", "REGR_R2", "REGR_SLOPE", "REGR_SXX",
+	"REGR_SXY", "REGR_SYY", "REINDEX", "RELATIVE", "RELEASE", "RENAME", "REPEATABLE", "REPLACE", "REPLICA",
+	"REQUIRING", "RESET", "RESPECT", "RESTART", "RESTORE", "RESTRICT", "RESULT", "RETURN",
+	"RETURNED_CARDINALITY", "RETURNED_LENGTH", "RETURNED_OCTET_LENGTH", "RETURNED_SQLSTATE", "RETURNING",
+	"RETURNS", "REVOKE", "RIGHT", "ROLE", "ROLLBACK", "ROLLUP", "ROUTINE", "ROUTINE_CATALOG", "ROUTINE_NAME",
+	"ROUTINE_SCHEMA", "ROW", "ROWS", "ROW_COUNT", "ROW_NUMBER", "RULE", "SAVEPOINT", "SCALE", "SCHEMA",
+	"SCHEMA_NAME", "SCOPE", "SCOPE_CATALOG", "SCOPE_NAME", "SCOPE_SCHEMA", "SCROLL", "SEARCH", "SECOND",
+	"SECTION", "SECURITY", "SELECT", "SELECTIVE", "SELF", "SENSITIVE", "SEQUENCE", "SEQUENCES", "SERIALIZABLE",
+	"SERVER", "SERVER_NAME", "SESSION", "SESSION_USER", "SET", "SETOF", "SETS", "SHARE", "SHOW", "SIMILAR",
+	"SIMPLE", "SIZE", "SKIP", "SMALLINT", "SNAPSHOT", "SOME", "SOURCE", "SPACE", "SPECIFIC", "SPECIFICTYPE",
+	"SPECIFIC_NAME", "SQL", "SQLCODE", "SQLERROR", "SQLEXCEPTION", "SQLSTATE", "SQLWARNING", "SQRT", "STABLE",
+	"STANDALONE", "START", "STATE", "STATEMENT", "STATIC", "STATISTICS", "STDDEV_POP", "STDDEV_SAMP", "STDIN",
+	"STDOUT", "STORAGE", "STRICT", "STRIP", "STRUCTURE", "STYLE", "SUBCLASS_ORIGIN", "SUBMULTISET", "SUBSTRING",
+	"SUBSTRING_REGEX", "SUCCEEDS", "SUM", "SYMMETRIC", "SYSID", "SYSTEM", "SYSTEM_TIME", "SYSTEM_USER", "T",
+	"TABLE", "TABLES", "TABLESAMPLE", "TABLESPACE", "TABLE_NAME", "TEMP", "TEMPLATE", "TEMPORARY", "TEXT",
+	"THEN", "TIES", "TIME", "TIMESTAMP", "TIMEZONE_HOUR", "TIMEZONE_MINUTE", "TO", "TOKEN", "TOP_LEVEL_COUNT",
+	"TRAILING", "TRANSACTION", "TRANSACTIONS_COMMITTED", "TRANSACTIONS_ROLLED_BACK", "TRANSACTION_ACTIVE",
+	"TRANSFORM", "TRANSFORMS", "TRANSLATE", "TRANSLATE_REGEX", "TRANSLATION", "TREAT", "TRIGGER",
+	"TRIGGER_CATALOG", "TRIGGER_NAME", "TRIGGER_SCHEMA", "TRIM", "TRIM_ARRAY", "TRUE", "TRUNCATE", "TRUSTED",
+	"TYPE", "TYPES", "UESCAPE", "UNBOUNDED", "UNCOMMITTED", "UNDER", "UNENCRYPTED", "UNION", "UNIQUE",
+	"UNKNOWN", "UNLINK", "UNLISTEN", "UNLOGGED", "UNNAMED", "UNNEST", "UNTIL", "UNTYPED", "UPDATE", "UPPER",
+	"URI", "USAGE", "USER", "USER_DEFINED_TYPE_CATALOG", "USER_DEFINED_TYPE_CODE", "USER_DEFINED_TYPE_NAME",
+	"USER_DEFINED_TYPE_SCHEMA", "USING", "VACUUM", "VALID", "VALIDATE", "VALIDATOR", "VALUE", "VALUES",
+	"VALUE_OF", "VARBINARY", "VARCHAR", "VARIADIC", "VARYING", "VAR_POP", "VAR_SAMP", "VERBOSE", "VERSION",
+	"VERSIONING", "VIEW", "VIEWS", "VOLATILE", "WHEN", "WHENEVER", "WHERE", "WHITESPACE", "WIDTH_BUCKET",
+	"WINDOW", "WITH", "WITHIN", "WITHOUT", "WORK", "WRAPPER", "WRITE", "XML", "XMLAGG", "XMLATTRIBUTES",
+	"XMLBINARY", "XMLCAST", "XMLCOMMENT", "XMLCONCAT", "XMLDECLARATION", "XMLDOCUMENT", "XMLELEMENT",
+	"XMLEXISTS", "XMLFOREST", "XMLITERATE", "XMLNAMESPACES", "XMLPARSE", "XMLPI", "XMLQUERY", "XMLROOT",
+	"XMLSCHEMA", "XMLSERIALIZE", "XMLTABLE", "XMLTEXT", "XMLVALIDATE", "YEAR", "YES", "ZONE"
+};
+
+static int pg_query_deparse_keyword_compare(const void *a, const void *b)
+{
+	return strcmp((const char *) a, *(const char * const *) b);
+}
+
+// KEYWORDS.include?(ident.upcase), for identifiers consisting of word characters
+static int pg_query_deparse_is_keyword(const char *str, size_t len)
+{
+	char upcased[64]; // Longer than any keyword
+	size_t i;
+
+	if (len >= sizeof(upcased)) return 0;
+
+	for (i = 0; i < len; i++)
+		upcased[i] = str[i] >= 'a' && str[i] <= 'z' ? str[i] - 'a' + 'A' : str[i];
+	upcased[len] = '\0';
+
+	return bsearch(upcased, pg_query_deparse_keywords, sizeof(pg_query_deparse_keywords) / sizeof(pg_query_deparse_keywords[0]),
+	               sizeof(pg_query_deparse_keywords[0]), pg_query_deparse_keyword_compare) != NULL;
+}
+
+static int pg_query_deparse_is_word_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Whether a String has no invalid UTF-8 byte sequences (matching a Regexp against it raises otherwise)
+static int pg_query_deparse_valid_utf8(const unsigned char *str, size_t len)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		unsigned char c = str[i];
+		size_t n, j;
+		unsigned long cp;
+
+		if (c < 0x80) {
+			i++;
+			continue;
+		} else if (c >= 0xC2 && c <= 0xDF) {
+			n = 1;
+			cp = c & 0x1F;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			n = 2;
+			cp = c & 0x0F;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			n = 3;
+			cp = c & 0x07;
+		} else {
+			return 0;
+		}
+
+		if (len - i <= n) return 0;
+		for (j = 1; j <= n; j++) {
+			if ((str[i + j] & 0xC0) != 0x80) return 0;
+			cp = (cp << 6) | (str[i + j] & 0x3F);
+		}
+		// Overlong encodings, surrogates and code points beyond U+10FFFF
+		if ((n == 2 && cp < 0x800) || (n == 3 && cp < 0x10000) || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) return 0;
+
+		i += n + 1;
+	}
+
+	return 1;
+}
+
+/*
+ * deparse_identifier: quotes the identifier unless it matches /^\w+$/ (a
+ * multiline match, i.e. any of its lines consists of word characters), and
+ * isn't a keyword.
+ */
+static int pg_query_deparse_identifier(PgQueryDeparseContext *ctx, const PgQueryTreeValue *ident, int escape_always)
+{
+	const char *str;
+	size_t len, i, line_start = 0;
+	int multiline = 0, word_line = 0, line_ok = 1;
+
+	if (pg_query_deparse_is_nil(ident)) return PG_QUERY_DEPARSE_NIL;
+	if (ident->type != PG_QUERY_TREE_STRING) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	str = ident->u.str;
+	len = ident->len;
+
+	if (!escape_always) {
+		for (i = 0; i < len; i++)
+			if ((unsigned char) str[i] >= 0x80) break;
+		if (i < len && !pg_query_deparse_valid_utf8((const unsigned char *) str, len)) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+		for (i = 0; i <= len; i++) {
+			if (i == len || str[i] == '\n') {
+				if (line_ok && i > line_start) word_line = 1;
+				if (i < len) multiline = 1;
+				line_start = i + 1;
+				line_ok = 1;
+			} else if (!pg_query_deparse_is_word_char(str[i])) {
+				line_ok = 0;
+			}
+		}
+
+		// Only identifiers without newlines can be equal to a keyword once upcased
+		if (word_line && (multiline || !pg_query_deparse_is_keyword(str, len))) {
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, str, len));
+			return PG_QUERY_DEPARSE_STRING;
+		}
+	}
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\""));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_escaped(ctx, str, len, '"'));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\""));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+// Appends a value that is concatenated with + (and therefore has to be a String)
+static int pg_query_deparse_append_string(PgQueryDeparseContext *ctx, const PgQueryTreeValue *value)
+{
+	if (value == NULL || value->type != PG_QUERY_TREE_STRING) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	return pg_query_deparse_append(ctx, value->u.str, value->len);
+}
+
+// Appends a deparsed item that is concatenated with + (and therefore has to deparse to a String)
+static int pg_query_deparse_item_string(PgQueryDeparseContext *ctx, PgQueryTreeValue *item, PgQueryDeparseItemContext context)
+{
+	int result = pg_query_deparse_item(ctx, item, context);
+
+	return result == PG_QUERY_DEPARSE_STRING ? result : PG_QUERY_DEPARSE_UNSUPPORTED;
+}
+
+static int pg_query_deparse_join_item(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *item, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, join));
+
+	return pg_query_deparse_item(ctx, item, context);
+}
+
+static int pg_query_deparse_join_scalar(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, const PgQueryTreeValue *value)
+{
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, join));
+
+	return pg_query_deparse_scalar(ctx, value);
+}
+
+// A list as a single element of a join (joined with its own separator)
+static int pg_query_deparse_join_list(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *list, const char *sep, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, join));
+
+	return pg_query_deparse_list(ctx, list, sep, context);
+}
+
+// "(" + deparse_item_list(nodes).join(', ') + ")"
+static int pg_query_deparse_parenthesized_list(PgQueryDeparseContext *ctx, PgQueryTreeValue *list)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, list, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_field_truthy(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char *key)
+{
+	return pg_query_deparse_truthy(pg_query_deparse_get(ctx, node, key));
+}
+
+// node[key] == value
+static int pg_query_deparse_field_equals(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char *key, long long value)
+{
+	long long field;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, key), &field));
+
+	return field == value;
+}
+
+static int pg_query_deparse_rangevar_fields(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, int inh)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *schemaname = pg_query_deparse_get(ctx, node, "schemaname");
+	PgQueryTreeValue *alias = pg_query_deparse_get(ctx, node, "alias");
+
+	pg_query_deparse_join_init(&join, " ");
+
+	if (!inh) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ONLY"));
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+	if (pg_query_deparse_truthy(schemaname)) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\""));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_string(ctx, schemaname));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\"."));
+	}
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\""));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_string(ctx, pg_query_deparse_get(ctx, node, "relname")));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\""));
+
+	if (pg_query_deparse_truthy(alias))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, alias, PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_rangevar(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	return pg_query_deparse_rangevar_fields(ctx, node, pg_query_deparse_field_truthy(ctx, node, "inh"));
+}
+
+static int pg_query_deparse_raw_stmt(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	return pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "stmt"), PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+static int pg_query_deparse_renamestmt(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	int is_table = pg_query_deparse_field_equals(ctx, node, "renameType", 37); // OBJECT_TYPE_TABLE
+
+	PG_QUERY_DEPARSE_TRY(is_table);
+	if (!is_table) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ALTER TABLE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "relation"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "RENAME TO"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_scalar(ctx, &join, pg_query_deparse_get(ctx, node, "newname")));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_columnref(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *fields = pg_query_deparse_get(ctx, node, "fields");
+	size_t i;
+
+	if (fields == NULL || fields->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	pg_query_deparse_join_init(&join, ".");
+	for (i = 0; i < fields->len; i++) {
+		PgQueryTreeValue *field = &fields->u.items[i];
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		if (field->type == PG_QUERY_TREE_STRING) {
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\""));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, field->u.str, field->len));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "\""));
+		} else {
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, field, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		}
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_a_arrayexp(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *elements = pg_query_deparse_get(ctx, node, "elements");
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "ARRAY["));
+	if (pg_query_deparse_truthy(elements))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, elements, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "]"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_a_const(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	return pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "val"), PG_QUERY_DEPARSE_CONTEXT_A_CONST);
+}
+
+static int pg_query_deparse_a_star(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "*"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_a_truncated(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "...")); // pg_query internal
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_a_indirection(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *arg = pg_query_deparse_get(ctx, node, "arg");
+	PgQueryTreeValue *indirection = pg_query_deparse_get(ctx, node, "indirection");
+	int func_call;
+
+	if (arg == NULL || arg->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	func_call = pg_query_deparse_get(ctx, arg, "FuncCall") != NULL;
+
+	if (func_call) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (func_call) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")."));
+
+	return pg_query_deparse_list(ctx, indirection, "", PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+static int pg_query_deparse_a_indices(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "["));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "uidx"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "]"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_alias(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *name = pg_query_deparse_get(ctx, node, "aliasname");
+	PgQueryTreeValue *colnames = pg_query_deparse_get(ctx, node, "colnames");
+
+	if (!pg_query_deparse_truthy(colnames)) return pg_query_deparse_identifier(ctx, name, 0);
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_string(ctx, name));
+
+	return pg_query_deparse_parenthesized_list(ctx, colnames);
+}
+
+static int pg_query_deparse_alter_table(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ALTER TABLE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "relation"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "cmds"), ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+// PgQuery::Deparse::AlterTable.commands
+static int pg_query_deparse_alter_table_command(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char **command, const char **options)
+{
+	long long subtype;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "subtype"), &subtype));
+
+	*options = NULL;
+	switch (subtype) {
+		case 0: *command = "ADD COLUMN"; break;
+		case 3:
+			*command = "ALTER COLUMN";
+			*options = pg_query_deparse_field_truthy(ctx, node, "def") ? "SET DEFAULT" : "DROP DEFAULT";
+			break;
+		case 4: *command = "ALTER COLUMN"; *options = "DROP NOT NULL"; break;
+		case 5: *command = "ALTER COLUMN"; *options = "SET NOT NULL"; break;
+		case 6: *command = "ALTER COLUMN"; *options = "SET STATISTICS"; break;
+		case 7: *command = "ALTER COLUMN"; *options = "SET"; break;
+		case 8: *command = "ALTER COLUMN"; *options = "RESET"; break;
+		case 9: *command = "ALTER COLUMN"; *options = "SET STORAGE"; break;
+		case 10: *command = "DROP"; break;
+		case 12: *command = "ADD INDEX"; break;
+		case 14: *command = "ADD"; break;
+		case 17: *command = "ALTER CONSTRAINT"; break;
+		case 18: *command = "VALIDATE CONSTRAINT"; break;
+		case 22: *command = "DROP CONSTRAINT"; break;
+		case 25: *command = "ALTER COLUMN"; *options = "TYPE"; break;
+		case 26: *command = "ALTER COLUMN"; *options = "OPTIONS"; break;
+		default: return PG_QUERY_DEPARSE_UNSUPPORTED;
+	}
+
+	return 0;
+}
+
+static int pg_query_deparse_alter_table_cmd(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *def = pg_query_deparse_get(ctx, node, "def");
+	const char *command, *options;
+	int cascade = pg_query_deparse_field_equals(ctx, node, "behavior", 1);
+
+	PG_QUERY_DEPARSE_TRY(cascade);
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_alter_table_command(ctx, node, &command, &options));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, command));
+	if (pg_query_deparse_field_truthy(ctx, node, "missing_ok"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "IF EXISTS"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_scalar(ctx, &join, pg_query_deparse_get(ctx, node, "name")));
+	if (options != NULL) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, options));
+	if (pg_query_deparse_truthy(def))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_item(ctx, &join, def, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (cascade) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CASCADE"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_object_with_args(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *objargs = pg_query_deparse_get(ctx, node, "objargs");
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, pg_query_deparse_get(ctx, node, "objname"), "", PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	if (!pg_query_deparse_field_truthy(ctx, node, "args_unspecified")) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+		if (objargs != NULL) PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, objargs, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_paramref(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *number = pg_query_deparse_get(ctx, node, "number");
+	long long value;
+
+	if (pg_query_deparse_is_nil(number)) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "?"));
+	} else {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_integer(number, &value));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "$"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_integer(ctx, value));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_restarget(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *name = pg_query_deparse_get(ctx, node, "name");
+	PgQueryTreeValue *val = pg_query_deparse_get(ctx, node, "val");
+	int result;
+
+	if (context == PG_QUERY_DEPARSE_CONTEXT_SELECT) {
+		pg_query_deparse_join_init(&join, " AS ");
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_item(ctx, &join, val, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		result = pg_query_deparse_identifier(ctx, name, 0);
+		PG_QUERY_DEPARSE_TRY(result);
+		if (result == PG_QUERY_DEPARSE_NIL) pg_query_deparse_join_drop(ctx, &join);
+	} else if (context == PG_QUERY_DEPARSE_CONTEXT_UPDATE) {
+		pg_query_deparse_join_init(&join, " = ");
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_scalar(ctx, &join, name));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_item(ctx, &join, val, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	} else if (pg_query_deparse_is_nil(val)) {
+		return pg_query_deparse_scalar(ctx, name);
+	} else {
+		return PG_QUERY_DEPARSE_UNSUPPORTED;
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_funccall(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *funcname = pg_query_deparse_get(ctx, node, "funcname");
+	PgQueryTreeValue *over = pg_query_deparse_get(ctx, node, "over");
+	size_t i;
+
+	if (funcname == NULL || funcname->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	// (names - ['pg_catalog']).join('.')
+	pg_query_deparse_join_init(&join, ".");
+	for (i = 0; i < funcname->len; i++) {
+		size_t start;
+		int result;
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		start = ctx->len;
+		result = pg_query_deparse_item(ctx, &funcname->u.items[i], PG_QUERY_DEPARSE_CONTEXT_FUNC_CALL);
+		PG_QUERY_DEPARSE_TRY(result);
+		if (result == PG_QUERY_DEPARSE_STRING && pg_query_deparse_written_equals(ctx, start, "pg_catalog"))
+			pg_query_deparse_join_drop(ctx, &join);
+	}
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+	if (pg_query_deparse_field_truthy(ctx, node, "agg_distinct"))
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "DISTINCT "));
+	pg_query_deparse_join_init(&join, ", ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_array(ctx, &join, pg_query_deparse_get(ctx, node, "args")));
+	if (pg_query_deparse_field_truthy(ctx, node, "agg_star"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "*"));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	if (pg_query_deparse_truthy(over)) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " OVER ("));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, over, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_windowdef(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *partition_clause = pg_query_deparse_get(ctx, node, "partitionClause");
+	PgQueryTreeValue *order_clause = pg_query_deparse_get(ctx, node, "orderClause");
+
+	pg_query_deparse_join_init(&join, " ");
+	if (pg_query_deparse_truthy(partition_clause)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "PARTITION BY"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, partition_clause, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+	if (pg_query_deparse_truthy(order_clause)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ORDER BY"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, order_clause, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_functionparameter(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	return pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "argType"), PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+static int pg_query_deparse_grant_role(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "GRANT"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "granted_roles"), ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "TO"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "grantee_roles"), ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_field_truthy(ctx, node, "admin_opt"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITH ADMIN OPTION"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_grant(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join, objects_join;
+	PgQueryTreeValue *privileges = pg_query_deparse_get(ctx, node, "privileges");
+	PgQueryTreeValue *objects = pg_query_deparse_get(ctx, node, "objects");
+	const char *objtype;
+	int allow_all = 0;
+	long long type;
+	size_t i;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "objtype"), &type));
+	switch (type) {
+		case 1: objtype = "TABLE"; allow_all = 1; break;
+		case 2: objtype = "SEQUENCE"; allow_all = 1; break;
+		case 3: objtype = "DATABASE"; break;
+		case 4: objtype = "DOMAIN"; break;
+		case 5: objtype = "FOREIGN DATA WRAPPER"; break;
+		case 6: objtype = "FOREIGN SERVER"; break;
+		case 7: objtype = "FUNCTION"; allow_all = 1; break;
+		case 8: objtype = "LANGUAGE"; break;
+		case 9: objtype = "LARGE OBJECT"; break;
+		case 10: objtype = "SCHEMA"; break;
+		case 11: objtype = "TABLESPACE"; break;
+		case 12: objtype = "TYPE"; break;
+		default: return PG_QUERY_DEPARSE_UNSUPPORTED;
+	}
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "GRANT"));
+	if (privileges != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, privileges, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	} else {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ALL"));
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ON"));
+
+	if (type == 4 || type == 12) PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(objects, &objects));
+	if (objects == NULL || objects->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+	pg_query_deparse_join_init(&objects_join, ", ");
+	for (i = 0; i < objects->len; i++) {
+		PgQueryTreeValue *object = &objects->u.items[i];
+
+		if (object->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &objects_join));
+		if (pg_query_deparse_get(ctx, object, "RangeVar") != NULL || pg_query_deparse_get(ctx, object, "ObjectWithArgs") != NULL || !allow_all) {
+			if (type != 1) {
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, objtype, strlen(objtype)));
+				PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+			}
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, object, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		} else {
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "ALL "));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, objtype, strlen(objtype)));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "S IN SCHEMA "));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, object, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		}
+	}
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "TO"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "grantees"), ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_field_truthy(ctx, node, "grant_option"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITH GRANT OPTION"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_access_priv(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *cols = pg_query_deparse_get(ctx, node, "cols");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_scalar(ctx, &join, pg_query_deparse_get(ctx, node, "priv_name")));
+	if (cols != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, cols));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_role_spec(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	long long roletype;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "roletype"), &roletype));
+
+	switch (roletype) {
+		case 1: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "CURRENT_USER")); break;
+		case 2: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "SESSION_USER")); break;
+		case 3: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "PUBLIC")); break;
+		default: return pg_query_deparse_identifier(ctx, pg_query_deparse_get(ctx, node, "rolename"), 1);
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_aexpr_in(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	int in = pg_query_deparse_operator_equals(ctx, pg_query_deparse_get(ctx, node, "name"), "=");
+
+	PG_QUERY_DEPARSE_TRY(in);
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "lexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (in) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IN ("));
+	} else {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " NOT IN ("));
+	}
+	pg_query_deparse_join_init(&join, ", ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_array(ctx, &join, pg_query_deparse_get(ctx, node, "rexpr")));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_aexpr_like(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	int like = pg_query_deparse_operator_equals(ctx, pg_query_deparse_get(ctx, node, "name"), "~~");
+
+	PG_QUERY_DEPARSE_TRY(like);
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "lexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (like) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " LIKE "));
+	} else {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " NOT LIKE "));
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "rexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_aexpr_ilike(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *name;
+
+	// node['name'][0]['String']['str'] == '~~*'
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "name"), &name));
+	if (name == NULL || name->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	name = pg_query_deparse_get_object(ctx, name, "String");
+	if (name == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "lexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_string_equals(pg_query_deparse_get(ctx, name, "str"), "~~*")) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " ILIKE "));
+	} else {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " NOT ILIKE "));
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "rexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_bool_expr_not(PgQueryDeparseContext *ctx, PgQueryTreeValue *node)
+{
+	PgQueryTreeValue *arg;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "args"), &arg));
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "NOT "));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_boolean_test(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	long long booltesttype;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "booltesttype"), &booltesttype));
+	if (booltesttype < 0 || booltesttype > 5) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item_string(ctx, pg_query_deparse_get(ctx, node, "arg"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	switch (booltesttype) {
+		case 0: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IS TRUE")); break;
+		case 1: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IS NOT TRUE")); break;
+		case 2: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IS FALSE")); break;
+		case 3: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IS NOT FALSE")); break;
+		case 4: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IS UNKNOWN")); break;
+		case 5: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IS NOT UNKNOWN")); break;
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_range_function(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *function, *alias = pg_query_deparse_get(ctx, node, "alias");
+	PgQueryTreeValue *coldeflist = pg_query_deparse_get(ctx, node, "coldeflist");
+
+	// node['functions'][0][0]
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "functions"), &function));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(function, &function));
+
+	pg_query_deparse_join_init(&join, " ");
+	if (pg_query_deparse_field_truthy(ctx, node, "lateral"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "LATERAL"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, function, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_truthy(alias))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, alias, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_truthy(coldeflist)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		if (!pg_query_deparse_truthy(alias)) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "AS "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, coldeflist));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+// ' ' + deparse_item(node['name'][0], :operator) + ' '
+static int pg_query_deparse_operator(PgQueryDeparseContext *ctx, PgQueryTreeValue *node)
+{
+	PgQueryTreeValue *name;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "name"), &name));
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item_string(ctx, name, PG_QUERY_DEPARSE_CONTEXT_OPERATOR));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_aexpr(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	// context || true
+	PgQueryDeparseItemContext operand_context = context == PG_QUERY_DEPARSE_CONTEXT_NONE ? PG_QUERY_DEPARSE_CONTEXT_TRUE : context;
+
+	// This is a nested expression, add parentheses.
+	if (context != PG_QUERY_DEPARSE_CONTEXT_NONE) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "lexpr"), operand_context));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_operator(ctx, node));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "rexpr"), operand_context));
+
+	if (context != PG_QUERY_DEPARSE_CONTEXT_NONE) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_bool_expr_args(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char *sep, long long boolop)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *args = pg_query_deparse_get(ctx, node, "args");
+	size_t i;
+
+	if (args == NULL || args->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	pg_query_deparse_join_init(&join, sep);
+	for (i = 0; i < args->len; i++) {
+		PgQueryTreeValue *arg = &args->u.items[i];
+		long long arg_boolop;
+		int parenthesize;
+
+		// arg.values[0]['boolop']
+		if (arg->type != PG_QUERY_TREE_OBJECT || arg->len == 0 || arg->u.members[0].value.type != PG_QUERY_TREE_OBJECT)
+			return PG_QUERY_DEPARSE_UNSUPPORTED;
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, &arg->u.members[0].value, "boolop"), &arg_boolop));
+
+		// Only put parentheses around OR nodes inside AND nodes, and AND + OR nodes inside OR nodes
+		parenthesize = arg_boolop == 1 || (boolop == 1 && arg_boolop == 0);
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		if (parenthesize) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		if (parenthesize) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_bool_expr(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	long long boolop;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "boolop"), &boolop));
+
+	switch (boolop) {
+		case 0: return pg_query_deparse_bool_expr_args(ctx, node, " AND ", boolop);
+		case 1: return pg_query_deparse_bool_expr_args(ctx, node, " OR ", boolop);
+		case 2: return pg_query_deparse_bool_expr_not(ctx, node);
+		default: return PG_QUERY_DEPARSE_NIL;
+	}
+}
+
+// deparse_aexpr_any and deparse_aexpr_all
+static int pg_query_deparse_aexpr_quantified(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char *quantifier)
+{
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "lexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_operator(ctx, node));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, quantifier, strlen(quantifier)));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "rexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_aexpr_between(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, const char *between)
+{
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item_string(ctx, pg_query_deparse_get(ctx, node, "lexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, between, strlen(between)));
+
+	return pg_query_deparse_list(ctx, pg_query_deparse_get(ctx, node, "rexpr"), " AND ", PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+static int pg_query_deparse_aexpr_nullif(PgQueryDeparseContext *ctx, PgQueryTreeValue *node)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "NULLIF("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "lexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ", "));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "rexpr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_a_expr(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	long long kind;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "kind"), &kind));
+
+	switch (kind) {
+		case 0: return pg_query_deparse_aexpr(ctx, node, context); // AEXPR_OP
+		case 1: return pg_query_deparse_aexpr_quantified(ctx, node, "ANY"); // AEXPR_OP_ANY
+		case 2: return pg_query_deparse_aexpr_quantified(ctx, node, "ALL"); // AEXPR_OP_ALL
+		case 5: return pg_query_deparse_aexpr_nullif(ctx, node); // AEXPR_NULLIF
+		case 7: return pg_query_deparse_aexpr_in(ctx, node, context); // AEXPR_IN
+		case 8: return pg_query_deparse_aexpr_like(ctx, node, context); // AEXPR_LIKE
+		case 9: return pg_query_deparse_aexpr_ilike(ctx, node, context); // AEXPR_ILIKE
+		case 11: return pg_query_deparse_aexpr_between(ctx, node, " BETWEEN ");
+		case 12: return pg_query_deparse_aexpr_between(ctx, node, " NOT BETWEEN ");
+		case 13: return pg_query_deparse_aexpr_between(ctx, node, " BETWEEN SYMMETRIC ");
+		case 14: return pg_query_deparse_aexpr_between(ctx, node, " NOT BETWEEN SYMMETRIC ");
+		default: return PG_QUERY_DEPARSE_UNSUPPORTED;
+	}
+}
+
+static int pg_query_deparse_joinexpr(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *quals = pg_query_deparse_get(ctx, node, "quals");
+	PgQueryTreeValue *using_clause = pg_query_deparse_get(ctx, node, "usingClause");
+	long long jointype;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "jointype"), &jointype));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "larg"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	switch (jointype) {
+		case 0:
+			if (pg_query_deparse_field_truthy(ctx, node, "isNatural")) {
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "NATURAL"));
+			} else if (pg_query_deparse_is_nil(quals) && pg_query_deparse_is_nil(using_clause)) {
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CROSS"));
+			}
+			break;
+		case 1: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "LEFT")); break;
+		case 2: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "FULL")); break;
+		case 3: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "RIGHT")); break;
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "JOIN"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "rarg"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	if (pg_query_deparse_truthy(quals)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ON"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, quals, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+
+	if (pg_query_deparse_truthy(using_clause)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "USING"));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, using_clause));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_lock(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "LOCK TABLE "));
+
+	return pg_query_deparse_list(ctx, pg_query_deparse_get(ctx, node, "relations"), ", ", PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+static int pg_query_deparse_lockingclause(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *locked_rels = pg_query_deparse_get(ctx, node, "lockedRels");
+	long long strength;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "strength"), &strength));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+	switch (strength) {
+		case 1: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "FOR KEY SHARE")); break;
+		case 2: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "FOR SHARE")); break;
+		case 3: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "FOR NO KEY UPDATE")); break;
+		case 4: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "FOR UPDATE")); break;
+	}
+	if (pg_query_deparse_truthy(locked_rels)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "OF"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, locked_rels, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_sortby(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	long long sortby_dir, sortby_nulls;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "sortby_dir"), &sortby_dir));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "sortby_nulls"), &sortby_nulls));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "node"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (sortby_dir == 1) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ASC"));
+	if (sortby_dir == 2) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "DESC"));
+	if (sortby_nulls == 1) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "NULLS FIRST"));
+	if (sortby_nulls == 2) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "NULLS LAST"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_collate(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "arg"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "COLLATE"));
+	// A nested Array, joined with the same separator
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "collname"), " ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_with_clause(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITH"));
+	if (pg_query_deparse_field_truthy(ctx, node, "recursive"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "RECURSIVE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "ctes"), ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+/*
+ * The PG parser adds several pieces of view data onto the RANGEVAR that need
+ * to be printed before deparse_rangevar is called (relpersistence). Returns
+ * NULL in out if there is nothing to print.
+ */
+static int pg_query_deparse_relpersistence(PgQueryDeparseContext *ctx, PgQueryTreeValue *rangevar, const char **out)
+{
+	PgQueryTreeValue *relpersistence;
+
+	*out = NULL;
+
+	if (rangevar == NULL || rangevar->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	rangevar = pg_query_deparse_get_object(ctx, rangevar, "RangeVar");
+	if (rangevar == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	relpersistence = pg_query_deparse_get(ctx, rangevar, "relpersistence");
+	if (pg_query_deparse_string_equals(relpersistence, "t")) *out = "TEMPORARY";
+	if (pg_query_deparse_string_equals(relpersistence, "u")) *out = "UNLOGGED";
+
+	return 0;
+}
+
+static int pg_query_deparse_viewstmt(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *view = pg_query_deparse_get(ctx, node, "view");
+	PgQueryTreeValue *aliases = pg_query_deparse_get(ctx, node, "aliases");
+	const char *persistence;
+	long long with_check_option;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_relpersistence(ctx, view, &persistence));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "withCheckOption"), &with_check_option));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CREATE"));
+	if (pg_query_deparse_field_truthy(ctx, node, "replace"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "OR REPLACE"));
+	if (persistence != NULL) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, persistence));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "VIEW"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_scalar(ctx, &join, pg_query_deparse_get(ctx, pg_query_deparse_get(ctx, view, "RangeVar"), "relname")));
+	if (pg_query_deparse_truthy(aliases)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, aliases));
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "AS"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "query"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	if (with_check_option == 1) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITH CHECK OPTION"));
+	if (with_check_option == 2) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITH CASCADED CHECK OPTION"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_variable_set_stmt(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "SET"));
+	if (pg_query_deparse_field_truthy(ctx, node, "is_local"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "LOCAL"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_scalar(ctx, &join, pg_query_deparse_get(ctx, node, "name")));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "TO"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "args"), ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+// node['options'][bit] == 1, for an Integer (bit reference) or an Array of options
+static int pg_query_deparse_vacuum_option(PgQueryTreeValue *options, int bit)
+{
+	long long value;
+
+	if (options == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	if (options->type == PG_QUERY_TREE_INTEGER)
+		return (int) (((unsigned long long) options->u.integer >> bit) & 1);
+
+	if (options->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	if ((size_t) bit >= options->len) return 0;
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(&options->u.items[bit], &value));
+
+	return value == 1;
+}
+
+static int pg_query_deparse_vacuum_stmt(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	static const struct {
+		int bit;
+		const char *option;
+	} vacuum_options[] = {{4, "FULL"}, {3, "FREEZE"}, {2, "VERBOSE"}, {1, "ANALYZE"}};
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *options = pg_query_deparse_get(ctx, node, "options");
+	PgQueryTreeValue *relation = pg_query_deparse_get(ctx, node, "relation");
+	PgQueryTreeValue *va_cols = pg_query_deparse_get(ctx, node, "va_cols");
+	size_t i;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "VACUUM"));
+	for (i = 0; i < sizeof(vacuum_options) / sizeof(vacuum_options[0]); i++) {
+		int set = pg_query_deparse_vacuum_option(options, vacuum_options[i].bit);
+
+		PG_QUERY_DEPARSE_TRY(set);
+		if (set) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, vacuum_options[i].option));
+	}
+	if (relation != NULL) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, relation, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (va_cols != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, va_cols));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_do_stmt(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *args = pg_query_deparse_get(ctx, node, "args");
+	PgQueryTreeValue *statement;
+	size_t i;
+
+	if (args == NULL || args->type != PG_QUERY_TREE_ARRAY || args->len == 0) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	// statement['DefElem']['arg']['String']['str']
+	statement = &args->u.items[0];
+	if (statement->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	statement = pg_query_deparse_get_object(ctx, statement, "DefElem");
+	if (statement != NULL) statement = pg_query_deparse_get_object(ctx, statement, "arg");
+	if (statement != NULL) statement = pg_query_deparse_get_object(ctx, statement, "String");
+	if (statement == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "DO"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "$$"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_scalar(ctx, pg_query_deparse_get(ctx, statement, "str")));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "$$"));
+	for (i = 1; i < args->len; i++)
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, &args->u.items[i], PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_cte(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *aliascolnames = pg_query_deparse_get(ctx, node, "aliascolnames");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_scalar(ctx, &join, pg_query_deparse_get(ctx, node, "ctename")));
+	if (pg_query_deparse_truthy(aliascolnames)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, aliascolnames));
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "AS ("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "ctequery"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_case(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *arg = pg_query_deparse_get(ctx, node, "arg");
+	PgQueryTreeValue *defresult = pg_query_deparse_get(ctx, node, "defresult");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CASE"));
+	if (pg_query_deparse_truthy(arg)) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, arg, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_items(ctx, &join, pg_query_deparse_get(ctx, node, "args"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_truthy(defresult)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ELSE"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, defresult, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "END"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_columndef(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *raw_default = pg_query_deparse_get(ctx, node, "raw_default");
+	PgQueryTreeValue *constraints = pg_query_deparse_get(ctx, node, "constraints");
+	PgQueryTreeValue *coll_clause = pg_query_deparse_get(ctx, node, "collClause");
+	PgQueryTreeValue *collname;
+	size_t i;
+
+	// Everything is compacted, so nil values and items are left out
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_scalar(ctx, &join, pg_query_deparse_get(ctx, node, "colname")));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_item(ctx, &join, pg_query_deparse_get(ctx, node, "typeName"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_truthy(raw_default)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "USING"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_item(ctx, &join, raw_default, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+	if (pg_query_deparse_truthy(constraints)) {
+		if (constraints->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		for (i = 0; i < constraints->len; i++)
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_item(ctx, &join, &constraints->u.items[i], PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+	if (pg_query_deparse_truthy(coll_clause)) {
+		// node['collClause']['CollateClause']['collname']
+		if (coll_clause->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		coll_clause = pg_query_deparse_get_object(ctx, coll_clause, "CollateClause");
+		if (coll_clause == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		collname = pg_query_deparse_get(ctx, coll_clause, "collname");
+		if (collname == NULL || collname->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "COLLATE"));
+		for (i = 0; i < collname->len; i++)
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_compact_item(ctx, &join, &collname->u.items[i], PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_composite_type(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *typevar = pg_query_deparse_get(ctx, node, "typevar");
+
+	// node['typevar'][RANGE_VAR].merge('inh' => true)
+	if (typevar == NULL || typevar->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	typevar = pg_query_deparse_get_object(ctx, typevar, "RangeVar");
+	if (typevar == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "CREATE TYPE "));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_rangevar_fields(ctx, typevar, 1));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " AS "));
+
+	return pg_query_deparse_parenthesized_list(ctx, pg_query_deparse_get(ctx, node, "coldeflist"));
+}
+
+static int pg_query_deparse_constraint(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *conname = pg_query_deparse_get(ctx, node, "conname");
+	PgQueryTreeValue *raw_expr = pg_query_deparse_get(ctx, node, "raw_expr");
+	PgQueryTreeValue *keys = pg_query_deparse_get(ctx, node, "keys");
+	PgQueryTreeValue *fk_attrs = pg_query_deparse_get(ctx, node, "fk_attrs");
+	PgQueryTreeValue *pktable = pg_query_deparse_get(ctx, node, "pktable");
+	PgQueryTreeValue *indexname = pg_query_deparse_get(ctx, node, "indexname");
+	long long contype;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "contype"), &contype));
+
+	pg_query_deparse_join_init(&join, " ");
+	if (pg_query_deparse_truthy(conname)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CONSTRAINT"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_scalar(ctx, &join, conname));
+	}
+	switch (contype) {
+		case 0: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "NULL")); break;
+		case 1: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "NOT NULL")); break;
+		case 2: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "DEFAULT")); break;
+		case 4: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CHECK")); break;
+		case 5: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "PRIMARY KEY")); break;
+		case 6: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "UNIQUE")); break;
+		case 7: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "EXCLUSION")); break;
+		case 8: PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "FOREIGN KEY")); break;
+	}
+
+	if (pg_query_deparse_truthy(raw_expr)) {
+		PgQueryTreeValue *a_expr;
+		int parentheses = 0, result, i;
+
+		// Unless it's simple, put parentheses around it
+		if (raw_expr->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		if (pg_query_deparse_field_truthy(ctx, raw_expr, "BoolExpr")) parentheses++;
+		a_expr = pg_query_deparse_get(ctx, raw_expr, "A_Expr");
+		if (pg_query_deparse_truthy(a_expr)) {
+			if (a_expr->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+			result = pg_query_deparse_field_equals(ctx, a_expr, "kind", 0); // AEXPR_OP
+			PG_QUERY_DEPARSE_TRY(result);
+			parentheses += result;
+		}
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		for (i = 0; i < parentheses; i++) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+		result = pg_query_deparse_item(ctx, raw_expr, PG_QUERY_DEPARSE_CONTEXT_NONE);
+		PG_QUERY_DEPARSE_TRY(result);
+		if (parentheses > 0 && result != PG_QUERY_DEPARSE_STRING) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		for (i = 0; i < parentheses; i++) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	}
+	if (pg_query_deparse_truthy(keys)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, keys));
+	}
+	if (pg_query_deparse_truthy(fk_attrs)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, fk_attrs));
+	}
+	if (pg_query_deparse_truthy(pktable)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "REFERENCES "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item_string(ctx, pktable, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, pg_query_deparse_get(ctx, node, "pk_attrs")));
+	}
+	if (pg_query_deparse_field_truthy(ctx, node, "skip_validation"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "NOT VALID"));
+	if (pg_query_deparse_truthy(indexname)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "USING INDEX "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_scalar(ctx, indexname));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_copy(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *relation = pg_query_deparse_get(ctx, node, "relation");
+	PgQueryTreeValue *query = pg_query_deparse_get(ctx, node, "query");
+	PgQueryTreeValue *attlist = pg_query_deparse_get(ctx, node, "attlist");
+	PgQueryTreeValue *filename = pg_query_deparse_get(ctx, node, "filename");
+	int is_from = pg_query_deparse_field_truthy(ctx, node, "is_from");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "COPY"));
+	if (relation != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, relation, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	} else if (query != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "("));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, query, PG_QUERY_DEPARSE_CONTEXT_NONE));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	}
+	if (attlist != NULL) {
+		if (attlist->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		if (attlist->len > 0) {
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, attlist));
+		}
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, is_from ? "FROM" : "TO"));
+	if (pg_query_deparse_field_truthy(ctx, node, "is_program"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "PROGRAM"));
+
+	if (filename != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "'"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_scalar(ctx, filename));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "'"));
+	} else {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, is_from ? "STDIN" : "STDOUT"));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_create_enum(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *type_name;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "typeName"), &type_name));
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "CREATE TYPE "));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, type_name, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " AS ENUM ("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, pg_query_deparse_get(ctx, node, "vals"), ", ", PG_QUERY_DEPARSE_CONTEXT_A_CONST));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_create_cast(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *func = pg_query_deparse_get(ctx, node, "func");
+	long long cast_context;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_integer(pg_query_deparse_get(ctx, node, "context"), &cast_context));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CREATE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CAST"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "sourcetype"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " AS "));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "targettype"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	if (pg_query_deparse_truthy(func)) {
+		// node['func']['ObjectWithArgs']
+		if (func->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		func = pg_query_deparse_get_object(ctx, func, "ObjectWithArgs");
+		if (func == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITH FUNCTION "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, pg_query_deparse_get(ctx, func, "objname"), ".", PG_QUERY_DEPARSE_CONTEXT_NONE));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, pg_query_deparse_get(ctx, func, "objargs")));
+	} else if (pg_query_deparse_field_truthy(ctx, node, "inout")) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITH INOUT"));
+	} else {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WITHOUT FUNCTION"));
+	}
+
+	if (cast_context == 0) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "AS IMPLICIT"));
+	if (cast_context == 1) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "AS ASSIGNMENT"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_create_domain(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *type_name = pg_query_deparse_get(ctx, node, "typeName");
+	PgQueryTreeValue *coll_clause = pg_query_deparse_get(ctx, node, "collClause");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CREATE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "DOMAIN"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "domainname"), ".", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "AS"));
+	if (pg_query_deparse_truthy(type_name))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, type_name, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_truthy(coll_clause))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, coll_clause, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	// A nested Array, joined with the same separator
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "constraints"), " ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_create_function(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *parameters = pg_query_deparse_get(ctx, node, "parameters");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CREATE"));
+	if (pg_query_deparse_field_truthy(ctx, node, "replace"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "OR REPLACE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "FUNCTION"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, pg_query_deparse_get(ctx, node, "funcname"), ".", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+	if (parameters != NULL) PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, parameters, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "RETURNS"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "returnType"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_items(ctx, &join, pg_query_deparse_get(ctx, node, "options"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+/*
+ * The definitions of CREATE AGGREGATE / OPERATOR / RANGE / TYPE: each DefElem
+ * as "defname=arg" (just "defname" without an arg). type_names writes the
+ * names of a TypeName arg (joined with names_sep) instead of the deparsed arg.
+ */
+static int pg_query_deparse_definitions(PgQueryDeparseContext *ctx, PgQueryTreeValue *definitions, int type_names, const char *names_sep)
+{
+	PgQueryDeparseJoin join;
+	size_t i;
+
+	if (definitions == NULL || definitions->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+	pg_query_deparse_join_init(&join, ", ");
+	for (i = 0; i < definitions->len; i++) {
+		PgQueryTreeValue *def_elem = &definitions->u.items[i];
+		PgQueryTreeValue *arg;
+
+		if (def_elem->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		def_elem = pg_query_deparse_get_object(ctx, def_elem, "DefElem");
+		if (def_elem == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_scalar(ctx, &join, pg_query_deparse_get(ctx, def_elem, "defname")));
+
+		arg = pg_query_deparse_get(ctx, def_elem, "arg");
+		if (arg == NULL) continue;
+
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "="));
+		if (!type_names) {
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE));
+			continue;
+		}
+
+		// definition['DefElem']['arg']['TypeName']['names']
+		if (arg->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		arg = pg_query_deparse_get_object(ctx, arg, "TypeName");
+		if (arg == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, pg_query_deparse_get(ctx, arg, "names"), names_sep, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_create_range(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *type_name;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "typeName"), &type_name));
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "CREATE TYPE "));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, type_name, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " AS RANGE "));
+
+	return pg_query_deparse_definitions(ctx, pg_query_deparse_get(ctx, node, "params"), 0, NULL);
+}
+
+static int pg_query_deparse_create_schema(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *schemaname = pg_query_deparse_get(ctx, node, "schemaname");
+	PgQueryTreeValue *authrole = pg_query_deparse_get(ctx, node, "authrole");
+	PgQueryTreeValue *schema_elts = pg_query_deparse_get(ctx, node, "schemaElts");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CREATE SCHEMA"));
+	if (pg_query_deparse_field_truthy(ctx, node, "if_not_exists"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "IF NOT EXISTS"));
+	if (schemaname != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_identifier(ctx, schemaname, 0));
+	}
+	if (authrole != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "AUTHORIZATION "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, authrole, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+	// A nested Array, joined with the same separator
+	if (schema_elts != NULL) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, schema_elts, " ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_create_table(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *relation = pg_query_deparse_get(ctx, node, "relation");
+	PgQueryTreeValue *inh_relations = pg_query_deparse_get(ctx, node, "inhRelations");
+	const char *persistence;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_relpersistence(ctx, relation, &persistence));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CREATE"));
+	if (persistence != NULL) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, persistence));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "TABLE"));
+	if (pg_query_deparse_field_truthy(ctx, node, "if_not_exists"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "IF NOT EXISTS"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, relation, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, pg_query_deparse_get(ctx, node, "tableElts")));
+	if (pg_query_deparse_truthy(inh_relations)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "INHERITS"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, inh_relations));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_create_table_as(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CREATE TEMPORARY TABLE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "into"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "AS"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "query"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_into_clause(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	return pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "rel"), PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+static int pg_query_deparse_when(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "WHEN"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "expr"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "THEN"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "result"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_sublink(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *testexpr = pg_query_deparse_get(ctx, node, "testexpr");
+	PgQueryTreeValue *oper_name;
+	long long sub_link_type;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "subLinkType"), &sub_link_type));
+
+	switch (sub_link_type) {
+		case 2: // SUBLINK_TYPE_ANY
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, testexpr, PG_QUERY_DEPARSE_CONTEXT_NONE));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " IN ("));
+			break;
+		case 1: // SUBLINK_TYPE_ALL
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "operName"), &oper_name));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, testexpr, PG_QUERY_DEPARSE_CONTEXT_NONE));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, oper_name, PG_QUERY_DEPARSE_CONTEXT_OPERATOR));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " ALL ("));
+			break;
+		case 0: // SUBLINK_TYPE_EXISTS
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "EXISTS("));
+			break;
+		default:
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+			break;
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, pg_query_deparse_get(ctx, node, "subselect"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_rangesubselect(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *alias = pg_query_deparse_get(ctx, node, "alias");
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item_string(ctx, pg_query_deparse_get(ctx, node, "subquery"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	if (pg_query_deparse_truthy(alias)) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item_string(ctx, alias, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_row(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "ROW"));
+
+	return pg_query_deparse_parenthesized_list(ctx, pg_query_deparse_get(ctx, node, "args"));
+}
+
+// An optional clause of a statement: the keyword and the deparsed item (if the field is truthy)
+static int pg_query_deparse_join_clause(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *node, const char *field, const char *keyword)
+{
+	PgQueryTreeValue *value = pg_query_deparse_get(ctx, node, field);
+
+	if (!pg_query_deparse_truthy(value)) return 0;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, join, keyword));
+
+	return pg_query_deparse_join_item(ctx, join, value, PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+// Same as pg_query_deparse_join_clause, for fields that are lists
+static int pg_query_deparse_join_list_clause(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *node, const char *field, const char *keyword, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *value = pg_query_deparse_get(ctx, node, field);
+
+	if (!pg_query_deparse_truthy(value)) return 0;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, join, keyword));
+
+	return pg_query_deparse_join_list(ctx, join, value, ", ", context);
+}
+
+static int pg_query_deparse_with_clause_field(PgQueryDeparseContext *ctx, PgQueryDeparseJoin *join, PgQueryTreeValue *node)
+{
+	PgQueryTreeValue *with_clause = pg_query_deparse_get(ctx, node, "withClause");
+
+	if (!pg_query_deparse_truthy(with_clause)) return 0;
+
+	return pg_query_deparse_join_item(ctx, join, with_clause, PG_QUERY_DEPARSE_CONTEXT_NONE);
+}
+
+static int pg_query_deparse_select(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *target_list = pg_query_deparse_get(ctx, node, "targetList");
+	PgQueryTreeValue *distinct_clause = pg_query_deparse_get(ctx, node, "distinctClause");
+	PgQueryTreeValue *values_lists = pg_query_deparse_get(ctx, node, "valuesLists");
+	PgQueryTreeValue *locking_clause = pg_query_deparse_get(ctx, node, "lockingClause");
+	long long op;
+	size_t i;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "op"), &op));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_with_clause_field(ctx, &join, node));
+
+	if (op == 1 || op == 3) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "larg"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+		if (op == 1) {
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "UNION"));
+			if (pg_query_deparse_field_truthy(ctx, node, "all"))
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ALL"));
+		} else {
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "EXCEPT"));
+		}
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "rarg"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+
+	if (pg_query_deparse_truthy(target_list)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "SELECT"));
+		if (pg_query_deparse_truthy(distinct_clause)) {
+			if (distinct_clause->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "DISTINCT"));
+			// unless node['distinctClause'].compact.empty?
+			for (i = 0; i < distinct_clause->len; i++)
+				if (!pg_query_deparse_is_nil(&distinct_clause->u.items[i])) break;
+			if (i < distinct_clause->len) {
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "ON ("));
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, distinct_clause, ", ", PG_QUERY_DEPARSE_CONTEXT_SELECT));
+				PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+			}
+		}
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, target_list, ", ", PG_QUERY_DEPARSE_CONTEXT_SELECT));
+	}
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list_clause(ctx, &join, node, "fromClause", "FROM", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_clause(ctx, &join, node, "whereClause", "WHERE"));
+
+	if (pg_query_deparse_truthy(values_lists)) {
+		PgQueryDeparseJoin values_join;
+
+		if (values_lists->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "VALUES"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		pg_query_deparse_join_init(&values_join, ", ");
+		for (i = 0; i < values_lists->len; i++) {
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &values_join));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, &values_lists->u.items[i]));
+		}
+	}
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list_clause(ctx, &join, node, "groupClause", "GROUP BY", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_clause(ctx, &join, node, "havingClause", "HAVING"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list_clause(ctx, &join, node, "sortClause", "ORDER BY", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_clause(ctx, &join, node, "limitCount", "LIMIT"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_clause(ctx, &join, node, "limitOffset", "OFFSET"));
+
+	if (pg_query_deparse_truthy(locking_clause))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_items(ctx, &join, locking_clause, PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_sql_value_function(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	static const char *lookup[] = {
+		"current_date",
+		"current_time",
+		"current_time", // with precision
+		"current_timestamp",
+		"current_timestamp", // with precision
+		"localtime",
+		"localtime", // with precision
+		"localtimestamp",
+		"localtimestamp", // with precision
+		"current_role",
+		"current_user",
+		"session_user",
+		"user",
+		"current_catalog",
+		"current_schema"
+	};
+	const long long lookup_size = sizeof(lookup) / sizeof(lookup[0]);
+	PgQueryTreeValue *typmod = pg_query_deparse_get(ctx, node, "typmod");
+	long long op, typmod_value;
+
+	// lookup[node['op']], negative indexes count from the end
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_integer(pg_query_deparse_get(ctx, node, "op"), &op));
+	if (op < 0) op += lookup_size;
+	if (op >= 0 && op < lookup_size) PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, lookup[op], strlen(lookup[op])));
+
+	// unless node.fetch('typmod', -1) == -1
+	if (typmod != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(typmod, &typmod_value));
+		if (typmod_value != -1) {
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_scalar(ctx, typmod));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+		}
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_insert_into(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *cols = pg_query_deparse_get(ctx, node, "cols");
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_with_clause_field(ctx, &join, node));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "INSERT INTO"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "relation"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (pg_query_deparse_truthy(cols)) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, cols));
+	}
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "selectStmt"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_update(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_with_clause_field(ctx, &join, node));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "UPDATE"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "relation"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list_clause(ctx, &join, node, "targetList", "SET", PG_QUERY_DEPARSE_CONTEXT_UPDATE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_clause(ctx, &join, node, "whereClause", "WHERE"));
+	// RETURNING is formatted like a SELECT
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list_clause(ctx, &join, node, "returningList", "RETURNING", PG_QUERY_DEPARSE_CONTEXT_SELECT));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_delete_from(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_with_clause_field(ctx, &join, node));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "DELETE FROM"));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "relation"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list_clause(ctx, &join, node, "usingClause", "USING", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_clause(ctx, &join, node, "whereClause", "WHERE"));
+	// RETURNING is formatted like a SELECT
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list_clause(ctx, &join, node, "returningList", "RETURNING", PG_QUERY_DEPARSE_CONTEXT_SELECT));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_typename_fields(PgQueryDeparseContext *ctx, PgQueryTreeValue *node);
+
+static int pg_query_deparse_typecast(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *type_name = pg_query_deparse_get(ctx, node, "typeName");
+	PgQueryTreeValue *arg = pg_query_deparse_get(ctx, node, "arg");
+	int result = pg_query_deparse_item_equals(ctx, type_name, PG_QUERY_DEPARSE_CONTEXT_NONE, "boolean");
+
+	PG_QUERY_DEPARSE_TRY(result);
+	if (result) {
+		result = pg_query_deparse_item_equals(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE, "'t'");
+		PG_QUERY_DEPARSE_TRY(result);
+		PG_QUERY_DEPARSE_TRY(result ? PG_QUERY_DEPARSE_APPEND(ctx, "true") : PG_QUERY_DEPARSE_APPEND(ctx, "false"));
+		return PG_QUERY_DEPARSE_STRING;
+	}
+
+	// deparse_item(node['arg']) + '::' + deparse_typename(node['typeName'][TYPE_NAME])
+	if (type_name == NULL || type_name->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	type_name = pg_query_deparse_get_object(ctx, type_name, "TypeName");
+	if (type_name == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_item_string(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "::"));
+
+	return pg_query_deparse_typename_fields(ctx, type_name);
+}
+
+// Where a part of the output was written, to look at it again
+typedef struct {
+	size_t offset;
+	size_t len;
+	int result;
+} PgQueryDeparseWritten;
+
+static int pg_query_deparse_written_is(PgQueryDeparseContext *ctx, const PgQueryDeparseWritten *written, const char *str)
+{
+	return written->result == PG_QUERY_DEPARSE_STRING && written->len == strlen(str) && memcmp(ctx->buf + written->offset, str, written->len) == 0;
+}
+
+// PgQuery::Deparse::Interval::SQL_BY_MASK
+static const char *pg_query_deparse_interval_parts(long long mask)
+{
+	switch (mask) {
+		case 1 << 2: return "year";
+		case 1 << 1: return "month";
+		case 1 << 3: return "day";
+		case 1 << 10: return "hour";
+		case 1 << 11: return "minute";
+		case 1 << 12: return "second";
+		case (1 << 2) | (1 << 1): return "year month";
+		case (1 << 3) | (1 << 10): return "day hour";
+		case (1 << 3) | (1 << 10) | (1 << 11): return "day minute";
+		case (1 << 3) | (1 << 10) | (1 << 11) | (1 << 12): return "day second";
+		case (1 << 10) | (1 << 11): return "hour minute";
+		case (1 << 10) | (1 << 11) | (1 << 12): return "hour second";
+		case (1 << 11) | (1 << 12): return "minute second";
+		default: return NULL;
+	}
+}
+
+// String#to_i for the text of a deparsed item, only for plain (optionally negative) decimal numbers
+static int pg_query_deparse_written_to_i(PgQueryDeparseContext *ctx, const PgQueryDeparseWritten *written, long long *out)
+{
+	const char *str = ctx->buf + written->offset;
+	size_t i = 0, digits = 0;
+	int negative = 0;
+
+	*out = 0;
+	if (written->result == PG_QUERY_DEPARSE_NIL) return 0; // nil.to_i
+
+	if (i < written->len && str[i] == '-') {
+		negative = 1;
+		i++;
+	}
+	for (; i < written->len; i++, digits++) {
+		if (str[i] < '0' || str[i] > '9' || digits >= 18) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		*out = *out * 10 + (str[i] - '0');
+	}
+	if (digits == 0) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	if (negative) *out = -*out;
+
+	return 0;
+}
+
+/*
+ * Deparses interval type expressions like `interval year to month` or
+ * `interval hour to second(5)` (deparse_interval_type)
+ */
+static int pg_query_deparse_interval_type(PgQueryDeparseContext *ctx, PgQueryTreeValue *node)
+{
+	PgQueryTreeValue *typmods = pg_query_deparse_get(ctx, node, "typmods");
+	PgQueryDeparseWritten first = {0, 0, PG_QUERY_DEPARSE_NIL}, last = {0, 0, PG_QUERY_DEPARSE_NIL};
+	PgQueryDeparseJoin join;
+	const char *parts, *part;
+	size_t start = ctx->len, output, i;
+	long long mask;
+
+	if (!pg_query_deparse_truthy(typmods)) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "interval"));
+		return PG_QUERY_DEPARSE_STRING;
+	}
+	if (typmods->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	// The typmods are deparsed first, and the output is built after them
+	for (i = 0; i < typmods->len; i++) {
+		last.offset = ctx->len;
+		last.result = pg_query_deparse_item(ctx, &typmods->u.items[i], PG_QUERY_DEPARSE_CONTEXT_NONE);
+		PG_QUERY_DEPARSE_TRY(last.result);
+		last.len = ctx->len - last.offset;
+		if (i == 0) first = last;
+	}
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_written_to_i(ctx, &first, &mask));
+	parts = pg_query_deparse_interval_parts(mask);
+	if (parts == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	output = ctx->len;
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "interval "));
+	pg_query_deparse_join_init(&join, " to ");
+	for (part = parts; *part != '\0'; ) {
+		size_t len = strcspn(part, " ");
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, part, len));
+
+		// only the `second` type can take an argument (which is downcased as well)
+		if (len == 6 && memcmp(part, "second", 6) == 0 && typmods->len == 2) {
+			size_t arg = ctx->len + 1;
+
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_written(ctx, last.offset, last.len));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+			for (; arg < ctx->len; arg++) {
+				char c = ctx->buf[arg];
+				if ((unsigned char) c >= 0x80) return PG_QUERY_DEPARSE_UNSUPPORTED;
+				if (c >= 'A' && c <= 'Z') ctx->buf[arg] = c - 'A' + 'a';
+			}
+		}
+
+		part += len;
+		if (*part == ' ') part++;
+	}
+
+	pg_query_deparse_move_back(ctx, start, output);
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+// deparse_typename_cast for pg_catalog types, NULL if it isn't one that can be deparsed
+static const char *pg_query_deparse_catalog_type(PgQueryDeparseContext *ctx, const PgQueryDeparseWritten *type)
+{
+	static const struct {
+		const char *type;
+		const char *name;
+	} types[] = {
+		{"bool", "boolean"},
+		{"int2", "smallint"},
+		{"int4", "int"},
+		{"int8", "bigint"},
+		{"real", "real"},
+		{"float4", "real"},
+		{"float8", "double"},
+		{"time", "time"},
+		{"timetz", "time with time zone"},
+		{"timestamp", "timestamp"},
+		{"timestamptz", "timestamp with time zone"}
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		if (pg_query_deparse_written_is(ctx, type, types[i].type)) return types[i].name;
+
+	return NULL;
+}
+
+static int pg_query_deparse_typename_fields(PgQueryDeparseContext *ctx, PgQueryTreeValue *node)
+{
+	PgQueryTreeValue *names = pg_query_deparse_get(ctx, node, "names");
+	PgQueryTreeValue *typmods = pg_query_deparse_get(ctx, node, "typmods");
+	PgQueryDeparseWritten catalog = {0, 0, PG_QUERY_DEPARSE_NIL}, type = {0, 0, PG_QUERY_DEPARSE_NIL}, arguments = {0, 0, PG_QUERY_DEPARSE_NIL};
+	PgQueryDeparseJoin join;
+	size_t start = ctx->len, names_len, output, i;
+	const char *name;
+
+	if (names == NULL || names->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	// names.join('.'), remembering the first two names
+	pg_query_deparse_join_init(&join, ".");
+	for (i = 0; i < names->len; i++) {
+		PgQueryDeparseWritten name_written;
+
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		name_written.offset = ctx->len;
+		name_written.result = pg_query_deparse_item(ctx, &names->u.items[i], PG_QUERY_DEPARSE_CONTEXT_TYPE_NAME);
+		PG_QUERY_DEPARSE_TRY(name_written.result);
+		name_written.len = ctx->len - name_written.offset;
+
+		if (i == 0) catalog = name_written;
+		if (i == 1) type = name_written;
+	}
+	names_len = ctx->len - start;
+
+	// Intervals are tricky and should be handled in a separate method because
+	// they require performing some bitmask operations.
+	if (names->len == 2 && pg_query_deparse_written_is(ctx, &catalog, "pg_catalog") && pg_query_deparse_written_is(ctx, &type, "interval")) {
+		ctx->len = start;
+		return pg_query_deparse_interval_type(ctx, node);
+	}
+
+	if (pg_query_deparse_truthy(typmods)) {
+		arguments.offset = ctx->len;
+		arguments.result = pg_query_deparse_list(ctx, typmods, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE);
+		PG_QUERY_DEPARSE_TRY(arguments.result);
+		arguments.len = ctx->len - arguments.offset;
+	}
+
+	// The output is built after the names and arguments, and then moved to the start
+	output = ctx->len;
+	if (pg_query_deparse_field_truthy(ctx, node, "setof")) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "SETOF "));
+
+	if (!pg_query_deparse_written_is(ctx, &catalog, "pg_catalog")) {
+		// Just pass along any custom types.
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_written(ctx, start, names_len));
+	} else if (pg_query_deparse_written_is(ctx, &type, "bpchar")) {
+		// char(2) or char(9)
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "char("));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_written(ctx, arguments.offset, arguments.len));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	} else if (pg_query_deparse_written_is(ctx, &type, "varchar") || pg_query_deparse_written_is(ctx, &type, "numeric")) {
+		// numeric(3, 5)
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_written(ctx, type.offset, type.len));
+		if (arguments.result != PG_QUERY_DEPARSE_NIL) {
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "("));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_written(ctx, arguments.offset, arguments.len));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+		}
+	} else if ((name = pg_query_deparse_catalog_type(ctx, &type)) != NULL) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append(ctx, name, strlen(name)));
+	} else {
+		return PG_QUERY_DEPARSE_UNSUPPORTED;
+	}
+
+	if (pg_query_deparse_field_truthy(ctx, node, "arrayBounds")) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "[]"));
+
+	pg_query_deparse_move_back(ctx, start, output);
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_typename(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	return pg_query_deparse_typename_fields(ctx, node);
+}
+
+static int pg_query_deparse_nulltest(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	long long nulltesttype;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "nulltesttype"), &nulltesttype));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "arg"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+	if (nulltesttype == 0) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "IS NULL"));
+	if (nulltesttype == 1) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "IS NOT NULL"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_transaction(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join;
+	PgQueryTreeValue *options = pg_query_deparse_get(ctx, node, "options");
+	long long kind;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "kind"), &kind));
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+	switch (kind) {
+		case 0: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "BEGIN")); break;
+		case 2: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "COMMIT")); break;
+		case 3: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "ROLLBACK")); break;
+		case 4: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "SAVEPOINT")); break;
+		case 5: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "RELEASE")); break;
+		case 6: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "ROLLBACK TO SAVEPOINT")); break;
+	}
+	if (pg_query_deparse_truthy(options))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_items(ctx, &join, options, PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_coalesce(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "COALESCE"));
+
+	return pg_query_deparse_parenthesized_list(ctx, pg_query_deparse_get(ctx, node, "args"));
+}
+
+static int pg_query_deparse_defelem(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *defname = pg_query_deparse_get(ctx, node, "defname");
+	PgQueryTreeValue *arg = pg_query_deparse_get(ctx, node, "arg");
+	int result;
+
+	if (pg_query_deparse_string_equals(defname, "as")) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "AS $$"));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, arg, "\n", PG_QUERY_DEPARSE_CONTEXT_DEFNAME_AS));
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "$$"));
+	} else if (pg_query_deparse_string_equals(defname, "language")) {
+		PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "language "));
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_item(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE));
+	} else if (pg_query_deparse_string_equals(defname, "volatility")) {
+		// volatility does not need to be quoted (node['arg']['String']['str'].upcase)
+		if (arg == NULL || arg->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		arg = pg_query_deparse_get_object(ctx, arg, "String");
+		if (arg == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_upcase(ctx, pg_query_deparse_get(ctx, arg, "str")));
+	} else if (pg_query_deparse_string_equals(defname, "strict")) {
+		result = pg_query_deparse_item_equals(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE, "1");
+		PG_QUERY_DEPARSE_TRY(result);
+		PG_QUERY_DEPARSE_TRY(result ? PG_QUERY_DEPARSE_APPEND(ctx, "RETURNS NULL ON NULL INPUT") : PG_QUERY_DEPARSE_APPEND(ctx, "CALLED ON NULL INPUT"));
+	} else {
+		return pg_query_deparse_item(ctx, arg, PG_QUERY_DEPARSE_CONTEXT_NONE);
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_define_stmt(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *defnames = pg_query_deparse_get(ctx, node, "defnames");
+	PgQueryTreeValue *definition = pg_query_deparse_get(ctx, node, "definition");
+	PgQueryTreeValue *args, *defname;
+	long long kind;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "kind"), &kind));
+
+	switch (kind) {
+		case 1: // OBJECT_TYPE_AGGREGATE
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(pg_query_deparse_get(ctx, node, "args"), &args));
+
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "CREATE AGGREGATE "));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, defnames, " ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+			if (pg_query_deparse_truthy(args)) {
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_parenthesized_list(ctx, args));
+			} else {
+				PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "(*)"));
+			}
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+			return pg_query_deparse_definitions(ctx, definition, 1, ", ");
+		case 25: // OBJECT_TYPE_OPERATOR
+			// node['defnames'][0]['String']['str']
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_first(defnames, &defname));
+			if (defname == NULL || defname->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+			defname = pg_query_deparse_get_object(ctx, defname, "String");
+			if (defname == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "CREATE OPERATOR "));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_scalar(ctx, pg_query_deparse_get(ctx, defname, "str")));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+			return pg_query_deparse_definitions(ctx, definition, 1, ", ");
+		case 45: // OBJECT_TYPE_TYPE
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "CREATE TYPE "));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_list(ctx, defnames, " ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+			if (definition != NULL) {
+				PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " "));
+				PG_QUERY_DEPARSE_TRY(pg_query_deparse_definitions(ctx, definition, 1, "="));
+			}
+			return PG_QUERY_DEPARSE_STRING;
+		default:
+			return PG_QUERY_DEPARSE_UNSUPPORTED;
+	}
+}
+
+static int pg_query_deparse_discard(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	long long target;
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_integer(pg_query_deparse_get(ctx, node, "target"), &target));
+
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "DISCARD"));
+	switch (target) {
+		case 0: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " ALL")); break;
+		case 1: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " PLANS")); break;
+		case 2: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " SEQUENCES")); break;
+		case 3: PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, " TEMP")); break;
+	}
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_drop(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join, objects_join;
+	PgQueryTreeValue *objects = pg_query_deparse_get(ctx, node, "objects");
+	long long remove_type;
+	int cascade = pg_query_deparse_field_equals(ctx, node, "behavior", 1);
+	size_t i;
+
+	PG_QUERY_DEPARSE_TRY(cascade);
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_enum(pg_query_deparse_get(ctx, node, "removeType"), &remove_type));
+	if (objects == NULL || objects->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "DROP"));
+	if (remove_type == 37) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "TABLE")); // OBJECT_TYPE_TABLE
+	if (remove_type == 32) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "SCHEMA")); // OBJECT_TYPE_SCHEMA
+	if (pg_query_deparse_field_truthy(ctx, node, "concurrent"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CONCURRENTLY"));
+	if (pg_query_deparse_field_truthy(ctx, node, "missing_ok"))
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "IF EXISTS"));
+
+	// objects = [objects] unless objects[0].is_a?(Array), and each list joined with ', '
+	if (objects->len > 0 && objects->u.items[0].type == PG_QUERY_TREE_ARRAY) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &join));
+		pg_query_deparse_join_init(&objects_join, ", ");
+		for (i = 0; i < objects->len; i++)
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &objects_join, &objects->u.items[i], ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	} else {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_list(ctx, &join, objects, ", ", PG_QUERY_DEPARSE_CONTEXT_NONE));
+	}
+
+	if (cascade) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "CASCADE"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_explain(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryDeparseJoin join, options_join;
+	PgQueryTreeValue *options = pg_query_deparse_get(ctx, node, "options");
+	size_t i;
+
+	pg_query_deparse_join_init(&join, " ");
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, "EXPLAIN"));
+
+	if (options != NULL) {
+		if (options->type != PG_QUERY_TREE_ARRAY) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+		// Multiple options are put into parentheses
+		if (options->len > 0) PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_literal(ctx, &join, options->len > 1 ? "(" : ""));
+		pg_query_deparse_join_init(&options_join, ", ");
+		for (i = 0; i < options->len; i++) {
+			// option['DefElem']['defname'].upcase
+			PgQueryTreeValue *option = &options->u.items[i];
+
+			if (option->type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+			option = pg_query_deparse_get_object(ctx, option, "DefElem");
+			if (option == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_next(ctx, &options_join));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_upcase(ctx, pg_query_deparse_get(ctx, option, "defname")));
+		}
+		if (options->len > 1) PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, ")"));
+	}
+
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_join_item(ctx, &join, pg_query_deparse_get(ctx, node, "query"), PG_QUERY_DEPARSE_CONTEXT_NONE));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_string(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *str = pg_query_deparse_get(ctx, node, "str");
+
+	switch (context) {
+		case PG_QUERY_DEPARSE_CONTEXT_A_CONST:
+			if (str == NULL || str->type != PG_QUERY_TREE_STRING) return PG_QUERY_DEPARSE_UNSUPPORTED;
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "'"));
+			PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_escaped(ctx, str->u.str, str->len, '\''));
+			PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "'"));
+			return PG_QUERY_DEPARSE_STRING;
+		case PG_QUERY_DEPARSE_CONTEXT_FUNC_CALL:
+		case PG_QUERY_DEPARSE_CONTEXT_TYPE_NAME:
+		case PG_QUERY_DEPARSE_CONTEXT_OPERATOR:
+		case PG_QUERY_DEPARSE_CONTEXT_DEFNAME_AS:
+			return pg_query_deparse_scalar(ctx, str);
+		default:
+			return pg_query_deparse_identifier(ctx, str, 1);
+	}
+}
+
+static int pg_query_deparse_integer_node(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PgQueryTreeValue *ival = pg_query_deparse_get(ctx, node, "ival");
+
+	// node['ival'].to_s
+	if (!pg_query_deparse_is_nil(ival) && ival->type != PG_QUERY_TREE_INTEGER && ival->type != PG_QUERY_TREE_STRING)
+		return PG_QUERY_DEPARSE_UNSUPPORTED;
+	PG_QUERY_DEPARSE_TRY(pg_query_deparse_scalar(ctx, ival));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+static int pg_query_deparse_float(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	return pg_query_deparse_scalar(ctx, pg_query_deparse_get(ctx, node, "str"));
+}
+
+static int pg_query_deparse_null(PgQueryDeparseContext *ctx, PgQueryTreeValue *node, PgQueryDeparseItemContext context)
+{
+	PG_QUERY_DEPARSE_TRY(PG_QUERY_DEPARSE_APPEND(ctx, "NULL"));
+
+	return PG_QUERY_DEPARSE_STRING;
+}
+
+// Every node type deparse_item handles, sorted by name (in byte order) for bsearch
+static const PgQueryDeparseNodeType pg_query_deparse_node_types[] = {
+	{"A_ArrayExpr", pg_query_deparse_a_arrayexp, 0},
+	{"A_Const", pg_query_deparse_a_const, 0},
+	{"A_Expr", pg_query_deparse_a_expr, 0},
+	{"A_Indices", pg_query_deparse_a_indices, 0},
+	{"A_Indirection", pg_query_deparse_a_indirection, 0},
+	{"A_Star", pg_query_deparse_a_star, 1},
+	{"A_Truncated", pg_query_deparse_a_truncated, 1},
+	{"AccessPriv", pg_query_deparse_access_priv, 0},
+	{"Alias", pg_query_deparse_alias, 0},
+	{"AlterTableCmd", pg_query_deparse_alter_table_cmd, 0},
+	{"AlterTableStmt", pg_query_deparse_alter_table, 0},
+	{"BoolExpr", pg_query_deparse_bool_expr, 0},
+	{"BooleanTest", pg_query_deparse_boolean_test, 0},
+	{"CaseExpr", pg_query_deparse_case, 0},
+	{"CaseWhen", pg_query_deparse_when, 0},
+	{"CoalesceExpr", pg_query_deparse_coalesce, 0},
+	{"CollateClause", pg_query_deparse_collate, 0},
+	{"ColumnDef", pg_query_deparse_columndef, 0},
+	{"ColumnRef", pg_query_deparse_columnref, 0},
+	{"CommonTableExpr", pg_query_deparse_cte, 0},
+	{"CompositeTypeStmt", pg_query_deparse_composite_type, 0},
+	{"Constraint", pg_query_deparse_constraint, 0},
+	{"CopyStmt", pg_query_deparse_copy, 0},
+	{"CreateCastStmt", pg_query_deparse_create_cast, 0},
+	{"CreateDomainStmt", pg_query_deparse_create_domain, 0},
+	{"CreateEnumStmt", pg_query_deparse_create_enum, 0},
+	{"CreateFunctionStmt", pg_query_deparse_create_function, 0},
+	{"CreateRangeStmt", pg_query_deparse_create_range, 0},
+	{"CreateSchemaStmt", pg_query_deparse_create_schema, 0},
+	{"CreateStmt", pg_query_deparse_create_table, 0},
+	{"CreateTableAsStmt", pg_query_deparse_create_table_as, 0},
+	{"DefElem", pg_query_deparse_defelem, 0},
+	{"DefineStmt", pg_query_deparse_define_stmt, 0},
+	{"DeleteStmt", pg_query_deparse_delete_from, 0},
+	{"DiscardStmt", pg_query_deparse_discard, 0},
+	{"DoStmt", pg_query_deparse_do_stmt, 0},
+	{"DropStmt", pg_query_deparse_drop, 0},
+	{"ExplainStmt", pg_query_deparse_explain, 0},
+	{"Float", pg_query_deparse_float, 0},
+	{"FuncCall", pg_query_deparse_funccall, 0},
+	{"FunctionParameter", pg_query_deparse_functionparameter, 0},
+	{"GrantRoleStmt", pg_query_deparse_grant_role, 0},
+	{"GrantStmt", pg_query_deparse_grant, 0},
+	{"InsertStmt", pg_query_deparse_insert_into, 0},
+	{"Integer", pg_query_deparse_integer_node, 0},
+	{"IntoClause", pg_query_deparse_into_clause, 0},
+	{"JoinExpr", pg_query_deparse_joinexpr, 0},
+	{"LockStmt", pg_query_deparse_lock, 0},
+	{"LockingClause", pg_query_deparse_lockingclause, 0},
+	{"Null", pg_query_deparse_null, 1},
+	{"NullTest", pg_query_deparse_nulltest, 0},
+	{"ObjectWithArgs", pg_query_deparse_object_with_args, 0},
+	{"ParamRef", pg_query_deparse_paramref, 0},
+	{"RangeFunction", pg_query_deparse_range_function, 0},
+	{"RangeSubselect", pg_query_deparse_rangesubselect, 0},
+	{"RangeVar", pg_query_deparse_rangevar, 0},
+	{"RawStmt", pg_query_deparse_raw_stmt, 0},
+	{"RenameStmt", pg_query_deparse_renamestmt, 0},
+	{"ResTarget", pg_query_deparse_restarget, 0},
+	{"RoleSpec", pg_query_deparse_role_spec, 0},
+	{"RowExpr", pg_query_deparse_row, 0},
+	{"SQLValueFunction", pg_query_deparse_sql_value_function, 0},
+	{"SelectStmt", pg_query_deparse_select, 0},
+	{"SortBy", pg_query_deparse_sortby, 0},
+	{"String", pg_query_deparse_string, 0},
+	{"SubLink", pg_query_deparse_sublink, 0},
+	{"TransactionStmt", pg_query_deparse_transaction, 0},
+	{"TypeCast", pg_query_deparse_typecast, 0},
+	{"TypeName", pg_query_deparse_typename, 0},
+	{"UpdateStmt", pg_query_deparse_update, 0},
+	{"VacuumStmt", pg_query_deparse_vacuum_stmt, 0},
+	{"VariableSetStmt", pg_query_deparse_variable_set_stmt, 0},
+	{"ViewStmt", pg_query_deparse_viewstmt, 0},
+	{"WindowDef", pg_query_deparse_windowdef, 0},
+	{"WithClause", pg_query_deparse_with_clause, 0}
+};
+
+static int pg_query_deparse_node_type_compare(const void *a, const void *b)
+{
+	const PgQueryTreeKey *key = (const PgQueryTreeKey *) a;
+	const char *name = ((const PgQueryDeparseNodeType *) b)->name;
+	size_t name_len = strlen(name);
+	int cmp = memcmp(key->str, name, key->len < name_len ? key->len : name_len);
+
+	if (cmp != 0) return cmp;
+	if (key->len == name_len) return 0;
+
+	return key->len < name_len ? -1 : 1;
+}
+
+static const PgQueryDeparseNodeType *pg_query_deparse_node_type(PgQueryDeparseContext *ctx, int key)
+{
+	const PgQueryDeparseNodeType *node_type = ctx->node_types[key];
+
+	if (node_type == NULL) {
+		node_type = bsearch(&ctx->tree->keys[key], pg_query_deparse_node_types, sizeof(pg_query_deparse_node_types) / sizeof(pg_query_deparse_node_types[0]),
+		                    sizeof(pg_query_deparse_node_types[0]), pg_query_deparse_node_type_compare);
+		if (node_type == NULL) node_type = &pg_query_deparse_unknown_node_type;
+		ctx->node_types[key] = node_type;
+	}
+
+	return node_type;
+}
+
+static int pg_query_deparse_item(PgQueryDeparseContext *ctx, PgQueryTreeValue *item, PgQueryDeparseItemContext context)
+{
+	const PgQueryDeparseNodeType *node_type;
+	PgQueryTreeMember *member;
+
+	if (pg_query_deparse_is_nil(item)) return PG_QUERY_DEPARSE_NIL;
+	if (item->type == PG_QUERY_TREE_INTEGER) {
+		PG_QUERY_DEPARSE_TRY(pg_query_deparse_append_integer(ctx, item->u.integer));
+		return PG_QUERY_DEPARSE_INTEGER;
+	}
+	if (item->type != PG_QUERY_TREE_OBJECT || item->len == 0) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	// The node type is the first key, and its fields the first value
+	member = &item->u.members[0];
+	node_type = pg_query_deparse_node_type(ctx, member->key);
+	if (node_type->deparse == NULL) return PG_QUERY_DEPARSE_UNSUPPORTED;
+	if (!node_type->any_fields && member->value.type != PG_QUERY_TREE_OBJECT) return PG_QUERY_DEPARSE_UNSUPPORTED;
+
+	return node_type->deparse(ctx, &member->value, context);
+}
+
+int pg_query_tree_deparse(PgQueryTree *tree, PgQueryTreeValue *statements, char **out, size_t *out_len)
+{
+	PgQueryDeparseContext ctx;
+	PgQueryDeparseJoin join;
+	int result = -1;
+
+	*out = NULL;
+	*out_len = 0;
+
+	if (statements == NULL || statements->type != PG_QUERY_TREE_ARRAY) return -1;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.tree = tree;
+	ctx.node_types = calloc(tree->keys_count > 0 ? tree->keys_count : 1, sizeof(PgQueryDeparseNodeType *));
+	if (ctx.node_types == NULL) return -1;
+
+	// Statements are joined with '; ' (each one is a RawStmt node)
+	pg_query_deparse_join_init(&join, "; ");
+	if (pg_query_deparse_join_items(&ctx, &join, statements, PG_QUERY_DEPARSE_CONTEXT_NONE) >= 0 && pg_query_deparse_reserve(&ctx, 1) == 0) {
+		ctx.buf[ctx.len] = '\0';
+		*out = ctx.buf;
+		*out_len = ctx.len;
+		ctx.buf = NULL;
+		result = 0;
+	}
+
+	free(ctx.buf);
+	free(ctx.node_types);
+
+	return result;
+}
@@ -0,0 +1,24 @@
+#ifndef PG_QUERY_RUBY_DEPARSE_H
+#define PG_QUERY_RUBY_DEPARSE_H
+
+#include <stddef.h>
+
+#include "pg_query_ruby_tree.h"
+
+/*
+ * Deparsing of native trees, producing the same output as the Ruby
+ * implementation in lib/pg_query/deparse.rb (PgQuery#deparse).
+ */
+
+/*
+ * Deparses a list of statement nodes of the tree, joined by "; ", into a
+ * malloc-ed, NUL-terminated buffer (free it with free), and its length.
+ * Returns 0 on success, or -1 when out of memory or if the Ruby
+ * implementation wouldn't produce the same output: for node types it doesn't
+ * support (for which it raises an error), and for values it treats in ways
+ * that aren't replicated here (e.g. Floats where Integers are expected).
+ * Callers should fall back to the Ruby implementation in that case.
+ */
+int pg_query_tree_deparse(PgQueryTree *tree, PgQueryTreeValue *statements, char **out, size_t *out_len);
+
+#endif
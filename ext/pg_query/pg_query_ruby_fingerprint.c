@@ -0,0 +1,635 @@
+#include "pg_query_ruby_fingerprint.h"
+#include "pg_query_ruby_sha1.h"
+#include "pg_query_ruby_xxh64.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Note: Everything in this file may run without the GVL, and must therefore
+ * only use malloc/free (never xmalloc) and not touch any Ruby objects.
+ *
+ * The Ruby implementation hashes a sequence of string "parts" (node names,
+ * field names and scalar values). Some lists are order-independent: the parts
+ * of each list item are sorted and deduplicated before being hashed, which
+ * compares them part by part. We therefore collect all parts on a single
+ * stack, and only feed them to the hash function once the whole tree has been
+ * walked.
+ */
+
+typedef struct {
+	const char *str;
+	size_t len;
+} PgQueryFingerprintPart;
+
+typedef struct {
+	const PgQueryTreeKey *key;
+	const PgQueryTreeValue *value;
+} PgQueryFingerprintField;
+
+// A list item's parts, as a range on the parts stack (relative to the start of the list)
+typedef struct {
+	size_t start;
+	size_t len;
+} PgQueryFingerprintSegment;
+
+typedef struct PgQueryFingerprintScratch PgQueryFingerprintScratch;
+
+struct PgQueryFingerprintScratch {
+	PgQueryFingerprintScratch *next;
+	size_t used;
+	char data[4096];
+};
+
+typedef struct {
+	PgQueryTree *tree;
+
+	PgQueryFingerprintPart *parts;
+	size_t parts_len;
+	size_t parts_capacity;
+
+	PgQueryFingerprintField *fields;
+	size_t fields_len;
+	size_t fields_capacity;
+
+	// Text of formatted numbers, parts point into it
+	PgQueryFingerprintScratch *scratch;
+} PgQueryFingerprintContext;
+
+#define PG_QUERY_FINGERPRINT_KEY_IS(key, literal) \
+	((key)->len == sizeof(literal) - 1 && memcmp((key)->str, literal, sizeof(literal) - 1) == 0)
+
+static int pg_query_fingerprint_push(PgQueryFingerprintContext *ctx, const char *str, size_t len)
+{
+	if (ctx->parts_len == ctx->parts_capacity) {
+		size_t new_capacity = ctx->parts_capacity ? ctx->parts_capacity * 2 : 256;
+		PgQueryFingerprintPart *new_parts = realloc(ctx->parts, sizeof(PgQueryFingerprintPart) * new_capacity);
+		if (new_parts == NULL) return -1;
+		ctx->parts = new_parts;
+		ctx->parts_capacity = new_capacity;
+	}
+
+	ctx->parts[ctx->parts_len].str = str;
+	ctx->parts[ctx->parts_len].len = len;
+	ctx->parts_len++;
+
+	return 0;
+}
+
+static int pg_query_fingerprint_push_copy(PgQueryFingerprintContext *ctx, const char *str, size_t len)
+{
+	PgQueryFingerprintScratch *scratch = ctx->scratch;
+	char *copy;
+
+	if (scratch == NULL || sizeof(scratch->data) - scratch->used < len) {
+		scratch = malloc(sizeof(PgQueryFingerprintScratch));
+		if (scratch == NULL) return -1;
+		scratch->used = 0;
+		scratch->next = ctx->scratch;
+		ctx->scratch = scratch;
+	}
+
+	copy = scratch->data + scratch->used;
+	memcpy(copy, str, len);
+	scratch->used += len;
+
+	return pg_query_fingerprint_push(ctx, copy, len);
+}
+
+/*
+ * Formats a double the same way as Ruby's Float#to_s: the shortest
+ * representation that reads back as the same value, using decimal notation
+ * for exponents from -4 to 14 (or 15, if there are digits after the point)
+ * and scientific notation otherwise.
+ */
+static size_t pg_query_fingerprint_format_float(double value, char *out)
+{
+	char buf[32], digits[20];
+	int precision, exponent, decpt, ndigits = 0, i;
+	char *p, *o = out;
+
+	if (isnan(value)) return (size_t) sprintf(out, "NaN");
+	if (isinf(value)) return (size_t) sprintf(out, value < 0 ? "-Infinity" : "Infinity");
+
+	for (precision = 0; precision < 17; precision++) {
+		snprintf(buf, sizeof(buf), "%.*e", precision, value);
+		if (strtod(buf, NULL) == value) break;
+	}
+
+	p = buf;
+	if (*p == '-') *o++ = *p++;
+	for (; *p != 'e'; p++)
+		if (*p != '.') digits[ndigits++] = *p;
+	exponent = atoi(p + 1);
+
+	while (ndigits > 1 && digits[ndigits - 1] == '0') ndigits--;
+
+	decpt = exponent + 1;
+	if (decpt > 0 && (decpt < 16 || decpt < ndigits)) {
+		for (i = 0; i < decpt; i++) *o++ = i < ndigits ? digits[i] : '0';
+		*o++ = '.';
+		if (ndigits > decpt) {
+			for (i = decpt; i < ndigits; i++) *o++ = digits[i];
+		} else {
+			*o++ = '0';
+		}
+	} else if (decpt <= 0 && decpt > -4) {
+		*o++ = '0';
+		*o++ = '.';
+		for (i = decpt; i < 0; i++) *o++ = '0';
+		for (i = 0; i < ndigits; i++) *o++ = digits[i];
+	} else {
+		*o++ = digits[0];
+		*o++ = '.';
+		if (ndigits > 1) {
+			for (i = 1; i < ndigits; i++) *o++ = digits[i];
+		} else {
+			*o++ = '0';
+		}
+		o += sprintf(o, "e%+03d", decpt - 1);
+	}
+
+	*o = '\0';
+
+	return o - out;
+}
+
+// Mirrors ignored_fingerprint_value? - nil, 0, false, [] and ''
+static int pg_query_fingerprint_ignored(const PgQueryTreeValue *value)
+{
+	switch (value->type) {
+		case PG_QUERY_TREE_NULL:
+			return 1;
+		case PG_QUERY_TREE_BOOL:
+			return !value->u.boolean;
+		case PG_QUERY_TREE_INTEGER:
+			return value->u.integer == 0;
+		case PG_QUERY_TREE_FLOAT:
+			return value->u.fl == 0;
+		case PG_QUERY_TREE_STRING:
+		case PG_QUERY_TREE_ARRAY:
+			return value->len == 0;
+		case PG_QUERY_TREE_OBJECT:
+			return 0;
+	}
+
+	return 0;
+}
+
+static int pg_query_fingerprint_node(PgQueryFingerprintContext *ctx, const PgQueryTreeValue *node, const PgQueryTreeKey *parent_node_name, const PgQueryTreeKey *parent_field_name);
+static int pg_query_fingerprint_list(PgQueryFingerprintContext *ctx, const PgQueryTreeValue *list, const PgQueryTreeKey *parent_node_name, const PgQueryTreeKey *parent_field_name);
+
+static int pg_query_fingerprint_value(PgQueryFingerprintContext *ctx, const PgQueryTreeValue *value, const PgQueryTreeKey *parent_node_name, const PgQueryTreeKey *parent_field_name, int need_to_write_name)
+{
+	size_t start;
+	char buf[32];
+	int len;
+
+	if (pg_query_fingerprint_ignored(value)) return 0;
+
+	// The field name is only written if the value produces any parts, reserve its place
+	if (need_to_write_name && pg_query_fingerprint_push(ctx, parent_field_name->str, parent_field_name->len) != 0)
+		return -1;
+
+	start = ctx->parts_len;
+
+	switch (value->type) {
+		case PG_QUERY_TREE_OBJECT:
+			if (pg_query_fingerprint_node(ctx, value, parent_node_name, parent_field_name) != 0) return -1;
+			break;
+		case PG_QUERY_TREE_ARRAY:
+			if (pg_query_fingerprint_list(ctx, value, parent_node_name, parent_field_name) != 0) return -1;
+			break;
+		case PG_QUERY_TREE_STRING:
+			if (pg_query_fingerprint_push(ctx, value->u.str, value->len) != 0) return -1;
+			break;
+		case PG_QUERY_TREE_INTEGER:
+			len = snprintf(buf, sizeof(buf), "%lld", value->u.integer);
+			if (pg_query_fingerprint_push_copy(ctx, buf, len) != 0) return -1;
+			break;
+		case PG_QUERY_TREE_FLOAT:
+			len = (int) pg_query_fingerprint_format_float(value->u.fl, buf);
+			if (pg_query_fingerprint_push_copy(ctx, buf, len) != 0) return -1;
+			break;
+		case PG_QUERY_TREE_BOOL:
+			if (pg_query_fingerprint_push(ctx, "true", 4) != 0) return -1;
+			break;
+		case PG_QUERY_TREE_NULL:
+			break;
+	}
+
+	if (need_to_write_name && ctx->parts_len == start)
+		ctx->parts_len--;
+
+	return 0;
+}
+
+static int pg_query_fingerprint_compare_fields(const void *a, const void *b)
+{
+	const PgQueryTreeKey *key_a = ((const PgQueryFingerprintField *) a)->key;
+	const PgQueryTreeKey *key_b = ((const PgQueryFingerprintField *) b)->key;
+	int cmp = memcmp(key_a->str, key_b->str, key_a->len < key_b->len ? key_a->len : key_b->len);
+
+	if (cmp != 0) return cmp;
+	if (key_a->len == key_b->len) return 0;
+	return key_a->len < key_b->len ? -1 : 1;
+}
+
+static int pg_query_fingerprint_skip_field(const PgQueryTreeKey *node_name, const PgQueryTreeKey *field_name, const PgQueryTreeValue *fields, const PgQueryTreeKey *parent_node_name, const PgQueryTreeKey *parent_field_name, PgQueryTree *tree)
+{
+	size_t i;
+
+	if (PG_QUERY_FINGERPRINT_KEY_IS(field_name, "location"))
+		return 1;
+
+	if (PG_QUERY_FINGERPRINT_KEY_IS(field_name, "name")) {
+		if (PG_QUERY_FINGERPRINT_KEY_IS(node_name, "ResTarget") &&
+			parent_node_name && PG_QUERY_FINGERPRINT_KEY_IS(parent_node_name, "SelectStmt") &&
+			parent_field_name && PG_QUERY_FINGERPRINT_KEY_IS(parent_field_name, "targetList"))
+			return 1;
+		return PG_QUERY_FINGERPRINT_KEY_IS(node_name, "PrepareStmt") ||
+			   PG_QUERY_FINGERPRINT_KEY_IS(node_name, "ExecuteStmt") ||
+			   PG_QUERY_FINGERPRINT_KEY_IS(node_name, "DeallocateStmt");
+	}
+
+	if (PG_QUERY_FINGERPRINT_KEY_IS(field_name, "gid") || PG_QUERY_FINGERPRINT_KEY_IS(field_name, "options"))
+		return PG_QUERY_FINGERPRINT_KEY_IS(node_name, "TransactionStmt");
+
+	if (PG_QUERY_FINGERPRINT_KEY_IS(field_name, "portalname"))
+		return PG_QUERY_FINGERPRINT_KEY_IS(node_name, "DeclareCursorStmt") ||
+			   PG_QUERY_FINGERPRINT_KEY_IS(node_name, "FetchStmt") ||
+			   PG_QUERY_FINGERPRINT_KEY_IS(node_name, "ClosePortalStmt");
+
+	if (PG_QUERY_FINGERPRINT_KEY_IS(field_name, "relname")) {
+		if (!PG_QUERY_FINGERPRINT_KEY_IS(node_name, "RangeVar")) return 0;
+
+		// Temporary tables get random names, ignore them
+		for (i = 0; i < fields->len; i++) {
+			const PgQueryTreeMember *member = &fields->u.members[i];
+			if (PG_QUERY_FINGERPRINT_KEY_IS(&tree->keys[member->key], "relpersistence"))
+				return member->value.type == PG_QUERY_TREE_STRING && member->value.len == 1 && member->value.u.str[0] == 't';
+		}
+		return 0;
+	}
+
+	if (PG_QUERY_FINGERPRINT_KEY_IS(field_name, "stmt_len") || PG_QUERY_FINGERPRINT_KEY_IS(field_name, "stmt_location"))
+		return PG_QUERY_FINGERPRINT_KEY_IS(node_name, "RawStmt");
+
+	return 0;
+}
+
+static int pg_query_fingerprint_node(PgQueryFingerprintContext *ctx, const PgQueryTreeValue *node, const PgQueryTreeKey *parent_node_name, const PgQueryTreeKey *parent_field_name)
+{
+	const PgQueryTreeKey *node_name;
+	const PgQueryTreeValue *fields;
+	size_t base, count, i;
+
+	if (node->type != PG_QUERY_TREE_OBJECT || node->len == 0) return -1;
+
+	node_name = &ctx->tree->keys[node->u.members[0].key];
+	fields = &node->u.members[0].value;
+
+	if (PG_QUERY_FINGERPRINT_KEY_IS(node_name, "A_Const") ||
+		PG_QUERY_FINGERPRINT_KEY_IS(node_name, "Alias") ||
+		PG_QUERY_FINGERPRINT_KEY_IS(node_name, "ParamRef") ||
+		PG_QUERY_FINGERPRINT_KEY_IS(node_name, "SetToDefault") ||
+		PG_QUERY_FINGERPRINT_KEY_IS(node_name, "IntList") ||
+		PG_QUERY_FINGERPRINT_KEY_IS(node_name, "OidList") ||
+		PG_QUERY_FINGERPRINT_KEY_IS(node_name, "Null"))
+		return 0;
+
+	if (fields->type != PG_QUERY_TREE_OBJECT) return -1;
+
+	if (pg_query_fingerprint_push(ctx, node_name->str, node_name->len) != 0) return -1;
+
+	// Sorted fields are kept on a stack, since child nodes sort theirs while we iterate
+	base = ctx->fields_len;
+	count = fields->len;
+
+	if (ctx->fields_len + count > ctx->fields_capacity) {
+		size_t new_capacity = ctx->fields_capacity ? ctx->fields_capacity : 64;
+		PgQueryFingerprintField *new_fields;
+		while (new_capacity < ctx->fields_len + count) new_capacity *= 2;
+		new_fields = realloc(ctx->fields, sizeof(PgQueryFingerprintField) * new_capacity);
+		if (new_fields == NULL) return -1;
+		ctx->fields = new_fields;
+		ctx->fields_capacity = new_capacity;
+	}
+
+	for (i = 0; i < count; i++) {
+		ctx->fields[base + i].key = &ctx->tree->keys[fields->u.members[i].key];
+		ctx->fields[base + i].value = &fields->u.members[i].value;
+	}
+	ctx->fields_len += count;
+
+	qsort(ctx->fields + base, count, sizeof(PgQueryFingerprintField), pg_query_fingerprint_compare_fields);
+
+	for (i = 0; i < count; i++) {
+		const PgQueryTreeKey *field_name = ctx->fields[base + i].key;
+		const PgQueryTreeValue *value = ctx->fields[base + i].value;
+
+		if (pg_query_fingerprint_ignored(value)) continue;
+		if (pg_query_fingerprint_skip_field(node_name, field_name, fields, parent_node_name, parent_field_name, ctx->tree)) continue;
+
+		if (pg_query_fingerprint_value(ctx, value, node_name, field_name, 1) != 0) {
+			ctx->fields_len = base;
+			return -1;
+		}
+	}
+
+	ctx->fields_len = base;
+
+	return 0;
+}
+
+// Same ordering as Ruby's Array#<=> on the parts (compared as Strings)
+static int pg_query_fingerprint_compare_segments(const PgQueryFingerprintPart *parts, const PgQueryFingerprintSegment *a, const PgQueryFingerprintSegment *b)
+{
+	size_t i;
+
+	for (i = 0; i < a->len && i < b->len; i++) {
+		const PgQueryFingerprintPart *part_a = &parts[a->start + i];
+		const PgQueryFingerprintPart *part_b = &parts[b->start + i];
+		int cmp = memcmp(part_a->str, part_b->str, part_a->len < part_b->len ? part_a->len : part_b->len);
+
+		if (cmp != 0) return cmp;
+		if (part_a->len != part_b->len) return part_a->len < part_b->len ? -1 : 1;
+	}
+
+	if (a->len == b->len) return 0;
+	return a->len < b->len ? -1 : 1;
+}
+
+// Merge sort, since qsort has no way to pass the parts to the comparison
+static void pg_query_fingerprint_sort_segments(const PgQueryFingerprintPart *parts, PgQueryFingerprintSegment *segments, PgQueryFingerprintSegment *tmp, size_t count)
+{
+	size_t middle, i, j, k;
+
+	if (count < 2) return;
+
+	middle = count / 2;
+	pg_query_fingerprint_sort_segments(parts, segments, tmp, middle);
+	pg_query_fingerprint_sort_segments(parts, segments + middle, tmp, count - middle);
+
+	i = 0;
+	j = middle;
+	k = 0;
+	while (i < middle && j < count)
+		tmp[k++] = pg_query_fingerprint_compare_segments(parts, &segments[j], &segments[i]) < 0 ? segments[j++] : segments[i++];
+	while (i < middle)
+		tmp[k++] = segments[i++];
+	while (j < count)
+		tmp[k++] = segments[j++];
+
+	memcpy(segments, tmp, sizeof(PgQueryFingerprintSegment) * count);
+}
+
+static int pg_query_fingerprint_is_unordered_list(const PgQueryTreeKey *field_name)
+{
+	return field_name && (PG_QUERY_FINGERPRINT_KEY_IS(field_name, "fromClause") ||
+						  PG_QUERY_FINGERPRINT_KEY_IS(field_name, "targetList") ||
+						  PG_QUERY_FINGERPRINT_KEY_IS(field_name, "cols") ||
+						  PG_QUERY_FINGERPRINT_KEY_IS(field_name, "rexpr") ||
+						  PG_QUERY_FINGERPRINT_KEY_IS(field_name, "valuesLists"));
+}
+
+static int pg_query_fingerprint_list(PgQueryFingerprintContext *ctx, const PgQueryTreeValue *list, const PgQueryTreeKey *parent_node_name, const PgQueryTreeKey *parent_field_name)
+{
+	PgQueryFingerprintSegment *segments, *tmp;
+	PgQueryFingerprintPart *parts;
+	size_t list_start, list_len, i;
+	int result = -1;
+
+	if (!pg_query_fingerprint_is_unordered_list(parent_field_name)) {
+		for (i = 0; i < list->len; i++)
+			if (pg_query_fingerprint_value(ctx, &list->u.items[i], parent_node_name, parent_field_name, 0) != 0)
+				return -1;
+		return 0;
+	}
+
+	segments = malloc(sizeof(PgQueryFingerprintSegment) * list->len * 2);
+	if (segments == NULL) return -1;
+	tmp = segments + list->len;
+
+	list_start = ctx->parts_len;
+	for (i = 0; i < list->len; i++) {
+		segments[i].start = ctx->parts_len - list_start;
+		if (pg_query_fingerprint_value(ctx, &list->u.items[i], parent_node_name, parent_field_name, 0) != 0)
+			goto done;
+		segments[i].len = ctx->parts_len - list_start - segments[i].start;
+	}
+
+	// Write back the distinct items in sorted order, from a copy of their parts
+	list_len = ctx->parts_len - list_start;
+	parts = malloc(sizeof(PgQueryFingerprintPart) * (list_len ? list_len : 1));
+	if (parts == NULL) goto done;
+	memcpy(parts, ctx->parts + list_start, sizeof(PgQueryFingerprintPart) * list_len);
+
+	pg_query_fingerprint_sort_segments(parts, segments, tmp, list->len);
+
+	ctx->parts_len = list_start;
+	for (i = 0; i < list->len; i++) {
+		if (i > 0 && pg_query_fingerprint_compare_segments(parts, &segments[i - 1], &segments[i]) == 0)
+			continue;
+		memcpy(ctx->parts + ctx->parts_len, parts + segments[i].start, sizeof(PgQueryFingerprintPart) * segments[i].len);
+		ctx->parts_len += segments[i].len;
+	}
+
+	free(parts);
+	result = 0;
+
+done:
+	free(segments);
+	return result;
+}
+
+// Collects the parts of a list of statements in the tree
+static int pg_query_fingerprint_collect(PgQueryFingerprintContext *ctx, PgQueryTree *tree, PgQueryTreeValue *statements, size_t len)
+{
+	size_t i;
+
+	ctx->tree = tree;
+
+	for (i = 0; i < len; i++)
+		if (pg_query_fingerprint_node(ctx, &statements[i], NULL, NULL) != 0)
+			return -1;
+
+	return 0;
+}
+
+static void pg_query_fingerprint_context_free(PgQueryFingerprintContext *ctx)
+{
+	while (ctx->scratch) {
+		PgQueryFingerprintScratch *next = ctx->scratch->next;
+		free(ctx->scratch);
+		ctx->scratch = next;
+	}
+	free(ctx->parts);
+	free(ctx->fields);
+}
+
+// Writes the (version 2) SHA-1 digest of a list of statements in the tree
+static int pg_query_tree_fingerprint_statements_digest(PgQueryTree *tree, PgQueryTreeValue *statements, size_t len,
+													   unsigned char digest[PG_QUERY_FINGERPRINT_DIGEST_LENGTH])
+{
+	PgQueryFingerprintContext ctx = {0};
+	PgQuerySHA1 sha1;
+	int result = -1;
+	size_t i;
+
+	if (pg_query_fingerprint_collect(&ctx, tree, statements, len) != 0)
+		goto done;
+
+	pg_query_sha1_init(&sha1);
+	for (i = 0; i < ctx.parts_len; i++)
+		pg_query_sha1_update(&sha1, ctx.parts[i].str, ctx.parts[i].len);
+	pg_query_sha1_final(&sha1, digest);
+
+	result = 0;
+
+done:
+	pg_query_fingerprint_context_free(&ctx);
+
+	return result;
+}
+
+static void pg_query_fingerprint_hex(const unsigned char digest[PG_QUERY_FINGERPRINT_DIGEST_LENGTH],
+									 char out[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1])
+{
+	size_t i;
+
+	sprintf(out, "%02x", PG_QUERY_FINGERPRINT_VERSION);
+	for (i = 0; i < PG_QUERY_FINGERPRINT_DIGEST_LENGTH; i++)
+		sprintf(out + 2 + i * 2, "%02x", digest[i]);
+}
+
+// Fingerprints a list of statements in the tree
+static int pg_query_tree_fingerprint_statements(PgQueryTree *tree, PgQueryTreeValue *statements, size_t len,
+												char out[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1])
+{
+	unsigned char digest[PG_QUERY_FINGERPRINT_DIGEST_LENGTH];
+
+	if (pg_query_tree_fingerprint_statements_digest(tree, statements, len, digest) != 0) return -1;
+
+	pg_query_fingerprint_hex(digest, out);
+
+	return 0;
+}
+
+int pg_query_tree_fingerprint(PgQueryTree *tree, char out[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1])
+{
+	if (tree->root.type != PG_QUERY_TREE_ARRAY) return -1;
+
+	return pg_query_tree_fingerprint_statements(tree, tree->root.u.items, tree->root.len, out);
+}
+
+int pg_query_tree_fingerprint_digest(PgQueryTree *tree, unsigned char out[PG_QUERY_FINGERPRINT_DIGEST_LENGTH])
+{
+	if (tree->root.type != PG_QUERY_TREE_ARRAY) return -1;
+
+	return pg_query_tree_fingerprint_statements_digest(tree, tree->root.u.items, tree->root.len, out);
+}
+
+int pg_query_tree_fingerprint_statement(PgQueryTree *tree, PgQueryTreeValue *statement, char out[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1])
+{
+	return pg_query_tree_fingerprint_statements(tree, statement, 1, out);
+}
+
+int pg_query_tree_fingerprint_xxh64(PgQueryTree *tree, uint64_t *out)
+{
+	PgQueryFingerprintContext ctx = {0};
+	PgQueryXXH64 xxh64;
+	int result = -1;
+	size_t i;
+
+	if (tree->root.type != PG_QUERY_TREE_ARRAY) return -1;
+
+	if (pg_query_fingerprint_collect(&ctx, tree, tree->root.u.items, tree->root.len) != 0)
+		goto done;
+
+	pg_query_xxh64_init(&xxh64, 0);
+	for (i = 0; i < ctx.parts_len; i++)
+		pg_query_xxh64_update(&xxh64, ctx.parts[i].str, ctx.parts[i].len);
+	*out = pg_query_xxh64_digest(&xxh64);
+
+	result = 0;
+
+done:
+	pg_query_fingerprint_context_free(&ctx);
+
+	return result;
+}
+
+PgQueryFingerprintResult pg_query_tree_fingerprint_query(const char *input, int flags, int version, unsigned char *digest,
+														 PgQueryParserStats *stats, uint64_t *fingerprint_ns)
+{
+	PgQueryFingerprintResult result = {0};
+	PgQueryParserResult parse_result;
+	PgQueryTree tree;
+	unsigned char sha1_digest[PG_QUERY_FINGERPRINT_DIGEST_LENGTH];
+	char fingerprint[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1];
+	uint64_t start, hash;
+	int error, i;
+
+	flags |= PG_QUERY_PARSER_JSON | PG_QUERY_PARSER_REUSE_BUFFERS | PG_QUERY_PARSER_SKIP_WARNINGS;
+	parse_result = pg_query_parser_parse(input, flags);
+
+	if (flags & PG_QUERY_PARSER_STATS) *stats = parse_result.stats;
+	start = (flags & PG_QUERY_PARSER_STATS) ? pg_query_parser_clock_ns() : 0;
+
+	if (parse_result.error) {
+		result.error = parse_result.error;
+		parse_result.error = NULL;
+		pg_query_parser_free_result(parse_result);
+		return result;
+	}
+
+	pg_query_tree_init(&tree);
+
+	// The tree takes ownership of the JSON buffer, unless it is to be reused
+	error = pg_query_tree_parse_json(&tree, parse_result.parse_tree, PG_QUERY_TREE_MAX_NESTING);
+	parse_result.parse_tree = NULL;
+
+	if (!error) {
+		if (version == PG_QUERY_FINGERPRINT_VERSION_XXH64)
+			error = pg_query_tree_fingerprint_xxh64(&tree, &hash);
+		else
+			error = pg_query_tree_fingerprint_digest(&tree, sha1_digest);
+	}
+
+	if (parse_result.reused_buffers) {
+		pg_query_parser_release_buffer(tree.buffer);
+		tree.buffer = NULL;
+	}
+	pg_query_tree_free(&tree);
+	pg_query_parser_free_result(parse_result);
+
+	if (flags & PG_QUERY_PARSER_STATS) *fingerprint_ns = pg_query_parser_clock_ns() - start;
+
+	if (error) {
+		// Same as the error raised for trees that can't be built (see new_ruby_tree_error)
+		result.error = calloc(1, sizeof(PgQueryError));
+		if (result.error) {
+			result.error->message = strdup("Failed to parse JSON");
+			result.error->filename = strdup(__FILE__);
+			result.error->funcname = strdup(__func__);
+			result.error->lineno = __LINE__;
+			result.error->cursorpos = -1;
+		}
+		return result;
+	}
+
+	if (version == PG_QUERY_FINGERPRINT_VERSION_XXH64) {
+		for (i = 0; i < PG_QUERY_FINGERPRINT_XXH64_DIGEST_LENGTH; i++)
+			digest[i] = (unsigned char) (hash >> (56 - i * 8));
+	} else if (digest) {
+		memcpy(digest, sha1_digest, PG_QUERY_FINGERPRINT_DIGEST_LENGTH);
+	} else {
+		pg_query_fingerprint_hex(sha1_digest, fingerprint);
+		result.hexdigest = strdup(fingerprint);
+	}
+
+	return result;
+}
@@ -0,0 +1,66 @@
+#ifndef PG_QUERY_RUBY_FINGERPRINT_H
+#define PG_QUERY_RUBY_FINGERPRINT_H
+
+#include "pg_query.h"
+#include "pg_query_ruby_parser.h"
+#include "pg_query_ruby_tree.h"
+
+/*
+ * Fingerprinting of native trees, producing the same result as the Ruby
+ * implementation in lib/pg_query/fingerprint.rb (PgQuery#fingerprint).
+ */
+
+#define PG_QUERY_FINGERPRINT_VERSION 2
+
+// Opt-in version 3: the same parts as version 2, hashed with XXH64 (seed 0) instead of SHA-1
+#define PG_QUERY_FINGERPRINT_VERSION_XXH64 3
+
+// Version prefix (2 hex characters) and the SHA-1 digest (40 hex characters)
+#define PG_QUERY_FINGERPRINT_HEX_LENGTH 42
+
+// Raw digests: the SHA-1 digest for version 2, the XXH64 hash (big-endian) for version 3
+#define PG_QUERY_FINGERPRINT_DIGEST_LENGTH 20
+#define PG_QUERY_FINGERPRINT_XXH64_DIGEST_LENGTH 8
+
+/*
+ * Writes the NUL-terminated hex fingerprint of the tree (a list of statement
+ * nodes) into out. Returns 0 on success, or -1 when out of memory or if the
+ * tree isn't shaped like a parse tree (e.g. a node that isn't an object).
+ */
+int pg_query_tree_fingerprint(PgQueryTree *tree, char out[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1]);
+
+// Same as pg_query_tree_fingerprint, but writes the raw SHA-1 digest (without the version)
+int pg_query_tree_fingerprint_digest(PgQueryTree *tree, unsigned char out[PG_QUERY_FINGERPRINT_DIGEST_LENGTH]);
+
+/*
+ * Same as pg_query_tree_fingerprint, for a single statement node of the tree
+ * (which gets the same fingerprint as a query consisting of only that statement)
+ */
+int pg_query_tree_fingerprint_statement(PgQueryTree *tree, PgQueryTreeValue *statement, char out[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1]);
+
+/*
+ * Writes the version 3 fingerprint of the tree into out. Returns 0 on success,
+ * or -1 like pg_query_tree_fingerprint.
+ */
+int pg_query_tree_fingerprint_xxh64(PgQueryTree *tree, uint64_t *out);
+
+/*
+ * Same as pg_query_fingerprint in libpg_query, but through the native tree,
+ * so that parsing doesn't redirect the process's stderr (which breaks when
+ * threads fingerprint concurrently). Free the result with
+ * pg_query_free_fingerprint_result.
+ *
+ * With digest, the raw digest (PG_QUERY_FINGERPRINT_DIGEST_LENGTH bytes for
+ * version 2, PG_QUERY_FINGERPRINT_XXH64_DIGEST_LENGTH for version 3) is
+ * written to it instead, and the result's hexdigest is NULL. Version 3
+ * fingerprints (PG_QUERY_FINGERPRINT_VERSION_XXH64) are only available as a
+ * digest, any other version produces the version 2 fingerprint.
+ *
+ * flags are passed on to pg_query_parser_parse. With PG_QUERY_PARSER_STATS,
+ * the parser's stats are written to stats, and the time spent building and
+ * fingerprinting the tree to fingerprint_ns.
+ */
+PgQueryFingerprintResult pg_query_tree_fingerprint_query(const char *input, int flags, int version, unsigned char *digest,
+														 PgQueryParserStats *stats, uint64_t *fingerprint_ns);
+
+#endif
@@ -0,0 +1,760 @@
+#include "pg_query_ruby.h"
+#include "pg_query_ruby_pool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * PgQuery::LogAggregator - reads PostgreSQL server logs (stderr or csvlog
+ * format) and aggregates the statements logged with their duration (e.g. by
+ * log_min_duration_statement) by fingerprint. See lib/pg_query/log_aggregator.rb.
+ *
+ * Log data is fed in chunks. Only the last, incomplete record of a chunk is kept
+ * around until the next one, all complete records are processed right away
+ * without holding the GVL: statements are fingerprinted on the native worker
+ * pool, and counted into a table of at most max_fingerprints entries.
+ */
+
+#define PG_QUERY_RUBY_LOG_STDERR 0
+#define PG_QUERY_RUBY_LOG_CSVLOG 1
+
+// csvlog columns, see "Using CSV-Format Log Output" in the PostgreSQL docs
+#define PG_QUERY_RUBY_LOG_CSV_SEVERITY 11
+#define PG_QUERY_RUBY_LOG_CSV_MESSAGE 13
+
+/*
+ * Logs usually repeat the exact same statement text many times (e.g. queries
+ * with bind parameters), so the entry for each text is remembered in a small
+ * direct-mapped cache, and those statements aren't parsed again.
+ */
+#define PG_QUERY_RUBY_LOG_TEXT_CACHE_SIZE 4096
+
+typedef struct {
+	char fingerprint[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1];
+	char *query; // first statement seen, up to max_query_length bytes
+	size_t query_len;
+	int query_truncated;
+	uint64_t count;
+	double total_ms;
+	double max_ms;
+} PgQueryRubyLogEntry;
+
+typedef struct {
+	int format;
+	size_t max_fingerprints;
+	size_t max_query_length;
+	int threads;
+	int busy; // set while a chunk is processed without the GVL
+
+	// Data that wasn't processed yet, always NUL-terminated
+	char *buffer;
+	size_t buffer_len;
+	size_t buffer_capacity;
+	size_t scan_offset; // how far the buffer was searched for the end of a record
+	int scan_quoted;    // csvlog: whether scan_offset is within a quoted field
+
+	PgQueryRubyLogEntry *entries;
+	size_t entries_count;
+	size_t entries_capacity;
+	size_t *slots; // open addressing by fingerprint, entry index + 1 (0 is empty)
+	size_t slots_capacity;
+	size_t text_cache[PG_QUERY_RUBY_LOG_TEXT_CACHE_SIZE]; // entry index + 1, by text hash
+
+	uint64_t records;
+	uint64_t statements;
+	uint64_t errors;
+	uint64_t dropped;
+	int out_of_memory;
+} PgQueryRubyLogAggregator;
+
+// A statement found in a chunk
+typedef struct {
+	char *text;
+	size_t len;
+	uint64_t hash;
+	double duration;
+	size_t entry; // entry index + 1 if found in the text cache, 0 otherwise
+	size_t same_as; // index of the first statement in the chunk with the same text
+	PgQueryFingerprintResult result;
+} PgQueryRubyLogStatement;
+
+typedef struct {
+	PgQueryRubyLogStatement *statements;
+	size_t count;
+	size_t capacity;
+	size_t *work; // statements that need to be fingerprinted
+	size_t work_count;
+} PgQueryRubyLogChunk;
+
+static uint64_t pg_query_ruby_log_hash(const char *str, size_t len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static const char *pg_query_ruby_log_find(const char *str, const char *end, const char *needle)
+{
+	size_t needle_len = strlen(needle);
+
+	while ((size_t) (end - str) >= needle_len) {
+		str = memchr(str, needle[0], end - str - needle_len + 1);
+		if (str == NULL) return NULL;
+		if (memcmp(str, needle, needle_len) == 0) return str;
+		str++;
+	}
+
+	return NULL;
+}
+
+static int pg_query_ruby_log_starts_with(const char *str, const char *end, const char *prefix)
+{
+	size_t prefix_len = strlen(prefix);
+
+	return (size_t) (end - str) >= prefix_len && memcmp(str, prefix, prefix_len) == 0;
+}
+
+/*
+ * Parses the message of a log record, e.g. "duration: 0.512 ms  statement: SELECT 1",
+ * returning a pointer to the statement text, or NULL if this is any other
+ * message. Only "statement" and "execute" (extended query protocol) messages
+ * are counted, the "parse" and "bind" steps of an execution are logged too when
+ * they are slow, but would count the same statement more than once.
+ */
+static const char *pg_query_ruby_log_parse_message(const char *str, const char *end, double *duration)
+{
+	double value = 0;
+	double scale = 1;
+
+	if (!pg_query_ruby_log_starts_with(str, end, "duration: ")) return NULL;
+	str += strlen("duration: ");
+
+	if (str == end || *str < '0' || *str > '9') return NULL;
+	for (; str < end && *str >= '0' && *str <= '9'; str++)
+		value = value * 10 + (*str - '0');
+	if (str < end && *str == '.')
+		for (str++; str < end && *str >= '0' && *str <= '9'; str++)
+			value += (*str - '0') * (scale /= 10);
+
+	if (!pg_query_ruby_log_starts_with(str, end, " ms  ")) return NULL;
+	str += strlen(" ms  ");
+
+	if (pg_query_ruby_log_starts_with(str, end, "statement: ")) {
+		str += strlen("statement: ");
+	} else if (pg_query_ruby_log_starts_with(str, end, "execute ")) {
+		// Statement name, e.g. "execute <unnamed>: SELECT 1" or "execute s1/p1: SELECT 1"
+		const char *colon = pg_query_ruby_log_find(str, end, ": ");
+		if (colon == NULL) return NULL;
+		str = colon + 2;
+	} else {
+		return NULL;
+	}
+
+	*duration = value;
+	return str;
+}
+
+static int pg_query_ruby_log_chunk_add(PgQueryRubyLogChunk *chunk, char *text, size_t len, double duration)
+{
+	PgQueryRubyLogStatement *statement;
+
+	if (chunk->count == chunk->capacity) {
+		size_t capacity = chunk->capacity ? chunk->capacity * 2 : 64;
+		PgQueryRubyLogStatement *statements = realloc(chunk->statements, capacity * sizeof(PgQueryRubyLogStatement));
+		if (statements == NULL) return -1;
+		chunk->statements = statements;
+		chunk->capacity = capacity;
+	}
+
+	statement = &chunk->statements[chunk->count++];
+	memset(statement, 0, sizeof(PgQueryRubyLogStatement));
+	statement->text = text;
+	statement->len = len;
+	statement->duration = duration;
+
+	return 0;
+}
+
+/*
+ * stderr format: the message follows the log_line_prefix and severity, and
+ * any further lines of it start with a tab.
+ */
+static int pg_query_ruby_log_stderr_record(PgQueryRubyLogChunk *chunk, const char *str, const char *end)
+{
+	const char *line_end = memchr(str, '\n', end - str);
+	const char *message = pg_query_ruby_log_find(str, line_end ? line_end : end, "LOG:  ");
+	const char *text;
+	char *copy;
+	size_t len = 0;
+	double duration;
+
+	if (message == NULL) return 1;
+
+	text = pg_query_ruby_log_parse_message(message + strlen("LOG:  "), end, &duration);
+	if (text == NULL) return 1;
+
+	copy = malloc(end - text + 1);
+	if (copy == NULL) return -1;
+
+	for (; text < end; text++) {
+		copy[len++] = *text;
+		if (*text == '\n' && text + 1 < end && text[1] == '\t') text++;
+	}
+	copy[len] = '\0';
+
+	if (pg_query_ruby_log_chunk_add(chunk, copy, len, duration) != 0) {
+		free(copy);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Unquotes the given field of a csvlog record into a new NUL-terminated
+ * string, or returns NULL if the record doesn't have the field (or when out
+ * of memory, in which case *error is set).
+ */
+static char *pg_query_ruby_log_csv_field(const char *str, const char *end, int field, size_t *len, int *error)
+{
+	char *copy;
+	int i;
+
+	for (i = 0; i < field; i++) {
+		int quoted = 0;
+		for (; str < end; str++) {
+			if (*str == '"') quoted = !quoted;
+			else if (*str == ',' && !quoted) break;
+		}
+		if (str == end) return NULL;
+		str++;
+	}
+
+	copy = malloc(end - str + 1);
+	if (copy == NULL) {
+		*error = 1;
+		return NULL;
+	}
+
+	*len = 0;
+	if (str < end && *str == '"') {
+		for (str++; str < end; str++) {
+			if (*str == '"') {
+				if (str + 1 < end && str[1] == '"') str++;
+				else break;
+			}
+			copy[(*len)++] = *str;
+		}
+	} else {
+		for (; str < end && *str != ','; str++)
+			copy[(*len)++] = *str;
+	}
+	copy[*len] = '\0';
+
+	return copy;
+}
+
+static int pg_query_ruby_log_csvlog_record(PgQueryRubyLogChunk *chunk, const char *str, const char *end)
+{
+	char *severity, *message;
+	const char *text;
+	size_t severity_len, message_len;
+	double duration;
+	int error = 0;
+	int result = 1;
+
+	severity = pg_query_ruby_log_csv_field(str, end, PG_QUERY_RUBY_LOG_CSV_SEVERITY, &severity_len, &error);
+	if (severity == NULL) return error ? -1 : 1;
+	if (strcmp(severity, "LOG") != 0) {
+		free(severity);
+		return 1;
+	}
+	free(severity);
+
+	message = pg_query_ruby_log_csv_field(str, end, PG_QUERY_RUBY_LOG_CSV_MESSAGE, &message_len, &error);
+	if (message == NULL) return error ? -1 : 1;
+
+	text = pg_query_ruby_log_parse_message(message, message + message_len, &duration);
+	if (text != NULL) {
+		// Reuse the unquoted message for the statement text
+		message_len -= text - message;
+		memmove(message, text, message_len + 1);
+		if (pg_query_ruby_log_chunk_add(chunk, message, message_len, duration) != 0) result = -1;
+		else return 0;
+	}
+
+	free(message);
+	return result;
+}
+
+/*
+ * Returns the length of the first complete record in the unprocessed part of
+ * the buffer (including its newline), or 0 if there is none yet. Unless
+ * flushing, a stderr record is only complete once the next one started,
+ * since it may continue on the next line.
+ */
+static size_t pg_query_ruby_log_next_record(PgQueryRubyLogAggregator *aggregator, size_t start, int flush)
+{
+	const char *buffer = aggregator->buffer;
+	size_t i;
+
+	if (aggregator->scan_offset < start) {
+		aggregator->scan_offset = start;
+		aggregator->scan_quoted = 0;
+	}
+
+	for (i = aggregator->scan_offset; i < aggregator->buffer_len; i++) {
+		if (aggregator->format == PG_QUERY_RUBY_LOG_CSVLOG) {
+			if (buffer[i] == '"') aggregator->scan_quoted = !aggregator->scan_quoted;
+			else if (buffer[i] == '\n' && !aggregator->scan_quoted) break;
+		} else if (buffer[i] == '\n') {
+			if (i + 1 == aggregator->buffer_len) {
+				if (flush) break;
+				aggregator->scan_offset = i;
+				return 0;
+			}
+			if (buffer[i + 1] != '\t') break;
+		}
+	}
+
+	if (i < aggregator->buffer_len) {
+		aggregator->scan_quoted = 0;
+		aggregator->scan_offset = i + 1;
+		return i + 1 - start;
+	}
+
+	aggregator->scan_offset = i;
+
+	// Whatever is left when flushing is a record without its final newline
+	if (flush && start < aggregator->buffer_len) {
+		aggregator->scan_quoted = 0;
+		return aggregator->buffer_len - start;
+	}
+
+	return 0;
+}
+
+static int pg_query_ruby_log_entry_text_equal(PgQueryRubyLogEntry *entry, PgQueryRubyLogStatement *statement)
+{
+	return !entry->query_truncated && entry->query_len == statement->len &&
+		memcmp(entry->query, statement->text, statement->len) == 0;
+}
+
+// Finds statements with a cached entry, and the first statement for each other text
+static int pg_query_ruby_log_dedup(PgQueryRubyLogAggregator *aggregator, PgQueryRubyLogChunk *chunk)
+{
+	size_t capacity = 16;
+	size_t *table;
+	size_t i;
+
+	while (capacity < chunk->count * 2) capacity *= 2;
+
+	table = calloc(capacity, sizeof(size_t));
+	chunk->work = malloc(chunk->count * sizeof(size_t) + 1);
+	if (table == NULL || chunk->work == NULL) {
+		free(table);
+		return -1;
+	}
+
+	for (i = 0; i < chunk->count; i++) {
+		PgQueryRubyLogStatement *statement = &chunk->statements[i];
+		size_t cached, slot;
+
+		statement->hash = pg_query_ruby_log_hash(statement->text, statement->len);
+		statement->same_as = i;
+
+		cached = aggregator->text_cache[statement->hash % PG_QUERY_RUBY_LOG_TEXT_CACHE_SIZE];
+		if (cached && pg_query_ruby_log_entry_text_equal(&aggregator->entries[cached - 1], statement)) {
+			statement->entry = cached;
+			continue;
+		}
+
+		for (slot = statement->hash & (capacity - 1); table[slot]; slot = (slot + 1) & (capacity - 1)) {
+			PgQueryRubyLogStatement *other = &chunk->statements[table[slot] - 1];
+			if (other->hash == statement->hash && other->len == statement->len &&
+				memcmp(other->text, statement->text, statement->len) == 0) {
+				statement->same_as = table[slot] - 1;
+				break;
+			}
+		}
+
+		if (!table[slot]) {
+			table[slot] = i + 1;
+			chunk->work[chunk->work_count++] = i;
+		}
+	}
+
+	free(table);
+	return 0;
+}
+
+static void pg_query_ruby_log_fingerprint_work(void *arg, size_t index)
+{
+	PgQueryRubyLogChunk *chunk = (PgQueryRubyLogChunk *) arg;
+	PgQueryRubyLogStatement *statement = &chunk->statements[chunk->work[index]];
+
+	statement->result = pg_query_tree_fingerprint_query(statement->text, 0, PG_QUERY_FINGERPRINT_VERSION, NULL, NULL, NULL);
+}
+
+static int pg_query_ruby_log_grow_slots(PgQueryRubyLogAggregator *aggregator)
+{
+	size_t capacity = aggregator->slots_capacity ? aggregator->slots_capacity * 2 : 64;
+	size_t *slots = calloc(capacity, sizeof(size_t));
+	size_t i, slot;
+
+	if (slots == NULL) return -1;
+
+	for (i = 0; i < aggregator->entries_count; i++) {
+		uint64_t hash = pg_query_ruby_log_hash(aggregator->entries[i].fingerprint, strlen(aggregator->entries[i].fingerprint));
+		for (slot = hash & (capacity - 1); slots[slot]; slot = (slot + 1) & (capacity - 1));
+		slots[slot] = i + 1;
+	}
+
+	free(aggregator->slots);
+	aggregator->slots = slots;
+	aggregator->slots_capacity = capacity;
+
+	return 0;
+}
+
+/*
+ * Returns the entry index + 1 for the fingerprint, adding an entry for the
+ * statement if there is none yet. Returns 0 if the table is full, and -1 when
+ * out of memory.
+ */
+static long pg_query_ruby_log_entry(PgQueryRubyLogAggregator *aggregator, const char *fingerprint, PgQueryRubyLogStatement *statement)
+{
+	uint64_t hash = pg_query_ruby_log_hash(fingerprint, strlen(fingerprint));
+	PgQueryRubyLogEntry *entry;
+	size_t slot;
+
+	if (aggregator->slots_capacity > 0) {
+		for (slot = hash & (aggregator->slots_capacity - 1); aggregator->slots[slot]; slot = (slot + 1) & (aggregator->slots_capacity - 1))
+			if (strcmp(aggregator->entries[aggregator->slots[slot] - 1].fingerprint, fingerprint) == 0)
+				return aggregator->slots[slot];
+	}
+
+	if (aggregator->entries_count >= aggregator->max_fingerprints) return 0;
+
+	if (aggregator->entries_count == aggregator->entries_capacity) {
+		size_t capacity = aggregator->entries_capacity ? aggregator->entries_capacity * 2 : 64;
+		PgQueryRubyLogEntry *entries = realloc(aggregator->entries, capacity * sizeof(PgQueryRubyLogEntry));
+		if (entries == NULL) return -1;
+		aggregator->entries = entries;
+		aggregator->entries_capacity = capacity;
+	}
+
+	// Keep the load factor at 50% at most
+	if ((aggregator->entries_count + 1) * 2 > aggregator->slots_capacity && pg_query_ruby_log_grow_slots(aggregator) != 0)
+		return -1;
+
+	entry = &aggregator->entries[aggregator->entries_count];
+	memset(entry, 0, sizeof(PgQueryRubyLogEntry));
+	strncpy(entry->fingerprint, fingerprint, PG_QUERY_FINGERPRINT_HEX_LENGTH);
+
+	entry->query_len = statement->len;
+	if (entry->query_len > aggregator->max_query_length) {
+		entry->query_len = aggregator->max_query_length;
+		// Don't cut a UTF-8 character in half
+		while (entry->query_len > 0 && (statement->text[entry->query_len] & 0xC0) == 0x80) entry->query_len--;
+		entry->query_truncated = 1;
+	}
+	entry->query = malloc(entry->query_len + 1);
+	if (entry->query == NULL) return -1;
+	memcpy(entry->query, statement->text, entry->query_len);
+	entry->query[entry->query_len] = '\0';
+
+	for (slot = hash & (aggregator->slots_capacity - 1); aggregator->slots[slot]; slot = (slot + 1) & (aggregator->slots_capacity - 1));
+	aggregator->slots[slot] = ++aggregator->entries_count;
+
+	return aggregator->entries_count;
+}
+
+static int pg_query_ruby_log_aggregate(PgQueryRubyLogAggregator *aggregator, PgQueryRubyLogChunk *chunk)
+{
+	size_t i;
+
+	for (i = 0; i < chunk->count; i++) {
+		PgQueryRubyLogStatement *statement = &chunk->statements[i];
+		PgQueryFingerprintResult *result = &chunk->statements[statement->same_as].result;
+		PgQueryRubyLogEntry *entry;
+		long index = statement->entry;
+
+		aggregator->statements++;
+
+		if (index == 0) {
+			if (result->error || result->hexdigest == NULL) {
+				aggregator->errors++;
+				continue;
+			}
+
+			index = pg_query_ruby_log_entry(aggregator, result->hexdigest, statement);
+			if (index < 0) return -1;
+			if (index == 0) {
+				aggregator->dropped++;
+				continue;
+			}
+
+			if (pg_query_ruby_log_entry_text_equal(&aggregator->entries[index - 1], statement))
+				aggregator->text_cache[statement->hash % PG_QUERY_RUBY_LOG_TEXT_CACHE_SIZE] = index;
+		}
+
+		entry = &aggregator->entries[index - 1];
+		entry->count++;
+		entry->total_ms += statement->duration;
+		if (statement->duration > entry->max_ms) entry->max_ms = statement->duration;
+	}
+
+	return 0;
+}
+
+static void pg_query_ruby_log_chunk_free(PgQueryRubyLogChunk *chunk)
+{
+	size_t i;
+
+	for (i = 0; i < chunk->count; i++) {
+		free(chunk->statements[i].text);
+		if (chunk->statements[i].same_as == i && chunk->statements[i].entry == 0)
+			pg_query_free_fingerprint_result(chunk->statements[i].result);
+	}
+
+	free(chunk->statements);
+	free(chunk->work);
+}
+
+// Processes all complete records in the buffer, runs without the GVL
+static void pg_query_ruby_log_process(PgQueryRubyLogAggregator *aggregator, int flush)
+{
+	PgQueryRubyLogChunk chunk = {0};
+	size_t start = 0;
+	size_t len;
+	int error = 0;
+
+	while (!error && (len = pg_query_ruby_log_next_record(aggregator, start, flush)) > 0) {
+		const char *str = aggregator->buffer + start;
+		const char *end = str + len;
+
+		// Trailing newlines (and carriage returns) aren't part of the message
+		while (end > str && (end[-1] == '\n' || end[-1] == '\r')) end--;
+
+		aggregator->records++;
+		if (aggregator->format == PG_QUERY_RUBY_LOG_CSVLOG)
+			error = pg_query_ruby_log_csvlog_record(&chunk, str, end) < 0;
+		else
+			error = pg_query_ruby_log_stderr_record(&chunk, str, end) < 0;
+
+		start += len;
+	}
+
+	if (!error && chunk.count > 0) {
+		error = pg_query_ruby_log_dedup(aggregator, &chunk) != 0;
+		if (!error) {
+			pg_query_pool_run(pg_query_ruby_log_fingerprint_work, &chunk, chunk.work_count, aggregator->threads);
+			error = pg_query_ruby_log_aggregate(aggregator, &chunk) != 0;
+		}
+	}
+
+	pg_query_ruby_log_chunk_free(&chunk);
+
+	if (error) {
+		aggregator->out_of_memory = 1;
+		return;
+	}
+
+	// Keep the incomplete record at the start of the buffer
+	memmove(aggregator->buffer, aggregator->buffer + start, aggregator->buffer_len - start + 1);
+	aggregator->buffer_len -= start;
+	aggregator->scan_offset -= start;
+}
+
+static void *pg_query_ruby_log_feed_without_gvl(void *arg)
+{
+	pg_query_ruby_log_process((PgQueryRubyLogAggregator *) arg, 0);
+	return NULL;
+}
+
+static void *pg_query_ruby_log_flush_without_gvl(void *arg)
+{
+	pg_query_ruby_log_process((PgQueryRubyLogAggregator *) arg, 1);
+	return NULL;
+}
+
+static void pg_query_ruby_log_aggregator_free(void *ptr)
+{
+	PgQueryRubyLogAggregator *aggregator = (PgQueryRubyLogAggregator *) ptr;
+	size_t i;
+
+	for (i = 0; i < aggregator->entries_count; i++)
+		free(aggregator->entries[i].query);
+
+	free(aggregator->entries);
+	free(aggregator->slots);
+	xfree(aggregator->buffer);
+	xfree(aggregator);
+}
+
+static size_t pg_query_ruby_log_aggregator_memsize(const void *ptr)
+{
+	const PgQueryRubyLogAggregator *aggregator = (const PgQueryRubyLogAggregator *) ptr;
+	size_t size = sizeof(PgQueryRubyLogAggregator) + aggregator->buffer_capacity +
+		aggregator->entries_capacity * sizeof(PgQueryRubyLogEntry) + aggregator->slots_capacity * sizeof(size_t);
+	size_t i;
+
+	for (i = 0; i < aggregator->entries_count; i++)
+		size += aggregator->entries[i].query_len + 1;
+
+	return size;
+}
+
+static const rb_data_type_t pg_query_ruby_log_aggregator_type = {
+	"PgQuery::LogAggregator",
+	{
+		NULL,
+		pg_query_ruby_log_aggregator_free,
+		pg_query_ruby_log_aggregator_memsize,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE pg_query_ruby_log_aggregator_alloc(VALUE klass)
+{
+	PgQueryRubyLogAggregator *aggregator;
+	VALUE self = TypedData_Make_Struct(klass, PgQueryRubyLogAggregator, &pg_query_ruby_log_aggregator_type, aggregator);
+
+	aggregator->buffer_capacity = 1;
+	aggregator->buffer = ALLOC_N(char, 1);
+	aggregator->buffer[0] = '\0';
+
+	return self;
+}
+
+/*
+ * Returns the aggregator, making sure it isn't being used by another thread
+ * at the same time (which can only happen while it runs without the GVL).
+ */
+static PgQueryRubyLogAggregator *pg_query_ruby_log_aggregator_get(VALUE self)
+{
+	PgQueryRubyLogAggregator *aggregator;
+
+	TypedData_Get_Struct(self, PgQueryRubyLogAggregator, &pg_query_ruby_log_aggregator_type, aggregator);
+
+	if (aggregator->busy) rb_raise(rb_eRuntimeError, "PgQuery::LogAggregator is in use by another thread");
+
+	return aggregator;
+}
+
+// Called by LogAggregator#initialize, which validates the arguments
+static VALUE pg_query_ruby_log_aggregator_setup(VALUE self, VALUE csvlog, VALUE max_fingerprints, VALUE max_query_length, VALUE threads)
+{
+	PgQueryRubyLogAggregator *aggregator = pg_query_ruby_log_aggregator_get(self);
+
+	aggregator->format = RTEST(csvlog) ? PG_QUERY_RUBY_LOG_CSVLOG : PG_QUERY_RUBY_LOG_STDERR;
+	aggregator->max_fingerprints = NUM2SIZET(max_fingerprints);
+	aggregator->max_query_length = NUM2SIZET(max_query_length);
+	aggregator->threads = NUM2INT(threads);
+
+	if (aggregator->threads < 1) aggregator->threads = 1;
+
+	return self;
+}
+
+static void pg_query_ruby_log_aggregator_run(VALUE self, PgQueryRubyLogAggregator *aggregator, void *(*func)(void *))
+{
+	aggregator->busy = 1;
+	pg_query_ruby_without_gvl(func, aggregator);
+	aggregator->busy = 0;
+
+	RB_GC_GUARD(self);
+
+	if (aggregator->out_of_memory) {
+		aggregator->out_of_memory = 0;
+		rb_memerror();
+	}
+}
+
+static VALUE pg_query_ruby_log_aggregator_feed(VALUE self, VALUE data)
+{
+	PgQueryRubyLogAggregator *aggregator = pg_query_ruby_log_aggregator_get(self);
+	size_t len;
+
+	StringValue(data);
+	len = RSTRING_LEN(data);
+
+	if (aggregator->buffer_len + len + 1 > aggregator->buffer_capacity) {
+		size_t capacity = aggregator->buffer_capacity * 2;
+		if (capacity < aggregator->buffer_len + len + 1) capacity = aggregator->buffer_len + len + 1;
+		REALLOC_N(aggregator->buffer, char, capacity);
+		aggregator->buffer_capacity = capacity;
+	}
+
+	memcpy(aggregator->buffer + aggregator->buffer_len, RSTRING_PTR(data), len);
+	aggregator->buffer_len += len;
+	aggregator->buffer[aggregator->buffer_len] = '\0';
+
+	pg_query_ruby_log_aggregator_run(self, aggregator, pg_query_ruby_log_feed_without_gvl);
+
+	return self;
+}
+
+static VALUE pg_query_ruby_log_aggregator_flush(VALUE self)
+{
+	PgQueryRubyLogAggregator *aggregator = pg_query_ruby_log_aggregator_get(self);
+
+	pg_query_ruby_log_aggregator_run(self, aggregator, pg_query_ruby_log_flush_without_gvl);
+
+	return self;
+}
+
+// Returns [fingerprint, query, count, total_ms, max_ms] for each fingerprint, in the order they were first seen
+static VALUE pg_query_ruby_log_aggregator_entries(VALUE self)
+{
+	PgQueryRubyLogAggregator *aggregator = pg_query_ruby_log_aggregator_get(self);
+	VALUE output = rb_ary_new_capa(aggregator->entries_count);
+	size_t i;
+
+	for (i = 0; i < aggregator->entries_count; i++) {
+		PgQueryRubyLogEntry *entry = &aggregator->entries[i];
+
+		rb_ary_push(output, rb_ary_new_from_args(5, rb_str_new2(entry->fingerprint),
+												 rb_enc_str_new(entry->query, entry->query_len, rb_utf8_encoding()),
+												 ULL2NUM(entry->count), DBL2NUM(entry->total_ms), DBL2NUM(entry->max_ms)));
+	}
+
+	return output;
+}
+
+// Returns [records, statements, errors, dropped]
+static VALUE pg_query_ruby_log_aggregator_stats(VALUE self)
+{
+	PgQueryRubyLogAggregator *aggregator = pg_query_ruby_log_aggregator_get(self);
+
+	return rb_ary_new_from_args(4, ULL2NUM(aggregator->records), ULL2NUM(aggregator->statements),
+								ULL2NUM(aggregator->errors), ULL2NUM(aggregator->dropped));
+}
+
+static VALUE pg_query_ruby_log_aggregator_size(VALUE self)
+{
+	return SIZET2NUM(pg_query_ruby_log_aggregator_get(self)->entries_count);
+}
+
+void Init_pg_query_log(VALUE cPgQuery)
+{
+	VALUE cLogAggregator = rb_define_class_under(cPgQuery, "LogAggregator", rb_cObject);
+
+	rb_define_alloc_func(cLogAggregator, pg_query_ruby_log_aggregator_alloc);
+
+	rb_define_private_method(cLogAggregator, "_setup", pg_query_ruby_log_aggregator_setup, 4);
+	rb_define_method(cLogAggregator, "<<", pg_query_ruby_log_aggregator_feed, 1);
+	rb_define_method(cLogAggregator, "flush", pg_query_ruby_log_aggregator_flush, 0);
+	rb_define_method(cLogAggregator, "size", pg_query_ruby_log_aggregator_size, 0);
+	rb_define_private_method(cLogAggregator, "_entries", pg_query_ruby_log_aggregator_entries, 0);
+	rb_define_private_method(cLogAggregator, "_stats", pg_query_ruby_log_aggregator_stats, 0);
+}
@@ -0,0 +1,318 @@
+#include "pg_query_ruby.h"
+
+/*
+ * PgQuery::NativeTree - a parse tree that stays in its native representation,
+ * with Ruby objects only created for the parts that are asked for. See
+ * PgQuery.parse(query, lazy: true).
+ *
+ * The tree is never modified after parsing, so a NativeTree can be shared
+ * freely, e.g. by PgQuery.cache.
+ */
+
+typedef struct {
+	PgQueryTree tree;
+	VALUE keys; // Ruby Strings for the tree's keys, created as they are needed
+} PgQueryRubyNativeTree;
+
+static void pg_query_ruby_native_tree_mark(void *ptr)
+{
+	PgQueryRubyNativeTree *native_tree = (PgQueryRubyNativeTree *) ptr;
+
+	rb_gc_mark(native_tree->keys);
+}
+
+static void pg_query_ruby_native_tree_free(void *ptr)
+{
+	PgQueryRubyNativeTree *native_tree = (PgQueryRubyNativeTree *) ptr;
+
+	pg_query_tree_free(&native_tree->tree);
+	xfree(native_tree);
+}
+
+static size_t pg_query_ruby_native_tree_memsize(const void *ptr)
+{
+	const PgQueryRubyNativeTree *native_tree = (const PgQueryRubyNativeTree *) ptr;
+
+	return sizeof(PgQueryRubyNativeTree) + native_tree->tree.memsize;
+}
+
+static const rb_data_type_t pg_query_ruby_native_tree_type = {
+	"PgQuery::NativeTree",
+	{
+		pg_query_ruby_native_tree_mark,
+		pg_query_ruby_native_tree_free,
+		pg_query_ruby_native_tree_memsize,
+	},
+	0, 0,
+	RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE cNativeTree;
+
+static PgQueryRubyNativeTree *pg_query_ruby_native_tree_get(VALUE self)
+{
+	PgQueryRubyNativeTree *native_tree;
+
+	TypedData_Get_Struct(self, PgQueryRubyNativeTree, &pg_query_ruby_native_tree_type, native_tree);
+
+	return native_tree;
+}
+
+static PgQueryRubyTreeBuilder pg_query_ruby_native_tree_builder(PgQueryRubyNativeTree *native_tree)
+{
+	PgQueryRubyTreeBuilder builder;
+
+	builder.tree = &native_tree->tree;
+	builder.keys = native_tree->keys;
+
+	return builder;
+}
+
+/*
+ * Takes ownership of the call's tree (which is left empty), returns
+ * [NativeTree, warnings].
+ */
+static VALUE pg_query_ruby_native_tree_build(VALUE arg)
+{
+	PgQueryRubyParseTreeCall *call = (PgQueryRubyParseTreeCall *) arg;
+	PgQueryRubyNativeTree *native_tree;
+	VALUE self, output;
+
+	self = TypedData_Make_Struct(cNativeTree, PgQueryRubyNativeTree, &pg_query_ruby_native_tree_type, native_tree);
+	native_tree->keys = rb_ary_new_capa(call->tree.keys_count);
+	native_tree->tree = call->tree;
+	pg_query_tree_init(&call->tree);
+
+	output = rb_ary_new();
+
+	rb_ary_push(output, self);
+	rb_ary_push(output, pg_query_ruby_warnings(&call->result));
+
+	return output;
+}
+
+static VALUE pg_query_ruby_parse_native_call(VALUE input, int try)
+{
+	PgQueryRubyParseTreeCall call = {0};
+
+	pg_query_tree_init(&call.tree);
+
+	call.input = pg_query_ruby_input_dup(input);
+	pg_query_ruby_without_gvl(pg_query_ruby_parse_tree_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error) {
+		VALUE error = try ? new_ruby_parse_result(call.result.error) : new_ruby_parse_error(call.result.error);
+		pg_query_ruby_parse_tree_cleanup((VALUE) &call);
+		if (try) return error;
+		rb_exc_raise(error);
+	}
+
+	if (call.tree_error) {
+		pg_query_ruby_parse_tree_cleanup((VALUE) &call);
+		if (try) return new_ruby_tree_result();
+		rb_exc_raise(new_ruby_tree_error());
+	}
+
+	pg_query_ruby_record_stats(&call.result.stats, "tree", call.tree_ns, call.tree.buffer_len);
+
+	return rb_ensure(pg_query_ruby_native_tree_build, (VALUE) &call, pg_query_ruby_parse_tree_cleanup, (VALUE) &call);
+}
+
+static VALUE pg_query_ruby_parse_native(VALUE self, VALUE input)
+{
+	return pg_query_ruby_parse_native_call(input, 0);
+}
+
+// Like _raw_parse_native, but returns a failed PgQuery::Result on errors
+static VALUE pg_query_ruby_try_parse_native(VALUE self, VALUE input)
+{
+	return pg_query_ruby_parse_native_call(input, 1);
+}
+
+// Number of statements
+static VALUE pg_query_ruby_native_tree_size(VALUE self)
+{
+	PgQueryRubyNativeTree *native_tree = pg_query_ruby_native_tree_get(self);
+
+	return SIZET2NUM(native_tree->tree.root.len);
+}
+
+// Builds the whole tree, same as PgQuery#tree of a regular parse
+static VALUE pg_query_ruby_native_tree_to_a(VALUE self)
+{
+	PgQueryRubyNativeTree *native_tree = pg_query_ruby_native_tree_get(self);
+	PgQueryRubyTreeBuilder builder = pg_query_ruby_native_tree_builder(native_tree);
+
+	return pg_query_ruby_tree_value_to_ruby(&builder, &native_tree->tree.root);
+}
+
+/*
+ * Like Array#dig on the full tree, but only builds the value at the end of the
+ * path (Integer indexes into arrays, String keys into objects). Returns nil if
+ * there is no such value.
+ */
+static VALUE pg_query_ruby_native_tree_dig(int argc, VALUE *argv, VALUE self)
+{
+	PgQueryRubyNativeTree *native_tree = pg_query_ruby_native_tree_get(self);
+	PgQueryRubyTreeBuilder builder = pg_query_ruby_native_tree_builder(native_tree);
+	PgQueryTreeValue *value = &native_tree->tree.root;
+	int i;
+
+	for (i = 0; i < argc && value != NULL; i++) {
+		if (value->type == PG_QUERY_TREE_ARRAY && FIXNUM_P(argv[i])) {
+			long index = FIX2LONG(argv[i]);
+			if (index < 0) index += (long) value->len;
+			value = (index >= 0 && (size_t) index < value->len) ? &value->u.items[index] : NULL;
+		} else if (value->type == PG_QUERY_TREE_OBJECT && RB_TYPE_P(argv[i], T_STRING)) {
+			value = pg_query_tree_object_get(&native_tree->tree, value, StringValueCStr(argv[i]));
+		} else {
+			value = NULL;
+		}
+	}
+
+	if (value == NULL) return Qnil;
+
+	return pg_query_ruby_tree_value_to_ruby(&builder, value);
+}
+
+static VALUE pg_query_ruby_native_tree_aref(VALUE self, VALUE index)
+{
+	return pg_query_ruby_native_tree_dig(1, &index, self);
+}
+
+typedef struct {
+	PgQueryTree *tree;
+	int version;
+	char fingerprint[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1];
+	uint64_t hash;
+	int error;
+} PgQueryRubyNativeTreeFingerprintCall;
+
+static void *pg_query_ruby_native_tree_fingerprint_without_gvl(void *arg)
+{
+	PgQueryRubyNativeTreeFingerprintCall *call = (PgQueryRubyNativeTreeFingerprintCall *) arg;
+	if (call->version == PG_QUERY_FINGERPRINT_VERSION_XXH64)
+		call->error = pg_query_tree_fingerprint_xxh64(call->tree, &call->hash);
+	else
+		call->error = pg_query_tree_fingerprint(call->tree, call->fingerprint);
+	return NULL;
+}
+
+// Same as PgQuery#fingerprint of the full tree, optionally with the fingerprint version
+static VALUE pg_query_ruby_native_tree_fingerprint(int argc, VALUE *argv, VALUE self)
+{
+	PgQueryRubyNativeTree *native_tree = pg_query_ruby_native_tree_get(self);
+	PgQueryRubyNativeTreeFingerprintCall call;
+	VALUE version;
+
+	rb_scan_args(argc, argv, "01", &version);
+
+	call.tree = &native_tree->tree;
+	call.version = NIL_P(version) ? PG_QUERY_FINGERPRINT_VERSION : pg_query_ruby_fingerprint_version(version);
+	pg_query_ruby_without_gvl(pg_query_ruby_native_tree_fingerprint_without_gvl, &call);
+
+	RB_GC_GUARD(self);
+
+	if (call.error) rb_exc_raise(new_ruby_tree_error());
+
+	if (call.version == PG_QUERY_FINGERPRINT_VERSION_XXH64) return pg_query_ruby_fingerprint_int(call.hash);
+
+	return rb_str_new2(call.fingerprint);
+}
+
+typedef struct {
+	PgQueryTree *tree;
+	char *output;
+	size_t output_len;
+	int error;
+} PgQueryRubyNativeTreeDeparseCall;
+
+static void *pg_query_ruby_native_tree_deparse_without_gvl(void *arg)
+{
+	PgQueryRubyNativeTreeDeparseCall *call = (PgQueryRubyNativeTreeDeparseCall *) arg;
+	call->error = pg_query_tree_deparse(call->tree, &call->tree->root, &call->output, &call->output_len);
+	return NULL;
+}
+
+// Same as PgQuery#deparse of the full tree, or nil if it needs the Ruby implementation
+static VALUE pg_query_ruby_native_tree_deparse(VALUE self)
+{
+	PgQueryRubyNativeTree *native_tree = pg_query_ruby_native_tree_get(self);
+	PgQueryRubyNativeTreeDeparseCall call;
+	VALUE output;
+
+	call.tree = &native_tree->tree;
+	call.output = NULL;
+	call.output_len = 0;
+	pg_query_ruby_without_gvl(pg_query_ruby_native_tree_deparse_without_gvl, &call);
+
+	RB_GC_GUARD(self);
+
+	if (call.error) return Qnil;
+
+	output = rb_enc_str_new(call.output, call.output_len, rb_utf8_encoding());
+	free(call.output);
+
+	return output;
+}
+
+static VALUE pg_query_ruby_native_tree_tables_walk(VALUE arg)
+{
+	PgQueryRubyAnalyzeWalk *walk = (PgQueryRubyAnalyzeWalk *) arg;
+	VALUE output;
+
+	pg_query_ruby_analyze_tables(walk);
+
+	output = rb_ary_new_capa(3);
+	rb_ary_push(output, walk->tables);
+	rb_ary_push(output, walk->cte_names);
+	rb_ary_push(output, walk->aliases);
+
+	return output;
+}
+
+static VALUE pg_query_ruby_native_tree_tables_cleanup(VALUE arg)
+{
+	pg_query_ruby_analyze_walk_free((PgQueryRubyAnalyzeWalk *) arg);
+	return Qnil;
+}
+
+// Returns [tables with types, CTE names, aliases], as in PgQuery#load_tables_and_aliases!
+static VALUE pg_query_ruby_native_tree_tables_and_aliases(VALUE self)
+{
+	PgQueryRubyNativeTree *native_tree = pg_query_ruby_native_tree_get(self);
+	PgQueryRubyAnalyzeWalk walk;
+	VALUE output;
+
+	pg_query_ruby_analyze_walk_init(&walk, pg_query_ruby_native_tree_builder(native_tree));
+
+	output = rb_ensure(pg_query_ruby_native_tree_tables_walk, (VALUE) &walk, pg_query_ruby_native_tree_tables_cleanup, (VALUE) &walk);
+
+	RB_GC_GUARD(self);
+
+	return output;
+}
+
+static VALUE pg_query_ruby_native_tree_memsize_method(VALUE self)
+{
+	return SIZET2NUM(pg_query_ruby_native_tree_memsize(pg_query_ruby_native_tree_get(self)));
+}
+
+void Init_pg_query_native_tree(VALUE cPgQuery)
+{
+	cNativeTree = rb_define_class_under(cPgQuery, "NativeTree", rb_cObject);
+	rb_undef_alloc_func(cNativeTree);
+
+	rb_define_singleton_method(cPgQuery, "_raw_parse_native", pg_query_ruby_parse_native, 1);
+	rb_define_singleton_method(cPgQuery, "_try_parse_native", pg_query_ruby_try_parse_native, 1);
+
+	rb_define_method(cNativeTree, "size", pg_query_ruby_native_tree_size, 0);
+	rb_define_method(cNativeTree, "to_a", pg_query_ruby_native_tree_to_a, 0);
+	rb_define_method(cNativeTree, "dig", pg_query_ruby_native_tree_dig, -1);
+	rb_define_method(cNativeTree, "[]", pg_query_ruby_native_tree_aref, 1);
+	rb_define_method(cNativeTree, "fingerprint", pg_query_ruby_native_tree_fingerprint, -1);
+	rb_define_method(cNativeTree, "deparse", pg_query_ruby_native_tree_deparse, 0);
+	rb_define_method(cNativeTree, "tables_and_aliases", pg_query_ruby_native_tree_tables_and_aliases, 0);
+	rb_define_method(cNativeTree, "memsize", pg_query_ruby_native_tree_memsize_method, 0);
+}
@@ -0,0 +1,1279 @@
+#include "pg_query_ruby_parser.h"
+
+#include "pg_query_internal.h"
+#include "pg_query_json.h"
+
+#include "parser/parser.h"
+#include "parser/scanner.h"
+#include "parser/scansup.h"
+#include "parser/gram.h" // after parser.h, for the types its YYSTYPE uses
+#include "nodes/nodeFuncs.h"
+#include "utils/memutils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Per-thread arenas, see pg_query_parser_set_arenas
+ */
+
+// Size of the block a reset arena keeps, enough for most short queries
+#define PG_QUERY_PARSER_ARENA_SIZE (64 * 1024)
+
+#define PG_QUERY_PARSER_REUSED_BUFFERS 2
+#define PG_QUERY_PARSER_MAX_REUSED_BUFFER (256 * 1024)
+
+// Reused buffers start with their capacity, followed by the text
+typedef struct {
+	size_t capacity;
+} PgQueryParserBuffer;
+
+typedef struct {
+	MemoryContext arena;
+	PgQueryParserBuffer *buffers[PG_QUERY_PARSER_REUSED_BUFFERS];
+} PgQueryParserThreadState;
+
+static volatile int pg_query_parser_arenas_enabled = 0;
+static pthread_once_t pg_query_parser_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pg_query_parser_thread_key;
+
+static void pg_query_parser_thread_state_free(void *ptr)
+{
+	PgQueryParserThreadState *state = (PgQueryParserThreadState *) ptr;
+	int i;
+
+	// Runs on the exiting thread, whose (thread-local) TopMemoryContext is still around
+	if (state->arena != NULL) MemoryContextDelete(state->arena);
+
+	for (i = 0; i < PG_QUERY_PARSER_REUSED_BUFFERS; i++)
+		free(state->buffers[i]);
+
+	free(state);
+}
+
+static void pg_query_parser_thread_key_create(void)
+{
+	pthread_key_create(&pg_query_parser_thread_key, pg_query_parser_thread_state_free);
+}
+
+// Returns NULL when out of memory
+static PgQueryParserThreadState *pg_query_parser_thread_state(void)
+{
+	PgQueryParserThreadState *state;
+
+	pthread_once(&pg_query_parser_thread_once, pg_query_parser_thread_key_create);
+
+	state = pthread_getspecific(pg_query_parser_thread_key);
+	if (state == NULL) {
+		state = calloc(1, sizeof(PgQueryParserThreadState));
+		if (state == NULL || pthread_setspecific(pg_query_parser_thread_key, state) != 0) {
+			free(state);
+			return NULL;
+		}
+	}
+
+	return state;
+}
+
+void pg_query_parser_set_arenas(int enabled)
+{
+	pg_query_parser_arenas_enabled = enabled;
+}
+
+int pg_query_parser_arenas(void)
+{
+	return pg_query_parser_arenas_enabled;
+}
+
+/*
+ * Same as pg_query_enter_memory_context, but switches to the thread's arena
+ * when arenas are enabled
+ */
+static MemoryContext pg_query_parser_enter_memory_context(const char *ctx_name)
+{
+	PgQueryParserThreadState *state;
+
+	if (!pg_query_parser_arenas_enabled || (state = pg_query_parser_thread_state()) == NULL)
+		return pg_query_enter_memory_context(ctx_name);
+
+	pg_query_init();
+
+	if (state->arena == NULL)
+		state->arena = AllocSetContextCreate(TopMemoryContext, "pg_query_parser_arena", PG_QUERY_PARSER_ARENA_SIZE,
+											 ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(state->arena);
+
+	return state->arena;
+}
+
+static void pg_query_parser_exit_memory_context(MemoryContext ctx)
+{
+	PgQueryParserThreadState *state;
+
+	pthread_once(&pg_query_parser_thread_once, pg_query_parser_thread_key_create);
+	state = pthread_getspecific(pg_query_parser_thread_key);
+
+	if (state == NULL || ctx != state->arena) {
+		pg_query_exit_memory_context(ctx);
+		return;
+	}
+
+	// Frees everything but the initial block
+	MemoryContextSwitchTo(TopMemoryContext);
+	MemoryContextReset(ctx);
+}
+
+/*
+ * Copies str into a malloc-ed string, or a reused buffer (if reuse is set),
+ * erroring out when out of memory.
+ */
+static char *pg_query_parser_output(const char *str, int reuse)
+{
+	size_t size = strlen(str) + 1;
+	PgQueryParserThreadState *state = reuse ? pg_query_parser_thread_state() : NULL;
+	PgQueryParserBuffer *buffer = NULL;
+	char *output;
+	int i, found = -1;
+
+	if (state == NULL) {
+		output = malloc(size);
+		if (output == NULL) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+		memcpy(output, str, size);
+		return output;
+	}
+
+	// Take a buffer that is large enough, or otherwise any one to grow
+	for (i = 0; i < PG_QUERY_PARSER_REUSED_BUFFERS; i++) {
+		if (state->buffers[i] == NULL) continue;
+		if (found < 0 || state->buffers[i]->capacity >= size) found = i;
+		if (state->buffers[i]->capacity >= size) break;
+	}
+
+	if (found >= 0) {
+		buffer = state->buffers[found];
+		state->buffers[found] = NULL;
+	}
+
+	if (buffer == NULL || buffer->capacity < size) {
+		PgQueryParserBuffer *grown = realloc(buffer, sizeof(PgQueryParserBuffer) + size);
+		if (grown == NULL) {
+			free(buffer);
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+		}
+		buffer = grown;
+		buffer->capacity = size;
+	}
+
+	output = (char *) (buffer + 1);
+	memcpy(output, str, size);
+
+	return output;
+}
+
+void pg_query_parser_release_buffer(char *output)
+{
+	PgQueryParserBuffer *buffer;
+	PgQueryParserThreadState *state;
+	int i;
+
+	if (output == NULL) return;
+
+	buffer = ((PgQueryParserBuffer *) output) - 1;
+
+	// Keep it for the next call on this thread, unless it is unusually large
+	if (buffer->capacity <= PG_QUERY_PARSER_MAX_REUSED_BUFFER && (state = pg_query_parser_thread_state()) != NULL) {
+		for (i = 0; i < PG_QUERY_PARSER_REUSED_BUFFERS; i++) {
+			if (state->buffers[i] == NULL) {
+				state->buffers[i] = buffer;
+				return;
+			}
+		}
+	}
+
+	free(buffer);
+}
+
+static void pg_query_parser_free_output(char *output, int reused)
+{
+	if (reused)
+		pg_query_parser_release_buffer(output);
+	else
+		free(output);
+}
+
+/*
+ * Constant tracking and normalization, following pg_query_normalize in
+ * libpg_query (which in turn is based on pg_stat_statements), so that
+ * normalized queries are identical to what PgQuery.normalize returns.
+ */
+
+typedef struct {
+	int location; // start offset in query text
+	int length;   // length in bytes, or -1 to ignore
+	PgQueryParserConstType type;
+} PgQueryParserConstLocation;
+
+typedef struct {
+	PgQueryParserConstLocation *clocations;
+	int clocations_buf_size;
+	int clocations_count;
+
+	// Highest ParamRef number seen, numbering of replaced constants continues after it
+	int highest_extern_param_id;
+} PgQueryParserConstLocations;
+
+static void pg_query_parser_const_locations_init(PgQueryParserConstLocations *jstate)
+{
+	jstate->clocations_buf_size = 32;
+	jstate->clocations = (PgQueryParserConstLocation *) palloc(jstate->clocations_buf_size * sizeof(PgQueryParserConstLocation));
+	jstate->clocations_count = 0;
+	jstate->highest_extern_param_id = 0;
+}
+
+static void pg_query_parser_record_const_location(PgQueryParserConstLocations *jstate, A_Const *node)
+{
+	int location = node->location;
+
+	// -1 indicates unknown or undefined location
+	if (location < 0) return;
+
+	if (jstate->clocations_count >= jstate->clocations_buf_size) {
+		jstate->clocations_buf_size *= 2;
+		jstate->clocations = (PgQueryParserConstLocation *)
+			repalloc(jstate->clocations, jstate->clocations_buf_size * sizeof(PgQueryParserConstLocation));
+	}
+
+	jstate->clocations[jstate->clocations_count].location = location;
+	jstate->clocations[jstate->clocations_count].length = -1;
+
+	switch (node->val.type) {
+		case T_Integer:
+			jstate->clocations[jstate->clocations_count].type = PG_QUERY_PARSER_CONST_INTEGER;
+			break;
+		case T_Float:
+			jstate->clocations[jstate->clocations_count].type = PG_QUERY_PARSER_CONST_FLOAT;
+			break;
+		case T_BitString:
+			jstate->clocations[jstate->clocations_count].type = PG_QUERY_PARSER_CONST_BITSTRING;
+			break;
+		case T_Null:
+			jstate->clocations[jstate->clocations_count].type = PG_QUERY_PARSER_CONST_NULL;
+			break;
+		default:
+			// Also booleans (TRUE is the string 't', cast to bool)
+			jstate->clocations[jstate->clocations_count].type = PG_QUERY_PARSER_CONST_STRING;
+			break;
+	}
+
+	jstate->clocations_count++;
+}
+
+static bool pg_query_parser_const_record_walker(Node *node, PgQueryParserConstLocations *jstate)
+{
+	bool result;
+
+	if (node == NULL) return false;
+
+	if (IsA(node, A_Const)) {
+		pg_query_parser_record_const_location(jstate, (A_Const *) node);
+	} else if (IsA(node, ParamRef)) {
+		if (((ParamRef *) node)->number > jstate->highest_extern_param_id)
+			jstate->highest_extern_param_id = ((ParamRef *) node)->number;
+	} else if (IsA(node, DefElem)) {
+		return pg_query_parser_const_record_walker((Node *) ((DefElem *) node)->arg, jstate);
+	} else if (IsA(node, RawStmt)) {
+		return pg_query_parser_const_record_walker((Node *) ((RawStmt *) node)->stmt, jstate);
+	} else if (IsA(node, VariableSetStmt)) {
+		return pg_query_parser_const_record_walker((Node *) ((VariableSetStmt *) node)->args, jstate);
+	} else if (IsA(node, CopyStmt)) {
+		return pg_query_parser_const_record_walker((Node *) ((CopyStmt *) node)->query, jstate);
+	} else if (IsA(node, ExplainStmt)) {
+		return pg_query_parser_const_record_walker((Node *) ((ExplainStmt *) node)->query, jstate);
+	} else if (IsA(node, AlterRoleStmt)) {
+		return pg_query_parser_const_record_walker((Node *) ((AlterRoleStmt *) node)->options, jstate);
+	} else if (IsA(node, DeclareCursorStmt)) {
+		return pg_query_parser_const_record_walker((Node *) ((DeclareCursorStmt *) node)->query, jstate);
+	}
+
+	// The walker errors out on (utility) statements it doesn't know, skip those
+	PG_TRY();
+	{
+		result = raw_expression_tree_walker(node, pg_query_parser_const_record_walker, (void *) jstate);
+	}
+	PG_CATCH();
+	{
+		FlushErrorState();
+		result = false;
+	}
+	PG_END_TRY();
+
+	return result;
+}
+
+static int pg_query_parser_comp_location(const void *a, const void *b)
+{
+	int l = ((const PgQueryParserConstLocation *) a)->location;
+	int r = ((const PgQueryParserConstLocation *) b)->location;
+
+	if (l < r) return -1;
+	if (l > r) return 1;
+	return 0;
+}
+
+/*
+ * The tree only has the start of each constant, get their lengths by running
+ * the lexer over the query again. Also sorts the locations.
+ */
+static void pg_query_parser_fill_in_constant_lengths(PgQueryParserConstLocations *jstate, const char *query)
+{
+	PgQueryParserConstLocation *locs;
+	core_yyscan_t yyscanner;
+	core_yy_extra_type yyextra;
+	core_YYSTYPE yylval;
+	YYLTYPE yylloc;
+	int last_loc = -1;
+	int i;
+
+	if (jstate->clocations_count > 1)
+		qsort(jstate->clocations, jstate->clocations_count, sizeof(PgQueryParserConstLocation), pg_query_parser_comp_location);
+	locs = jstate->clocations;
+
+	yyscanner = scanner_init(query, &yyextra, ScanKeywords, NumScanKeywords);
+
+	for (i = 0; i < jstate->clocations_count; i++) {
+		int loc = locs[i].location;
+		int tok;
+
+		if (loc <= last_loc) continue; // Duplicate constant, ignore
+
+		// Lex tokens until we find the desired constant
+		for (;;) {
+			tok = core_yylex(&yylval, &yylloc, yyscanner);
+			if (tok == 0) break;
+
+			if (yylloc >= loc) {
+				// Negative value - the only case where we replace more than one token
+				if (query[loc] == '-') {
+					tok = core_yylex(&yylval, &yylloc, yyscanner);
+					if (tok == 0) break;
+				}
+
+				// Flex places a zero byte after the text of the current token in scanbuf
+				locs[i].length = (int) strlen(yyextra.scanbuf + loc);
+
+				/*
+				 * The lexer consumes trailing whitespace after U&'' strings to find a
+				 * UESCAPE, don't count that as part of the constant.
+				 */
+				if (locs[i].length > 4 &&
+					(yyextra.scanbuf[loc] == 'u' || yyextra.scanbuf[loc] == 'U') &&
+					yyextra.scanbuf[loc + 1] == '&' && yyextra.scanbuf[loc + 2] == '\'') {
+					int j = locs[i].length - 1;
+					for (; j >= 0 && scanner_isspace(yyextra.scanbuf[loc + j]); j--) {}
+					locs[i].length = j + 1;
+				}
+
+				break;
+			}
+		}
+
+		// If we hit end-of-string, give up, leaving remaining lengths -1
+		if (tok == 0) break;
+
+		last_loc = loc;
+	}
+
+	scanner_finish(yyscanner);
+}
+
+static char *pg_query_parser_generate_normalized_query(PgQueryParserConstLocations *jstate, const char *query)
+{
+	char *norm_query;
+	int query_len = (int) strlen(query);
+	int i,
+		len_to_wrt,       // length (in bytes) to write
+		quer_loc = 0,     // source query byte location
+		n_quer_loc = 0,   // normalized query byte location
+		last_off = 0,     // offset from start for previous token
+		last_tok_len = 0; // length (in bytes) of that token
+
+	pg_query_parser_fill_in_constant_lengths(jstate, query);
+
+	// A "$n" placeholder can be longer than the constant it replaces
+	norm_query = palloc(query_len + jstate->clocations_count * 10 + 1);
+
+	for (i = 0; i < jstate->clocations_count; i++) {
+		int off = jstate->clocations[i].location;
+		int tok_len = jstate->clocations[i].length;
+
+		if (tok_len < 0) continue; // ignore any duplicates
+
+		// Copy next chunk (what precedes the next constant)
+		len_to_wrt = off - last_off;
+		len_to_wrt -= last_tok_len;
+
+		memcpy(norm_query + n_quer_loc, query + quer_loc, len_to_wrt);
+		n_quer_loc += len_to_wrt;
+
+		// And insert a param symbol in place of the constant token
+		n_quer_loc += sprintf(norm_query + n_quer_loc, "$%d", i + 1 + jstate->highest_extern_param_id);
+
+		quer_loc = off + tok_len;
+		last_off = off;
+		last_tok_len = tok_len;
+	}
+
+	// Copy over the remaining bytes after the last constant
+	len_to_wrt = query_len - quer_loc;
+
+	memcpy(norm_query + n_quer_loc, query + quer_loc, len_to_wrt);
+	n_quer_loc += len_to_wrt;
+
+	norm_query[n_quer_loc] = '\0';
+
+	return norm_query;
+}
+
+// The constants that were replaced in the normalized query (and their $n)
+static int pg_query_parser_constants(PgQueryParserConstLocations *jstate, PgQueryParserConstant *constants)
+{
+	int i, count = 0;
+
+	for (i = 0; i < jstate->clocations_count; i++) {
+		if (jstate->clocations[i].length < 0) continue;
+
+		constants[count].location = jstate->clocations[i].location;
+		constants[count].length = jstate->clocations[i].length;
+		constants[count].param = i + 1 + jstate->highest_extern_param_id;
+		constants[count].type = jstate->clocations[i].type;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Returns the normalized query. Unless constants is NULL, also returns the
+ * constants it replaced, as a malloc-ed array of constants_count entries.
+ */
+static char *pg_query_parser_normalize(List *tree, const char *input, PgQueryParserConstant **constants, int *constants_count)
+{
+	PgQueryParserConstLocations jstate;
+	char *normalized_query;
+
+	pg_query_parser_const_locations_init(&jstate);
+	pg_query_parser_const_record_walker((Node *) tree, &jstate);
+
+	normalized_query = pg_query_parser_generate_normalized_query(&jstate, input);
+
+	if (constants != NULL) {
+		*constants = malloc(sizeof(PgQueryParserConstant) * (jstate.clocations_count + 1));
+		if (*constants == NULL) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+		*constants_count = pg_query_parser_constants(&jstate, *constants);
+	}
+
+	return normalized_query;
+}
+
+static void pg_query_parser_free_statements(PgQueryParserStatement *statements, int count)
+{
+	int i;
+
+	if (statements == NULL) return;
+
+	for (i = 0; i < count; i++)
+		free(statements[i].normalized_query);
+	free(statements);
+}
+
+/*
+ * Normalizes each statement on its own, so that its normalized text is the
+ * same as if only its text had been normalized (with constants numbered from
+ * $1 in each statement). Returns a malloc-ed array of count statements.
+ */
+static PgQueryParserStatement *pg_query_parser_statements(List *tree, const char *input, int *count)
+{
+	PgQueryParserStatement *statements, *copy;
+	char **normalized;
+	int input_len = (int) strlen(input);
+	int i = 0, j;
+	ListCell *lc;
+
+	statements = palloc(sizeof(PgQueryParserStatement) * (list_length(tree) + 1));
+	normalized = palloc(sizeof(char *) * (list_length(tree) + 1));
+
+	foreach(lc, tree) {
+		RawStmt *raw_stmt = (RawStmt *) lfirst(lc);
+		PgQueryParserConstLocations jstate;
+		int location = raw_stmt->stmt_location > 0 ? raw_stmt->stmt_location : 0;
+		// A length of 0 means the rest of the input
+		int length = raw_stmt->stmt_len > 0 ? raw_stmt->stmt_len : input_len - location;
+
+		pg_query_parser_const_locations_init(&jstate);
+		pg_query_parser_const_record_walker((Node *) raw_stmt, &jstate);
+
+		for (j = 0; j < jstate.clocations_count; j++)
+			jstate.clocations[j].location -= location;
+
+		statements[i].location = location;
+		statements[i].length = length;
+		normalized[i] = pg_query_parser_generate_normalized_query(&jstate, pnstrdup(input + location, length));
+		i++;
+	}
+
+	// Everything so far was allocated in the memory context, copy it out of there
+	copy = malloc(sizeof(PgQueryParserStatement) * (i + 1));
+	if (copy == NULL) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+
+	for (j = 0; j < i; j++) {
+		copy[j] = statements[j];
+		copy[j].normalized_query = strdup(normalized[j]);
+		if (copy[j].normalized_query == NULL) {
+			pg_query_parser_free_statements(copy, j);
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+		}
+	}
+
+	*count = i;
+
+	return copy;
+}
+
+/*
+ * Spans of the parts of each statement that truncation can omit, so they can
+ * be replaced in the query text itself. The tree only has the start of these
+ * (or of their first node), their end is found among the query's tokens, by
+ * skipping over parentheses until a token that ends the part.
+ */
+
+typedef struct {
+	PgQueryParserToken *tokens; // Including comments, which are skipped
+	int tokens_count;
+	PgQueryParserSpan *spans;
+	int spans_count;
+	int spans_capacity;
+	int depth; // of the node being walked
+} PgQueryParserSpans;
+
+static void pg_query_parser_scan_tokens(const char *input, PgQueryParserScanResult *result);
+
+// Index of the first token (that isn't a comment) starting at or after location
+static int pg_query_parser_span_token(PgQueryParserSpans *spans, int location)
+{
+	int low = 0, high = spans->tokens_count;
+
+	while (low < high) {
+		int mid = low + (high - low) / 2;
+		if (spans->tokens[mid].start < location)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	while (low < spans->tokens_count && spans->tokens[low].token < 0)
+		low++;
+
+	return low;
+}
+
+// Index of the next token that isn't a comment, or tokens_count
+static int pg_query_parser_span_next_token(PgQueryParserSpans *spans, int i)
+{
+	for (i++; i < spans->tokens_count && spans->tokens[i].token < 0; i++) {}
+	return i < spans->tokens_count ? i : spans->tokens_count;
+}
+
+// Index of the previous token that isn't a comment, or -1
+static int pg_query_parser_span_prev_token(PgQueryParserSpans *spans, int i)
+{
+	for (i--; i >= 0 && spans->tokens[i].token < 0; i--) {}
+	return i;
+}
+
+// Whether the token (outside of parentheses) ends a target list or where clause
+static int pg_query_parser_span_ends_clause(PgQueryParserSpans *spans, int i)
+{
+	int prev = pg_query_parser_span_prev_token(spans, i);
+	int prev_token = prev >= 0 ? spans->tokens[prev].token : 0;
+
+	// Keywords are column labels after AS or a dot, e.g. "SELECT 1 AS from"
+	if (prev_token == AS || prev_token == '.') return 0;
+
+	switch (spans->tokens[i].token) {
+		case FROM:
+			return prev_token != DISTINCT; // "a IS DISTINCT FROM b"
+		case GROUP_P:
+			return prev_token != WITHIN; // "WITHIN GROUP (ORDER BY a)"
+		case INTO:
+		case WHERE:
+		case HAVING:
+		case WINDOW:
+		case ORDER:
+		case LIMIT:
+		case OFFSET:
+		case FETCH:
+		case FOR:
+		case UNION:
+		case INTERSECT:
+		case EXCEPT:
+		case ON:
+		case RETURNING:
+		case DO:
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the end of the part starting at token i: that of its last token
+ * before a closing parenthesis it didn't open, or the end of the statement,
+ * or with clause set, before a token that ends the clause. Returns -1 if the
+ * part is empty.
+ */
+static int pg_query_parser_span_end(PgQueryParserSpans *spans, int i, int clause)
+{
+	int depth = 0, end = -1;
+
+	for (; i < spans->tokens_count; i = pg_query_parser_span_next_token(spans, i)) {
+		int token = spans->tokens[i].token;
+
+		if (token == ';') break;
+
+		if (token == '(' || token == '[') {
+			depth++;
+		} else if (token == ')' || token == ']') {
+			if (depth == 0) break;
+			depth--;
+		} else if (depth == 0 && clause && pg_query_parser_span_ends_clause(spans, i)) {
+			break;
+		}
+
+		end = spans->tokens[i].end;
+	}
+
+	return end;
+}
+
+static void pg_query_parser_add_span(PgQueryParserSpans *spans, PgQueryParserSpanType type, int start, int end)
+{
+	PgQueryParserSpan *span;
+
+	if (start < 0 || end <= start) return;
+
+	if (spans->spans_count == spans->spans_capacity) {
+		spans->spans_capacity *= 2;
+		spans->spans = (PgQueryParserSpan *) repalloc(spans->spans, spans->spans_capacity * sizeof(PgQueryParserSpan));
+	}
+
+	span = &spans->spans[spans->spans_count++];
+	span->location = start;
+	span->length = end - start;
+	span->depth = spans->depth + 1;
+	span->type = type;
+}
+
+/*
+ * Adds the span of a target list or where clause, starting with the first
+ * token of its first node - or the parentheses before it, which have no node
+ * of their own. Unless keyword is 0, the clause must follow that keyword.
+ */
+static void pg_query_parser_add_clause_span(PgQueryParserSpans *spans, PgQueryParserSpanType type, Node *first, int keyword)
+{
+	int location = exprLocation(first);
+	int i, prev;
+
+	if (location < 0) return;
+
+	i = pg_query_parser_span_token(spans, location);
+	if (i >= spans->tokens_count || spans->tokens[i].start != location) return;
+
+	while ((prev = pg_query_parser_span_prev_token(spans, i)) >= 0 && spans->tokens[prev].token == '(')
+		i = prev;
+
+	if (keyword != 0 && (prev < 0 || spans->tokens[prev].token != keyword)) return;
+
+	pg_query_parser_add_span(spans, type, spans->tokens[i].start, pg_query_parser_span_end(spans, i, 1));
+}
+
+// Adds the span of an INSERT column list, within its parentheses
+static void pg_query_parser_add_cols_span(PgQueryParserSpans *spans, List *cols)
+{
+	int location = exprLocation((Node *) linitial(cols));
+	int i;
+
+	if (location < 0) return;
+
+	i = pg_query_parser_span_token(spans, location);
+	if (i >= spans->tokens_count || spans->tokens[i].start != location) return;
+
+	pg_query_parser_add_span(spans, PG_QUERY_PARSER_SPAN_COLS, location, pg_query_parser_span_end(spans, i, 0));
+}
+
+// Adds the span of a CTE's query, within the parentheses after "name [(columns)] AS"
+static void pg_query_parser_add_cte_span(PgQueryParserSpans *spans, CommonTableExpr *cte)
+{
+	int depth = 0;
+	int i;
+
+	if (cte->location < 0) return;
+
+	for (i = pg_query_parser_span_token(spans, cte->location); i < spans->tokens_count;
+		 i = pg_query_parser_span_next_token(spans, i)) {
+		int token = spans->tokens[i].token;
+
+		if (token == '(')
+			depth++;
+		else if (token == ')')
+			depth--;
+		else if (token == AS && depth == 0)
+			break;
+	}
+
+	i = pg_query_parser_span_next_token(spans, i);
+	if (i >= spans->tokens_count || spans->tokens[i].token != '(') return;
+
+	i = pg_query_parser_span_next_token(spans, i);
+	if (i >= spans->tokens_count) return;
+
+	pg_query_parser_add_span(spans, PG_QUERY_PARSER_SPAN_CTE_QUERY, spans->tokens[i].start, pg_query_parser_span_end(spans, i, 0));
+}
+
+static bool pg_query_parser_span_walker(Node *node, PgQueryParserSpans *spans)
+{
+	bool result;
+
+	if (node == NULL) return false;
+
+	if (IsA(node, SelectStmt)) {
+		SelectStmt *stmt = (SelectStmt *) node;
+		if (stmt->targetList != NIL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_TARGET_LIST, linitial(stmt->targetList), 0);
+		if (stmt->whereClause != NULL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_WHERE_CLAUSE, stmt->whereClause, WHERE);
+	} else if (IsA(node, InsertStmt)) {
+		InsertStmt *stmt = (InsertStmt *) node;
+		if (stmt->cols != NIL) pg_query_parser_add_cols_span(spans, stmt->cols);
+	} else if (IsA(node, UpdateStmt)) {
+		UpdateStmt *stmt = (UpdateStmt *) node;
+		if (stmt->targetList != NIL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_TARGET_LIST, linitial(stmt->targetList), 0);
+		if (stmt->whereClause != NULL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_WHERE_CLAUSE, stmt->whereClause, WHERE);
+	} else if (IsA(node, DeleteStmt)) {
+		DeleteStmt *stmt = (DeleteStmt *) node;
+		if (stmt->whereClause != NULL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_WHERE_CLAUSE, stmt->whereClause, WHERE);
+	} else if (IsA(node, OnConflictClause)) {
+		OnConflictClause *clause = (OnConflictClause *) node;
+		if (clause->targetList != NIL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_TARGET_LIST, linitial(clause->targetList), 0);
+		if (clause->whereClause != NULL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_WHERE_CLAUSE, clause->whereClause, WHERE);
+	} else if (IsA(node, InferClause)) {
+		InferClause *clause = (InferClause *) node;
+		if (clause->whereClause != NULL)
+			pg_query_parser_add_clause_span(spans, PG_QUERY_PARSER_SPAN_WHERE_CLAUSE, clause->whereClause, WHERE);
+	} else if (IsA(node, CommonTableExpr)) {
+		if (((CommonTableExpr *) node)->ctequery != NULL) pg_query_parser_add_cte_span(spans, (CommonTableExpr *) node);
+	}
+
+	spans->depth++;
+
+	// Statements that can contain a query, which the walker doesn't know about
+	if (IsA(node, RawStmt)) {
+		result = pg_query_parser_span_walker((Node *) ((RawStmt *) node)->stmt, spans);
+	} else if (IsA(node, CopyStmt)) {
+		result = pg_query_parser_span_walker((Node *) ((CopyStmt *) node)->query, spans);
+	} else if (IsA(node, ExplainStmt)) {
+		result = pg_query_parser_span_walker((Node *) ((ExplainStmt *) node)->query, spans);
+	} else if (IsA(node, DeclareCursorStmt)) {
+		result = pg_query_parser_span_walker((Node *) ((DeclareCursorStmt *) node)->query, spans);
+	} else {
+		// The walker errors out on (utility) statements it doesn't know, skip those
+		PG_TRY();
+		{
+			result = raw_expression_tree_walker(node, pg_query_parser_span_walker, (void *) spans);
+		}
+		PG_CATCH();
+		{
+			FlushErrorState();
+			result = false;
+		}
+		PG_END_TRY();
+	}
+
+	spans->depth--;
+
+	return result;
+}
+
+/*
+ * Returns the spans of the parts of all statements that truncation can omit,
+ * as a malloc-ed array of count spans.
+ */
+static PgQueryParserSpan *pg_query_parser_spans(List *tree, const char *input, int *count)
+{
+	PgQueryParserScanResult *tokens = palloc0(sizeof(PgQueryParserScanResult));
+	PgQueryParserSpans spans = {0};
+	PgQueryParserSpan *copy;
+
+	spans.spans_capacity = 16;
+	spans.spans = (PgQueryParserSpan *) palloc(spans.spans_capacity * sizeof(PgQueryParserSpan));
+
+	// The tokens are malloc-ed, unlike everything else here
+	PG_TRY();
+	{
+		pg_query_parser_scan_tokens(input, tokens);
+
+		spans.tokens = tokens->tokens;
+		spans.tokens_count = tokens->tokens_count;
+		pg_query_parser_span_walker((Node *) tree, &spans);
+	}
+	PG_CATCH();
+	{
+		free(tokens->tokens);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	free(tokens->tokens);
+
+	copy = malloc(sizeof(PgQueryParserSpan) * (spans.spans_count + 1));
+	if (copy == NULL) ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+	memcpy(copy, spans.spans, sizeof(PgQueryParserSpan) * spans.spans_count);
+
+	*count = spans.spans_count;
+
+	return copy;
+}
+
+static PgQueryError *pg_query_parser_copy_error(MemoryContext ctx)
+{
+	ErrorData *error_data;
+	PgQueryError *error;
+
+	MemoryContextSwitchTo(ctx);
+	error_data = CopyErrorData();
+
+	// Intentionally malloc, so exiting the memory context doesn't free this
+	error = malloc(sizeof(PgQueryError));
+	error->message = strdup(error_data->message);
+	error->filename = strdup(error_data->filename);
+	error->funcname = strdup(error_data->funcname);
+	error->context = NULL;
+	error->lineno = error_data->lineno;
+	error->cursorpos = error_data->cursorpos;
+
+	FlushErrorState();
+
+	return error;
+}
+
+/*
+ * Warnings are collected by a hook into PostgreSQL's error reporting, for the
+ * thread's current call. Calls to libpg_query's public functions have no
+ * collector, and capture stderr as usual.
+ */
+
+typedef struct {
+	int skip;
+	char **warnings;
+	int warnings_count;
+	int warnings_capacity;
+} PgQueryParserWarnings;
+
+static __thread PgQueryParserWarnings *pg_query_parser_current_warnings = NULL;
+
+// Same format as PostgreSQL's server log (and thus libpg_query's stderr_buffer)
+#define PG_QUERY_PARSER_WARNING_PREFIX "WARNING:  "
+
+static void pg_query_parser_add_warning(PgQueryParserWarnings *warnings, const char *message)
+{
+	size_t prefix_len = strlen(PG_QUERY_PARSER_WARNING_PREFIX);
+	size_t len = strlen(message);
+	char *warning;
+
+	if (warnings->warnings_count == warnings->warnings_capacity) {
+		int capacity = warnings->warnings_capacity ? warnings->warnings_capacity * 2 : 4;
+		char **grown = realloc(warnings->warnings, capacity * sizeof(char *));
+
+		if (grown == NULL) return; // Not worth failing the parse for
+		warnings->warnings = grown;
+		warnings->warnings_capacity = capacity;
+	}
+
+	warning = malloc(prefix_len + len + 1);
+	if (warning == NULL) return;
+
+	memcpy(warning, PG_QUERY_PARSER_WARNING_PREFIX, prefix_len);
+	memcpy(warning + prefix_len, message, len + 1);
+
+	warnings->warnings[warnings->warnings_count++] = warning;
+}
+
+static void pg_query_parser_emit_log(ErrorData *edata)
+{
+	PgQueryParserWarnings *warnings = pg_query_parser_current_warnings;
+
+	// Errors are caught and returned instead
+	if (warnings == NULL || edata->elevel >= ERROR) return;
+
+	// Never write to stderr
+	edata->output_to_server = false;
+
+	if (!warnings->skip && edata->elevel == WARNING && edata->message != NULL)
+		pg_query_parser_add_warning(warnings, edata->message);
+}
+
+static void pg_query_parser_begin_warnings(PgQueryParserWarnings *warnings, int skip)
+{
+	memset(warnings, 0, sizeof(PgQueryParserWarnings));
+	warnings->skip = skip;
+
+	// Might be thread-local in libpg_query, so set on every call
+	emit_log_hook = pg_query_parser_emit_log;
+	pg_query_parser_current_warnings = warnings;
+}
+
+static void pg_query_parser_end_warnings(void)
+{
+	pg_query_parser_current_warnings = NULL;
+}
+
+uint64_t pg_query_parser_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+// Nothing is freed while parsing, so the current size is also the peak
+static size_t pg_query_parser_memory(MemoryContext ctx)
+{
+	MemoryContextCounters counters = {0};
+
+	ctx->methods->stats(ctx, 0, false, &counters);
+
+	return counters.totalspace;
+}
+
+PgQueryParserResult pg_query_parser_parse(const char *input, int flags)
+{
+	MemoryContext ctx;
+	PgQueryParserWarnings warnings;
+	List *volatile tree = NIL;
+	PgQueryParserResult result = {0};
+	int reuse = (flags & PG_QUERY_PARSER_REUSE_BUFFERS) && pg_query_parser_arenas_enabled;
+	int stats = flags & PG_QUERY_PARSER_STATS;
+	uint64_t start = stats ? pg_query_parser_clock_ns() : 0;
+
+	ctx = pg_query_parser_enter_memory_context("pg_query_parser_parse");
+	pg_query_parser_begin_warnings(&warnings, flags & PG_QUERY_PARSER_SKIP_WARNINGS);
+
+	result.reused_buffers = reuse;
+
+	// Same as pg_query_raw_parse, without the stderr redirection
+	PG_TRY();
+	{
+		tree = raw_parser(input);
+	}
+	PG_CATCH();
+	{
+		result.error = pg_query_parser_copy_error(ctx);
+	}
+	PG_END_TRY();
+
+	pg_query_parser_end_warnings();
+	result.warnings = warnings.warnings;
+	result.warnings_count = warnings.warnings_count;
+
+	if (stats) {
+		uint64_t now = pg_query_parser_clock_ns();
+		result.stats.parse_ns = now - start;
+		start = now;
+	}
+
+	if (result.error == NULL) {
+		char *volatile parse_tree = NULL;
+		char *volatile normalized_query = NULL;
+		PgQueryParserConstant *volatile constants = NULL;
+		PgQueryParserConstant *normalized_constants = NULL;
+		PgQueryParserStatement *volatile statements = NULL;
+		volatile int statements_count = 0;
+		PgQueryParserSpan *volatile spans = NULL;
+		volatile int spans_count = 0;
+
+		PG_TRY();
+		{
+			if (flags & PG_QUERY_PARSER_JSON)
+				parse_tree = pg_query_parser_output(pg_query_nodes_to_json(tree), reuse);
+
+			if (flags & PG_QUERY_PARSER_NORMALIZE) {
+				char *normalized = pg_query_parser_normalize(tree, input, (flags & PG_QUERY_PARSER_CONSTANTS) ? &normalized_constants : NULL,
+															 &result.constants_count);
+				constants = normalized_constants;
+				normalized_query = pg_query_parser_output(normalized, reuse);
+			}
+
+			if (flags & PG_QUERY_PARSER_STATEMENTS) {
+				int count;
+				statements = pg_query_parser_statements(tree, input, &count);
+				statements_count = count;
+			}
+
+			if (flags & PG_QUERY_PARSER_SPANS) {
+				int count;
+				spans = pg_query_parser_spans(tree, input, &count);
+				spans_count = count;
+			}
+		}
+		PG_CATCH();
+		{
+			pg_query_parser_free_output(parse_tree, reuse);
+			pg_query_parser_free_output(normalized_query, reuse);
+			parse_tree = NULL;
+			normalized_query = NULL;
+			free(constants);
+			constants = NULL;
+			pg_query_parser_free_statements(statements, statements_count);
+			statements = NULL;
+			free(spans);
+			spans = NULL;
+
+			result.error = pg_query_parser_copy_error(ctx);
+		}
+		PG_END_TRY();
+
+		result.parse_tree = parse_tree;
+		result.normalized_query = normalized_query;
+		result.constants = constants;
+		if (constants == NULL) result.constants_count = 0;
+		result.statements = statements;
+		result.statements_count = statements ? statements_count : 0;
+		result.spans = spans;
+		result.spans_count = spans ? spans_count : 0;
+	}
+
+	if (stats) {
+		result.stats.output_ns = pg_query_parser_clock_ns() - start;
+		result.stats.memory = pg_query_parser_memory(ctx);
+	}
+
+	// Everything else was allocated in the memory context, which goes away (or is reset) here
+	pg_query_parser_exit_memory_context(ctx);
+
+	return result;
+}
+
+void pg_query_parser_free_result(PgQueryParserResult result)
+{
+	int i;
+
+	if (result.error) pg_query_free_error(result.error);
+
+	pg_query_parser_free_output(result.parse_tree, result.reused_buffers);
+	pg_query_parser_free_output(result.normalized_query, result.reused_buffers);
+	free(result.constants);
+	pg_query_parser_free_statements(result.statements, result.statements_count);
+	free(result.spans);
+
+	for (i = 0; i < result.warnings_count; i++)
+		free(result.warnings[i]);
+	free(result.warnings);
+}
+
+static void pg_query_parser_add_token(PgQueryParserScanResult *result, int token, const char *name,
+									  PgQueryParserKeywordKind keyword_kind, int start, int end)
+{
+	PgQueryParserToken *out;
+
+	if (result->tokens_count == result->tokens_capacity) {
+		int capacity = result->tokens_capacity ? result->tokens_capacity * 2 : 64;
+		PgQueryParserToken *tokens = realloc(result->tokens, capacity * sizeof(PgQueryParserToken));
+
+		if (tokens == NULL)
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+
+		result->tokens = tokens;
+		result->tokens_capacity = capacity;
+	}
+
+	out = &result->tokens[result->tokens_count++];
+	out->token = token;
+	out->name = name;
+	out->keyword_kind = keyword_kind;
+	out->start = start;
+	out->end = end;
+}
+
+// Adds the comments in the text between two tokens, following the rules in scan.l
+static void pg_query_parser_add_comments(PgQueryParserScanResult *result, const char *input, int start, int end)
+{
+	int i = start;
+
+	while (i < end - 1) {
+		if (input[i] == '-' && input[i + 1] == '-') {
+			int j = i + 2;
+			while (j < end && input[j] != '\n' && input[j] != '\r')
+				j++;
+			pg_query_parser_add_token(result, PG_QUERY_PARSER_SQL_COMMENT, "SQL_COMMENT", PG_QUERY_PARSER_NO_KEYWORD, i, j);
+			i = j;
+		} else if (input[i] == '/' && input[i + 1] == '*') {
+			int depth = 1;
+			int j = i + 2;
+			while (j < end && depth > 0) {
+				if (j < end - 1 && input[j] == '/' && input[j + 1] == '*') {
+					depth++;
+					j += 2;
+				} else if (j < end - 1 && input[j] == '*' && input[j + 1] == '/') {
+					depth--;
+					j += 2;
+				} else {
+					j++;
+				}
+			}
+			pg_query_parser_add_token(result, PG_QUERY_PARSER_C_COMMENT, "C_COMMENT", PG_QUERY_PARSER_NO_KEYWORD, i, j);
+			i = j;
+		} else {
+			i++;
+		}
+	}
+}
+
+static const char *pg_query_parser_token_name(int token)
+{
+	switch (token) {
+		case IDENT: return "IDENT";
+		case FCONST: return "FCONST";
+		case SCONST: return "SCONST";
+		case BCONST: return "BCONST";
+		case XCONST: return "XCONST";
+		case Op: return "Op";
+		case ICONST: return "ICONST";
+		case PARAM: return "PARAM";
+		case TYPECAST: return "TYPECAST";
+		case DOT_DOT: return "DOT_DOT";
+		case COLON_EQUALS: return "COLON_EQUALS";
+		case EQUALS_GREATER: return "EQUALS_GREATER";
+		case LESS_EQUALS: return "LESS_EQUALS";
+		case GREATER_EQUALS: return "GREATER_EQUALS";
+		case NOT_EQUALS: return "NOT_EQUALS";
+	}
+
+	return NULL;
+}
+
+static void pg_query_parser_scan_tokens(const char *input, PgQueryParserScanResult *result)
+{
+	core_yyscan_t yyscanner;
+	core_yy_extra_type yyextra;
+	core_YYSTYPE yylval;
+	YYLTYPE yylloc;
+	int last_end = 0;
+
+	yyscanner = scanner_init(input, &yyextra, ScanKeywords, NumScanKeywords);
+
+	for (;;) {
+		int token = core_yylex(&yylval, &yylloc, yyscanner);
+		const char *name = NULL;
+		PgQueryParserKeywordKind keyword_kind = PG_QUERY_PARSER_NO_KEYWORD;
+		int start = yylloc;
+		int end;
+
+		if (token == 0) break;
+
+		// Flex places a zero byte after the text of the current token in scanbuf
+		end = start + (int) strlen(yyextra.scanbuf + start);
+
+		// Some tokens (U&'' strings) include the whitespace after them
+		while (end > start && scanner_isspace(yyextra.scanbuf[end - 1]))
+			end--;
+
+		if (token > NOT_EQUALS) {
+			// All other tokens the core scanner returns are keywords
+			const ScanKeyword *keyword = ScanKeywordLookup(yyextra.scanbuf + start, ScanKeywords, NumScanKeywords);
+			if (keyword != NULL) {
+				name = keyword->name;
+				keyword_kind = (PgQueryParserKeywordKind) (keyword->category + 1);
+			}
+		} else if (token >= 256) {
+			name = pg_query_parser_token_name(token);
+		}
+
+		if (name == NULL && token >= 256) name = "UNKNOWN";
+
+		pg_query_parser_add_comments(result, input, last_end, start);
+		pg_query_parser_add_token(result, token, name, keyword_kind, start, end);
+
+		last_end = end;
+	}
+
+	pg_query_parser_add_comments(result, input, last_end, (int) strlen(input));
+
+	scanner_finish(yyscanner);
+}
+
+PgQueryParserScanResult pg_query_parser_scan(const char *input)
+{
+	MemoryContext ctx;
+	PgQueryParserWarnings warnings;
+	PgQueryParserScanResult result = {0};
+
+	ctx = pg_query_parser_enter_memory_context("pg_query_parser_scan");
+	pg_query_parser_begin_warnings(&warnings, 1);
+
+	PG_TRY();
+	{
+		pg_query_parser_scan_tokens(input, &result);
+	}
+	PG_CATCH();
+	{
+		result.error = pg_query_parser_copy_error(ctx);
+	}
+	PG_END_TRY();
+
+	pg_query_parser_end_warnings();
+
+	pg_query_parser_exit_memory_context(ctx);
+
+	if (result.error) {
+		free(result.tokens);
+		result.tokens = NULL;
+		result.tokens_count = 0;
+	}
+
+	return result;
+}
+
+const char *pg_query_parser_token_info(int token, PgQueryParserKeywordKind *keyword_kind)
+{
+	int i;
+
+	*keyword_kind = PG_QUERY_PARSER_NO_KEYWORD;
+
+	if (token == PG_QUERY_PARSER_SQL_COMMENT) return "SQL_COMMENT";
+	if (token == PG_QUERY_PARSER_C_COMMENT) return "C_COMMENT";
+	if (token <= NOT_EQUALS) return pg_query_parser_token_name(token);
+
+	for (i = 0; i < NumScanKeywords; i++) {
+		if (ScanKeywords[i].value == token) {
+			*keyword_kind = (PgQueryParserKeywordKind) (ScanKeywords[i].category + 1);
+			return ScanKeywords[i].name;
+		}
+	}
+
+	return NULL;
+}
+
+void pg_query_parser_free_scan_result(PgQueryParserScanResult result)
+{
+	if (result.error) pg_query_free_error(result.error);
+
+	free(result.tokens);
+}
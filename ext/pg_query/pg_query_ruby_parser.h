@@ -0,0 +1,183 @@
+#ifndef PG_QUERY_RUBY_PARSER_H
+#define PG_QUERY_RUBY_PARSER_H
+
+#include "pg_query.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Parsing on top of libpg_query's internals, for results that its public API
+ * can only produce by parsing the same query several times.
+ *
+ * This is the only part of the extension that includes PostgreSQL headers,
+ * which clash with ruby.h - the interface here is plain C on purpose. Like the
+ * public libpg_query functions it may be called without holding the GVL.
+ */
+
+// Return the parse tree as JSON, as pg_query_parse does
+#define PG_QUERY_PARSER_JSON 1
+// Return the query text with constants replaced, as pg_query_normalize does
+#define PG_QUERY_PARSER_NORMALIZE 2
+/*
+ * With per-thread arenas enabled, return the JSON and normalized query in
+ * buffers that are reused by later calls once the result is freed. Only worth
+ * it for results that are consumed right away.
+ */
+#define PG_QUERY_PARSER_REUSE_BUFFERS 4
+// Don't collect warnings, they are dropped (instead of being written to stderr)
+#define PG_QUERY_PARSER_SKIP_WARNINGS 8
+// Measure the time spent in each phase, and the memory used (see PgQueryParserStats)
+#define PG_QUERY_PARSER_STATS 16
+// With PG_QUERY_PARSER_NORMALIZE, also return the constants that were replaced
+#define PG_QUERY_PARSER_CONSTANTS 32
+// Return the location and normalized text of each statement (see PgQueryParserStatement)
+#define PG_QUERY_PARSER_STATEMENTS 64
+// Return the spans of the parts of each statement that truncation can omit (see PgQueryParserSpan)
+#define PG_QUERY_PARSER_SPANS 128
+
+typedef struct {
+	uint64_t parse_ns;  // raw parsing
+	uint64_t output_ns; // JSON and normalized query
+	size_t memory;      // bytes allocated in the memory context, at its peak
+} PgQueryParserStats;
+
+// Type of a constant, as in the A_Const node's value
+typedef enum {
+	PG_QUERY_PARSER_CONST_INTEGER,
+	PG_QUERY_PARSER_CONST_FLOAT,
+	PG_QUERY_PARSER_CONST_STRING,
+	PG_QUERY_PARSER_CONST_BITSTRING,
+	PG_QUERY_PARSER_CONST_NULL
+} PgQueryParserConstType;
+
+typedef struct {
+	int location; // byte offsets into the input
+	int length;
+	int param;    // number of the $n placeholder that replaced it
+	PgQueryParserConstType type;
+} PgQueryParserConstant;
+
+/*
+ * A statement (RawStmt) of the input, in the same order as the statements in
+ * the parse tree
+ */
+typedef struct {
+	int location; // byte offsets of the statement's text in the input (stmt_location and stmt_len)
+	int length;
+	char *normalized_query; // the statement's text, normalized as if it was the whole input
+} PgQueryParserStatement;
+
+// Parts of a statement that truncation can omit, by the name of their field in the tree
+typedef enum {
+	PG_QUERY_PARSER_SPAN_TARGET_LIST,  // targetList, of SELECT, UPDATE and ON CONFLICT DO UPDATE
+	PG_QUERY_PARSER_SPAN_WHERE_CLAUSE, // whereClause
+	PG_QUERY_PARSER_SPAN_CTE_QUERY,    // ctequery, the body of a CTE (without its parentheses)
+	PG_QUERY_PARSER_SPAN_COLS          // cols, the column list of an INSERT (without its parentheses)
+} PgQueryParserSpanType;
+
+/*
+ * The text of a part of a statement, from its first to its last token (so
+ * without surrounding whitespace or comments), in the order the parts are
+ * found in the tree
+ */
+typedef struct {
+	int location; // byte offsets into the input
+	int length;
+	int depth;    // nesting depth of the part in the tree (its number of enclosing nodes and lists)
+	PgQueryParserSpanType type;
+} PgQueryParserSpan;
+
+typedef struct {
+	char *parse_tree;
+	char *normalized_query;
+	/*
+	 * Warnings reported while parsing, e.g. "WARNING:  nonstandard use of \\' in
+	 * a string literal". These are collected from PostgreSQL's error reporting
+	 * directly, unlike libpg_query, which redirects the process's stderr to a pipe
+	 * while parsing (which is slow, and breaks when threads parse concurrently).
+	 */
+	char **warnings;
+	int warnings_count;
+	// Replaced constants in the order they appear in, with PG_QUERY_PARSER_CONSTANTS
+	PgQueryParserConstant *constants;
+	int constants_count;
+	// With PG_QUERY_PARSER_STATEMENTS
+	PgQueryParserStatement *statements;
+	int statements_count;
+	// With PG_QUERY_PARSER_SPANS
+	PgQueryParserSpan *spans;
+	int spans_count;
+	PgQueryError *error;
+	/*
+	 * Whether parse_tree and normalized_query are reused buffers - these must be
+	 * given back with pg_query_parser_free_result or pg_query_parser_release_buffer,
+	 * instead of being freed
+	 */
+	int reused_buffers;
+	PgQueryParserStats stats; // Only with PG_QUERY_PARSER_STATS
+} PgQueryParserResult;
+
+PgQueryParserResult pg_query_parser_parse(const char *input, int flags);
+void pg_query_parser_free_result(PgQueryParserResult result);
+void pg_query_parser_release_buffer(char *buffer);
+
+/*
+ * Per-thread arenas: when enabled, every thread that parses keeps a PostgreSQL
+ * memory context around, which is reset instead of being created and deleted
+ * for each call, and a few output buffers (see PG_QUERY_PARSER_REUSE_BUFFERS).
+ * Both are freed when the thread exits. Disabled by default.
+ */
+void pg_query_parser_set_arenas(int enabled);
+int pg_query_parser_arenas(void);
+
+// Monotonic clock, in nanoseconds
+uint64_t pg_query_parser_clock_ns(void);
+
+/*
+ * Lexical scanning with PostgreSQL's core scanner (the first stage of parsing),
+ * which skips comments - those are found in the text between tokens instead.
+ */
+
+// Token numbers for comments, all others are the scanner's (see parser/gram.h)
+#define PG_QUERY_PARSER_SQL_COMMENT -1
+#define PG_QUERY_PARSER_C_COMMENT -2
+
+typedef enum {
+	PG_QUERY_PARSER_NO_KEYWORD,
+	PG_QUERY_PARSER_UNRESERVED_KEYWORD,
+	PG_QUERY_PARSER_COL_NAME_KEYWORD,
+	PG_QUERY_PARSER_TYPE_FUNC_NAME_KEYWORD,
+	PG_QUERY_PARSER_RESERVED_KEYWORD
+} PgQueryParserKeywordKind;
+
+typedef struct {
+	int token;
+	/*
+	 * Static name of the token (lowercase for keywords, e.g. "select"), or
+	 * NULL for single character tokens, where the token is the character
+	 */
+	const char *name;
+	PgQueryParserKeywordKind keyword_kind;
+	int start; // byte offsets into the input
+	int end;
+} PgQueryParserToken;
+
+typedef struct {
+	PgQueryParserToken *tokens;
+	int tokens_count;
+	int tokens_capacity;
+	PgQueryError *error;
+} PgQueryParserScanResult;
+
+PgQueryParserScanResult pg_query_parser_scan(const char *input);
+
+/*
+ * Returns the name of the token with the given number, as it would appear in
+ * a PgQueryParserToken (also setting keyword_kind), or NULL for single
+ * character tokens and unused numbers
+ */
+const char *pg_query_parser_token_info(int token, PgQueryParserKeywordKind *keyword_kind);
+void pg_query_parser_free_scan_result(PgQueryParserScanResult result);
+
+#endif
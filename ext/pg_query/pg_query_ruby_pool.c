@@ -0,0 +1,167 @@
+#include "pg_query_ruby_pool.h"
+
+#include <pthread.h>
+#include <signal.h>
+
+/*
+ * Note: This runs without the GVL, and must not touch any Ruby objects.
+ */
+
+// The parser recurses for deeply nested queries, don't rely on platform defaults
+#define PG_QUERY_POOL_STACK_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+	PgQueryPoolFunc func;
+	void *arg;
+	size_t count;
+	size_t next; // next index to be processed, incremented atomically
+
+	int workers_wanted; // number of pool workers that may join this job
+	int workers_joined;
+	int workers_active;
+	int closed;
+	unsigned long generation;
+} PgQueryPoolJob;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_run_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER;
+static int pool_threads = 0;
+static PgQueryPoolJob pool_job;
+
+static void pg_query_pool_work(PgQueryPoolJob *job)
+{
+	for (;;) {
+		size_t i = __sync_fetch_and_add(&job->next, 1);
+		if (i >= job->count) break;
+		job->func(job->arg, i);
+	}
+}
+
+static void *pg_query_pool_worker(void *unused)
+{
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&pool_mutex);
+
+	for (;;) {
+		while (pool_job.generation == seen)
+			pthread_cond_wait(&pool_work_cond, &pool_mutex);
+
+		seen = pool_job.generation;
+		if (pool_job.closed || pool_job.workers_joined >= pool_job.workers_wanted)
+			continue;
+
+		pool_job.workers_joined++;
+		pool_job.workers_active++;
+		pthread_mutex_unlock(&pool_mutex);
+
+		pg_query_pool_work(&pool_job);
+
+		pthread_mutex_lock(&pool_mutex);
+		pool_job.workers_active--;
+		if (pool_job.workers_active == 0)
+			pthread_cond_signal(&pool_done_cond);
+	}
+
+	return NULL;
+}
+
+/*
+ * Worker threads don't survive fork(), start over with an empty pool in the
+ * child. This runs while the child is still single-threaded.
+ */
+static void pg_query_pool_atfork_child(void)
+{
+	pthread_mutex_init(&pool_run_mutex, NULL);
+	pthread_mutex_init(&pool_mutex, NULL);
+	pthread_cond_init(&pool_work_cond, NULL);
+	pthread_cond_init(&pool_done_cond, NULL);
+	pool_threads = 0;
+	pool_job.closed = 1;
+	pool_job.workers_active = 0;
+}
+
+static void pg_query_pool_init(void)
+{
+	pthread_atfork(NULL, NULL, pg_query_pool_atfork_child);
+}
+
+// Must be called with pool_mutex held
+static void pg_query_pool_start_workers(int workers)
+{
+	pthread_attr_t attr;
+	sigset_t all_signals, old_signals;
+
+	if (pool_threads >= workers) return;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, PG_QUERY_POOL_STACK_SIZE);
+
+	// Signals should keep going to Ruby's threads, not to our workers
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+
+	while (pool_threads < workers) {
+		pthread_t thread;
+		if (pthread_create(&thread, &attr, pg_query_pool_worker, NULL) != 0) break;
+		pool_threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+	pthread_attr_destroy(&attr);
+}
+
+void pg_query_pool_run(PgQueryPoolFunc func, void *arg, size_t count, int threads)
+{
+	int workers;
+	size_t i;
+
+	if (threads > PG_QUERY_POOL_MAX_THREADS) threads = PG_QUERY_POOL_MAX_THREADS;
+
+	// The calling thread does its share of the work as well
+	workers = threads - 1;
+	if (count < 2) workers = 0;
+	else if ((size_t) workers > count - 1) workers = (int) (count - 1);
+
+	if (workers <= 0) {
+		for (i = 0; i < count; i++)
+			func(arg, i);
+		return;
+	}
+
+	pthread_once(&pool_once, pg_query_pool_init);
+
+	pthread_mutex_lock(&pool_run_mutex);
+	pthread_mutex_lock(&pool_mutex);
+
+	pg_query_pool_start_workers(workers);
+	if (workers > pool_threads) workers = pool_threads;
+
+	pool_job.func = func;
+	pool_job.arg = arg;
+	pool_job.count = count;
+	pool_job.next = 0;
+	pool_job.workers_wanted = workers;
+	pool_job.workers_joined = 0;
+	pool_job.workers_active = 0;
+	pool_job.closed = 0;
+	pool_job.generation++;
+
+	pthread_cond_broadcast(&pool_work_cond);
+	pthread_mutex_unlock(&pool_mutex);
+
+	pg_query_pool_work(&pool_job);
+
+	// Wait for workers that are still processing their last item
+	pthread_mutex_lock(&pool_mutex);
+	pool_job.closed = 1;
+	while (pool_job.workers_active > 0)
+		pthread_cond_wait(&pool_done_cond, &pool_mutex);
+	pthread_mutex_unlock(&pool_mutex);
+
+	pthread_mutex_unlock(&pool_run_mutex);
+}
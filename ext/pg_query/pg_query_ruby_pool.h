@@ -0,0 +1,26 @@
+#ifndef PG_QUERY_RUBY_POOL_H
+#define PG_QUERY_RUBY_POOL_H
+
+#include <stddef.h>
+
+/*
+ * Process-wide pool of native worker threads used by the batch APIs.
+ *
+ * Workers are started on first use and kept around, since libpg_query sets up
+ * its (thread-local) top-level memory contexts once per thread. The pool must
+ * only be used without holding the GVL.
+ */
+
+#define PG_QUERY_POOL_MAX_THREADS 64
+
+typedef void (*PgQueryPoolFunc)(void *arg, size_t index);
+
+/*
+ * Calls func(arg, i) for every i in 0...count, spread over up to "threads"
+ * threads (the calling thread counts as one of them), and returns once all
+ * calls have finished. Only one batch runs at a time, concurrent callers wait
+ * for their turn.
+ */
+void pg_query_pool_run(PgQueryPoolFunc func, void *arg, size_t count, int threads);
+
+#endif
@@ -0,0 +1,139 @@
+#include "pg_query_ruby.h"
+
+#include <ctype.h>
+
+/*
+ * Symbols for token kinds, by token number - there are only a few hundred
+ * distinct tokens, so these are all created up front, and never modified
+ * afterwards (which keeps this safe to use from multiple Ractors). Comments
+ * (which have negative token numbers) are stored after the others.
+ */
+#define PG_QUERY_RUBY_SCAN_MAX_TOKEN 1024
+static ID token_kinds[PG_QUERY_RUBY_SCAN_MAX_TOKEN + 2];
+
+static ID keyword_kinds[PG_QUERY_PARSER_RESERVED_KEYWORD + 1];
+
+// Single character tokens returned by the scanner ("self" in scan.l)
+static const char single_char_tokens[] = ",()[].;:+-*/%^<>=";
+
+typedef struct {
+	char *input;
+	PgQueryParserScanResult result;
+} PgQueryRubyScanCall;
+
+static void *pg_query_ruby_scan_without_gvl(void *arg)
+{
+	PgQueryRubyScanCall *call = (PgQueryRubyScanCall *) arg;
+	call->result = pg_query_parser_scan(call->input);
+	return NULL;
+}
+
+static int pg_query_ruby_scan_token_index(int token)
+{
+	return token >= 0 ? token : PG_QUERY_RUBY_SCAN_MAX_TOKEN - token - 1;
+}
+
+static ID pg_query_ruby_scan_kind_id(int token, const char *name, PgQueryParserKeywordKind keyword_kind)
+{
+	char buf[64];
+	size_t i;
+
+	if (name == NULL) {
+		// Single character tokens, e.g. :"(" or :","
+		buf[0] = (char) token;
+		return rb_intern2(buf, 1);
+	}
+
+	if (keyword_kind != PG_QUERY_PARSER_NO_KEYWORD) {
+		// Keywords are named like in the grammar, e.g. :SELECT
+		for (i = 0; i < sizeof(buf) && name[i]; i++)
+			buf[i] = (char) toupper((unsigned char) name[i]);
+		return rb_intern2(buf, i);
+	}
+
+	return rb_intern(name);
+}
+
+static ID pg_query_ruby_scan_token_kind(PgQueryParserToken *token)
+{
+	int index = pg_query_ruby_scan_token_index(token->token);
+
+	if (index >= 0 && index < PG_QUERY_RUBY_SCAN_MAX_TOKEN + 2 && token_kinds[index])
+		return token_kinds[index];
+
+	// Not expected, but don't cache anything outside of Init_pg_query_scan
+	return pg_query_ruby_scan_kind_id(token->token, token->name, token->keyword_kind);
+}
+
+static VALUE pg_query_ruby_scan_build(VALUE arg)
+{
+	PgQueryRubyScanCall *call = (PgQueryRubyScanCall *) arg;
+	VALUE output = rb_ary_new_capa(call->result.tokens_count);
+	int i;
+
+	for (i = 0; i < call->result.tokens_count; i++) {
+		PgQueryParserToken *token = &call->result.tokens[i];
+		VALUE keyword_kind = Qnil;
+
+		if (token->keyword_kind != PG_QUERY_PARSER_NO_KEYWORD)
+			keyword_kind = ID2SYM(keyword_kinds[token->keyword_kind]);
+
+		rb_ary_push(output, rb_ary_new_from_args(4, ID2SYM(pg_query_ruby_scan_token_kind(token)), keyword_kind,
+												 INT2NUM(token->start), INT2NUM(token->end)));
+	}
+
+	return output;
+}
+
+static VALUE pg_query_ruby_scan_cleanup(VALUE arg)
+{
+	PgQueryRubyScanCall *call = (PgQueryRubyScanCall *) arg;
+
+	pg_query_parser_free_scan_result(call->result);
+
+	return Qnil;
+}
+
+/*
+ * Returns an Array of [kind, keyword kind, start, end] for each token (and
+ * comment) - see PgQuery.scan.
+ */
+static VALUE pg_query_ruby_scan(VALUE self, VALUE input)
+{
+	PgQueryRubyScanCall call = {0};
+
+	call.input = pg_query_ruby_input_dup(input);
+	pg_query_ruby_without_gvl(pg_query_ruby_scan_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error) {
+		VALUE error = new_ruby_parse_error(call.result.error);
+		pg_query_ruby_scan_cleanup((VALUE) &call);
+		rb_exc_raise(error);
+	}
+
+	return rb_ensure(pg_query_ruby_scan_build, (VALUE) &call, pg_query_ruby_scan_cleanup, (VALUE) &call);
+}
+
+void Init_pg_query_scan(VALUE cPgQuery)
+{
+	int i, token;
+
+	keyword_kinds[PG_QUERY_PARSER_UNRESERVED_KEYWORD] = rb_intern("unreserved_keyword");
+	keyword_kinds[PG_QUERY_PARSER_COL_NAME_KEYWORD] = rb_intern("col_name_keyword");
+	keyword_kinds[PG_QUERY_PARSER_TYPE_FUNC_NAME_KEYWORD] = rb_intern("type_func_name_keyword");
+	keyword_kinds[PG_QUERY_PARSER_RESERVED_KEYWORD] = rb_intern("reserved_keyword");
+
+	for (i = 0; single_char_tokens[i]; i++)
+		token_kinds[(int) single_char_tokens[i]] = pg_query_ruby_scan_kind_id(single_char_tokens[i], NULL, PG_QUERY_PARSER_NO_KEYWORD);
+
+	for (token = PG_QUERY_PARSER_C_COMMENT; token < PG_QUERY_RUBY_SCAN_MAX_TOKEN; token++) {
+		PgQueryParserKeywordKind keyword_kind;
+		const char *name = pg_query_parser_token_info(token, &keyword_kind);
+
+		if (name != NULL)
+			token_kinds[pg_query_ruby_scan_token_index(token)] = pg_query_ruby_scan_kind_id(token, name, keyword_kind);
+	}
+
+	rb_define_singleton_method(cPgQuery, "scan", pg_query_ruby_scan, 1);
+}
@@ -0,0 +1,116 @@
+#include "pg_query_ruby_sha1.h"
+
+#include <string.h>
+
+#define PG_QUERY_SHA1_ROL(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+static void pg_query_sha1_transform(uint32_t state[5], const unsigned char block[64])
+{
+	uint32_t w[80];
+	uint32_t a, b, c, d, e, f, k, temp;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16) |
+			   ((uint32_t) block[i * 4 + 2] << 8) | (uint32_t) block[i * 4 + 3];
+	for (i = 16; i < 80; i++)
+		w[i] = PG_QUERY_SHA1_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+
+	for (i = 0; i < 80; i++) {
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+
+		temp = PG_QUERY_SHA1_ROL(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = PG_QUERY_SHA1_ROL(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+void pg_query_sha1_init(PgQuerySHA1 *ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xEFCDAB89;
+	ctx->state[2] = 0x98BADCFE;
+	ctx->state[3] = 0x10325476;
+	ctx->state[4] = 0xC3D2E1F0;
+	ctx->length = 0;
+	ctx->buffer_len = 0;
+}
+
+void pg_query_sha1_update(PgQuerySHA1 *ctx, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	ctx->length += len;
+
+	if (ctx->buffer_len > 0) {
+		size_t n = 64 - ctx->buffer_len;
+		if (n > len) n = len;
+		memcpy(ctx->buffer + ctx->buffer_len, p, n);
+		ctx->buffer_len += n;
+		p += n;
+		len -= n;
+		if (ctx->buffer_len < 64) return;
+		pg_query_sha1_transform(ctx->state, ctx->buffer);
+		ctx->buffer_len = 0;
+	}
+
+	while (len >= 64) {
+		pg_query_sha1_transform(ctx->state, p);
+		p += 64;
+		len -= 64;
+	}
+
+	memcpy(ctx->buffer, p, len);
+	ctx->buffer_len = len;
+}
+
+void pg_query_sha1_final(PgQuerySHA1 *ctx, unsigned char digest[PG_QUERY_SHA1_DIGEST_LENGTH])
+{
+	uint64_t bits = ctx->length * 8;
+	unsigned char padding[72];
+	size_t padding_len;
+	int i;
+
+	// Pad to 56 bytes (mod 64), followed by the message length in bits
+	padding_len = (ctx->buffer_len < 56 ? 56 : 120) - ctx->buffer_len;
+	memset(padding, 0, sizeof(padding));
+	padding[0] = 0x80;
+	for (i = 0; i < 8; i++)
+		padding[padding_len + i] = (unsigned char) (bits >> (56 - i * 8));
+
+	pg_query_sha1_update(ctx, padding, padding_len + 8);
+
+	for (i = 0; i < 5; i++) {
+		digest[i * 4] = (unsigned char) (ctx->state[i] >> 24);
+		digest[i * 4 + 1] = (unsigned char) (ctx->state[i] >> 16);
+		digest[i * 4 + 2] = (unsigned char) (ctx->state[i] >> 8);
+		digest[i * 4 + 3] = (unsigned char) ctx->state[i];
+	}
+}
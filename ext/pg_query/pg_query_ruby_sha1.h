@@ -0,0 +1,24 @@
+#ifndef PG_QUERY_RUBY_SHA1_H
+#define PG_QUERY_RUBY_SHA1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal SHA-1 (FIPS 180-1), used for version 2 fingerprints of native trees.
+ */
+
+#define PG_QUERY_SHA1_DIGEST_LENGTH 20
+
+typedef struct {
+	uint32_t state[5];
+	uint64_t length; // total bytes hashed
+	unsigned char buffer[64];
+	size_t buffer_len;
+} PgQuerySHA1;
+
+void pg_query_sha1_init(PgQuerySHA1 *ctx);
+void pg_query_sha1_update(PgQuerySHA1 *ctx, const void *data, size_t len);
+void pg_query_sha1_final(PgQuerySHA1 *ctx, unsigned char digest[PG_QUERY_SHA1_DIGEST_LENGTH]);
+
+#endif
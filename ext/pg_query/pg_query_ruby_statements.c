@@ -0,0 +1,139 @@
+#include "pg_query_ruby.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * PgQuery.statements - splits a query into its statements (e.g. a migration
+ * or a batch of ;-separated statements from a log), and returns the location,
+ * type, fingerprint and normalized text of each, all from a single parse.
+ */
+
+static VALUE cStatement;
+
+typedef struct {
+	char *input;
+	PgQueryParserResult result;
+	PgQueryTree tree;
+	int tree_error;
+	// One per statement, an empty string if the statement couldn't be fingerprinted
+	char (*fingerprints)[PG_QUERY_FINGERPRINT_HEX_LENGTH + 1];
+	uint64_t tree_ns; // Building and fingerprinting the tree, with PG_QUERY_PARSER_STATS
+} PgQueryRubyStatementsCall;
+
+static void *pg_query_ruby_statements_without_gvl(void *arg)
+{
+	PgQueryRubyStatementsCall *call = (PgQueryRubyStatementsCall *) arg;
+	int flags = PG_QUERY_PARSER_JSON | PG_QUERY_PARSER_STATEMENTS | PG_QUERY_PARSER_REUSE_BUFFERS |
+				PG_QUERY_PARSER_SKIP_WARNINGS | pg_query_ruby_parser_flags();
+	uint64_t start;
+	size_t i;
+
+	call->result = pg_query_parser_parse(call->input, flags);
+	if (call->result.error) return NULL;
+
+	start = (flags & PG_QUERY_PARSER_STATS) ? pg_query_parser_clock_ns() : 0;
+
+	// The tree takes ownership of the JSON buffer
+	call->tree_error = pg_query_tree_parse_json(&call->tree, call->result.parse_tree, PG_QUERY_TREE_MAX_NESTING);
+	call->result.parse_tree = NULL;
+
+	// Statements in the tree are RawStmt nodes, in the same order as the parser's
+	if (!call->tree_error &&
+		(call->tree.root.type != PG_QUERY_TREE_ARRAY || call->tree.root.len != (size_t) call->result.statements_count))
+		call->tree_error = -1;
+
+	if (!call->tree_error) {
+		call->fingerprints = calloc(call->tree.root.len + 1, sizeof(*call->fingerprints));
+		if (call->fingerprints == NULL) call->tree_error = -1;
+	}
+
+	if (!call->tree_error) {
+		for (i = 0; i < call->tree.root.len; i++)
+			if (pg_query_tree_fingerprint_statement(&call->tree, &call->tree.root.u.items[i], call->fingerprints[i]) != 0)
+				call->fingerprints[i][0] = '\0';
+	}
+
+	if (flags & PG_QUERY_PARSER_STATS) call->tree_ns = pg_query_parser_clock_ns() - start;
+
+	return NULL;
+}
+
+static VALUE pg_query_ruby_statements_build(VALUE arg)
+{
+	PgQueryRubyStatementsCall *call = (PgQueryRubyStatementsCall *) arg;
+	PgQueryRubyTreeBuilder builder;
+	VALUE output = rb_ary_new_capa(call->result.statements_count);
+	int i;
+
+	pg_query_ruby_tree_builder_init(&builder, &call->tree);
+
+	for (i = 0; i < call->result.statements_count; i++) {
+		PgQueryParserStatement *statement = &call->result.statements[i];
+		PgQueryTreeValue *stmt = pg_query_tree_object_get(&call->tree, &call->tree.root.u.items[i], "RawStmt");
+		VALUE type = Qnil;
+
+		stmt = pg_query_tree_object_get(&call->tree, stmt, "stmt");
+		if (stmt != NULL && stmt->type == PG_QUERY_TREE_OBJECT && stmt->len > 0)
+			type = pg_query_ruby_tree_key(&builder, stmt->u.members[0].key);
+
+		rb_ary_push(output, rb_struct_new(cStatement, INT2NUM(statement->location), INT2NUM(statement->length), type,
+										  call->fingerprints[i][0] ? rb_str_new2(call->fingerprints[i]) : Qnil,
+										  rb_enc_str_new_cstr(statement->normalized_query, rb_utf8_encoding())));
+	}
+
+	RB_GC_GUARD(builder.keys);
+
+	return output;
+}
+
+static VALUE pg_query_ruby_statements_cleanup(VALUE arg)
+{
+	PgQueryRubyStatementsCall *call = (PgQueryRubyStatementsCall *) arg;
+
+	// The tree owns the JSON buffer, unless it is to be reused
+	if (call->result.reused_buffers) {
+		pg_query_parser_release_buffer(call->tree.buffer);
+		call->tree.buffer = NULL;
+	}
+
+	free(call->fingerprints);
+	pg_query_tree_free(&call->tree);
+	pg_query_parser_free_result(call->result);
+
+	return Qnil;
+}
+
+// Returns an Array with a PgQuery::Statement for each statement
+static VALUE pg_query_ruby_statements(VALUE self, VALUE input)
+{
+	PgQueryRubyStatementsCall call = {0};
+
+	pg_query_tree_init(&call.tree);
+
+	call.input = pg_query_ruby_input_dup(input);
+	pg_query_ruby_without_gvl(pg_query_ruby_statements_without_gvl, &call);
+	xfree(call.input);
+
+	if (call.result.error) {
+		VALUE error = new_ruby_parse_error(call.result.error);
+		pg_query_ruby_statements_cleanup((VALUE) &call);
+		rb_exc_raise(error);
+	}
+
+	if (call.tree_error) {
+		pg_query_ruby_statements_cleanup((VALUE) &call);
+		rb_exc_raise(new_ruby_tree_error());
+	}
+
+	pg_query_ruby_record_stats(&call.result.stats, "tree", call.tree_ns, call.tree.buffer_len);
+
+	return rb_ensure(pg_query_ruby_statements_build, (VALUE) &call, pg_query_ruby_statements_cleanup, (VALUE) &call);
+}
+
+void Init_pg_query_statements(VALUE cPgQuery)
+{
+	cStatement = rb_struct_define_under(cPgQuery, "Statement", "location", "length", "type", "fingerprint", "normalized", NULL);
+
+	rb_define_singleton_method(cPgQuery, "_statements", pg_query_ruby_statements, 1);
+}
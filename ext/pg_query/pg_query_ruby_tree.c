@@ -0,0 +1,537 @@
+#include "pg_query_ruby_tree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Note: Everything in this file may run without the GVL, and must therefore
+ * only use malloc/free (never xmalloc) and not touch any Ruby objects.
+ */
+
+/*
+ * Chunks start small and double in size, so trees of small queries (which may
+ * be kept around, see PgQuery::NativeTree) don't hold on to much unused memory
+ */
+#define PG_QUERY_TREE_MIN_CHUNK_SIZE (1024)
+#define PG_QUERY_TREE_MAX_CHUNK_SIZE (64 * 1024)
+
+struct PgQueryTreeChunk {
+	PgQueryTreeChunk *next;
+	size_t used;
+	size_t size;
+	// data follows
+};
+
+void pg_query_tree_init(PgQueryTree *tree)
+{
+	memset(tree, 0, sizeof(PgQueryTree));
+	tree->root.type = PG_QUERY_TREE_ARRAY;
+}
+
+void pg_query_tree_free(PgQueryTree *tree)
+{
+	PgQueryTreeChunk *chunk = tree->chunks;
+
+	while (chunk) {
+		PgQueryTreeChunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	free(tree->keys);
+	free(tree->keys_hash);
+	free(tree->buffer);
+
+	pg_query_tree_init(tree);
+}
+
+void *pg_query_tree_alloc(PgQueryTree *tree, size_t size)
+{
+	PgQueryTreeChunk *chunk = tree->chunks;
+	void *ptr;
+
+	size = (size + 7) & ~((size_t) 7);
+
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		size_t chunk_size = chunk ? chunk->size * 2 : PG_QUERY_TREE_MIN_CHUNK_SIZE;
+		if (chunk_size > PG_QUERY_TREE_MAX_CHUNK_SIZE) chunk_size = PG_QUERY_TREE_MAX_CHUNK_SIZE;
+		if (chunk_size < size) chunk_size = size;
+
+		chunk = malloc(sizeof(PgQueryTreeChunk) + chunk_size);
+		if (chunk == NULL) return NULL;
+
+		chunk->used = 0;
+		chunk->size = chunk_size;
+		chunk->next = tree->chunks;
+		tree->chunks = chunk;
+		tree->memsize += sizeof(PgQueryTreeChunk) + chunk_size;
+	}
+
+	ptr = ((char *) chunk) + sizeof(PgQueryTreeChunk) + chunk->used;
+	chunk->used += size;
+
+	return ptr;
+}
+
+static unsigned int pg_query_tree_key_hash(const char *str, size_t len)
+{
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int pg_query_tree_grow_keys(PgQueryTree *tree)
+{
+	int new_size = tree->keys_hash_size ? tree->keys_hash_size * 2 : 512;
+	int *new_hash;
+	int i;
+
+	new_hash = malloc(sizeof(int) * new_size);
+	if (new_hash == NULL) return -1;
+
+	for (i = 0; i < new_size; i++)
+		new_hash[i] = -1;
+
+	for (i = 0; i < tree->keys_count; i++) {
+		unsigned int slot = pg_query_tree_key_hash(tree->keys[i].str, tree->keys[i].len) & (new_size - 1);
+		while (new_hash[slot] != -1)
+			slot = (slot + 1) & (new_size - 1);
+		new_hash[slot] = i;
+	}
+
+	free(tree->keys_hash);
+	tree->memsize += sizeof(int) * (new_size - tree->keys_hash_size);
+	tree->keys_hash = new_hash;
+	tree->keys_hash_size = new_size;
+
+	return 0;
+}
+
+int pg_query_tree_intern_key(PgQueryTree *tree, const char *str, size_t len)
+{
+	unsigned int slot;
+	char *copy;
+
+	if (tree->keys_count * 2 >= tree->keys_hash_size && pg_query_tree_grow_keys(tree) != 0)
+		return -1;
+
+	slot = pg_query_tree_key_hash(str, len) & (tree->keys_hash_size - 1);
+	while (tree->keys_hash[slot] != -1) {
+		PgQueryTreeKey *key = &tree->keys[tree->keys_hash[slot]];
+		if (key->len == len && memcmp(key->str, str, len) == 0)
+			return tree->keys_hash[slot];
+		slot = (slot + 1) & (tree->keys_hash_size - 1);
+	}
+
+	if (tree->keys_count == tree->keys_capacity) {
+		int new_capacity = tree->keys_capacity ? tree->keys_capacity * 2 : 256;
+		PgQueryTreeKey *new_keys = realloc(tree->keys, sizeof(PgQueryTreeKey) * new_capacity);
+		if (new_keys == NULL) return -1;
+		tree->memsize += sizeof(PgQueryTreeKey) * (new_capacity - tree->keys_capacity);
+		tree->keys = new_keys;
+		tree->keys_capacity = new_capacity;
+	}
+
+	copy = pg_query_tree_alloc(tree, len + 1);
+	if (copy == NULL) return -1;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	tree->keys[tree->keys_count].str = copy;
+	tree->keys[tree->keys_count].len = len;
+	tree->keys_hash[slot] = tree->keys_count;
+
+	return tree->keys_count++;
+}
+
+/*
+ * JSON reader
+ *
+ * This only needs to understand the JSON that libpg_query produces, but is
+ * written to accept any valid JSON document. Child values are collected on a
+ * stack while an array or object is being read, and copied into the arena in
+ * one piece once its size is known.
+ */
+
+typedef struct {
+	PgQueryTree *tree;
+	char *p;
+	int max_nesting;
+
+	PgQueryTreeValue *values;
+	size_t values_len;
+	size_t values_capacity;
+
+	PgQueryTreeMember *members;
+	size_t members_len;
+	size_t members_capacity;
+} PgQueryTreeParser;
+
+static int pg_query_tree_read_value(PgQueryTreeParser *parser, PgQueryTreeValue *out, int depth);
+
+static void pg_query_tree_skip_whitespace(PgQueryTreeParser *parser)
+{
+	while (*parser->p == ' ' || *parser->p == '\n' || *parser->p == '\r' || *parser->p == '\t')
+		parser->p++;
+}
+
+static int pg_query_tree_hex(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static long pg_query_tree_read_hex4(const char *p)
+{
+	long value = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		int digit = pg_query_tree_hex(p[i]);
+		if (digit < 0) return -1;
+		value = (value << 4) | digit;
+	}
+
+	return value;
+}
+
+/*
+ * Reads a string and unescapes it in place. Unescaping never makes a string
+ * longer, so the output can't overtake the input.
+ */
+static int pg_query_tree_read_string(PgQueryTreeParser *parser, const char **str, size_t *len)
+{
+	char *r = parser->p + 1; // skip opening quote
+	char *w = r;
+
+	*str = r;
+
+	while (*r != '"') {
+		if (*r == '\0') return -1;
+
+		if (*r != '\\') {
+			*w++ = *r++;
+			continue;
+		}
+
+		r++;
+		switch (*r) {
+			case '"': *w++ = '"'; r++; break;
+			case '\\': *w++ = '\\'; r++; break;
+			case '/': *w++ = '/'; r++; break;
+			case 'b': *w++ = '\b'; r++; break;
+			case 'f': *w++ = '\f'; r++; break;
+			case 'n': *w++ = '\n'; r++; break;
+			case 'r': *w++ = '\r'; r++; break;
+			case 't': *w++ = '\t'; r++; break;
+			case 'u':
+			{
+				long cp = pg_query_tree_read_hex4(r + 1);
+				if (cp < 0) return -1;
+				r += 5;
+
+				if (cp >= 0xD800 && cp <= 0xDBFF && r[0] == '\\' && r[1] == 'u') {
+					long low = pg_query_tree_read_hex4(r + 2);
+					if (low >= 0xDC00 && low <= 0xDFFF) {
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+						r += 6;
+					}
+				}
+
+				if (cp < 0x80) {
+					*w++ = (char) cp;
+				} else if (cp < 0x800) {
+					*w++ = (char) (0xC0 | (cp >> 6));
+					*w++ = (char) (0x80 | (cp & 0x3F));
+				} else if (cp < 0x10000) {
+					*w++ = (char) (0xE0 | (cp >> 12));
+					*w++ = (char) (0x80 | ((cp >> 6) & 0x3F));
+					*w++ = (char) (0x80 | (cp & 0x3F));
+				} else {
+					*w++ = (char) (0xF0 | (cp >> 18));
+					*w++ = (char) (0x80 | ((cp >> 12) & 0x3F));
+					*w++ = (char) (0x80 | ((cp >> 6) & 0x3F));
+					*w++ = (char) (0x80 | (cp & 0x3F));
+				}
+				break;
+			}
+			default:
+				return -1;
+		}
+	}
+
+	*len = w - *str;
+	parser->p = r + 1;
+
+	return 0;
+}
+
+static int pg_query_tree_read_number(PgQueryTreeParser *parser, PgQueryTreeValue *out)
+{
+	char *start = parser->p;
+	char *end;
+	int is_float = 0;
+
+	if (*parser->p == '-') parser->p++;
+	if (*parser->p < '0' || *parser->p > '9') return -1;
+
+	while ((*parser->p >= '0' && *parser->p <= '9') || *parser->p == '.' ||
+		   *parser->p == 'e' || *parser->p == 'E' || *parser->p == '+' || *parser->p == '-') {
+		if (*parser->p == '.' || *parser->p == 'e' || *parser->p == 'E') is_float = 1;
+		parser->p++;
+	}
+
+	if (is_float) {
+		out->type = PG_QUERY_TREE_FLOAT;
+		out->u.fl = strtod(start, &end);
+	} else {
+		out->type = PG_QUERY_TREE_INTEGER;
+		out->u.integer = strtoll(start, &end, 10);
+	}
+
+	return end == parser->p ? 0 : -1;
+}
+
+static int pg_query_tree_read_array(PgQueryTreeParser *parser, PgQueryTreeValue *out, int depth)
+{
+	size_t start = parser->values_len;
+	size_t count;
+
+	parser->p++; // skip [
+	pg_query_tree_skip_whitespace(parser);
+
+	out->type = PG_QUERY_TREE_ARRAY;
+	out->len = 0;
+	out->u.items = NULL;
+
+	if (*parser->p == ']') {
+		parser->p++;
+		return 0;
+	}
+
+	for (;;) {
+		PgQueryTreeValue item;
+
+		if (pg_query_tree_read_value(parser, &item, depth) != 0) return -1;
+
+		if (parser->values_len == parser->values_capacity) {
+			size_t new_capacity = parser->values_capacity ? parser->values_capacity * 2 : 256;
+			PgQueryTreeValue *new_values = realloc(parser->values, sizeof(PgQueryTreeValue) * new_capacity);
+			if (new_values == NULL) return -1;
+			parser->values = new_values;
+			parser->values_capacity = new_capacity;
+		}
+		parser->values[parser->values_len++] = item;
+
+		pg_query_tree_skip_whitespace(parser);
+		if (*parser->p == ',') {
+			parser->p++;
+			continue;
+		}
+		if (*parser->p == ']') {
+			parser->p++;
+			break;
+		}
+		return -1;
+	}
+
+	count = parser->values_len - start;
+	out->len = count;
+	out->u.items = pg_query_tree_alloc(parser->tree, sizeof(PgQueryTreeValue) * count);
+	if (out->u.items == NULL) return -1;
+	memcpy(out->u.items, parser->values + start, sizeof(PgQueryTreeValue) * count);
+	parser->values_len = start;
+
+	return 0;
+}
+
+static int pg_query_tree_read_object(PgQueryTreeParser *parser, PgQueryTreeValue *out, int depth)
+{
+	size_t start = parser->members_len;
+	size_t count;
+
+	parser->p++; // skip {
+	pg_query_tree_skip_whitespace(parser);
+
+	out->type = PG_QUERY_TREE_OBJECT;
+	out->len = 0;
+	out->u.members = NULL;
+
+	if (*parser->p == '}') {
+		parser->p++;
+		return 0;
+	}
+
+	for (;;) {
+		PgQueryTreeMember member;
+		const char *key;
+		size_t key_len;
+
+		if (*parser->p != '"') return -1;
+		if (pg_query_tree_read_string(parser, &key, &key_len) != 0) return -1;
+
+		member.key = pg_query_tree_intern_key(parser->tree, key, key_len);
+		if (member.key < 0) return -1;
+
+		pg_query_tree_skip_whitespace(parser);
+		if (*parser->p != ':') return -1;
+		parser->p++;
+
+		if (pg_query_tree_read_value(parser, &member.value, depth) != 0) return -1;
+
+		if (parser->members_len == parser->members_capacity) {
+			size_t new_capacity = parser->members_capacity ? parser->members_capacity * 2 : 256;
+			PgQueryTreeMember *new_members = realloc(parser->members, sizeof(PgQueryTreeMember) * new_capacity);
+			if (new_members == NULL) return -1;
+			parser->members = new_members;
+			parser->members_capacity = new_capacity;
+		}
+		parser->members[parser->members_len++] = member;
+
+		pg_query_tree_skip_whitespace(parser);
+		if (*parser->p == ',') {
+			parser->p++;
+			pg_query_tree_skip_whitespace(parser);
+			continue;
+		}
+		if (*parser->p == '}') {
+			parser->p++;
+			break;
+		}
+		return -1;
+	}
+
+	count = parser->members_len - start;
+	out->len = count;
+	out->u.members = pg_query_tree_alloc(parser->tree, sizeof(PgQueryTreeMember) * count);
+	if (out->u.members == NULL) return -1;
+	memcpy(out->u.members, parser->members + start, sizeof(PgQueryTreeMember) * count);
+	parser->members_len = start;
+
+	return 0;
+}
+
+static int pg_query_tree_read_value(PgQueryTreeParser *parser, PgQueryTreeValue *out, int depth)
+{
+	pg_query_tree_skip_whitespace(parser);
+
+	out->len = 0;
+
+	switch (*parser->p) {
+		case '[':
+			if (depth + 1 > parser->max_nesting) return -1;
+			return pg_query_tree_read_array(parser, out, depth + 1);
+		case '{':
+			if (depth + 1 > parser->max_nesting) return -1;
+			return pg_query_tree_read_object(parser, out, depth + 1);
+		case '"':
+			out->type = PG_QUERY_TREE_STRING;
+			return pg_query_tree_read_string(parser, &out->u.str, &out->len);
+		case 't':
+			if (strncmp(parser->p, "true", 4) != 0) return -1;
+			parser->p += 4;
+			out->type = PG_QUERY_TREE_BOOL;
+			out->u.boolean = 1;
+			return 0;
+		case 'f':
+			if (strncmp(parser->p, "false", 5) != 0) return -1;
+			parser->p += 5;
+			out->type = PG_QUERY_TREE_BOOL;
+			out->u.boolean = 0;
+			return 0;
+		case 'n':
+			if (strncmp(parser->p, "null", 4) != 0) return -1;
+			parser->p += 4;
+			out->type = PG_QUERY_TREE_NULL;
+			return 0;
+		default:
+			return pg_query_tree_read_number(parser, out);
+	}
+}
+
+int pg_query_tree_parse_json(PgQueryTree *tree, char *json, int max_nesting)
+{
+	PgQueryTreeParser parser = {0};
+	int ret;
+
+	tree->buffer = json;
+	tree->buffer_len = strlen(json);
+	tree->memsize += tree->buffer_len + 1;
+
+	parser.tree = tree;
+	parser.p = json;
+	parser.max_nesting = max_nesting;
+
+	ret = pg_query_tree_read_value(&parser, &tree->root, 0);
+	if (ret == 0) {
+		pg_query_tree_skip_whitespace(&parser);
+		if (*parser.p != '\0') ret = -1;
+	}
+
+	free(parser.values);
+	free(parser.members);
+
+	return ret;
+}
+
+/*
+ * Accessors
+ */
+
+PgQueryTreeValue *pg_query_tree_object_get(PgQueryTree *tree, PgQueryTreeValue *object, const char *key)
+{
+	size_t len = strlen(key);
+	size_t i;
+
+	if (object == NULL || object->type != PG_QUERY_TREE_OBJECT) return NULL;
+
+	for (i = 0; i < object->len; i++) {
+		PgQueryTreeKey *member_key = &tree->keys[object->u.members[i].key];
+		if (member_key->len == len && memcmp(member_key->str, key, len) == 0)
+			return &object->u.members[i].value;
+	}
+
+	return NULL;
+}
+
+int pg_query_tree_object_delete(PgQueryTree *tree, PgQueryTreeValue *object, const char *key)
+{
+	PgQueryTreeValue *value = pg_query_tree_object_get(tree, object, key);
+	PgQueryTreeMember *member;
+
+	if (value == NULL) return 0;
+
+	// Members hold their value inline, so this gets us back to the member
+	member = (PgQueryTreeMember *) ((char *) value - offsetof(PgQueryTreeMember, value));
+	memmove(member, member + 1, sizeof(PgQueryTreeMember) * (object->u.members + object->len - member - 1));
+	object->len--;
+
+	return 1;
+}
+
+PgQueryTreeKey *pg_query_tree_node_name(PgQueryTree *tree, PgQueryTreeValue *node)
+{
+	if (node == NULL || node->type != PG_QUERY_TREE_OBJECT || node->len == 0) return NULL;
+
+	return &tree->keys[node->u.members[0].key];
+}
+
+PgQueryTreeValue *pg_query_tree_node_fields(PgQueryTreeValue *node)
+{
+	if (node == NULL || node->type != PG_QUERY_TREE_OBJECT || node->len == 0) return NULL;
+
+	return &node->u.members[0].value;
+}
+
+int pg_query_tree_key_equals(const PgQueryTreeKey *key, const char *str)
+{
+	return key != NULL && key->len == strlen(str) && memcmp(key->str, str, key->len) == 0;
+}
@@ -0,0 +1,100 @@
+#ifndef PG_QUERY_RUBY_TREE_H
+#define PG_QUERY_RUBY_TREE_H
+
+#include <stddef.h>
+
+/*
+ * Native representation of the parse tree that libpg_query outputs as JSON.
+ *
+ * This mirrors the structure of PgQuery#tree (objects, arrays and scalars),
+ * but lives entirely in malloc-ed memory, so it can be built and inspected
+ * without holding the GVL. All values are allocated from an arena owned by
+ * the tree, and freed together with it.
+ */
+
+typedef enum {
+	PG_QUERY_TREE_NULL,
+	PG_QUERY_TREE_BOOL,
+	PG_QUERY_TREE_INTEGER,
+	PG_QUERY_TREE_FLOAT,
+	PG_QUERY_TREE_STRING,
+	PG_QUERY_TREE_ARRAY,
+	PG_QUERY_TREE_OBJECT
+} PgQueryTreeType;
+
+typedef struct PgQueryTreeValue PgQueryTreeValue;
+typedef struct PgQueryTreeMember PgQueryTreeMember;
+
+struct PgQueryTreeValue {
+	PgQueryTreeType type;
+	size_t len; // string length, or number of array items / object members
+	union {
+		int boolean;
+		long long integer;
+		double fl;
+		const char *str; // not NUL-terminated, use len
+		PgQueryTreeValue *items;
+		PgQueryTreeMember *members;
+	} u;
+};
+
+struct PgQueryTreeMember {
+	int key; // index into PgQueryTree.keys
+	PgQueryTreeValue value;
+};
+
+typedef struct {
+	const char *str;
+	size_t len;
+} PgQueryTreeKey;
+
+typedef struct PgQueryTreeChunk PgQueryTreeChunk;
+
+typedef struct {
+	PgQueryTreeValue root;
+
+	// Object keys are interned, there are only a few hundred distinct ones
+	PgQueryTreeKey *keys;
+	int keys_count;
+	int keys_capacity;
+	int *keys_hash;
+	int keys_hash_size;
+
+	char *buffer; // JSON text, string values point into it after unescaping
+	size_t buffer_len;
+	PgQueryTreeChunk *chunks;
+	size_t memsize;
+} PgQueryTree;
+
+#define PG_QUERY_TREE_MAX_NESTING 1000
+
+void pg_query_tree_init(PgQueryTree *tree);
+void pg_query_tree_free(PgQueryTree *tree);
+
+/*
+ * Takes ownership of the malloc-ed JSON buffer (it is modified in place) and
+ * builds the tree from it. Returns 0 on success, or -1 if the JSON was invalid
+ * or nested deeper than max_nesting.
+ */
+int pg_query_tree_parse_json(PgQueryTree *tree, char *json, int max_nesting);
+
+/*
+ * Building blocks for constructing a tree by other means than JSON. Both
+ * return NULL / -1 when out of memory.
+ */
+void *pg_query_tree_alloc(PgQueryTree *tree, size_t size);
+int pg_query_tree_intern_key(PgQueryTree *tree, const char *str, size_t len);
+
+/*
+ * Accessors, mirroring how the Ruby code looks at the tree: a node is an object
+ * with a single member, keyed by the node name, whose value holds the fields.
+ * All of them accept NULL (or a value of the wrong type), and return NULL (or
+ * 0 for pg_query_tree_object_delete) if there is no such member.
+ */
+PgQueryTreeValue *pg_query_tree_object_get(PgQueryTree *tree, PgQueryTreeValue *object, const char *key);
+int pg_query_tree_object_delete(PgQueryTree *tree, PgQueryTreeValue *object, const char *key);
+PgQueryTreeKey *pg_query_tree_node_name(PgQueryTree *tree, PgQueryTreeValue *node);
+PgQueryTreeValue *pg_query_tree_node_fields(PgQueryTreeValue *node);
+int pg_query_tree_key_equals(const PgQueryTreeKey *key, const char *str);
+
+#endif
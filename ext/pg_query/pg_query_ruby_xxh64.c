@@ -0,0 +1,127 @@
+#include "pg_query_ruby_xxh64.h"
+
+#include <string.h>
+
+#define PG_QUERY_XXH64_PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define PG_QUERY_XXH64_PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PG_QUERY_XXH64_PRIME3 UINT64_C(0x165667B19E3779F9)
+#define PG_QUERY_XXH64_PRIME4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PG_QUERY_XXH64_PRIME5 UINT64_C(0x27D4EB2F165667C5)
+
+#define PG_QUERY_XXH64_ROL(value, bits) (((value) << (bits)) | ((value) >> (64 - (bits))))
+
+// Little-endian reads, independent of the platform's byte order and alignment
+static uint64_t pg_query_xxh64_read64(const unsigned char *p)
+{
+	return (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24) |
+		   ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) | ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+static uint32_t pg_query_xxh64_read32(const unsigned char *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t pg_query_xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PG_QUERY_XXH64_PRIME2;
+	acc = PG_QUERY_XXH64_ROL(acc, 31);
+	return acc * PG_QUERY_XXH64_PRIME1;
+}
+
+static uint64_t pg_query_xxh64_merge_round(uint64_t acc, uint64_t value)
+{
+	acc ^= pg_query_xxh64_round(0, value);
+	return acc * PG_QUERY_XXH64_PRIME1 + PG_QUERY_XXH64_PRIME4;
+}
+
+static void pg_query_xxh64_stripe(PgQueryXXH64 *ctx, const unsigned char *p)
+{
+	ctx->v[0] = pg_query_xxh64_round(ctx->v[0], pg_query_xxh64_read64(p));
+	ctx->v[1] = pg_query_xxh64_round(ctx->v[1], pg_query_xxh64_read64(p + 8));
+	ctx->v[2] = pg_query_xxh64_round(ctx->v[2], pg_query_xxh64_read64(p + 16));
+	ctx->v[3] = pg_query_xxh64_round(ctx->v[3], pg_query_xxh64_read64(p + 24));
+}
+
+void pg_query_xxh64_init(PgQueryXXH64 *ctx, uint64_t seed)
+{
+	ctx->v[0] = seed + PG_QUERY_XXH64_PRIME1 + PG_QUERY_XXH64_PRIME2;
+	ctx->v[1] = seed + PG_QUERY_XXH64_PRIME2;
+	ctx->v[2] = seed;
+	ctx->v[3] = seed - PG_QUERY_XXH64_PRIME1;
+	ctx->seed = seed;
+	ctx->length = 0;
+	ctx->buffer_len = 0;
+}
+
+void pg_query_xxh64_update(PgQueryXXH64 *ctx, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	ctx->length += len;
+
+	if (ctx->buffer_len > 0) {
+		size_t n = 32 - ctx->buffer_len;
+		if (n > len) n = len;
+		memcpy(ctx->buffer + ctx->buffer_len, p, n);
+		ctx->buffer_len += n;
+		p += n;
+		len -= n;
+		if (ctx->buffer_len < 32) return;
+		pg_query_xxh64_stripe(ctx, ctx->buffer);
+		ctx->buffer_len = 0;
+	}
+
+	while (len >= 32) {
+		pg_query_xxh64_stripe(ctx, p);
+		p += 32;
+		len -= 32;
+	}
+
+	memcpy(ctx->buffer, p, len);
+	ctx->buffer_len = len;
+}
+
+uint64_t pg_query_xxh64_digest(const PgQueryXXH64 *ctx)
+{
+	const unsigned char *p = ctx->buffer;
+	size_t len = ctx->buffer_len;
+	uint64_t hash;
+	int i;
+
+	if (ctx->length >= 32) {
+		hash = PG_QUERY_XXH64_ROL(ctx->v[0], 1) + PG_QUERY_XXH64_ROL(ctx->v[1], 7) +
+			   PG_QUERY_XXH64_ROL(ctx->v[2], 12) + PG_QUERY_XXH64_ROL(ctx->v[3], 18);
+		for (i = 0; i < 4; i++)
+			hash = pg_query_xxh64_merge_round(hash, ctx->v[i]);
+	} else {
+		hash = ctx->seed + PG_QUERY_XXH64_PRIME5;
+	}
+
+	hash += ctx->length;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		hash ^= pg_query_xxh64_round(0, pg_query_xxh64_read64(p));
+		hash = PG_QUERY_XXH64_ROL(hash, 27) * PG_QUERY_XXH64_PRIME1 + PG_QUERY_XXH64_PRIME4;
+	}
+
+	if (len >= 4) {
+		hash ^= (uint64_t) pg_query_xxh64_read32(p) * PG_QUERY_XXH64_PRIME1;
+		hash = PG_QUERY_XXH64_ROL(hash, 23) * PG_QUERY_XXH64_PRIME2 + PG_QUERY_XXH64_PRIME3;
+		p += 4;
+		len -= 4;
+	}
+
+	for (; len > 0; p++, len--) {
+		hash ^= *p * PG_QUERY_XXH64_PRIME5;
+		hash = PG_QUERY_XXH64_ROL(hash, 11) * PG_QUERY_XXH64_PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PG_QUERY_XXH64_PRIME2;
+	hash ^= hash >> 29;
+	hash *= PG_QUERY_XXH64_PRIME3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
@@ -0,0 +1,25 @@
+#ifndef PG_QUERY_RUBY_XXH64_H
+#define PG_QUERY_RUBY_XXH64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal streaming XXH64 (https://github.com/Cyan4973/xxHash), used for
+ * version 3 fingerprints of native trees. Must produce the same hashes as
+ * PgQuery::XXH64 in lib/pg_query/xxh64.rb.
+ */
+
+typedef struct {
+	uint64_t v[4];
+	uint64_t seed;
+	uint64_t length; // total bytes hashed
+	unsigned char buffer[32];
+	size_t buffer_len;
+} PgQueryXXH64;
+
+void pg_query_xxh64_init(PgQueryXXH64 *ctx, uint64_t seed);
+void pg_query_xxh64_update(PgQueryXXH64 *ctx, const void *data, size_t len);
+uint64_t pg_query_xxh64_digest(const PgQueryXXH64 *ctx);
+
+#endif
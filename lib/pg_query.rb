@@ -1,8 +1,15 @@
 require 'pg_query/version'
 require 'pg_query/parse_error'
+require 'pg_query/shareable'
 
 require 'pg_query/pg_query'
 require 'pg_query/parse'
+require 'pg_query/result'
+require 'pg_query/cache'
+require 'pg_query/batch'
+require 'pg_query/analyze'
+require 'pg_query/statements'
+require 'pg_query/log_aggregator'
 require 'pg_query/treewalker'
 require 'pg_query/node_types'
 require 'pg_query/deep_dup'
@@ -11,6 +18,8 @@ require 'pg_query/legacy_parsetree'
 
 require 'pg_query/filter_columns'
 require 'pg_query/fingerprint'
+require 'pg_query/xxh64'
 require 'pg_query/param_refs'
 require 'pg_query/deparse'
 require 'pg_query/truncate'
+require 'pg_query/instrument'
@@ -0,0 +1,57 @@
+class PgQuery
+  # Summary of a query, as returned by PgQuery.analyze
+  class Analysis
+    attr_reader :query
+    attr_reader :normalized
+    attr_reader :fingerprint
+    attr_reader :statement_types
+    attr_reader :tables_with_types
+    attr_reader :cte_names
+    attr_reader :aliases
+    attr_reader :param_refs
+    attr_reader :warnings
+
+    def initialize(query, normalized, fingerprint, statement_types, tables_with_types, cte_names, aliases, param_refs, warnings) # rubocop:disable Metrics/ParameterLists
+      @query = query
+      @normalized = normalized
+      @fingerprint = fingerprint
+      @statement_types = statement_types
+      @tables_with_types = tables_with_types
+      @cte_names = cte_names
+      @aliases = aliases
+      @param_refs = param_refs
+      @warnings = warnings
+    end
+
+    def tables
+      tables_with_types.map { |t| t[:table] }
+    end
+
+    def select_tables
+      tables_with_types.select { |t| t[:type] == :select }.map { |t| t[:table] }
+    end
+
+    def dml_tables
+      tables_with_types.select { |t| t[:type] == :dml }.map { |t| t[:table] }
+    end
+
+    def ddl_tables
+      tables_with_types.select { |t| t[:type] == :ddl }.map { |t| t[:table] }
+    end
+  end
+
+  # Parses the query once and returns what PgQuery.normalize, PgQuery#fingerprint,
+  # PgQuery#tables_with_types, #cte_names, #aliases and #param_refs would return
+  # for it, along with the node type of each statement (e.g. "SelectStmt").
+  #
+  # The parse tree itself is never turned into Ruby objects, which makes this
+  # considerably cheaper than calling these methods separately.
+  def self.analyze(query)
+    normalized, fingerprint, statement_types, tables, cte_names, aliases, param_refs, warnings = _analyze(query)
+
+    fingerprint ||= parse(query).fingerprint
+    param_refs.sort_by! { |r| r['location'] }
+
+    Analysis.new(query, normalized, fingerprint, statement_types, tables, cte_names, aliases, param_refs, warnings)
+  end
+end
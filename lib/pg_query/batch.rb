@@ -0,0 +1,69 @@
+require 'etc'
+
+class PgQuery
+  DEFAULT_BATCH_THREADS = (Etc.respond_to?(:nprocessors) ? Etc.nprocessors : 1).freeze
+
+  class << self
+    # Number of native threads the *_many methods use by default (one per CPU
+    # unless changed, which can only be done from the main Ractor)
+    def batch_threads
+      @batch_threads || DEFAULT_BATCH_THREADS
+    end
+
+    def batch_threads=(threads)
+      if defined?(Ractor) && !Ractor.current.equal?(MAIN_RACTOR)
+        raise Ractor::UnsafeError, 'PgQuery.batch_threads can only be changed from the main Ractor'
+      end
+      @batch_threads = threads
+    end
+  end
+
+  # Parses all queries on a pool of native threads, without holding the GVL.
+  #
+  # Returns an Array in the same order as the input, with a PgQuery object for
+  # each query, or the PgQuery::ParseError (not raised) if it failed to parse.
+  def self.parse_many(queries, threads: batch_threads)
+    results = _raw_parse_tree_many(queries, threads)
+    results.each_with_index.map do |result, i|
+      next result if result.is_a?(ParseError)
+      tree, warnings = result
+      PgQuery.new(queries[i], tree, warnings)
+    end
+  end
+
+  # Like PgQuery.normalize, for many queries at once (see PgQuery.parse_many)
+  def self.normalize_many(queries, threads: batch_threads)
+    _normalize_many(queries, threads)
+  end
+
+  # Like PgQuery.fingerprint, for many queries at once (see PgQuery.parse_many)
+  def self.fingerprint_many(queries, threads: batch_threads)
+    _fingerprint_many(queries, threads)
+  end
+
+  # Like PgQuery.fingerprint_many, but spreads the queries over a number of
+  # Ractors instead, so the Ruby side of each call (e.g. creating the result
+  # Strings) runs in parallel as well. Falls back to PgQuery.fingerprint_many
+  # on Rubies without Ractors.
+  def self.fingerprint_parallel(queries, ractors: batch_threads)
+    return fingerprint_many(queries, threads: ractors) unless defined?(Ractor)
+    return [] if queries.empty?
+
+    ractors = 1 if ractors < 1
+
+    slice_size = (queries.size + ractors - 1) / ractors
+    workers = queries.each_slice(slice_size).map do |slice|
+      Ractor.new(slice) do |slice_queries|
+        slice_queries.map do |query|
+          begin
+            PgQuery.fingerprint(query)
+          rescue ParseError => e
+            e
+          end
+        end
+      end
+    end
+
+    workers.flat_map { |worker| worker.respond_to?(:value) ? worker.value : worker.take }
+  end
+end
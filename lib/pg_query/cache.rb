@@ -0,0 +1,189 @@
+class PgQuery
+  # Bounded LRU cache for the results of PgQuery.parse, PgQuery.normalize and
+  # PgQuery.fingerprint, keyed by the query text. Disabled by default, enable it
+  # with:
+  #
+  #   PgQuery.cache = PgQuery::Cache.new(max_bytes: 64 * 1024 * 1024)
+  #
+  # Entries are spread over a number of shards by the hash of the query, each
+  # with its own lock and an equal share of the byte budget, so threads only
+  # contend when they look up queries in the same shard.
+  #
+  # Cached results are deep-frozen and shared between callers - PgQuery.parse
+  # returns a new PgQuery object on every call, but its tree can't be modified
+  # in place (copy it with PgQuery#deep_dup first). Queries parsed with
+  # lazy: true share their native tree instead, and each build their own copy of
+  # the tree from it when needed.
+  class Cache
+    DEFAULT_SHARDS = 16
+
+    # Estimated size of an entry without its results, and of the Ruby objects
+    # cached results are made of (the actual size depends on the Ruby version)
+    ENTRY_OVERHEAD = 160
+    OBJECT_OVERHEAD = 40
+    REFERENCE_SIZE = 8
+
+    SLOTS = { parse: 0, parse_native: 1, normalize: 2, fingerprint: 3, normalize_with_constants: 4,
+              fingerprint_xxh64: 5, fingerprint_int: 6, fingerprint_binary: 7 }.freeze
+    MISSING = Object.new.freeze
+    private_constant :SLOTS, :MISSING
+
+    Entry = Struct.new(:key, :values, :bytes)
+    Shard = Struct.new(:lock, :entries, :bytes, :hits, :misses, :evictions)
+    private_constant :Entry, :Shard
+
+    attr_reader :max_bytes
+
+    def initialize(max_bytes:, shards: DEFAULT_SHARDS)
+      raise ArgumentError, 'shards must be a power of two' unless shards > 0 && (shards & (shards - 1)).zero?
+
+      @max_bytes = max_bytes
+      @shard_max_bytes = max_bytes / shards
+      @mask = shards - 1
+      @shards = Array.new(shards) { Shard.new(Mutex.new, {}, 0, 0, 0, 0) }
+    end
+
+    # Returns the cached result of the given kind (:parse, :parse_native,
+    # :normalize, :normalize_with_constants, :fingerprint, :fingerprint_xxh64,
+    # :fingerprint_int or :fingerprint_binary) for the query, or
+    # calls the block and caches what it returns.
+    #
+    # The block runs without holding any lock, so two threads that miss on the
+    # same query at the same time both compute it (and the first result wins).
+    def fetch(query, kind)
+      index = SLOTS.fetch(kind)
+      shard = @shards[query.hash & @mask]
+
+      value = shard.lock.synchronize { lookup(shard, query, index) }
+      return value unless value.equal?(MISSING)
+
+      value = yield
+      bytes = Cache.deep_freeze(value)
+      shard.lock.synchronize { store(shard, query, index, value, bytes) }
+    end
+
+    # Returns a Hash with the number of :hits, :misses and :evictions since the
+    # cache was created, and the current number of :entries and their :bytes
+    def stats
+      stats = { hits: 0, misses: 0, evictions: 0, entries: 0, bytes: 0 }
+      @shards.each do |shard|
+        shard.lock.synchronize do
+          stats[:hits] += shard.hits
+          stats[:misses] += shard.misses
+          stats[:evictions] += shard.evictions
+          stats[:entries] += shard.entries.size
+          stats[:bytes] += shard.bytes
+        end
+      end
+      stats
+    end
+
+    def clear
+      @shards.each do |shard|
+        shard.lock.synchronize do
+          shard.entries.clear
+          shard.bytes = 0
+        end
+      end
+      nil
+    end
+
+    # Freezes the object and everything it references, and returns an estimate
+    # of the memory used by the parts that weren't frozen already (frozen Strings
+    # like the node and field names in parse trees are shared between trees)
+    def self.deep_freeze(obj)
+      case obj
+      when Hash
+        bytes = OBJECT_OVERHEAD + obj.size * 3 * REFERENCE_SIZE
+        obj.each do |key, value|
+          bytes += deep_freeze(key) + deep_freeze(value)
+        end
+        obj.freeze
+        bytes
+      when Array, Struct
+        bytes = OBJECT_OVERHEAD + obj.size * REFERENCE_SIZE
+        obj.each { |value| bytes += deep_freeze(value) }
+        obj.freeze
+        bytes
+      when NativeTree
+        obj.freeze
+        obj.memsize
+      when String
+        return 0 if obj.frozen?
+        obj.freeze
+        OBJECT_OVERHEAD + obj.bytesize
+      else
+        obj.freeze
+        0
+      end
+    end
+
+    private
+
+    def lookup(shard, query, index)
+      entry = shard.entries.delete(query)
+      if entry.nil?
+        shard.misses += 1
+        return MISSING
+      end
+
+      # Move to the most recently used end
+      shard.entries[entry.key] = entry
+
+      value = entry.values[index]
+      if value.equal?(MISSING)
+        shard.misses += 1
+      else
+        shard.hits += 1
+      end
+      value
+    end
+
+    def store(shard, query, index, value, bytes)
+      entry = shard.entries[query]
+      if entry.nil?
+        key = query.frozen? ? query : query.dup.freeze
+        entry = Entry.new(key, [MISSING] * SLOTS.size, ENTRY_OVERHEAD + key.bytesize)
+        shard.entries[key] = entry
+        shard.bytes += entry.bytes
+      end
+
+      # Another thread got here first, keep its result
+      return entry.values[index] unless entry.values[index].equal?(MISSING)
+
+      entry.values[index] = value
+      entry.bytes += bytes
+      shard.bytes += bytes
+
+      evict(shard)
+      value
+    end
+
+    def evict(shard)
+      while shard.bytes > @shard_max_bytes && !shard.entries.empty?
+        _, entry = shard.entries.shift
+        shard.bytes -= entry.bytes
+        shard.evictions += 1
+      end
+    end
+  end
+
+  class << self
+    # Cache used by PgQuery.parse, PgQuery.normalize and PgQuery.fingerprint,
+    # or nil (the default) to not cache anything
+    attr_accessor :cache
+  end
+
+  MAIN_RACTOR = Ractor.current if defined?(Ractor)
+  private_constant :MAIN_RACTOR if defined?(Ractor)
+
+  # The cache can only be used from the main Ractor, others don't cache anything
+  def self.cached(query, kind)
+    return yield if defined?(Ractor) && !Ractor.current.equal?(MAIN_RACTOR)
+
+    current_cache = cache
+    return yield if current_cache.nil?
+    current_cache.fetch(query, kind) { yield }
+  end
+  private_class_method :cached
+end
@@ -1,15 +1,38 @@
+# frozen_string_literal: true
+
 require_relative 'deparse/alter_table'
 require_relative 'deparse/interval'
 require_relative 'deparse/keywords'
 
 class PgQuery
+  # Placeholder for the parts of a query omitted by #truncate
+  A_TRUNCATED = 'A_Truncated'
+
   # Reconstruct all of the parsed queries into their original form
-  def deparse(tree = @tree)
-    tree.map do |item|
-      Deparse.from(item)
-    end.join('; ')
+  def deparse(tree = nil)
+    if tree.nil?
+      deparsed = @native_tree.deparse if @native_tree
+      return deparsed if deparsed
+      tree = self.tree
+    end
+
+    # Returns nil for trees the native deparser doesn't handle the same way
+    # (e.g. unsupported node types, which raise here), and for values that
+    # aren't part of a regular parse tree
+    PgQuery._deparse_tree(tree) || ruby_deparse(tree)
   end
 
+  def ruby_deparse(tree)
+    Deparse.from_tree(tree)
+  end
+  private :ruby_deparse
+
+  # All of the deparse_* methods append to the output String they are given,
+  # instead of returning a new String, so deparsing a tree only allocates the
+  # output itself. They return nil (having appended nothing) for items that
+  # deparse to nothing, e.g. nil items, which some lists leave out instead of
+  # joining them as empty strings.
+  #
   # rubocop:disable Metrics/ModuleLength
   module Deparse
     extend self
@@ -17,549 +40,594 @@ class PgQuery
     # Given one element of the PgQuery#parsetree reconstruct it back into the
     # original query.
     def from(item)
-      deparse_item(item)
+      output = ''.dup
+      deparse_item(output, item) ? output : nil
+    end
+
+    # Reconstructs all of the statements of a PgQuery#tree, separated by
+    # semicolons.
+    def from_tree(tree)
+      deparse_list(''.dup, tree, '; ')
     end
 
     private
 
-    def deparse_item(item, context = nil) # rubocop:disable Metrics/CyclomaticComplexity
+    DEPARSERS = PgQuery.make_shareable(
+      A_EXPR               => :deparse_a_expr,
+      ACCESS_PRIV          => :deparse_access_priv,
+      ALIAS                => :deparse_alias,
+      ALTER_TABLE_STMT     => :deparse_alter_table,
+      ALTER_TABLE_CMD      => :deparse_alter_table_cmd,
+      A_ARRAY_EXPR         => :deparse_a_arrayexp,
+      A_CONST              => :deparse_a_const,
+      A_INDICES            => :deparse_a_indices,
+      A_INDIRECTION        => :deparse_a_indirection,
+      A_STAR               => :deparse_a_star,
+      A_TRUNCATED          => :deparse_a_truncated,
+      BOOL_EXPR            => :deparse_bool_expr,
+      BOOLEAN_TEST         => :deparse_boolean_test,
+      CASE_EXPR            => :deparse_case,
+      COALESCE_EXPR        => :deparse_coalesce,
+      COLLATE_CLAUSE       => :deparse_collate,
+      COLUMN_DEF           => :deparse_columndef,
+      COLUMN_REF           => :deparse_columnref,
+      COMMON_TABLE_EXPR    => :deparse_cte,
+      COMPOSITE_TYPE_STMT  => :deparse_composite_type,
+      CONSTRAINT           => :deparse_constraint,
+      COPY_STMT            => :deparse_copy,
+      CREATE_CAST_STMT     => :deparse_create_cast,
+      CREATE_DOMAIN_STMT   => :deparse_create_domain,
+      CREATE_ENUM_STMT     => :deparse_create_enum,
+      CREATE_FUNCTION_STMT => :deparse_create_function,
+      CREATE_RANGE_STMT    => :deparse_create_range,
+      CREATE_SCHEMA_STMT   => :deparse_create_schema,
+      CREATE_STMT          => :deparse_create_table,
+      CREATE_TABLE_AS_STMT => :deparse_create_table_as,
+      INTO_CLAUSE          => :deparse_into_clause,
+      DEF_ELEM             => :deparse_defelem,
+      DEFINE_STMT          => :deparse_define_stmt,
+      DELETE_STMT          => :deparse_delete_from,
+      DISCARD_STMT         => :deparse_discard,
+      DROP_STMT            => :deparse_drop,
+      EXPLAIN_STMT         => :deparse_explain,
+      FUNC_CALL            => :deparse_funccall,
+      FUNCTION_PARAMETER   => :deparse_functionparameter,
+      GRANT_ROLE_STMT      => :deparse_grant_role,
+      GRANT_STMT           => :deparse_grant,
+      INSERT_STMT          => :deparse_insert_into,
+      JOIN_EXPR            => :deparse_joinexpr,
+      LOCK_STMT            => :deparse_lock,
+      LOCKING_CLAUSE       => :deparse_lockingclause,
+      NULL_TEST            => :deparse_nulltest,
+      OBJECT_WITH_ARGS     => :deparse_object_with_args,
+      PARAM_REF            => :deparse_paramref,
+      RANGE_FUNCTION       => :deparse_range_function,
+      RANGE_SUBSELECT      => :deparse_rangesubselect,
+      RANGE_VAR            => :deparse_rangevar,
+      RAW_STMT             => :deparse_raw_stmt,
+      RENAME_STMT          => :deparse_renamestmt,
+      RES_TARGET           => :deparse_restarget,
+      ROLE_SPEC            => :deparse_role_spec,
+      ROW_EXPR             => :deparse_row,
+      SELECT_STMT          => :deparse_select,
+      SQL_VALUE_FUNCTION   => :deparse_sql_value_function,
+      SORT_BY              => :deparse_sortby,
+      SUB_LINK             => :deparse_sublink,
+      TRANSACTION_STMT     => :deparse_transaction,
+      TYPE_CAST            => :deparse_typecast,
+      TYPE_NAME            => :deparse_typename,
+      UPDATE_STMT          => :deparse_update,
+      CASE_WHEN            => :deparse_when,
+      WINDOW_DEF           => :deparse_windowdef,
+      WITH_CLAUSE          => :deparse_with_clause,
+      VIEW_STMT            => :deparse_viewstmt,
+      VARIABLE_SET_STMT    => :deparse_variable_set_stmt,
+      VACUUM_STMT          => :deparse_vacuum_stmt,
+      DO_STMT              => :deparse_do_stmt,
+      STRING               => :deparse_string,
+      INTEGER              => :deparse_integer,
+      FLOAT                => :deparse_float,
+      NULL                 => :deparse_null
+    )
+
+    def deparse_item(output, item, context = nil)
       return if item.nil?
-      return item if item.is_a?(Integer)
+      return output << item.to_s if item.is_a?(Integer)
 
-      type = item.keys[0]
-      node = item.values[0]
+      # Unlike Hash#first (or breaking out of the block), this doesn't allocate
+      type = node = nil
+      item.each_pair do |key, value|
+        type = key
+        node = value
+      end
 
-      case type
-      when A_EXPR
-        case node['kind']
-        when AEXPR_OP
-          deparse_aexpr(node, context)
-        when AEXPR_OP_ALL
-          deparse_aexpr_all(node)
-        when AEXPR_OP_ANY
-          deparse_aexpr_any(node)
-        when AEXPR_IN
-          deparse_aexpr_in(node)
-        when AEXPR_ILIKE
-          deparse_aexpr_ilike(node)
-        when CONSTR_TYPE_FOREIGN
-          deparse_aexpr_like(node)
-        when AEXPR_BETWEEN, AEXPR_NOT_BETWEEN, AEXPR_BETWEEN_SYM, AEXPR_NOT_BETWEEN_SYM
-          deparse_aexpr_between(node)
-        when AEXPR_NULLIF
-          deparse_aexpr_nullif(node)
-        else
-          raise format("Can't deparse: %s: %s", type, node.inspect)
-        end
-      when ACCESS_PRIV
-        deparse_access_priv(node)
-      when ALIAS
-        deparse_alias(node)
-      when ALTER_TABLE_STMT
-        deparse_alter_table(node)
-      when ALTER_TABLE_CMD
-        deparse_alter_table_cmd(node)
-      when A_ARRAY_EXPR
-        deparse_a_arrayexp(node)
-      when A_CONST
-        deparse_a_const(node)
-      when A_INDICES
-        deparse_a_indices(node)
-      when A_INDIRECTION
-        deparse_a_indirection(node)
-      when A_STAR
-        deparse_a_star(node)
-      when A_TRUNCATED
-        '...' # pg_query internal
-      when BOOL_EXPR
-        case node['boolop']
-        when BOOL_EXPR_AND
-          deparse_bool_expr_and(node)
-        when BOOL_EXPR_OR
-          deparse_bool_expr_or(node)
-        when BOOL_EXPR_NOT
-          deparse_bool_expr_not(node)
-        end
-      when BOOLEAN_TEST
-        deparse_boolean_test(node)
-      when CASE_EXPR
-        deparse_case(node)
-      when COALESCE_EXPR
-        deparse_coalesce(node)
-      when COLLATE_CLAUSE
-        deparse_collate(node)
-      when COLUMN_DEF
-        deparse_columndef(node)
-      when COLUMN_REF
-        deparse_columnref(node)
-      when COMMON_TABLE_EXPR
-        deparse_cte(node)
-      when COMPOSITE_TYPE_STMT
-        deparse_composite_type(node)
-      when CONSTRAINT
-        deparse_constraint(node)
-      when COPY_STMT
-        deparse_copy(node)
-      when CREATE_CAST_STMT
-        deparse_create_cast(node)
-      when CREATE_DOMAIN_STMT
-        deparse_create_domain(node)
-      when CREATE_ENUM_STMT
-        deparse_create_enum(node)
-      when CREATE_FUNCTION_STMT
-        deparse_create_function(node)
-      when CREATE_RANGE_STMT
-        deparse_create_range(node)
-      when CREATE_SCHEMA_STMT
-        deparse_create_schema(node)
-      when CREATE_STMT
-        deparse_create_table(node)
-      when CREATE_TABLE_AS_STMT
-        deparse_create_table_as(node)
-      when INTO_CLAUSE
-        deparse_into_clause(node)
-      when DEF_ELEM
-        deparse_defelem(node)
-      when DEFINE_STMT
-        deparse_define_stmt(node)
-      when DELETE_STMT
-        deparse_delete_from(node)
-      when DISCARD_STMT
-        deparse_discard(node)
-      when DROP_STMT
-        deparse_drop(node)
-      when EXPLAIN_STMT
-        deparse_explain(node)
-      when FUNC_CALL
-        deparse_funccall(node)
-      when FUNCTION_PARAMETER
-        deparse_functionparameter(node)
-      when GRANT_ROLE_STMT
-        deparse_grant_role(node)
-      when GRANT_STMT
-        deparse_grant(node)
-      when INSERT_STMT
-        deparse_insert_into(node)
-      when JOIN_EXPR
-        deparse_joinexpr(node)
-      when LOCK_STMT
-        deparse_lock(node)
-      when LOCKING_CLAUSE
-        deparse_lockingclause(node)
-      when NULL_TEST
-        deparse_nulltest(node)
-      when OBJECT_WITH_ARGS
-        deparse_object_with_args(node)
-      when PARAM_REF
-        deparse_paramref(node)
-      when RANGE_FUNCTION
-        deparse_range_function(node)
-      when RANGE_SUBSELECT
-        deparse_rangesubselect(node)
-      when RANGE_VAR
-        deparse_rangevar(node)
-      when RAW_STMT
-        deparse_raw_stmt(node)
-      when RENAME_STMT
-        deparse_renamestmt(node)
-      when RES_TARGET
-        deparse_restarget(node, context)
-      when ROLE_SPEC
-        deparse_role_spec(node)
-      when ROW_EXPR
-        deparse_row(node)
-      when SELECT_STMT
-        deparse_select(node)
-      when SQL_VALUE_FUNCTION
-        deparse_sql_value_function(node)
-      when SORT_BY
-        deparse_sortby(node)
-      when SUB_LINK
-        deparse_sublink(node)
-      when TRANSACTION_STMT
-        deparse_transaction(node)
-      when TYPE_CAST
-        deparse_typecast(node)
-      when TYPE_NAME
-        deparse_typename(node)
-      when UPDATE_STMT
-        deparse_update(node)
-      when CASE_WHEN
-        deparse_when(node)
-      when WINDOW_DEF
-        deparse_windowdef(node)
-      when WITH_CLAUSE
-        deparse_with_clause(node)
-      when VIEW_STMT
-        deparse_viewstmt(node)
-      when VARIABLE_SET_STMT
-        deparse_variable_set_stmt(node)
-      when VACUUM_STMT
-        deparse_vacuum_stmt(node)
-      when DO_STMT
-        deparse_do_stmt(node)
-      when STRING
-        if context == A_CONST
-          format("'%s'", node['str'].gsub("'", "''"))
-        elsif [FUNC_CALL, TYPE_NAME, :operator, :defname_as].include?(context)
-          node['str']
-        else
-          deparse_identifier(node['str'], escape_always: true)
-        end
-      when INTEGER
-        node['ival'].to_s
-      when FLOAT
-        node['str']
-      when NULL
-        'NULL'
-      else
-        raise format("Can't deparse: %s: %s", type, node.inspect)
+      deparser = DEPARSERS[type] || raise(format("Can't deparse: %s: %s", type, node.inspect))
+      __send__(deparser, output, node, context)
+    end
+
+    # Appends the items separated by separator, like mapping them with
+    # deparse_item and joining the results
+    def deparse_list(output, items, separator = ', ', context = nil)
+      items.each_with_index do |item, index|
+        output << separator unless index.zero?
+        deparse_item(output, item, context)
       end
+      output
+    end
+
+    # Appends a part of a list joined by separator that leaves out nil parts
+    # (like Array#compact), after the parts written so far (if any). Returns
+    # whether any part has been written.
+    def deparse_compact(output, written, part, separator = ' ')
+      return written if part.nil?
+      output << separator if written
+      output << part.to_s
+      true
+    end
+
+    # Same as deparse_compact, for an item that is deparsed
+    def deparse_compact_item(output, written, item, separator = ' ')
+      output << separator if written
+      return true if deparse_item(output, item)
+      output.chomp!(separator) if written
+      written
+    end
+
+    # Appends the space between two parts of the output, unless nothing has
+    # been written yet. Returns true, for the written flag of the caller.
+    def deparse_space(output, written)
+      output << ' ' if written
+      true
+    end
+
+    # Appends a clause keyword (e.g. "WHERE") and the space after it
+    def deparse_clause(output, written, keyword)
+      deparse_space(output, written)
+      output << keyword << ' '
+      true
+    end
+
+    # The result of deparsing a single item, for the few places that need to
+    # look at it
+    def deparse_to_s(item, context = nil)
+      output = ''.dup
+      deparse_item(output, item, context) ? output : nil
     end
 
-    def deparse_item_list(nodes, context = nil)
-      nodes.map { |n| deparse_item(n, context) }
+    # What deparse_item returns for a name (e.g. of a function or operator),
+    # without deparsing String nodes
+    def deparse_name(item, context)
+      string = item[STRING] if item.is_a?(Hash)
+      string ? string['str'] : deparse_to_s(item, context)
     end
 
-    def deparse_identifier(ident, escape_always: false)
+    def deparse_quoted(output, str, quote)
+      output << quote << (str.include?(quote) ? str.gsub(quote, quote + quote) : str) << quote
+    end
+
+    # KEYWORDS and their lowercase versions, so identifiers don't need to be
+    # upcased to look them up
+    KEYWORD_LOOKUP = PgQuery.make_shareable(Hash[(KEYWORDS + KEYWORDS.map(&:downcase)).map { |keyword| [keyword, true] }])
+
+    def deparse_identifier(output, ident, escape_always = false)
       return if ident.nil?
-      if escape_always || !ident[/^\w+$/] || KEYWORDS.include?(ident.upcase)
-        format('"%s"', ident.gsub('"', '""'))
+      if escape_always || !ident[/^\w+$/] || keyword?(ident)
+        deparse_quoted(output, ident, '"')
       else
-        ident
+        output << ident.to_s
       end
     end
 
-    def deparse_rangevar(node)
-      output = []
-      output << 'ONLY' unless node['inh']
-      schema = node['schemaname'] ? '"' + node['schemaname'] + '".' : ''
-      output << schema + '"' + node['relname'] + '"'
-      output << deparse_item(node['alias']) if node['alias']
-      output.join(' ')
+    def keyword?(ident)
+      KEYWORD_LOOKUP.key?(ident) || (ident[/[A-Z]/] && KEYWORD_LOOKUP.key?(ident.upcase))
     end
 
-    def deparse_raw_stmt(node)
-      deparse_item(node[STMT_FIELD])
+    def deparse_a_expr(output, node, context)
+      case node['kind']
+      when AEXPR_OP
+        deparse_aexpr(output, node, context)
+      when AEXPR_OP_ALL
+        deparse_aexpr_quantified(output, node, 'ALL(')
+      when AEXPR_OP_ANY
+        deparse_aexpr_quantified(output, node, 'ANY(')
+      when AEXPR_IN
+        deparse_aexpr_in(output, node)
+      when AEXPR_ILIKE
+        deparse_aexpr_ilike(output, node)
+      when CONSTR_TYPE_FOREIGN
+        deparse_aexpr_like(output, node)
+      when AEXPR_BETWEEN, AEXPR_NOT_BETWEEN, AEXPR_BETWEEN_SYM, AEXPR_NOT_BETWEEN_SYM
+        deparse_aexpr_between(output, node)
+      when AEXPR_NULLIF
+        deparse_aexpr_nullif(output, node)
+      else
+        raise format("Can't deparse: %s: %s", A_EXPR, node.inspect)
+      end
+    end
+
+    def deparse_bool_expr(output, node, _context)
+      case node['boolop']
+      when BOOL_EXPR_AND
+        deparse_bool_expr_and(output, node)
+      when BOOL_EXPR_OR
+        deparse_bool_expr_or(output, node)
+      when BOOL_EXPR_NOT
+        deparse_bool_expr_not(output, node)
+      end
     end
 
-    def deparse_renamestmt(node)
-      output = []
+    def deparse_rangevar(output, node, _context)
+      output << 'ONLY ' unless node['inh']
+      deparse_relation(output, node)
+    end
 
+    # A RangeVar without ONLY
+    def deparse_relation(output, node)
+      output << '"' << node['schemaname'] << '".' if node['schemaname']
+      output << '"' << node['relname'] << '"'
+      if node['alias']
+        output << ' '
+        deparse_item(output, node['alias'])
+      end
+      output
+    end
+
+    def deparse_raw_stmt(output, node, _context)
+      deparse_item(output, node[STMT_FIELD])
+    end
+
+    def deparse_renamestmt(output, node, _context)
       case node['renameType']
       when OBJECT_TYPE_TABLE
-        output << 'ALTER TABLE'
-        output << deparse_item(node['relation'])
-        output << 'RENAME TO'
-        output << node['newname']
+        output << 'ALTER TABLE '
+        deparse_item(output, node['relation'])
+        output << ' RENAME TO ' << node['newname'].to_s
       else
         raise format("Can't deparse: %s", node.inspect)
       end
+    end
 
-      output.join(' ')
+    def deparse_columnref(output, node, _context)
+      node['fields'].each_with_index do |field, index|
+        output << '.' unless index.zero?
+        if field.is_a?(String)
+          output << '"' << field << '"'
+        else
+          deparse_item(output, field)
+        end
+      end
+      output
     end
 
-    def deparse_columnref(node)
-      node['fields'].map do |field|
-        field.is_a?(String) ? '"' + field + '"' : deparse_item(field)
-      end.join('.')
+    def deparse_a_arrayexp(output, node, _context)
+      output << 'ARRAY['
+      deparse_list(output, node['elements']) if node['elements']
+      output << ']'
     end
 
-    def deparse_a_arrayexp(node)
-      'ARRAY[' + (node['elements'] || []).map do |element|
-        deparse_item(element)
-      end.join(', ') + ']'
+    def deparse_a_const(output, node, _context)
+      deparse_item(output, node['val'], A_CONST)
     end
 
-    def deparse_a_const(node)
-      deparse_item(node['val'], A_CONST)
+    def deparse_a_star(output, _node, _context)
+      output << '*'
     end
 
-    def deparse_a_star(_node)
-      '*'
+    def deparse_a_truncated(output, _node, _context)
+      output << '...' # pg_query internal
     end
 
-    def deparse_a_indirection(node)
-      output = []
-      arg = deparse_item(node['arg'])
-      output << if node['arg'].key?(FUNC_CALL)
-                  "(#{arg})."
-                else
-                  arg
-                end
+    def deparse_a_indirection(output, node, _context)
+      if node['arg'].key?(FUNC_CALL)
+        output << '('
+        deparse_item(output, node['arg'])
+        output << ').'
+      else
+        deparse_item(output, node['arg'])
+      end
       node['indirection'].each do |subnode|
-        output << deparse_item(subnode)
+        deparse_item(output, subnode)
       end
-      output.join
+      output
     end
 
-    def deparse_a_indices(node)
-      format('[%s]', deparse_item(node['uidx']))
+    def deparse_a_indices(output, node, _context)
+      output << '['
+      deparse_item(output, node['uidx'])
+      output << ']'
     end
 
-    def deparse_alias(node)
+    def deparse_alias(output, node, _context)
       name = node['aliasname']
       if node['colnames']
-        name + '(' + deparse_item_list(node['colnames']).join(', ') + ')'
+        output << name << '('
+        deparse_list(output, node['colnames'])
+        output << ')'
       else
-        deparse_identifier(name)
+        deparse_identifier(output, name)
       end
     end
 
-    def deparse_alter_table(node)
-      output = []
-      output << 'ALTER TABLE'
-
-      output << deparse_item(node['relation'])
-
-      output << node['cmds'].map do |item|
-        deparse_item(item)
-      end.join(', ')
-
-      output.join(' ')
+    def deparse_alter_table(output, node, _context)
+      output << 'ALTER TABLE '
+      deparse_item(output, node['relation'])
+      output << ' '
+      deparse_list(output, node['cmds'])
     end
 
-    def deparse_alter_table_cmd(node)
+    def deparse_alter_table_cmd(output, node, _context)
       command, options = AlterTable.commands(node)
 
-      output = []
-      output << command if command
-      output << 'IF EXISTS' if node['missing_ok']
-      output << node['name']
-      output << options if options
-      output << deparse_item(node['def']) if node['def']
-      output << 'CASCADE' if node['behavior'] == 1
-
-      output.compact.join(' ')
+      written = deparse_compact(output, false, command)
+      written = deparse_compact(output, written, 'IF EXISTS') if node['missing_ok']
+      written = deparse_compact(output, written, node['name'])
+      written = deparse_compact(output, written, options)
+      written = deparse_compact_item(output, written, node['def']) if node['def']
+      deparse_compact(output, written, 'CASCADE') if node['behavior'] == 1
+      output
     end
 
-    def deparse_object_with_args(node)
-      output = []
-      output += node['objname'].map(&method(:deparse_item))
+    def deparse_object_with_args(output, node, _context)
+      node['objname'].each { |name| deparse_item(output, name) }
       unless node['args_unspecified']
-        args = node.fetch('objargs', []).map(&method(:deparse_item)).join(', ')
-        output << "(#{args})"
+        output << '('
+        deparse_list(output, node.fetch('objargs', []))
+        output << ')'
       end
-      output.join('')
+      output
     end
 
-    def deparse_paramref(node)
+    def deparse_paramref(output, node, _context)
       if node['number'].nil?
-        '?'
+        output << '?'
       else
-        format('$%d', node['number'])
+        output << format('$%d', node['number'])
       end
     end
 
-    def deparse_restarget(node, context)
+    def deparse_restarget(output, node, context)
       if context == :select
-        [deparse_item(node['val']), deparse_identifier(node['name'])].compact.join(' AS ')
+        written = deparse_compact_item(output, false, node['val'], ' AS ')
+        if node['name']
+          output << ' AS ' if written
+          deparse_identifier(output, node['name'])
+        end
+        output
       elsif context == :update
-        [node['name'], deparse_item(node['val'])].compact.join(' = ')
+        written = deparse_compact(output, false, node['name'], ' = ')
+        deparse_compact_item(output, written, node['val'], ' = ')
+        output
       elsif node['val'].nil?
-        node['name']
+        return if node['name'].nil?
+        output << node['name'].to_s
       else
         raise format("Can't deparse %s in context %s", node.inspect, context)
       end
     end
 
-    def deparse_funccall(node)
-      output = []
+    def deparse_funccall(output, node, _context)
+      written = false
+      node['funcname'].each do |name|
+        next if deparse_name(name, FUNC_CALL) == 'pg_catalog'
+        output << '.' if written
+        deparse_item(output, name, FUNC_CALL)
+        written = true
+      end
 
+      output << '('
+      output << 'DISTINCT ' if node['agg_distinct']
       # SUM(a, b)
-      args = Array(node['args']).map { |arg| deparse_item(arg) }
+      args = Array(node['args'])
+      deparse_list(output, args)
       # COUNT(*)
-      args << '*' if node['agg_star']
-
-      name = (node['funcname'].map { |n| deparse_item(n, FUNC_CALL) } - ['pg_catalog']).join('.')
-      distinct = node['agg_distinct'] ? 'DISTINCT ' : ''
-      output << format('%s(%s%s)', name, distinct, args.join(', '))
-      output << format('OVER (%s)', deparse_item(node['over'])) if node['over']
+      if node['agg_star']
+        output << ', ' unless args.empty?
+        output << '*'
+      end
+      output << ')'
 
-      output.join(' ')
+      if node['over']
+        output << ' OVER ('
+        deparse_item(output, node['over'])
+        output << ')'
+      end
+      output
     end
 
-    def deparse_windowdef(node)
-      output = []
-
+    def deparse_windowdef(output, node, _context)
       if node['partitionClause']
-        output << 'PARTITION BY'
-        output << node['partitionClause'].map do |item|
-          deparse_item(item)
-        end.join(', ')
+        output << 'PARTITION BY '
+        deparse_list(output, node['partitionClause'])
       end
 
       if node['orderClause']
-        output << 'ORDER BY'
-        output << node['orderClause'].map do |item|
-          deparse_item(item)
-        end.join(', ')
+        output << ' ' if node['partitionClause']
+        output << 'ORDER BY '
+        deparse_list(output, node['orderClause'])
       end
 
-      output.join(' ')
+      output
     end
 
-    def deparse_functionparameter(node)
-      deparse_item(node['argType'])
+    def deparse_functionparameter(output, node, _context)
+      deparse_item(output, node['argType'])
     end
 
-    def deparse_grant_role(node)
-      output = ['GRANT']
-      output << node['granted_roles'].map(&method(:deparse_item)).join(', ')
-      output << 'TO'
-      output << node['grantee_roles'].map(&method(:deparse_item)).join(', ')
-      output << 'WITH ADMIN OPTION' if node['admin_opt']
-      output.join(' ')
+    def deparse_grant_role(output, node, _context)
+      output << 'GRANT '
+      deparse_list(output, node['granted_roles'])
+      output << ' TO '
+      deparse_list(output, node['grantee_roles'])
+      output << ' WITH ADMIN OPTION' if node['admin_opt']
+      output
     end
 
-    def deparse_grant(node) # rubocop:disable Metrics/CyclomaticComplexity
-      objtype, allow_all = deparse_grant_objtype(node)
-      output = ['GRANT']
-      output << if node.key?('privileges')
-                  node['privileges'].map(&method(:deparse_item)).join(', ')
-                else
-                  'ALL'
-                end
-      output << 'ON'
+    GRANT_OBJECT_TYPES = PgQuery.make_shareable(
+      1 => ['TABLE', true],
+      2 => ['SEQUENCE', true],
+      3 => ['DATABASE', false],
+      4 => ['DOMAIN', false],
+      5 => ['FOREIGN DATA WRAPPER', false],
+      6 => ['FOREIGN SERVER', false],
+      7 => ['FUNCTION', true],
+      8 => ['LANGUAGE', false],
+      9 => ['LARGE OBJECT', false],
+      10 => ['SCHEMA', false],
+      11 => ['TABLESPACE', false],
+      12 => ['TYPE', false]
+    )
+    def deparse_grant(output, node, _context) # rubocop:disable Metrics/CyclomaticComplexity
+      objtype, allow_all = GRANT_OBJECT_TYPES.fetch(node['objtype'])
+      output << 'GRANT '
+      if node.key?('privileges')
+        deparse_list(output, node['privileges'])
+      else
+        output << 'ALL'
+      end
+      output << ' ON '
       objects = node['objects']
-      objects = objects[0] if %w[DOMAIN TYPE].include?(objtype)
-      objects = objects.map do |object|
-        deparsed = deparse_item(object)
+      objects = objects[0] if objtype == 'DOMAIN' || objtype == 'TYPE'
+      objects.each_with_index do |object, index|
+        output << ', ' unless index.zero?
         if object.key?(RANGE_VAR) || object.key?(OBJECT_WITH_ARGS) || !allow_all
-          objtype == 'TABLE' ? deparsed : "#{objtype} #{deparsed}"
+          output << objtype << ' ' unless objtype == 'TABLE'
         else
-          "ALL #{objtype}S IN SCHEMA #{deparsed}"
+          output << 'ALL ' << objtype << 'S IN SCHEMA '
         end
+        deparse_item(output, object)
       end
-      output << objects.join(', ')
-      output << 'TO'
-      output << node['grantees'].map(&method(:deparse_item)).join(', ')
-      output << 'WITH GRANT OPTION' if node['grant_option']
-      output.join(' ')
+      output << ' TO '
+      deparse_list(output, node['grantees'])
+      output << ' WITH GRANT OPTION' if node['grant_option']
+      output
     end
 
-    def deparse_grant_objtype(node)
-      {
-        1 => ['TABLE', true],
-        2 => ['SEQUENCE', true],
-        3 => ['DATABASE', false],
-        4 => ['DOMAIN', false],
-        5 => ['FOREIGN DATA WRAPPER', false],
-        6 => ['FOREIGN SERVER', false],
-        7 => ['FUNCTION', true],
-        8 => ['LANGUAGE', false],
-        9 => ['LARGE OBJECT', false],
-        10 => ['SCHEMA', false],
-        11 => ['TABLESPACE', false],
-        12 => ['TYPE', false]
-      }.fetch(node['objtype'])
+    def deparse_access_priv(output, node, _context)
+      output << node['priv_name'].to_s
+      if node.key?('cols')
+        output << ' ('
+        deparse_list(output, node['cols'])
+        output << ')'
+      end
+      output
     end
 
-    def deparse_access_priv(node)
-      output = [node['priv_name']]
-      output << "(#{node['cols'].map(&method(:deparse_item)).join(', ')})" if node.key?('cols')
-      output.join(' ')
+    def deparse_role_spec(output, node, _context)
+      return output << 'CURRENT_USER' if node['roletype'] == 1
+      return output << 'SESSION_USER' if node['roletype'] == 2
+      return output << 'PUBLIC' if node['roletype'] == 3
+      deparse_identifier(output, node['rolename'], true)
     end
 
-    def deparse_role_spec(node)
-      return 'CURRENT_USER' if node['roletype'] == 1
-      return 'SESSION_USER' if node['roletype'] == 2
-      return 'PUBLIC' if node['roletype'] == 3
-      deparse_identifier(node['rolename'], escape_always: true)
+    # Whether the names (of an operator) deparse to the single given name
+    def operator?(names, name)
+      names.size == 1 && deparse_name(names[0], :operator) == name
     end
 
-    def deparse_aexpr_in(node)
-      rexpr = Array(node['rexpr']).map { |arg| deparse_item(arg) }
-      operator = node['name'].map { |n| deparse_item(n, :operator) } == ['='] ? 'IN' : 'NOT IN'
-      format('%s %s (%s)', deparse_item(node['lexpr']), operator, rexpr.join(', '))
+    def deparse_aexpr_in(output, node)
+      deparse_item(output, node['lexpr'])
+      output << (operator?(node['name'], '=') ? ' IN (' : ' NOT IN (')
+      deparse_list(output, Array(node['rexpr']))
+      output << ')'
     end
 
-    def deparse_aexpr_like(node)
-      value = deparse_item(node['rexpr'])
-      operator = node['name'].map { |n| deparse_item(n, :operator) } == ['~~'] ? 'LIKE' : 'NOT LIKE'
-      format('%s %s %s', deparse_item(node['lexpr']), operator, value)
+    def deparse_aexpr_like(output, node)
+      deparse_item(output, node['lexpr'])
+      output << (operator?(node['name'], '~~') ? ' LIKE ' : ' NOT LIKE ')
+      deparse_item(output, node['rexpr'])
+      output
     end
 
-    def deparse_aexpr_ilike(node)
-      value = deparse_item(node['rexpr'])
-      operator = node['name'][0]['String']['str'] == '~~*' ? 'ILIKE' : 'NOT ILIKE'
-      format('%s %s %s', deparse_item(node['lexpr']), operator, value)
+    def deparse_aexpr_ilike(output, node)
+      deparse_item(output, node['lexpr'])
+      output << (node['name'][0]['String']['str'] == '~~*' ? ' ILIKE ' : ' NOT ILIKE ')
+      deparse_item(output, node['rexpr'])
+      output
     end
 
-    def deparse_bool_expr_not(node)
-      format('NOT %s', deparse_item(node['args'][0]))
+    def deparse_bool_expr_not(output, node)
+      output << 'NOT '
+      deparse_item(output, node['args'][0])
+      output
     end
 
-    BOOLEAN_TEST_TYPE_TO_STRING = {
+    BOOLEAN_TEST_TYPE_TO_STRING = PgQuery.make_shareable(
       BOOLEAN_TEST_TRUE        => ' IS TRUE',
       BOOLEAN_TEST_NOT_TRUE    => ' IS NOT TRUE',
       BOOLEAN_TEST_FALSE       => ' IS FALSE',
       BOOLEAN_TEST_NOT_FALSE   => ' IS NOT FALSE',
       BOOLEAN_TEST_UNKNOWN     => ' IS UNKNOWN',
       BOOLEAN_TEST_NOT_UNKNOWN => ' IS NOT UNKNOWN'
-    }.freeze
-    def deparse_boolean_test(node)
-      deparse_item(node['arg']) + BOOLEAN_TEST_TYPE_TO_STRING[node['booltesttype']]
+    )
+    def deparse_boolean_test(output, node, _context)
+      deparse_item(output, node['arg'])
+      output << BOOLEAN_TEST_TYPE_TO_STRING[node['booltesttype']]
     end
 
-    def deparse_range_function(node)
-      output = []
-      output << 'LATERAL' if node['lateral']
-      output << deparse_item(node['functions'][0][0]) # FIXME: Needs more test cases
-      output << deparse_item(node['alias']) if node['alias']
-      output << "#{node['alias'] ? '' : 'AS '}(#{deparse_item_list(node['coldeflist']).join(', ')})" if node['coldeflist']
-      output.join(' ')
+    def deparse_range_function(output, node, _context)
+      output << 'LATERAL ' if node['lateral']
+      deparse_item(output, node['functions'][0][0]) # FIXME: Needs more test cases
+      if node['alias']
+        output << ' '
+        deparse_item(output, node['alias'])
+      end
+      if node['coldeflist']
+        output << (node['alias'] ? ' (' : ' AS (')
+        deparse_list(output, node['coldeflist'])
+        output << ')'
+      end
+      output
     end
 
-    def deparse_aexpr(node, context = false)
-      output = []
-      output << deparse_item(node['lexpr'], context || true)
-      output << deparse_item(node['rexpr'], context || true)
-      output = output.join(' ' + deparse_item(node['name'][0], :operator) + ' ')
-      if context
-        # This is a nested expression, add parentheses.
-        output = '(' + output + ')'
-      end
+    def deparse_aexpr(output, node, context = false)
+      # This is a nested expression, add parentheses.
+      output << '(' if context
+      deparse_item(output, node['lexpr'], context || true)
+      output << ' '
+      deparse_item(output, node['name'][0], :operator)
+      output << ' '
+      deparse_item(output, node['rexpr'], context || true)
+      output << ')' if context
       output
     end
 
-    def deparse_bool_expr_and(node)
+    def deparse_bool_expr_and(output, node)
       # Only put parantheses around OR nodes that are inside this one
-      node['args'].map do |arg|
-        if [BOOL_EXPR_OR].include?(arg.values[0]['boolop'])
-          format('(%s)', deparse_item(arg))
-        else
-          deparse_item(arg)
-        end
-      end.join(' AND ')
+      node['args'].each_with_index do |arg, index|
+        output << ' AND ' unless index.zero?
+        deparse_bool_expr_arg(output, arg, arg.values[0]['boolop'] == BOOL_EXPR_OR)
+      end
+      output
     end
 
-    def deparse_bool_expr_or(node)
+    def deparse_bool_expr_or(output, node)
       # Put parantheses around AND + OR nodes that are inside
-      node['args'].map do |arg|
-        if [BOOL_EXPR_AND, BOOL_EXPR_OR].include?(arg.values[0]['boolop'])
-          format('(%s)', deparse_item(arg))
-        else
-          deparse_item(arg)
-        end
-      end.join(' OR ')
+      node['args'].each_with_index do |arg, index|
+        output << ' OR ' unless index.zero?
+        boolop = arg.values[0]['boolop']
+        deparse_bool_expr_arg(output, arg, boolop == BOOL_EXPR_AND || boolop == BOOL_EXPR_OR)
+      end
+      output
     end
 
-    def deparse_aexpr_any(node)
-      output = []
-      output << deparse_item(node['lexpr'])
-      output << format('ANY(%s)', deparse_item(node['rexpr']))
-      output.join(' ' + deparse_item(node['name'][0], :operator) + ' ')
+    def deparse_bool_expr_arg(output, arg, parenthesize)
+      return deparse_item(output, arg) unless parenthesize
+      output << '('
+      deparse_item(output, arg)
+      output << ')'
     end
 
-    def deparse_aexpr_all(node)
-      output = []
-      output << deparse_item(node['lexpr'])
-      output << format('ALL(%s)', deparse_item(node['rexpr']))
-      output.join(' ' + deparse_item(node['name'][0], :operator) + ' ')
+    # ANY(...) or ALL(...)
+    def deparse_aexpr_quantified(output, node, quantifier)
+      deparse_item(output, node['lexpr'])
+      output << ' '
+      deparse_item(output, node['name'][0], :operator)
+      output << ' ' << quantifier
+      deparse_item(output, node['rexpr'])
+      output << ')'
     end
 
-    def deparse_aexpr_between(node)
+    def deparse_aexpr_between(output, node)
       between = case node['kind']
                 when AEXPR_BETWEEN
                   ' BETWEEN '
@@ -570,521 +638,571 @@ class PgQuery
                 when AEXPR_NOT_BETWEEN_SYM
                   ' NOT BETWEEN SYMMETRIC '
                 end
-      name   = deparse_item(node['lexpr'])
-      output = node['rexpr'].map { |n| deparse_item(n) }
-      name << between << output.join(' AND ')
+      deparse_item(output, node['lexpr'])
+      output << between
+      deparse_list(output, node['rexpr'], ' AND ')
     end
 
-    def deparse_aexpr_nullif(node)
-      lexpr = deparse_item(node['lexpr'])
-      rexpr = deparse_item(node['rexpr'])
-      format('NULLIF(%s, %s)', lexpr, rexpr)
+    def deparse_aexpr_nullif(output, node)
+      output << 'NULLIF('
+      deparse_item(output, node['lexpr'])
+      output << ', '
+      deparse_item(output, node['rexpr'])
+      output << ')'
     end
 
-    def deparse_joinexpr(node) # rubocop:disable Metrics/CyclomaticComplexity
-      output = []
-      output << deparse_item(node['larg'])
+    def deparse_joinexpr(output, node, _context) # rubocop:disable Metrics/CyclomaticComplexity
+      deparse_item(output, node['larg'])
       case node['jointype']
       when 0
         if node['isNatural']
-          output << 'NATURAL'
+          output << ' NATURAL'
         elsif node['quals'].nil? && node['usingClause'].nil?
-          output << 'CROSS'
+          output << ' CROSS'
         end
       when 1
-        output << 'LEFT'
+        output << ' LEFT'
       when 2
-        output << 'FULL'
+        output << ' FULL'
       when 3
-        output << 'RIGHT'
+        output << ' RIGHT'
       end
-      output << 'JOIN'
-      output << deparse_item(node['rarg'])
+      output << ' JOIN '
+      deparse_item(output, node['rarg'])
 
       if node['quals']
-        output << 'ON'
-        output << deparse_item(node['quals'])
+        output << ' ON '
+        deparse_item(output, node['quals'])
       end
 
-      output << format('USING (%s)', node['usingClause'].map { |n| deparse_item(n) }.join(', ')) if node['usingClause']
+      if node['usingClause']
+        output << ' USING ('
+        deparse_list(output, node['usingClause'])
+        output << ')'
+      end
 
-      output.join(' ')
+      output
     end
 
-    def deparse_lock(node)
-      output = []
-      output << 'LOCK TABLE'
-      tables = node['relations'].map { |table| deparse_item(table) }
-      output << tables.join(', ')
-      output.join(' ')
+    def deparse_lock(output, node, _context)
+      output << 'LOCK TABLE '
+      deparse_list(output, node['relations'])
     end
 
-    LOCK_CLAUSE_STRENGTH = {
+    LOCK_CLAUSE_STRENGTH = PgQuery.make_shareable(
       LCS_FORKEYSHARE => 'FOR KEY SHARE',
       LCS_FORSHARE => 'FOR SHARE',
       LCS_FORNOKEYUPDATE => 'FOR NO KEY UPDATE',
       LCS_FORUPDATE => 'FOR UPDATE'
-    }.freeze
-    def deparse_lockingclause(node)
-      output = []
-      output << LOCK_CLAUSE_STRENGTH[node['strength']]
+    )
+    def deparse_lockingclause(output, node, _context)
+      output << LOCK_CLAUSE_STRENGTH[node['strength']].to_s
       if node['lockedRels']
-        output << 'OF'
-        output << node['lockedRels'].map do |item|
-          deparse_item(item)
-        end.join(', ')
+        output << ' OF '
+        deparse_list(output, node['lockedRels'])
       end
-      output.join(' ')
+      output
     end
 
-    def deparse_sortby(node)
-      output = []
-      output << deparse_item(node['node'])
-      output << 'ASC' if node['sortby_dir'] == 1
-      output << 'DESC' if node['sortby_dir'] == 2
-      output << 'NULLS FIRST' if node['sortby_nulls'] == 1
-      output << 'NULLS LAST' if node['sortby_nulls'] == 2
-      output.join(' ')
+    def deparse_sortby(output, node, _context)
+      deparse_item(output, node['node'])
+      output << ' ASC' if node['sortby_dir'] == 1
+      output << ' DESC' if node['sortby_dir'] == 2
+      output << ' NULLS FIRST' if node['sortby_nulls'] == 1
+      output << ' NULLS LAST' if node['sortby_nulls'] == 2
+      output
     end
 
-    def deparse_collate(node)
-      output = []
-      output << deparse_item(node['arg'])
-      output << 'COLLATE'
-      output << deparse_item_list(node['collname'])
-      output.join(' ')
+    def deparse_collate(output, node, _context)
+      deparse_item(output, node['arg'])
+      output << ' COLLATE '
+      deparse_list(output, node['collname'], ' ')
     end
 
-    def deparse_with_clause(node)
-      output = ['WITH']
-      output << 'RECURSIVE' if node['recursive']
-      output << node['ctes'].map do |cte|
-        deparse_item(cte)
-      end.join(', ')
-      output.join(' ')
+    def deparse_with_clause(output, node, _context)
+      output << 'WITH '
+      output << 'RECURSIVE ' if node['recursive']
+      deparse_list(output, node['ctes'])
     end
 
-    def deparse_viewstmt(node)
-      output = []
+    def deparse_viewstmt(output, node, _context)
       output << 'CREATE'
-      output << 'OR REPLACE' if node['replace']
+      output << ' OR REPLACE' if node['replace']
 
       persistence = relpersistence(node['view'])
-      output << persistence if persistence
+      output << ' ' << persistence if persistence
 
-      output << 'VIEW'
-      output << node['view'][RANGE_VAR]['relname']
-      output << format('(%s)', deparse_item_list(node['aliases']).join(', ')) if node['aliases']
+      output << ' VIEW ' << node['view'][RANGE_VAR]['relname'].to_s
+      if node['aliases']
+        output << ' ('
+        deparse_list(output, node['aliases'])
+        output << ')'
+      end
 
-      output << 'AS'
-      output << deparse_item(node['query'])
+      output << ' AS '
+      deparse_item(output, node['query'])
 
       case node['withCheckOption']
       when 1
-        output << 'WITH CHECK OPTION'
+        output << ' WITH CHECK OPTION'
       when 2
-        output << 'WITH CASCADED CHECK OPTION'
+        output << ' WITH CASCADED CHECK OPTION'
       end
-      output.join(' ')
+      output
     end
 
-    def deparse_variable_set_stmt(node)
-      output = []
+    def deparse_variable_set_stmt(output, node, _context)
       output << 'SET'
-      output << 'LOCAL' if node['is_local']
-      output << node['name']
-      output << 'TO'
-      output << node['args'].map { |arg| deparse_item(arg) }.join(', ')
-      output.join(' ')
+      output << ' LOCAL' if node['is_local']
+      output << ' ' << node['name'].to_s << ' TO '
+      deparse_list(output, node['args'])
     end
 
-    def deparse_vacuum_stmt(node)
-      output = []
+    def deparse_vacuum_stmt(output, node, _context)
       output << 'VACUUM'
-      output.concat(deparse_vacuum_options(node))
-      output << deparse_item(node['relation']) if node.key?('relation')
+      deparse_vacuum_options(output, node)
+      if node.key?('relation')
+        output << ' '
+        deparse_item(output, node['relation'])
+      end
       if node.key?('va_cols')
-        output << "(#{node['va_cols'].map(&method(:deparse_item)).join(', ')})"
+        output << ' ('
+        deparse_list(output, node['va_cols'])
+        output << ')'
       end
-      output.join(' ')
+      output
     end
 
-    def deparse_vacuum_options(node)
-      output = []
-      output << 'FULL' if node['options'][4] == 1
-      output << 'FREEZE' if node['options'][3] == 1
-      output << 'VERBOSE' if node['options'][2] == 1
-      output << 'ANALYZE' if node['options'][1] == 1
+    def deparse_vacuum_options(output, node)
+      output << ' FULL' if node['options'][4] == 1
+      output << ' FREEZE' if node['options'][3] == 1
+      output << ' VERBOSE' if node['options'][2] == 1
+      output << ' ANALYZE' if node['options'][1] == 1
       output
     end
 
-    def deparse_do_stmt(node)
-      output = []
-      output << 'DO'
+    def deparse_do_stmt(output, node, _context)
       statement, *rest = node['args']
-      output << "$$#{statement['DefElem']['arg']['String']['str']}$$"
-      output += rest.map { |item| deparse_item(item) }
-      output.join(' ')
+      output << 'DO $$' << statement['DefElem']['arg']['String']['str'].to_s << '$$'
+      rest.each do |item|
+        output << ' '
+        deparse_item(output, item)
+      end
+      output
     end
 
-    def deparse_cte(node)
-      output = []
-      output << node['ctename']
-      output << format('(%s)', node['aliascolnames'].map { |n| deparse_item(n) }.join(', ')) if node['aliascolnames']
-      output << format('AS (%s)', deparse_item(node['ctequery']))
-      output.join(' ')
+    def deparse_cte(output, node, _context)
+      output << node['ctename'].to_s
+      if node['aliascolnames']
+        output << ' ('
+        deparse_list(output, node['aliascolnames'])
+        output << ')'
+      end
+      output << ' AS ('
+      deparse_item(output, node['ctequery'])
+      output << ')'
     end
 
-    def deparse_case(node)
-      output = ['CASE']
-      output << deparse_item(node['arg']) if node['arg']
-      output += node['args'].map { |arg| deparse_item(arg) }
+    def deparse_case(output, node, _context)
+      output << 'CASE'
+      if node['arg']
+        output << ' '
+        deparse_item(output, node['arg'])
+      end
+      node['args'].each do |arg|
+        output << ' '
+        deparse_item(output, arg)
+      end
       if node['defresult']
-        output << 'ELSE'
-        output << deparse_item(node['defresult'])
+        output << ' ELSE '
+        deparse_item(output, node['defresult'])
       end
-      output << 'END'
-      output.join(' ')
+      output << ' END'
     end
 
-    def deparse_columndef(node)
-      output = [node['colname']]
-      output << deparse_item(node['typeName'])
+    def deparse_columndef(output, node, _context)
+      written = deparse_compact(output, false, node['colname'])
+      written = deparse_compact_item(output, written, node['typeName'])
       if node['raw_default']
-        output << 'USING'
-        output << deparse_item(node['raw_default'])
+        written = deparse_compact(output, written, 'USING')
+        written = deparse_compact_item(output, written, node['raw_default'])
       end
       if node['constraints']
-        output += node['constraints'].map do |item|
-          deparse_item(item)
+        node['constraints'].each do |item|
+          written = deparse_compact_item(output, written, item)
         end
       end
       if node['collClause']
-        output << 'COLLATE'
-        output += node['collClause']['CollateClause']['collname'].map(&method(:deparse_item))
+        written = deparse_compact(output, written, 'COLLATE')
+        node['collClause']['CollateClause']['collname'].each do |name|
+          written = deparse_compact_item(output, written, name)
+        end
       end
-      output.compact.join(' ')
-    end
-
-    def deparse_composite_type(node)
-      output = ['CREATE TYPE']
-      output << deparse_rangevar(node['typevar'][RANGE_VAR].merge('inh' => true))
-      output << 'AS'
-      coldeflist = node['coldeflist'].map(&method(:deparse_item))
-      output << "(#{coldeflist.join(', ')})"
-      output.join(' ')
+      output
     end
 
-    def deparse_constraint(node) # rubocop:disable Metrics/CyclomaticComplexity
-      output = []
+    def deparse_composite_type(output, node, _context)
+      output << 'CREATE TYPE '
+      deparse_relation(output, node['typevar'][RANGE_VAR])
+      output << ' AS ('
+      deparse_list(output, node['coldeflist'])
+      output << ')'
+    end
+
+    CONSTRAINT_TYPES = PgQuery.make_shareable(
+      CONSTR_TYPE_NULL      => 'NULL',
+      CONSTR_TYPE_NOTNULL   => 'NOT NULL',
+      CONSTR_TYPE_DEFAULT   => 'DEFAULT',
+      CONSTR_TYPE_CHECK     => 'CHECK',
+      CONSTR_TYPE_PRIMARY   => 'PRIMARY KEY',
+      CONSTR_TYPE_UNIQUE    => 'UNIQUE',
+      CONSTR_TYPE_EXCLUSION => 'EXCLUSION',
+      CONSTR_TYPE_FOREIGN   => 'FOREIGN KEY'
+    )
+    def deparse_constraint(output, node, _context) # rubocop:disable Metrics/CyclomaticComplexity
+      written = false
       if node['conname']
-        output << 'CONSTRAINT'
-        output << node['conname']
-      end
-      case node['contype']
-      when CONSTR_TYPE_NULL
-        output << 'NULL'
-      when CONSTR_TYPE_NOTNULL
-        output << 'NOT NULL'
-      when CONSTR_TYPE_DEFAULT
-        output << 'DEFAULT'
-      when CONSTR_TYPE_CHECK
-        output << 'CHECK'
-      when CONSTR_TYPE_PRIMARY
-        output << 'PRIMARY KEY'
-      when CONSTR_TYPE_UNIQUE
-        output << 'UNIQUE'
-      when CONSTR_TYPE_EXCLUSION
-        output << 'EXCLUSION'
-      when CONSTR_TYPE_FOREIGN
-        output << 'FOREIGN KEY'
+        output << 'CONSTRAINT ' << node['conname'].to_s
+        written = true
       end
+      written = deparse_compact(output, written, CONSTRAINT_TYPES[node['contype']])
 
       if node['raw_expr']
-        expression = deparse_item(node['raw_expr'])
+        written = deparse_space(output, written)
         # Unless it's simple, put parentheses around it
-        expression = '(' + expression + ')' if node['raw_expr'][BOOL_EXPR]
-        expression = '(' + expression + ')' if node['raw_expr'][A_EXPR] && node['raw_expr'][A_EXPR]['kind'] == AEXPR_OP
-        output << expression
+        parentheses = 0
+        parentheses += 1 if node['raw_expr'][BOOL_EXPR]
+        parentheses += 1 if node['raw_expr'][A_EXPR] && node['raw_expr'][A_EXPR]['kind'] == AEXPR_OP
+        parentheses.times { output << '(' }
+        deparse_item(output, node['raw_expr'])
+        parentheses.times { output << ')' }
       end
-      output << '(' + deparse_item_list(node['keys']).join(', ') + ')' if node['keys']
-      output << '(' + deparse_item_list(node['fk_attrs']).join(', ') + ')' if node['fk_attrs']
-      output << 'REFERENCES ' + deparse_item(node['pktable']) + ' (' + deparse_item_list(node['pk_attrs']).join(', ') + ')' if node['pktable']
-      output << 'NOT VALID' if node['skip_validation']
-      output << "USING INDEX #{node['indexname']}" if node['indexname']
-      output.join(' ')
+      if node['keys']
+        written = deparse_space(output, written)
+        output << '('
+        deparse_list(output, node['keys'])
+        output << ')'
+      end
+      if node['fk_attrs']
+        written = deparse_space(output, written)
+        output << '('
+        deparse_list(output, node['fk_attrs'])
+        output << ')'
+      end
+      if node['pktable']
+        written = deparse_space(output, written)
+        output << 'REFERENCES '
+        deparse_item(output, node['pktable'])
+        output << ' ('
+        deparse_list(output, node['pk_attrs'])
+        output << ')'
+      end
+      written = deparse_compact(output, written, 'NOT VALID') if node['skip_validation']
+      deparse_compact(output, written, "USING INDEX #{node['indexname']}") if node['indexname']
+      output
     end
 
-    def deparse_copy(node)
-      output = ['COPY']
+    def deparse_copy(output, node, _context)
+      output << 'COPY'
       if node.key?('relation')
-        output << deparse_item(node['relation'])
+        output << ' '
+        deparse_item(output, node['relation'])
       elsif node.key?('query')
-        output << "(#{deparse_item(node['query'])})"
+        output << ' ('
+        deparse_item(output, node['query'])
+        output << ')'
       end
-      columns = node.fetch('attlist', []).map { |column| deparse_item(column) }
-      output << "(#{columns.join(', ')})" unless columns.empty?
-      output << (node['is_from'] ? 'FROM' : 'TO')
-      output << 'PROGRAM' if node['is_program']
-      output << deparse_copy_output(node)
-      output.join(' ')
-    end
-
-    def deparse_copy_output(node)
-      return "'#{node['filename']}'" if node.key?('filename')
-      return 'STDIN' if node['is_from']
-      'STDOUT'
-    end
-
-    def deparse_create_enum(node)
-      output = ['CREATE TYPE']
-      output << deparse_item(node['typeName'][0])
-      output << 'AS ENUM'
-      vals = node['vals'].map { |val| deparse_item(val, A_CONST) }
-      output << "(#{vals.join(', ')})"
-      output.join(' ')
-    end
-
-    def deparse_create_cast(node)
-      output = []
-      output << 'CREATE'
-      output << 'CAST'
-      output << format('(%s AS %s)', deparse_item(node['sourcetype']), deparse_item(node['targettype']))
-      output << if node['func']
-                  function = node['func']['ObjectWithArgs']
-                  name = deparse_item_list(function['objname']).join('.')
-                  arguments = deparse_item_list(function['objargs']).join(', ')
-                  format('WITH FUNCTION %s(%s)', name, arguments)
-                elsif node['inout']
-                  'WITH INOUT'
-                else
-                  'WITHOUT FUNCTION'
-                end
-      output << 'AS IMPLICIT' if (node['context']).zero?
-      output << 'AS ASSIGNMENT' if node['context'] == 1
-      output.join(' ')
+      columns = node.fetch('attlist', [])
+      unless columns.empty?
+        output << ' ('
+        deparse_list(output, columns)
+        output << ')'
+      end
+      output << (node['is_from'] ? ' FROM' : ' TO')
+      output << ' PROGRAM' if node['is_program']
+      output << ' '
+      deparse_copy_output(output, node)
+    end
+
+    def deparse_copy_output(output, node)
+      return output << "'" << node['filename'].to_s << "'" if node.key?('filename')
+      return output << 'STDIN' if node['is_from']
+      output << 'STDOUT'
+    end
+
+    def deparse_create_enum(output, node, _context)
+      output << 'CREATE TYPE '
+      deparse_item(output, node['typeName'][0])
+      output << ' AS ENUM ('
+      deparse_list(output, node['vals'], ', ', A_CONST)
+      output << ')'
+    end
+
+    def deparse_create_cast(output, node, _context)
+      output << 'CREATE CAST ('
+      deparse_item(output, node['sourcetype'])
+      output << ' AS '
+      deparse_item(output, node['targettype'])
+      output << ') '
+      if node['func']
+        function = node['func']['ObjectWithArgs']
+        output << 'WITH FUNCTION '
+        deparse_list(output, function['objname'], '.')
+        output << '('
+        deparse_list(output, function['objargs'])
+        output << ')'
+      elsif node['inout']
+        output << 'WITH INOUT'
+      else
+        output << 'WITHOUT FUNCTION'
+      end
+      output << ' AS IMPLICIT' if (node['context']).zero?
+      output << ' AS ASSIGNMENT' if node['context'] == 1
+      output
     end
 
-    def deparse_create_domain(node)
-      output = []
-      output << 'CREATE'
-      output << 'DOMAIN'
-      output << deparse_item_list(node['domainname']).join('.')
-      output << 'AS'
-      output << deparse_item(node['typeName']) if node['typeName']
-      output << deparse_item(node['collClause']) if node['collClause']
-      output << deparse_item_list(node['constraints'])
-      output.join(' ')
+    def deparse_create_domain(output, node, _context)
+      output << 'CREATE DOMAIN '
+      deparse_list(output, node['domainname'], '.')
+      output << ' AS'
+      if node['typeName']
+        output << ' '
+        deparse_item(output, node['typeName'])
+      end
+      if node['collClause']
+        output << ' '
+        deparse_item(output, node['collClause'])
+      end
+      output << ' '
+      deparse_list(output, node['constraints'], ' ')
     end
 
-    def deparse_create_function(node)
-      output = []
+    def deparse_create_function(output, node, _context)
       output << 'CREATE'
-      output << 'OR REPLACE' if node['replace']
-      output << 'FUNCTION'
-
-      arguments = deparse_item_list(node.fetch('parameters', [])).join(', ')
-
-      output << deparse_item_list(node['funcname']).join('.') + '(' + arguments + ')'
-
-      output << 'RETURNS'
-      output << deparse_item(node['returnType'])
-      output += node['options'].map { |item| deparse_item(item) }
-
-      output.join(' ')
+      output << ' OR REPLACE' if node['replace']
+      output << ' FUNCTION '
+      deparse_list(output, node['funcname'], '.')
+      output << '('
+      deparse_list(output, node.fetch('parameters', []))
+      output << ') RETURNS '
+      deparse_item(output, node['returnType'])
+      node['options'].each do |item|
+        output << ' '
+        deparse_item(output, item)
+      end
+      output
     end
 
-    def deparse_create_range(node)
-      output = ['CREATE TYPE']
-      output << deparse_item(node['typeName'][0])
-      output << 'AS RANGE'
-      params = node['params'].map do |param|
-        param_out = [param['DefElem']['defname']]
+    def deparse_create_range(output, node, _context)
+      output << 'CREATE TYPE '
+      deparse_item(output, node['typeName'][0])
+      output << ' AS RANGE ('
+      node['params'].each_with_index do |param, index|
+        output << ', ' unless index.zero?
+        output << param['DefElem']['defname'].to_s
         if param['DefElem'].key?('arg')
-          param_out << deparse_item(param['DefElem']['arg'])
+          output << '='
+          deparse_item(output, param['DefElem']['arg'])
         end
-        param_out.join('=')
       end
-      output << "(#{params.join(', ')})"
-      output.join(' ')
+      output << ')'
     end
 
-    def deparse_create_schema(node)
-      output = ['CREATE SCHEMA']
-      output << 'IF NOT EXISTS' if node['if_not_exists']
-      output << deparse_identifier(node['schemaname']) if node.key?('schemaname')
-      output << format('AUTHORIZATION %s', deparse_item(node['authrole'])) if node.key?('authrole')
-      output << deparse_item_list(node['schemaElts']) if node.key?('schemaElts')
-      output.join(' ')
+    def deparse_create_schema(output, node, _context)
+      output << 'CREATE SCHEMA'
+      output << ' IF NOT EXISTS' if node['if_not_exists']
+      if node.key?('schemaname')
+        output << ' '
+        deparse_identifier(output, node['schemaname'])
+      end
+      if node.key?('authrole')
+        output << ' AUTHORIZATION '
+        deparse_item(output, node['authrole'])
+      end
+      if node.key?('schemaElts')
+        output << ' '
+        deparse_list(output, node['schemaElts'], ' ')
+      end
+      output
     end
 
-    def deparse_create_table(node)
-      output = []
+    def deparse_create_table(output, node, _context)
       output << 'CREATE'
 
       persistence = relpersistence(node['relation'])
-      output << persistence if persistence
+      output << ' ' << persistence if persistence
 
-      output << 'TABLE'
+      output << ' TABLE'
 
-      output << 'IF NOT EXISTS' if node['if_not_exists']
+      output << ' IF NOT EXISTS' if node['if_not_exists']
 
-      output << deparse_item(node['relation'])
+      output << ' '
+      deparse_item(output, node['relation'])
 
-      output << '(' + node['tableElts'].map do |item|
-        deparse_item(item)
-      end.join(', ') + ')'
+      output << ' ('
+      deparse_list(output, node['tableElts'])
+      output << ')'
 
       if node['inhRelations']
-        output << 'INHERITS'
-        output << '(' + node['inhRelations'].map do |relation|
-          deparse_item(relation)
-        end.join(', ') + ')'
+        output << ' INHERITS ('
+        deparse_list(output, node['inhRelations'])
+        output << ')'
       end
 
-      output.join(' ')
+      output
     end
 
-    def deparse_create_table_as(node)
-      output = []
-      output << 'CREATE TEMPORARY TABLE'
-      output << deparse_item(node['into'])
-      output << 'AS'
-      output << deparse_item(node['query'])
-      output.join(' ')
+    def deparse_create_table_as(output, node, _context)
+      output << 'CREATE TEMPORARY TABLE '
+      deparse_item(output, node['into'])
+      output << ' AS '
+      deparse_item(output, node['query'])
+      output
     end
 
-    def deparse_into_clause(node)
-      deparse_item(node['rel'])
+    def deparse_into_clause(output, node, _context)
+      deparse_item(output, node['rel'])
     end
 
-    def deparse_when(node)
-      output = ['WHEN']
-      output << deparse_item(node['expr'])
-      output << 'THEN'
-      output << deparse_item(node['result'])
-      output.join(' ')
+    def deparse_when(output, node, _context)
+      output << 'WHEN '
+      deparse_item(output, node['expr'])
+      output << ' THEN '
+      deparse_item(output, node['result'])
+      output
     end
 
-    def deparse_sublink(node)
+    def deparse_sublink(output, node, _context)
       if node['subLinkType'] == SUBLINK_TYPE_ANY
-        format('%s IN (%s)', deparse_item(node['testexpr']), deparse_item(node['subselect']))
+        deparse_item(output, node['testexpr'])
+        output << ' IN ('
       elsif node['subLinkType'] == SUBLINK_TYPE_ALL
-        format('%s %s ALL (%s)', deparse_item(node['testexpr']), deparse_item(node['operName'][0], :operator), deparse_item(node['subselect']))
+        deparse_item(output, node['testexpr'])
+        output << ' '
+        deparse_item(output, node['operName'][0], :operator)
+        output << ' ALL ('
       elsif node['subLinkType'] == SUBLINK_TYPE_EXISTS
-        format('EXISTS(%s)', deparse_item(node['subselect']))
+        output << 'EXISTS('
       else
-        format('(%s)', deparse_item(node['subselect']))
+        output << '('
       end
+      deparse_item(output, node['subselect'])
+      output << ')'
     end
 
-    def deparse_rangesubselect(node)
-      output = '(' + deparse_item(node['subquery']) + ')'
+    def deparse_rangesubselect(output, node, _context)
+      output << '('
+      deparse_item(output, node['subquery'])
+      output << ')'
       if node['alias']
-        output + ' ' + deparse_item(node['alias'])
-      else
-        output
+        output << ' '
+        deparse_item(output, node['alias'])
       end
+      output
     end
 
-    def deparse_row(node)
-      'ROW(' + node['args'].map { |arg| deparse_item(arg) }.join(', ') + ')'
+    def deparse_row(output, node, _context)
+      output << 'ROW('
+      deparse_list(output, node['args'])
+      output << ')'
     end
 
-    def deparse_select(node) # rubocop:disable Metrics/CyclomaticComplexity
-      output = []
+    def deparse_select(output, node, _context) # rubocop:disable Metrics/CyclomaticComplexity
+      written = false
 
-      output << deparse_item(node['withClause']) if node['withClause']
+      if node['withClause']
+        written = deparse_space(output, written)
+        deparse_item(output, node['withClause'])
+      end
 
       if node['op'] == 1
-        output << deparse_item(node['larg'])
-        output << 'UNION'
-        output << 'ALL' if node['all']
-        output << deparse_item(node['rarg'])
-        output.join(' ')
+        written = deparse_space(output, written)
+        deparse_item(output, node['larg'])
+        output << ' UNION'
+        output << ' ALL' if node['all']
+        output << ' '
+        deparse_item(output, node['rarg'])
       end
 
       if node['op'] == 3
-        output << deparse_item(node['larg'])
-        output << 'EXCEPT'
-        output << deparse_item(node['rarg'])
-        output.join(' ')
+        written = deparse_space(output, written)
+        deparse_item(output, node['larg'])
+        output << ' EXCEPT '
+        deparse_item(output, node['rarg'])
       end
 
       if node[TARGET_LIST_FIELD]
+        written = deparse_space(output, written)
         output << 'SELECT'
         if node['distinctClause']
-          output << 'DISTINCT'
-          unless node['distinctClause'].compact.empty?
-            columns = node['distinctClause'].map { |item| deparse_item(item, :select) }
-            output << "ON (#{columns.join(', ')})"
+          output << ' DISTINCT'
+          unless node['distinctClause'].all?(&:nil?)
+            output << ' ON ('
+            deparse_list(output, node['distinctClause'], ', ', :select)
+            output << ')'
           end
         end
-        output << node[TARGET_LIST_FIELD].map do |item|
-          deparse_item(item, :select)
-        end.join(', ')
+        output << ' '
+        deparse_list(output, node[TARGET_LIST_FIELD], ', ', :select)
       end
 
       if node[FROM_CLAUSE_FIELD]
-        output << 'FROM'
-        output << node[FROM_CLAUSE_FIELD].map do |item|
-          deparse_item(item)
-        end.join(', ')
+        written = deparse_clause(output, written, 'FROM')
+        deparse_list(output, node[FROM_CLAUSE_FIELD])
       end
 
       if node['whereClause']
-        output << 'WHERE'
-        output << deparse_item(node['whereClause'])
+        written = deparse_clause(output, written, 'WHERE')
+        deparse_item(output, node['whereClause'])
       end
 
       if node['valuesLists']
-        output << 'VALUES'
-        output << node['valuesLists'].map do |value_list|
-          '(' + value_list.map { |v| deparse_item(v) }.join(', ') + ')'
-        end.join(', ')
+        written = deparse_clause(output, written, 'VALUES')
+        node['valuesLists'].each_with_index do |value_list, index|
+          output << ', ' unless index.zero?
+          output << '('
+          deparse_list(output, value_list)
+          output << ')'
+        end
       end
 
       if node['groupClause']
-        output << 'GROUP BY'
-        output << node['groupClause'].map do |item|
-          deparse_item(item)
-        end.join(', ')
+        written = deparse_clause(output, written, 'GROUP BY')
+        deparse_list(output, node['groupClause'])
       end
 
       if node['havingClause']
-        output << 'HAVING'
-        output << deparse_item(node['havingClause'])
+        written = deparse_clause(output, written, 'HAVING')
+        deparse_item(output, node['havingClause'])
       end
 
       if node['sortClause']
-        output << 'ORDER BY'
-        output << node['sortClause'].map do |item|
-          deparse_item(item)
-        end.join(', ')
+        written = deparse_clause(output, written, 'ORDER BY')
+        deparse_list(output, node['sortClause'])
       end
 
       if node['limitCount']
-        output << 'LIMIT'
-        output << deparse_item(node['limitCount'])
+        written = deparse_clause(output, written, 'LIMIT')
+        deparse_item(output, node['limitCount'])
       end
 
       if node['limitOffset']
-        output << 'OFFSET'
-        output << deparse_item(node['limitOffset'])
+        written = deparse_clause(output, written, 'OFFSET')
+        deparse_item(output, node['limitOffset'])
       end
 
       if node['lockingClause']
-        node['lockingClause'].map do |item|
-          output << deparse_item(item)
+        node['lockingClause'].each do |item|
+          written = deparse_space(output, written)
+          deparse_item(output, item)
         end
       end
 
-      output.join(' ')
+      output
     end
 
-    def deparse_sql_value_function(node)
-      output = []
-      lookup = [
+    SQL_VALUE_FUNCTIONS = PgQuery.make_shareable(
+      [
         'current_date',
         'current_time',
         'current_time', # with precision
@@ -1101,125 +1219,146 @@ class PgQuery
         'current_catalog',
         'current_schema'
       ]
-      output << lookup[node['op']]
-      output << "(#{node['typmod']})" unless node.fetch('typmod', -1) == -1
-      output.join('')
+    )
+    def deparse_sql_value_function(output, node, _context)
+      output << SQL_VALUE_FUNCTIONS[node['op']].to_s
+      output << '(' << node['typmod'].to_s << ')' unless node.fetch('typmod', -1) == -1
+      output
     end
 
-    def deparse_insert_into(node)
-      output = []
-      output << deparse_item(node['withClause']) if node['withClause']
+    def deparse_insert_into(output, node, _context)
+      if node['withClause']
+        deparse_item(output, node['withClause'])
+        output << ' '
+      end
 
-      output << 'INSERT INTO'
-      output << deparse_item(node['relation'])
+      output << 'INSERT INTO '
+      deparse_item(output, node['relation'])
 
       if node['cols']
-        output << '(' + node['cols'].map do |column|
-          deparse_item(column)
-        end.join(', ') + ')'
+        output << ' ('
+        deparse_list(output, node['cols'])
+        output << ')'
       end
 
-      output << deparse_item(node['selectStmt'])
+      output << ' '
+      deparse_item(output, node['selectStmt'])
 
-      output.join(' ')
+      output
     end
 
-    def deparse_update(node)
-      output = []
-      output << deparse_item(node['withClause']) if node['withClause']
+    def deparse_update(output, node, _context)
+      if node['withClause']
+        deparse_item(output, node['withClause'])
+        output << ' '
+      end
 
-      output << 'UPDATE'
-      output << deparse_item(node['relation'])
+      output << 'UPDATE '
+      deparse_item(output, node['relation'])
 
       if node[TARGET_LIST_FIELD]
-        output << 'SET'
-        columns = node[TARGET_LIST_FIELD].map do |item|
-          deparse_item(item, :update)
-        end
-        output << columns.join(', ')
+        output << ' SET '
+        deparse_list(output, node[TARGET_LIST_FIELD], ', ', :update)
       end
 
       if node['whereClause']
-        output << 'WHERE'
-        output << deparse_item(node['whereClause'])
+        output << ' WHERE '
+        deparse_item(output, node['whereClause'])
       end
 
       if node['returningList']
-        output << 'RETURNING'
-        output << node['returningList'].map do |item|
-          # RETURNING is formatted like a SELECT
-          deparse_item(item, :select)
-        end.join(', ')
+        output << ' RETURNING '
+        # RETURNING is formatted like a SELECT
+        deparse_list(output, node['returningList'], ', ', :select)
       end
 
-      output.join(' ')
+      output
     end
 
-    def deparse_typecast(node)
-      if deparse_item(node['typeName']) == 'boolean'
-        deparse_item(node['arg']) == "'t'" ? 'true' : 'false'
+    def deparse_typecast(output, node, _context)
+      if boolean_type?(node['typeName'])
+        output << (deparse_to_s(node['arg']) == "'t'" ? 'true' : 'false')
       else
-        deparse_item(node['arg']) + '::' + deparse_typename(node['typeName'][TYPE_NAME])
+        deparse_item(output, node['arg'])
+        output << '::'
+        deparse_typename(output, node['typeName'][TYPE_NAME], nil)
       end
     end
 
-    def deparse_typename(node)
-      names = node['names'].map { |n| deparse_item(n, TYPE_NAME) }
+    # Whether the type name deparses to "boolean", without deparsing TypeName
+    # nodes
+    def boolean_type?(item)
+      node = item[TYPE_NAME]
+      return deparse_to_s(item) == 'boolean' if node.nil?
+      return false if node['setof'] || node['arrayBounds']
 
-      # Intervals are tricky and should be handled in a separate method because
-      # they require performing some bitmask operations.
-      return deparse_interval_type(node) if names == %w[pg_catalog interval]
+      names = node['names']
+      if names.size == 1
+        deparse_name(names[0], TYPE_NAME) == 'boolean'
+      else
+        pg_catalog_type?(names, 'bool')
+      end
+    end
 
-      output = []
-      output << 'SETOF' if node['setof']
+    def pg_catalog_type?(names, type)
+      names.size >= 2 && deparse_name(names[0], TYPE_NAME) == 'pg_catalog' && deparse_name(names[1], TYPE_NAME) == type
+    end
 
-      if node['typmods']
-        arguments = node['typmods'].map do |item|
-          deparse_item(item)
-        end.join(', ')
-      end
-      output << deparse_typename_cast(names, arguments)
-      output.last << '[]' if node['arrayBounds']
+    def deparse_typename(output, node, _context)
+      names = node['names']
+
+      # Intervals are tricky and should be handled in a separate method because
+      # they require performing some bitmask operations.
+      return deparse_interval_type(output, node) if names.size == 2 && pg_catalog_type?(names, 'interval')
 
-      output.join(' ')
+      output << 'SETOF ' if node['setof']
+      deparse_typename_cast(output, names, node['typmods'])
+      output << '[]' if node['arrayBounds']
+      output
     end
 
-    def deparse_typename_cast(names, arguments) # rubocop:disable Metrics/CyclomaticComplexity
-      catalog, type = names
+    def deparse_typename_cast(output, names, typmods) # rubocop:disable Metrics/CyclomaticComplexity
       # Just pass along any custom types.
       # (The pg_catalog types are built-in Postgres system types and are
       #  handled in the case statement below)
-      return names.join('.') if catalog != 'pg_catalog'
+      return deparse_list(output, names, '.', TYPE_NAME) if names.empty? || deparse_name(names[0], TYPE_NAME) != 'pg_catalog'
 
+      type = deparse_name(names[1], TYPE_NAME) if names.size > 1
       case type
       when 'bpchar'
         # char(2) or char(9)
-        "char(#{arguments})"
-      when 'varchar'
-        arguments.nil? ? 'varchar' : "varchar(#{arguments})"
-      when 'numeric'
+        output << 'char('
+        deparse_list(output, typmods) if typmods
+        output << ')'
+      when 'varchar', 'numeric'
         # numeric(3, 5)
-        arguments.nil? ? 'numeric' : "numeric(#{arguments})"
+        output << type
+        if typmods
+          output << '('
+          deparse_list(output, typmods)
+          output << ')'
+        end
+        output
       when 'bool'
-        'boolean'
+        output << 'boolean'
       when 'int2'
-        'smallint'
+        output << 'smallint'
       when 'int4'
-        'int'
+        output << 'int'
       when 'int8'
-        'bigint'
+        output << 'bigint'
       when 'real', 'float4'
-        'real'
+        output << 'real'
       when 'float8'
-        'double'
+        output << 'double'
       when 'time'
-        'time'
+        output << 'time'
       when 'timetz'
-        'time with time zone'
+        output << 'time with time zone'
       when 'timestamp'
-        'timestamp'
+        output << 'timestamp'
       when 'timestamptz'
-        'timestamp with time zone'
+        output << 'timestamp with time zone'
       else
         raise format("Can't deparse type: %s", type)
       end
@@ -1227,12 +1366,13 @@ class PgQuery
 
     # Deparses interval type expressions like `interval year to month` or
     # `interval hour to second(5)`
-    def deparse_interval_type(node)
-      type = ['interval']
+    def deparse_interval_type(output, node)
+      output << 'interval'
 
       if node['typmods']
-        typmods = node['typmods'].map { |typmod| deparse_item(typmod) }
-        type << Interval.from_int(typmods.first.to_i).map do |part|
+        typmods = node['typmods'].map { |typmod| deparse_to_s(typmod) }
+        output << ' '
+        output << Interval.from_int(typmods.first.to_i).map do |part|
           # only the `second` type can take an argument.
           if part == 'second' && typmods.size == 2
             "second(#{typmods.last})"
@@ -1242,174 +1382,225 @@ class PgQuery
         end.join(' to ')
       end
 
-      type.join(' ')
+      output
     end
 
-    def deparse_nulltest(node)
-      output = [deparse_item(node['arg'])]
+    def deparse_nulltest(output, node, _context)
+      deparse_item(output, node['arg'])
       case node['nulltesttype']
       when 0
-        output << 'IS NULL'
+        output << ' IS NULL'
       when 1
-        output << 'IS NOT NULL'
+        output << ' IS NOT NULL'
       end
-      output.join(' ')
+      output
     end
 
-    TRANSACTION_CMDS = {
+    TRANSACTION_CMDS = PgQuery.make_shareable(
       TRANS_STMT_BEGIN => 'BEGIN',
       TRANS_STMT_COMMIT => 'COMMIT',
       TRANS_STMT_ROLLBACK => 'ROLLBACK',
       TRANS_STMT_SAVEPOINT => 'SAVEPOINT',
       TRANS_STMT_RELEASE => 'RELEASE',
       TRANS_STMT_ROLLBACK_TO => 'ROLLBACK TO SAVEPOINT'
-    }.freeze
-    def deparse_transaction(node)
-      output = []
-      output << TRANSACTION_CMDS[node['kind']] || raise(format("Can't deparse TRANSACTION %s", node.inspect))
+    )
+    def deparse_transaction(output, node, _context)
+      output << TRANSACTION_CMDS[node['kind']].to_s
 
       if node['options']
-        output += node['options'].map { |item| deparse_item(item) }
+        node['options'].each do |item|
+          output << ' '
+          deparse_item(output, item)
+        end
       end
 
-      output.join(' ')
+      output
     end
 
-    def deparse_coalesce(node)
-      format('COALESCE(%s)', node['args'].map { |a| deparse_item(a) }.join(', '))
+    def deparse_coalesce(output, node, _context)
+      output << 'COALESCE('
+      deparse_list(output, node['args'])
+      output << ')'
     end
 
-    def deparse_defelem(node)
+    def deparse_defelem(output, node, _context)
       case node['defname']
       when 'as'
-        "AS $$#{deparse_item_list(node['arg'], :defname_as).join("\n")}$$"
+        output << 'AS $$'
+        deparse_list(output, node['arg'], "\n", :defname_as)
+        output << '$$'
       when 'language'
-        "language #{deparse_item(node['arg'])}"
+        output << 'language '
+        deparse_item(output, node['arg'])
+        output
       when 'volatility'
-        node['arg']['String']['str'].upcase # volatility does not need to be quoted
+        output << node['arg']['String']['str'].upcase # volatility does not need to be quoted
       when 'strict'
-        deparse_item(node['arg']) == '1' ? 'RETURNS NULL ON NULL INPUT' : 'CALLED ON NULL INPUT'
+        output << (deparse_to_s(node['arg']) == '1' ? 'RETURNS NULL ON NULL INPUT' : 'CALLED ON NULL INPUT')
       else
-        deparse_item(node['arg'])
+        deparse_item(output, node['arg'])
       end
     end
 
-    def deparse_define_stmt(node)
-      dispatch = {
-        1 => :deparse_create_aggregate,
-        25 => :deparse_create_operator,
-        45 => :deparse_create_type
-      }
-      method(dispatch.fetch(node['kind'])).call(node)
+    DEFINE_STMT_DEPARSERS = PgQuery.make_shareable(
+      1 => :deparse_create_aggregate,
+      25 => :deparse_create_operator,
+      45 => :deparse_create_type
+    )
+    def deparse_define_stmt(output, node, _context)
+      __send__(DEFINE_STMT_DEPARSERS.fetch(node['kind']), output, node)
     end
 
-    def deparse_create_aggregate(node)
-      output = ['CREATE AGGREGATE']
-      output << node['defnames'].map(&method(:deparse_item))
-      args = node['args'][0] || [{ A_STAR => nil }]
-      output << "(#{args.map(&method(:deparse_item)).join(', ')})"
-      definitions = node['definition'].map do |definition|
-        definition_output = [definition['DefElem']['defname']]
-        definition_output << definition['DefElem']['arg']['TypeName']['names'].map(&method(:deparse_item)).join(', ') if definition['DefElem'].key?('arg')
-        definition_output.join('=')
+    def deparse_create_aggregate(output, node)
+      output << 'CREATE AGGREGATE '
+      deparse_list(output, node['defnames'], ' ')
+      output << ' ('
+      args = node['args'][0]
+      if args
+        deparse_list(output, args)
+      else
+        output << '*'
       end
-      output << "(#{definitions.join(', ')})"
-      output.join(' ')
+      output << ') ('
+      deparse_definitions(output, node['definition'])
+      output << ')'
     end
 
-    def deparse_create_operator(node)
-      output = ['CREATE OPERATOR']
-      output << node['defnames'][0]['String']['str']
-      definitions = node['definition'].map do |definition|
-        definition_output = [definition['DefElem']['defname']]
-        definition_output << definition['DefElem']['arg']['TypeName']['names'].map(&method(:deparse_item)).join(', ') if definition['DefElem'].key?('arg')
-        definition_output.join('=')
+    def deparse_create_operator(output, node)
+      output << 'CREATE OPERATOR ' << node['defnames'][0]['String']['str'].to_s << ' ('
+      deparse_definitions(output, node['definition'])
+      output << ')'
+    end
+
+    # name=type, ... of aggregates and operators
+    def deparse_definitions(output, definitions)
+      definitions.each_with_index do |definition, index|
+        output << ', ' unless index.zero?
+        output << definition['DefElem']['defname'].to_s
+        next unless definition['DefElem'].key?('arg')
+        output << '='
+        deparse_list(output, definition['DefElem']['arg']['TypeName']['names'])
       end
-      output << "(#{definitions.join(', ')})"
-      output.join(' ')
+      output
     end
 
-    def deparse_create_type(node)
-      output = ['CREATE TYPE']
-      output << node['defnames'].map(&method(:deparse_item))
+    def deparse_create_type(output, node)
+      output << 'CREATE TYPE '
+      deparse_list(output, node['defnames'], ' ')
       if node.key?('definition')
-        definitions = node['definition'].map do |definition|
-          definition_output = [definition['DefElem']['defname']]
-          if definition['DefElem'].key?('arg')
-            definition_output += definition['DefElem']['arg']['TypeName']['names'].map(&method(:deparse_item))
+        output << ' ('
+        node['definition'].each_with_index do |definition, index|
+          output << ', ' unless index.zero?
+          output << definition['DefElem']['defname'].to_s
+          next unless definition['DefElem'].key?('arg')
+          definition['DefElem']['arg']['TypeName']['names'].each do |name|
+            output << '='
+            deparse_item(output, name)
           end
-          definition_output.join('=')
         end
-        output << "(#{definitions.join(', ')})"
+        output << ')'
       end
-      output.join(' ')
+      output
     end
 
-    def deparse_delete_from(node)
-      output = []
-      output << deparse_item(node['withClause']) if node['withClause']
+    def deparse_delete_from(output, node, _context)
+      if node['withClause']
+        deparse_item(output, node['withClause'])
+        output << ' '
+      end
 
-      output << 'DELETE FROM'
-      output << deparse_item(node['relation'])
+      output << 'DELETE FROM '
+      deparse_item(output, node['relation'])
 
       if node['usingClause']
-        output << 'USING'
-        output << node['usingClause'].map do |item|
-          deparse_item(item)
-        end.join(', ')
+        output << ' USING '
+        deparse_list(output, node['usingClause'])
       end
 
       if node['whereClause']
-        output << 'WHERE'
-        output << deparse_item(node['whereClause'])
+        output << ' WHERE '
+        deparse_item(output, node['whereClause'])
       end
 
       if node['returningList']
-        output << 'RETURNING'
-        output << node['returningList'].map do |item|
-          # RETURNING is formatted like a SELECT
-          deparse_item(item, :select)
-        end.join(', ')
+        output << ' RETURNING '
+        # RETURNING is formatted like a SELECT
+        deparse_list(output, node['returningList'], ', ', :select)
       end
 
-      output.join(' ')
+      output
     end
 
-    def deparse_discard(node)
-      output = ['DISCARD']
-      output << 'ALL' if (node['target']).zero?
-      output << 'PLANS' if node['target'] == 1
-      output << 'SEQUENCES' if node['target'] == 2
-      output << 'TEMP' if node['target'] == 3
-      output.join(' ')
+    def deparse_discard(output, node, _context)
+      output << 'DISCARD'
+      output << ' ALL' if (node['target']).zero?
+      output << ' PLANS' if node['target'] == 1
+      output << ' SEQUENCES' if node['target'] == 2
+      output << ' TEMP' if node['target'] == 3
+      output
     end
 
-    def deparse_drop(node) # rubocop:disable Metrics/CyclomaticComplexity
-      output = ['DROP']
-      output << 'TABLE' if node['removeType'] == OBJECT_TYPE_TABLE
-      output << 'SCHEMA' if node['removeType'] == OBJECT_TYPE_SCHEMA
-      output << 'CONCURRENTLY' if node['concurrent']
-      output << 'IF EXISTS' if node['missing_ok']
+    def deparse_drop(output, node, _context) # rubocop:disable Metrics/CyclomaticComplexity
+      output << 'DROP'
+      output << ' TABLE' if node['removeType'] == OBJECT_TYPE_TABLE
+      output << ' SCHEMA' if node['removeType'] == OBJECT_TYPE_SCHEMA
+      output << ' CONCURRENTLY' if node['concurrent']
+      output << ' IF EXISTS' if node['missing_ok']
 
       objects = node['objects']
       objects = [objects] unless objects[0].is_a?(Array)
-      output << objects.map { |list| list.map { |object| deparse_item(object) } }.join(', ')
+      output << ' '
+      objects.each_with_index do |list, index|
+        output << ', ' unless index.zero?
+        deparse_list(output, list)
+      end
 
-      output << 'CASCADE' if node['behavior'] == 1
+      output << ' CASCADE' if node['behavior'] == 1
 
-      output.join(' ')
+      output
     end
 
-    def deparse_explain(node)
-      output = ['EXPLAIN']
-      options = node.fetch('options', []).map { |option| option['DefElem']['defname'].upcase }
+    def deparse_explain(output, node, _context)
+      output << 'EXPLAIN'
+      options = node.fetch('options', [])
       if options.size == 1
-        output.concat(options)
+        output << ' ' << options[0]['DefElem']['defname'].upcase
       elsif options.size > 1
-        output << "(#{options.join(', ')})"
+        output << ' ('
+        options.each_with_index do |option, index|
+          output << ', ' unless index.zero?
+          output << option['DefElem']['defname'].upcase
+        end
+        output << ')'
+      end
+      output << ' '
+      deparse_item(output, node['query'])
+      output
+    end
+
+    def deparse_string(output, node, context)
+      if context == A_CONST
+        deparse_quoted(output, node['str'], "'")
+      elsif RAW_STRING_CONTEXTS.include?(context)
+        return if node['str'].nil?
+        output << node['str'].to_s
+      else
+        deparse_identifier(output, node['str'], true)
       end
-      output << deparse_item(node['query'])
-      output.join(' ')
+    end
+    RAW_STRING_CONTEXTS = PgQuery.make_shareable([FUNC_CALL, TYPE_NAME, :operator, :defname_as])
+
+    def deparse_integer(output, node, _context)
+      output << node['ival'].to_s
+    end
+
+    def deparse_float(output, node, _context)
+      return if node['str'].nil?
+      output << node['str'].to_s
+    end
+
+    def deparse_null(output, _node, _context)
+      output << 'NULL'
     end
 
     # The PG parser adds several pieces of view data onto the RANGEVAR
@@ -19,7 +19,7 @@ class PgQuery
         PgQuery::Deparse.instance_exec(node, &action)
       end
 
-      ALTER_TABLE_TYPES_MAPPING = {
+      ALTER_TABLE_TYPES_MAPPING = PgQuery.make_shareable(
         AT_AddColumn                 => ->(_node) { ['ADD COLUMN'] },
         AT_ColumnDefault             => ->(node) { ['ALTER COLUMN', node['def'] ? 'SET DEFAULT' : 'DROP DEFAULT'] },
         AT_DropNotNull               => ->(_node) { ['ALTER COLUMN', 'DROP NOT NULL'] },
@@ -36,7 +36,7 @@ class PgQuery
         AT_DropConstraint            => ->(_node) { ['DROP CONSTRAINT'] },
         AT_AlterColumnType           => ->(_node) { ['ALTER COLUMN', 'TYPE'] },
         AT_AlterColumnGenericOptions => ->(_node) { ['ALTER COLUMN', 'OPTIONS'] }
-      }.freeze
+      )
     end
   end
 end
@@ -27,7 +27,7 @@ class PgQuery
 
       # From src/include/utils/datetime.h
       # The number is the power of 2 used for the mask.
-      MASKS = {
+      MASKS = PgQuery.make_shareable(
         0  => 'RESERV',
         1  => 'MONTH',
         2  => 'YEAR',
@@ -57,8 +57,8 @@ class PgQuery
         26 => 'CENTURY',
         27 => 'MILLENNIUM',
         28 => 'DTZMOD'
-      }.freeze
-      KEYS = MASKS.invert
+      )
+      KEYS = PgQuery.make_shareable(MASKS.invert)
 
       # Postgres stores the interval 'day second' as 'day hour minute second' so
       # we need to reconstruct the sql with only the largest and smallest time
@@ -74,7 +74,7 @@ class PgQuery
       #
       #      { 6 => 'year to month' }
       #
-      SQL_BY_MASK = {
+      SQL_BY_MASK = PgQuery.make_shareable(
         (1 << KEYS['YEAR'])     => %w[year],
         (1 << KEYS['MONTH'])    => %w[month],
         (1 << KEYS['DAY'])      => %w[day],
@@ -99,7 +99,7 @@ class PgQuery
            1 << KEYS['SECOND']) => %w[hour second],
         (1 << KEYS['MINUTE'] |
            1 << KEYS['SECOND']) => %w[minute second]
-      }.freeze
+      )
     end
   end
 end
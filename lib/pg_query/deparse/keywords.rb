@@ -2,7 +2,7 @@ class PgQuery
   module Deparse # rubocop:disable Metrics/ModuleLength
     # Copy of https://www.postgresql.org/docs/current/sql-keywords-appendix.html
     # to make sure we escape identifiers that are reserved or non-reserved keywords
-    KEYWORDS = [
+    KEYWORDS = PgQuery.make_shareable([
       'A',
       'ABORT',
       'ABS',
@@ -755,6 +755,6 @@ class PgQuery
       'YEAR',
       'YES',
       'ZONE'
-    ].freeze
+    ])
   end
 end
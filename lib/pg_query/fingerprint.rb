@@ -1,15 +1,73 @@
 require 'digest'
 
 class PgQuery
-  def fingerprint
-    hash = Digest::SHA1.new
-    fingerprint_tree(hash)
-    format('%02x', FINGERPRINT_VERSION) + hash.hexdigest
+  # Fingerprint as computed by libpg_query, see PgQuery#fingerprint for the
+  # fingerprint of a parsed (and possibly modified) query.
+  #
+  # With version: 3, the same parts of the query are hashed with XXH64 instead
+  # of SHA-1, which is considerably faster, and the fingerprint is returned as
+  # a signed 64-bit Integer (like the queryid of pg_stat_statements, so it
+  # fits a bigint column) instead of a hex String. Version 3 fingerprints are
+  # not cryptographically strong, and are only equal for the same queries
+  # that get equal version 2 fingerprints (barring collisions).
+  def self.fingerprint(query, version: FINGERPRINT_VERSION)
+    cached(query, fingerprint_cache_kind(version)) { _raw_fingerprint(query, version) }
   end
 
-  private
+  # Like PgQuery.fingerprint, but returns an Integer instead of a hex String:
+  # the first 64 bits of the SHA-1 digest (big-endian, as a signed integer) for
+  # version 2, or the same Integer as PgQuery.fingerprint for version 3. Use it
+  # to store or compare fingerprints without allocating a String for each.
+  #
+  # Integers from 2**62 up (or below -2**62) are Bignums and still allocate
+  # an object, but one that is smaller than the hex String. Version 2 Integers
+  # are truncated, so they can only be compared with each other.
+  def self.fingerprint_int(query, version: FINGERPRINT_VERSION)
+    kind = version == FINGERPRINT_VERSION_XXH64 ? :fingerprint_xxh64 : :fingerprint_int
+    cached(query, kind) { _fingerprint_int(query, version) }
+  end
+
+  # The version 2 fingerprint as a binary String of 21 bytes (the version
+  # byte, followed by the SHA-1 digest) instead of 42 hex characters, i.e. the
+  # same as [PgQuery.fingerprint(query)].pack('H*'), e.g. for a bytea column.
+  def self.fingerprint_binary(query)
+    cached(query, :fingerprint_binary) { _fingerprint_binary(query) }
+  end
+
+  def fingerprint(version: FINGERPRINT_VERSION)
+    return @native_tree.fingerprint(version) if @native_tree
+
+    # Returns nil for trees containing values that aren't part of a regular
+    # parse tree (e.g. Symbols), which are left to the Ruby implementation
+    PgQuery._fingerprint_tree(@tree, version) || ruby_fingerprint(version)
+  end
 
   FINGERPRINT_VERSION = 2
+  FINGERPRINT_VERSION_XXH64 = 3
+
+  def self.fingerprint_cache_kind(version)
+    case version
+    when FINGERPRINT_VERSION then :fingerprint
+    when FINGERPRINT_VERSION_XXH64 then :fingerprint_xxh64
+    else raise ArgumentError, "unsupported fingerprint version: #{version}"
+    end
+  end
+  private_class_method :fingerprint_cache_kind
+
+  private
+
+  def ruby_fingerprint(version = FINGERPRINT_VERSION)
+    if version == FINGERPRINT_VERSION_XXH64
+      hash = XXH64.new
+      fingerprint_tree(hash)
+      digest = hash.digest
+      return digest >= 2**63 ? digest - 2**64 : digest
+    end
+
+    hash = Digest::SHA1.new
+    fingerprint_tree(hash)
+    format('%02x', FINGERPRINT_VERSION) + hash.hexdigest
+  end
 
   class FingerprintSubHash
     attr_reader :parts
@@ -108,7 +166,7 @@ class PgQuery
   end
 
   def fingerprint_tree(hash)
-    @tree.each do |node|
+    tree.each do |node|
       fingerprint_node(node, hash)
     end
   end
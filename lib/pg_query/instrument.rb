@@ -0,0 +1,171 @@
+class PgQuery
+  # What a single instrumented call cost, as passed to the PgQuery.instrument
+  # block. duration and the phases (a Hash of phase name => seconds, e.g.
+  # :parse, :output, :tree and :ruby for the time spent in Ruby code) are wall
+  # time in seconds. native_memory is the peak size of the PostgreSQL memory
+  # context used for parsing, in bytes, and allocations is the number of Ruby
+  # objects allocated while the call ran. Ruby only counts allocations for the
+  # whole process, so this includes objects allocated by other threads (and
+  # Ractors) in the meantime - it is only exact when nothing else runs.
+  Event = Struct.new(:operation, :duration, :phases, :bytes_in, :bytes_out, :native_memory, :allocations)
+
+  # Instrumentation is opt-in, and costs a single check per call while off:
+  #
+  #   PgQuery.instrument { |event| StatsD.timing("pg_query.#{event.operation}", event.duration) }
+  #
+  # Without a block, only the per-thread counters returned by PgQuery.stats are
+  # kept. Subscribers are only called from the main Ractor (the counters are
+  # kept in every Ractor), and are called in the thread that made the call,
+  # so they should be quick.
+  def self.instrument(&subscriber)
+    @subscriber = subscriber
+    self._instrumenting = true
+    nil
+  end
+
+  def self.uninstrument
+    self._instrumenting = false
+    @subscriber = nil
+    nil
+  end
+
+  # Counters for the calls made by the current thread while instrumenting, by
+  # operation (:parse, :normalize, :normalize_with_constants, :fingerprint,
+  # :fingerprint_int, :fingerprint_binary, :analyze, :statements, :try_parse,
+  # :try_normalize, :try_fingerprint, :tables, :filter_columns, :param_refs and
+  # :deparse), e.g.
+  #
+  #   { parse: { calls: 2, time: 0.00012, phases: { parse: 0.00005, ... },
+  #              bytes_in: 16, bytes_out: 1530, native_memory_peak: 8192, allocations: 84 } }
+  def self.stats
+    Thread.current[:pg_query_stats] || {}
+  end
+
+  def self.reset_stats
+    Thread.current[:pg_query_stats] = nil
+  end
+
+  # Runs the block, and records what it cost if instrumenting (bytes_in is
+  # the size of the query text)
+  def self.instrumented(operation, bytes_in = 0)
+    return yield unless instrumenting?
+
+    Thread.current[:pg_query_native_stats] = nil
+    # Process-wide, see Event
+    allocated = GC.stat(:total_allocated_objects)
+    start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+    result = yield
+
+    duration = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+    allocations = GC.stat(:total_allocated_objects) - allocated
+    native = Thread.current[:pg_query_native_stats]
+    Thread.current[:pg_query_native_stats] = nil
+
+    # Native stats are missing for cache hits, and for operations that are
+    # implemented in Ruby
+    native ||= {}
+    bytes_out = native.delete(:bytes_out) || 0
+    native_memory = native.delete(:native_memory) || 0
+    native[:ruby] = [duration - native.values.inject(0.0, :+), 0.0].max
+
+    record_event(Event.new(operation, duration, native, bytes_in, bytes_out, native_memory, allocations))
+    result
+  end
+  private_class_method :instrumented
+
+  def self.record_event(event)
+    stats = (Thread.current[:pg_query_stats] ||= {})
+    counters = (stats[event.operation] ||= { calls: 0, time: 0.0, phases: Hash.new(0.0), bytes_in: 0, bytes_out: 0,
+                                             native_memory_peak: 0, allocations: 0 })
+    counters[:calls] += 1
+    counters[:time] += event.duration
+    event.phases.each { |phase, seconds| counters[:phases][phase] += seconds }
+    counters[:bytes_in] += event.bytes_in
+    counters[:bytes_out] += event.bytes_out
+    counters[:native_memory_peak] = event.native_memory if event.native_memory > counters[:native_memory_peak]
+    counters[:allocations] += event.allocations
+
+    return if defined?(Ractor) && !Ractor.current.equal?(MAIN_RACTOR)
+    subscriber = @subscriber
+    subscriber.call(event) if subscriber
+  end
+  private_class_method :record_event
+
+  # Wraps the instrumented operations, so they don't need to know about it
+  module Instrumentation
+    module ClassMethods
+      def parse(query, lazy: false)
+        instrumented(:parse, query.bytesize) { super }
+      end
+
+      def normalize(query)
+        instrumented(:normalize, query.bytesize) { super }
+      end
+
+      def normalize_with_constants(query)
+        instrumented(:normalize_with_constants, query.bytesize) { super }
+      end
+
+      def fingerprint(query, version: FINGERPRINT_VERSION)
+        instrumented(:fingerprint, query.bytesize) { super }
+      end
+
+      def fingerprint_int(query, version: FINGERPRINT_VERSION)
+        instrumented(:fingerprint_int, query.bytesize) { super }
+      end
+
+      def fingerprint_binary(query)
+        instrumented(:fingerprint_binary, query.bytesize) { super }
+      end
+
+      def analyze(query)
+        instrumented(:analyze, query.bytesize) { super }
+      end
+
+      def statements(query)
+        instrumented(:statements, query.bytesize) { super }
+      end
+
+      def try_parse(query, lazy: false)
+        instrumented(:try_parse, query.bytesize) { super }
+      end
+
+      def try_normalize(query)
+        instrumented(:try_normalize, query.bytesize) { super }
+      end
+
+      def try_fingerprint(query, version: FINGERPRINT_VERSION)
+        instrumented(:try_fingerprint, query.bytesize) { super }
+      end
+    end
+
+    def filter_columns
+      instrumented(:filter_columns) { super }
+    end
+
+    def param_refs
+      instrumented(:param_refs) { super }
+    end
+
+    def deparse(*)
+      instrumented(:deparse) { super }
+    end
+
+    protected
+
+    def load_tables_and_aliases!
+      instrumented(:tables) { super }
+    end
+
+    private
+
+    def instrumented(operation, &block)
+      PgQuery.__send__(:instrumented, operation, @query.bytesize, &block)
+    end
+  end
+  private_constant :Instrumentation
+
+  prepend Instrumentation
+  singleton_class.prepend Instrumentation::ClassMethods
+end
@@ -1,54 +1,20 @@
 class PgQuery
   # Legacy parsetree from 0.7 and earlier versions - migrate to "tree" format if you can
-  def parsetree # rubocop:disable Metrics/CyclomaticComplexity
-    @parsetree ||= transform_nodes!(@tree) do |raw_node|
-      node = raw_node.keys[0] == RAW_STMT ? raw_node.delete(RAW_STMT)[STMT_FIELD] : raw_node
+  #
+  # Parts of the tree that don't change (e.g. the fields of String nodes) are
+  # shared with #tree, instead of being copied.
+  def parsetree
+    @parsetree ||= transform_nodes(tree) do |raw_node|
+      node = raw_node.keys[0] == RAW_STMT ? raw_node[RAW_STMT][STMT_FIELD] : raw_node
 
       key = node.keys[0]
-      new_key = LEGACY_NODE_NAMES[key] || key.upcase
-
-      case key
-      when A_CONST
-        transform_parsetree_a_const(node)
-      when A_EXPR
-        node[A_EXPR]['name'] = transform_string_list(node[A_EXPR]['name'])
-        node[key].delete('kind')
-      when COLUMN_REF
-        node[COLUMN_REF]['fields'] = transform_string_list(node[COLUMN_REF]['fields'])
-      when CREATE_FUNCTION_STMT
-        node[CREATE_FUNCTION_STMT]['funcname'] = transform_string_list(node[CREATE_FUNCTION_STMT]['funcname'])
-      when CREATE_TRIG_STMT
-        node[CREATE_TRIG_STMT]['funcname'] = transform_string_list(node[CREATE_TRIG_STMT]['funcname'])
-      when CONSTRAINT
-        node[CONSTRAINT]['contype'] = LEGACY_CONSTRAINT_TYPES[node[CONSTRAINT]['contype']]
-        node[CONSTRAINT]['keys'] = transform_string_list(node[CONSTRAINT]['keys'])
-      when COPY_STMT
-        node[COPY_STMT]['attlist'] = transform_string_list(node[COPY_STMT]['attlist'])
-      when DEF_ELEM
-        node[DEF_ELEM]['arg'] = node[DEF_ELEM]['arg'][INTEGER]['ival'] if node[DEF_ELEM]['arg'].is_a?(Hash) && node[DEF_ELEM]['arg'].keys[0] == INTEGER
-        node[DEF_ELEM]['arg'] = node[DEF_ELEM]['arg'][STRING]['str'] if node[DEF_ELEM]['arg'].is_a?(Hash) && node[DEF_ELEM]['arg'].keys[0] == STRING
-        node[DEF_ELEM]['arg'] = transform_string_list(node[DEF_ELEM]['arg']) if node[DEF_ELEM]['arg'].is_a?(Array)
-      when DROP_STMT
-        node[DROP_STMT]['objects'].each_with_index do |obj, idx|
-          node[DROP_STMT]['objects'][idx] = transform_string_list(obj)
-        end
-      when FUNC_CALL
-        node[FUNC_CALL]['funcname'] = transform_string_list(node[FUNC_CALL]['funcname'])
-      when GRANT_ROLE_STMT
-        node[GRANT_ROLE_STMT]['grantee_roles'] = transform_string_list(node[GRANT_ROLE_STMT]['grantee_roles'])
-      when RANGE_VAR
-        node[RANGE_VAR]['inhOpt'] = node[RANGE_VAR].delete('inh') ? 2 : 0
-      when TYPE_NAME
-        node[TYPE_NAME]['names'] = transform_string_list(node[TYPE_NAME]['names'])
-      end
-
-      raw_node[new_key] = node.delete(key)
+      { (LEGACY_NODE_NAMES[key] || key.upcase) => transform_parsetree_fields(key, node[key]) }
     end
   end
 
   private
 
-  LEGACY_NODE_NAMES = {
+  LEGACY_NODE_NAMES = PgQuery.make_shareable(
     A_EXPR => 'AEXPR',
     SELECT_STMT => 'SELECT',
     ALTER_TABLE_CMD => 'ALTER TABLE CMD',
@@ -69,31 +35,67 @@ class PgQuery
     VARIABLE_SET_STMT => 'SET',
     VARIABLE_SHOW_STMT => 'SHOW'
     # All others default to simply upper-casing the input name
-  }.freeze
+  )
 
-  LEGACY_CONSTRAINT_TYPES = {
+  LEGACY_CONSTRAINT_TYPES = PgQuery.make_shareable(
     CONSTR_TYPE_PRIMARY => 'PRIMARY_KEY'
-  }.freeze
+  )
 
-  def transform_parsetree_a_const(node)
-    type_key = node[A_CONST]['val'].keys[0]
+  # Returns the fields of a node in the legacy format, copying them only if
+  # anything changes
+  def transform_parsetree_fields(key, fields) # rubocop:disable Metrics/CyclomaticComplexity
+    case key
+    when A_CONST
+      transform_parsetree_a_const(fields)
+    when A_EXPR
+      fields = fields.merge('name' => transform_string_list(fields['name']))
+      fields.delete('kind')
+      fields
+    when COLUMN_REF
+      fields.merge('fields' => transform_string_list(fields['fields']))
+    when CREATE_FUNCTION_STMT, CREATE_TRIG_STMT, FUNC_CALL
+      fields.merge('funcname' => transform_string_list(fields['funcname']))
+    when CONSTRAINT
+      fields.merge('contype' => LEGACY_CONSTRAINT_TYPES[fields['contype']], 'keys' => transform_string_list(fields['keys']))
+    when COPY_STMT
+      fields.merge('attlist' => transform_string_list(fields['attlist']))
+    when DEF_ELEM
+      arg = fields['arg']
+      arg = arg[INTEGER]['ival'] if arg.is_a?(Hash) && arg.keys[0] == INTEGER
+      arg = arg[STRING]['str'] if arg.is_a?(Hash) && arg.keys[0] == STRING
+      arg = transform_string_list(arg) if arg.is_a?(Array)
+      arg.equal?(fields['arg']) ? fields : fields.merge('arg' => arg)
+    when DROP_STMT
+      fields.merge('objects' => fields['objects'].map { |obj| transform_string_list(obj) })
+    when GRANT_ROLE_STMT
+      fields.merge('grantee_roles' => transform_string_list(fields['grantee_roles']))
+    when RANGE_VAR
+      fields = fields.dup
+      fields['inhOpt'] = fields.delete('inh') ? 2 : 0
+      fields
+    when TYPE_NAME
+      fields.merge('names' => transform_string_list(fields['names']))
+    else
+      fields
+    end
+  end
+
+  def transform_parsetree_a_const(fields)
+    val = fields['val']
 
-    case type_key
+    case val.keys[0]
     when INTEGER
-      node[A_CONST]['type'] = 'integer'
-      node[A_CONST]['val'] = node[A_CONST]['val'][INTEGER]['ival']
+      fields.merge('type' => 'integer', 'val' => val[INTEGER]['ival'])
     when STRING
-      node[A_CONST]['type'] = 'string'
-      node[A_CONST]['val'] = node[A_CONST]['val'][STRING]['str']
+      fields.merge('type' => 'string', 'val' => val[STRING]['str'])
     when FLOAT
-      node[A_CONST]['type'] = 'float'
-      node[A_CONST]['val'] = node[A_CONST]['val'][FLOAT]['str'].to_f
+      fields.merge('type' => 'float', 'val' => val[FLOAT]['str'].to_f)
     when BIT_STRING
-      node[A_CONST]['type'] = 'bitstring'
-      node[A_CONST]['val'] = node[A_CONST]['val'][BIT_STRING]['str']
+      fields.merge('type' => 'bitstring', 'val' => val[BIT_STRING]['str'])
     when NULL
-      node[A_CONST]['type'] = 'null'
-      node[A_CONST]['val'] = nil
+      fields.merge('type' => 'null', 'val' => nil)
+    else
+      fields
     end
   end
 
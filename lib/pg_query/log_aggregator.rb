@@ -0,0 +1,78 @@
+class PgQuery
+  # Aggregates the statements in a PostgreSQL server log by their fingerprint,
+  # counting how often each ran and for how long. Only statements logged along
+  # with their duration are counted, e.g. with log_min_duration_statement = 0:
+  #
+  #   2018-01-01 12:00:00.000 UTC [1234] LOG:  duration: 0.512 ms  statement: SELECT 1
+  #
+  # Log data is processed natively as it is read, without holding the GVL, and
+  # only the aggregates are turned into Ruby objects. Memory use is bounded by
+  # the number of distinct fingerprints tracked (max_fingerprints), statements
+  # with a new fingerprint are dropped (and counted in #stats) once it is reached.
+  #
+  #   aggregator = PgQuery.aggregate_log(File.open('postgresql.csv'), format: :csvlog)
+  #   aggregator.sort_by { |e| -e.total_ms }.first(10).each { |e| puts "#{e.total_ms} #{e.query}" }
+  class LogAggregator
+    include Enumerable
+
+    FORMATS = %i[stderr csvlog].freeze
+    CHUNK_SIZE = 64 * 1024
+
+    # Statements with the same fingerprint, with the text of the first one seen
+    # (cut off at max_query_length bytes)
+    Entry = Struct.new(:fingerprint, :query, :count, :total_ms, :max_ms) do
+      def mean_ms
+        total_ms / count
+      end
+    end
+
+    attr_reader :format
+
+    # format is the log_destination the log was written with (:stderr or
+    # :csvlog), statements are fingerprinted on up to "threads" native threads
+    def initialize(format: :stderr, max_fingerprints: 10_000, max_query_length: 1024, threads: PgQuery.batch_threads)
+      raise ArgumentError, "unknown log format: #{format.inspect}" unless FORMATS.include?(format)
+      raise ArgumentError, 'max_fingerprints must not be negative' if max_fingerprints < 0
+      raise ArgumentError, 'max_query_length must not be negative' if max_query_length < 0
+
+      @format = format
+      _setup(format == :csvlog, max_fingerprints, max_query_length, threads)
+    end
+
+    # Reads the whole IO (which is left open), and processes the log records in it
+    def read(io)
+      chunk = String.new
+      self << chunk while io.read(CHUNK_SIZE, chunk)
+      flush
+    end
+
+    # Also available natively:
+    #
+    # <<(data) - processes the log records in data (a String with any part of a
+    #   log), keeping an incomplete last record until more data is added
+    # flush - processes the last record, for when the log ends without a newline
+    # size - number of distinct fingerprints
+
+    def each
+      return enum_for(:each) unless block_given?
+      _entries.each { |values| yield Entry.new(*values) }
+      self
+    end
+
+    # Returns a Hash with the number of log :records processed, the :statements
+    # among them, and how many of those failed to parse (:errors) or weren't
+    # counted because max_fingerprints was reached (:dropped)
+    def stats
+      records, statements, errors, dropped = _stats
+      { records: records, statements: statements, errors: errors, dropped: dropped }
+    end
+  end
+
+  # Reads the log from the IO into a new PgQuery::LogAggregator (see there for
+  # the options) and returns it
+  def self.aggregate_log(io, **options)
+    aggregator = LogAggregator.new(**options)
+    aggregator.read(io)
+    aggregator
+  end
+end
@@ -2,17 +2,30 @@ class PgQuery
   def param_refs # rubocop:disable Metrics/CyclomaticComplexity
     results = []
 
-    treewalker! @tree do |_, _, v|
+    # Param refs that are part of a type cast are reported with the cast, and
+    # neither they nor the type name are looked at again. This is tracked here
+    # instead of deleting them from the tree, which may be frozen or shared.
+    removed = {}.compare_by_identity
+
+    treewalker! tree do |expr, k, v, walker|
+      if removed[expr] == k
+        walker.skip!
+        next
+      end
       next unless v.is_a?(Hash)
 
-      if v[PARAM_REF]
+      if v[PARAM_REF] && removed[v] != PARAM_REF
         results << { 'location' => v[PARAM_REF]['location'],
                      'length' => param_ref_length(v[PARAM_REF]) }
       elsif v[TYPE_CAST]
-        next unless v[TYPE_CAST]['arg'] && v[TYPE_CAST]['typeName']
-
-        p = v[TYPE_CAST]['arg'].delete(PARAM_REF)
-        t = v[TYPE_CAST]['typeName'].delete(TYPE_NAME)
+        arg = v[TYPE_CAST]['arg']
+        type_name = v[TYPE_CAST]['typeName']
+        next unless arg && type_name
+
+        p = arg[PARAM_REF] if arg.is_a?(Hash) && removed[arg] != PARAM_REF
+        t = type_name[TYPE_NAME] if type_name.is_a?(Hash)
+        removed[arg] = PARAM_REF if arg.is_a?(Hash) && arg.key?(PARAM_REF)
+        removed[type_name] = TYPE_NAME if type_name.is_a?(Hash) && type_name.key?(TYPE_NAME)
         next unless p && t
 
         location = p['location']
@@ -1,37 +1,73 @@
 require 'json'
 
 class PgQuery
-  def self.parse(query)
-    tree, stderr = _raw_parse(query)
-
-    begin
-      tree = JSON.parse(tree, max_nesting: 1000)
-    rescue JSON::ParserError
-      raise ParseError.new('Failed to parse JSON', __FILE__, __LINE__, -1)
-    end
-
-    warnings = []
-    stderr.each_line do |line|
-      next unless line[/^WARNING/]
-      warnings << line.strip
+  # Warnings reported by the parser (e.g. that GLOBAL is deprecated in CREATE
+  # GLOBAL TEMPORARY TABLE) are returned in PgQuery#warnings.
+  # Collecting them can be turned off for all threads with
+  # PgQuery.collect_warnings = false, #warnings is empty then (note that
+  # PgQuery.cache keeps whatever was returned when a query was first parsed).
+  #
+  # With lazy: true, the parse tree is kept in native memory (as a
+  # PgQuery::NativeTree) until PgQuery#tree is called. Methods like #tables and
+  # #fingerprint work on the native tree directly, without building the tree
+  # as Ruby objects at all.
+  def self.parse(query, lazy: false)
+    tree, warnings = cached(query, lazy ? :parse_native : :parse) do
+      lazy ? _raw_parse_native(query) : _raw_parse_tree(query)
     end
 
     PgQuery.new(query, tree, warnings)
   end
 
+  def self.normalize(query)
+    cached(query, :normalize) { _raw_normalize(query) }
+  end
+
+  # Returns the normalized query along with the constants that were replaced
+  # in it, as a PgQuery::Constant each (in the order they appear in):
+  #
+  #   PgQuery.normalize_with_constants("SELECT * FROM x WHERE y = 'a' AND z > -1.5")
+  #   => ["SELECT * FROM x WHERE y = $1 AND z > $2",
+  #       [#<struct PgQuery::Constant text="'a'", location=26, length=3, param=1, type=:string>,
+  #        #<struct PgQuery::Constant text="-1.5", location=36, length=4, param=2, type=:float>]]
+  #
+  # text is the constant as it appears in the query (including quotes), at
+  # the byte offset location. param is the number of the $n that replaced it,
+  # and type one of :integer, :float, :string (which includes booleans),
+  # :bitstring or :null. Both come from the same pass over the query as the
+  # normalized text.
+  def self.normalize_with_constants(query)
+    cached(query, :normalize_with_constants) { _normalize_with_constants(query) }
+  end
+
   attr_reader :query
-  attr_reader :tree
   attr_reader :warnings
 
   def initialize(query, tree, warnings = [])
     @query = query
-    @tree = tree
+    if tree.is_a?(NativeTree)
+      @native_tree = tree
+      @tree = nil
+    else
+      @native_tree = nil
+      @tree = tree
+    end
     @warnings = warnings
     @tables = nil
     @aliases = nil
     @cte_names = nil
   end
 
+  # Builds the tree from the native tree first if the query was parsed lazily,
+  # after which the native tree is no longer used
+  def tree
+    if @native_tree
+      @tree = @native_tree.to_a
+      @native_tree = nil
+    end
+    @tree
+  end
+
   def tables
     tables_with_types.map { |t| t[:table] }
   end
@@ -70,6 +106,11 @@ class PgQuery
     @cte_names = []
     @aliases = {}
 
+    if @native_tree
+      @tables, @cte_names, @aliases = @native_tree.tables_and_aliases
+      return
+    end
+
     statements = @tree.dup
     from_clause_items = [] # types: select, dml, ddl
     subselect_items = []
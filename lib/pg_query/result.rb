@@ -0,0 +1,68 @@
+class PgQuery
+  # Returned by PgQuery.try_parse, PgQuery.try_normalize and
+  # PgQuery.try_fingerprint: either the value the regular method would have
+  # returned, or the message and cursor position (1-based, 0 if unknown) of the
+  # error it would have raised.
+  #
+  # The ParseError itself is only created when asked for (by #error or
+  # #value!), which is considerably cheaper than raising and rescuing it when
+  # many queries fail to parse.
+  #
+  # (Defined as a Struct in the extension, with the members value, message,
+  # cursorpos, source_file and source_line)
+  class Result
+    def ok?
+      message.nil?
+    end
+
+    def error?
+      !message.nil?
+    end
+
+    # The ParseError PgQuery.parse (etc) would have raised, or nil
+    def error
+      ParseError.new(message, source_file, source_line, cursorpos) if error?
+    end
+
+    # Returns the value, or raises the error
+    def value!
+      raise error if error?
+      value
+    end
+  end
+
+  # Like PgQuery.parse, but returns a PgQuery::Result with the PgQuery object
+  # as its value, or the error, instead of raising it
+  def self.try_parse(query, lazy: false)
+    result = cached(query, lazy ? :parse_native : :parse) do
+      result = lazy ? _try_parse_native(query) : _try_parse_tree(query)
+      # Exits cached without caching the failure
+      break result if result.is_a?(Result)
+      result
+    end
+    return result if result.is_a?(Result)
+
+    tree, warnings = result
+    Result.new(PgQuery.new(query, tree, warnings))
+  end
+
+  # Like PgQuery.normalize, but returns a PgQuery::Result (see PgQuery.try_parse)
+  def self.try_normalize(query)
+    try_cached(query, :normalize) { _try_normalize(query) }
+  end
+
+  # Like PgQuery.fingerprint, but returns a PgQuery::Result (see PgQuery.try_parse)
+  def self.try_fingerprint(query, version: FINGERPRINT_VERSION)
+    try_cached(query, fingerprint_cache_kind(version)) { _try_fingerprint(query, version) }
+  end
+
+  def self.try_cached(query, kind)
+    result = cached(query, kind) do
+      result = yield
+      break result if result.is_a?(Result)
+      result
+    end
+    result.is_a?(Result) ? result : Result.new(result)
+  end
+  private_class_method :try_cached
+end
@@ -0,0 +1,19 @@
+class PgQuery
+  # Deep-freezes the value of a constant table (and returns it), so it can be
+  # used from any Ractor. On Rubies without Ractors, this freezes the value and
+  # everything it contains.
+  def self.make_shareable(obj)
+    return Ractor.make_shareable(obj) if defined?(Ractor)
+
+    case obj
+    when Hash
+      obj.each do |key, value|
+        make_shareable(key)
+        make_shareable(value)
+      end
+    when Array
+      obj.each { |value| make_shareable(value) }
+    end
+    obj.freeze
+  end
+end
@@ -0,0 +1,18 @@
+class PgQuery
+  # Returns a PgQuery::Statement for each statement in the query (e.g. a
+  # migration, or a batch of statements separated by ";"), from a single parse:
+  #
+  #   PgQuery.statements("SELECT 1; UPDATE x SET y = 2")
+  #   => [#<struct PgQuery::Statement location=0, length=8, type="SelectStmt",
+  #                                   fingerprint="02e4...", normalized="SELECT $1">,
+  #       #<struct PgQuery::Statement location=9, length=19, type="UpdateStmt",
+  #                                   fingerprint="02a1...", normalized=" UPDATE x SET y = $1">]
+  #
+  # location and length are the byte offsets of the statement's text in the
+  # query (stmt_location and stmt_len of the RawStmt), which starts right
+  # after the previous statement's ";". The fingerprint and normalized text are
+  # the same as PgQuery.fingerprint and PgQuery.normalize return for that text.
+  def self.statements(query)
+    _statements(query)
+  end
+end
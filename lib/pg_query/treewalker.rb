@@ -1,53 +1,138 @@
 class PgQuery
   private
 
-  def treewalker!(normalized_parsetree)
-    exprs = normalized_parsetree.dup.map { |e| [e, []] }
+  # Walks over the statements of a tree depth-first, yielding each Hash with
+  # each of its keys and values (and each Array with each of its indices and
+  # elements), and the TreeWalker (which knows where in the tree the value is).
+  # Values are walked after they were yielded, unless the block calls
+  # TreeWalker#skip!.
+  #
+  # Nothing is allocated per value: the same TreeWalker is yielded every time,
+  # and it only builds the location of a value when asked for it.
+  def treewalker!(tree, &block)
+    TreeWalker.new(block).walk_statements(tree)
+  end
 
-    loop do
-      expr, parent_location = exprs.shift
+  class TreeWalker
+    def initialize(block)
+      @block = block
+      # Keys and indices of the Hashes and Arrays the current value is in
+      @path = []
+      @key = nil
+      @skip = false
+    end
 
-      if expr.is_a?(Hash)
-        expr.each do |k, v|
-          location = parent_location + [k]
+    # The Hash keys and Array indices from the statement to the current value,
+    # as a new Array
+    def location
+      @path.dup << @key
+    end
 
-          yield(expr, k, v, location)
+    # Don't walk the current value
+    def skip!
+      @skip = true
+    end
 
-          exprs << [v, location] unless v.nil?
+    # Locations are relative to each statement, they don't include its index
+    def walk_statements(tree)
+      tree.each do |statement|
+        if statement.is_a?(Hash)
+          walk_hash(statement)
+        elsif statement.is_a?(Array)
+          walk_array(statement)
         end
-      elsif expr.is_a?(Array)
-        exprs += expr.map.with_index { |e, idx| [e, parent_location + [idx]] }
       end
+    end
 
-      break if exprs.empty?
+    private
+
+    def walk_hash(hash)
+      hash.each_pair do |k, v|
+        @key = k
+        @block.call(hash, k, v, self)
+
+        if @skip
+          @skip = false
+        elsif v.is_a?(Hash)
+          @path << k
+          walk_hash(v)
+          @path.pop
+        elsif v.is_a?(Array)
+          @path << k
+          walk_array(v)
+          @path.pop
+        end
+      end
     end
-  end
 
-  def find_tree_location(normalized_parsetree, searched_location)
-    treewalker! normalized_parsetree do |expr, k, v, location|
-      next unless location == searched_location
-      yield(expr, k, v)
+    def walk_array(array)
+      index = 0
+      array.each do |v|
+        @key = index
+        @block.call(array, index, v, self)
+
+        if @skip
+          @skip = false
+        elsif v.is_a?(Hash)
+          @path << index
+          walk_hash(v)
+          @path.pop
+        elsif v.is_a?(Array)
+          @path << index
+          walk_array(v)
+          @path.pop
+        end
+        index += 1
+      end
     end
   end
+  private_constant :TreeWalker
 
-  def transform_nodes!(parsetree)
-    result = deep_dup(parsetree)
-    exprs = result.dup
+  # Returns the tree with the value at location (a list of Hash keys and Array
+  # indices) replaced by what the block returns for it. Only the Hashes and
+  # Arrays on the path to it are copied, everything else is shared with the
+  # original tree, which is left unchanged. Returns the tree itself if there
+  # is nothing at location (e.g. because a parent was replaced before).
+  def replace_tree_location(tree, location, depth = 0, &block)
+    key = location[depth]
+    return tree unless tree.is_a?(Hash) ? tree.key?(key) : tree.is_a?(Array) && key.is_a?(Integer) && key < tree.size
 
-    loop do
-      expr = exprs.shift
+    value = tree[key]
+    new_value = depth == location.size - 1 ? yield(value) : replace_tree_location(value, location, depth + 1, &block)
+    return tree if new_value.equal?(value)
 
-      if expr.is_a?(Hash)
-        yield(expr) if expr.size == 1 && expr.keys[0][/^[A-Z]+/]
+    copy = tree.dup
+    copy[key] = new_value
+    copy
+  end
 
-        exprs += expr.values.compact
-      elsif expr.is_a?(Array)
-        exprs += expr
+  # Returns the tree with each node (a Hash with a single, capitalized key)
+  # replaced by what the block returns for it, after which the values of the
+  # replacement are transformed in turn. The block must not modify the node.
+  # Like replace_tree_location, Hashes and Arrays are only copied when
+  # something within them was replaced.
+  def transform_nodes(tree, &block)
+    if tree.is_a?(Hash)
+      tree = yield(tree) if tree.size == 1 && tree.keys[0][/^[A-Z]+/]
+      copy = nil
+      tree.each do |key, value|
+        new_value = transform_nodes(value, &block)
+        next if new_value.equal?(value)
+        copy ||= tree.dup
+        copy[key] = new_value
       end
-
-      break if exprs.empty?
+      copy || tree
+    elsif tree.is_a?(Array)
+      copy = nil
+      tree.each_with_index do |value, i|
+        new_value = transform_nodes(value, &block)
+        next if new_value.equal?(value)
+        copy ||= tree.dup
+        copy[i] = new_value
+      end
+      copy || tree
+    else
+      tree
     end
-
-    result
   end
 end
@@ -1,60 +1,197 @@
 class PgQuery
-  PossibleTruncation = Struct.new(:location, :node_type, :length, :is_array)
-
-  A_TRUNCATED = 'A_Truncated'.freeze
+  # location is the path of the truncatable part in the tree (nil when
+  # truncating the query text), span the Range of the output it takes up, and
+  # parent the possible truncation it is part of (if any)
+  PossibleTruncation = Struct.new(:location, :node_type, :length, :span, :parent)
 
   # Truncates the query string to be below the specified length, first trying to
   # omit less important parts of the query, and only then cutting off the end.
-  def truncate(max_length)
-    output = deparse(@tree)
+  #
+  # By default the query is deparsed from the tree. With source: true, the
+  # parts are omitted from the original query text instead, which keeps its
+  # formatting and works for statements the deparser doesn't support - but
+  # doesn't reflect changes made to the tree. Lengths are measured in bytes
+  # when choosing the parts to omit from the query text.
+  def truncate(max_length, source: false)
+    output = source ? @query.dup : deparse(tree)
 
     # Early exit if we're already below the max length
     return output if output.size <= max_length
 
-    truncations = find_possible_truncations
+    # Omitting a part of the query only replaces its span of the output with
+    # '...', so the query is deparsed (or scanned) once, and the length after
+    # each truncation is computed from the spans
+    candidates, output = source ? find_source_truncations : find_possible_truncations
 
-    # Truncate the deepest possible truncation that is the longest first
-    truncations.sort_by! { |t| [-t.location.size, -t.length] }
+    output = apply_truncations(output, choose_truncations(candidates, output.size - max_length))
+    output.force_encoding(@query.encoding) if source
+    return output if output.size <= max_length
+
+    # We couldn't do a proper smart truncation, so we need a hard cut-off
+    output[0..max_length - 4] + '...'
+  end
+
+  private
+
+  TRUNCATABLE_FIELDS = PgQuery.make_shareable([TARGET_LIST_FIELD, 'whereClause', 'ctequery', 'cols'])
+
+  # Deparses a tree like PgQuery::Deparse.from_tree, recording the span of the
+  # output each of the given subtrees (identified by object identity) was
+  # deparsed into, and which of them it was deparsed within. Subtrees the
+  # deparser leaves out get no span.
+  class DeparseSpans
+    include Deparse
+
+    attr_reader :output
+
+    def initialize(tree, subtrees)
+      @spans = {}.compare_by_identity
+      @parents = {}.compare_by_identity
+      subtrees.each { |subtree| @spans[subtree] = nil }
+      @open = []
+      @output = ''.dup
+      deparse_list(@output, tree, '; ')
+    end
+
+    def span(subtree)
+      @spans[subtree]
+    end
 
-    tree = deep_dup(@tree)
-    truncations.each do |truncation|
-      next if truncation.length < 3
+    def parent(subtree)
+      @parents[subtree]
+    end
+
+    private
+
+    def deparse_item(output, item, context = nil)
+      return super unless output.equal?(@output) && @spans.key?(item)
+      record(item) { super }
+    end
 
-      find_tree_location(tree, truncation.location) do |expr, k|
-        expr[k] = { A_TRUNCATED => nil }
-        expr[k] = [expr[k]] if truncation.is_array
+    def deparse_list(output, items, separator = ', ', context = nil)
+      return super unless output.equal?(@output) && @spans.key?(items)
+      record(items) { super }
+    end
+
+    def record(subtree)
+      start = @output.size
+      @open << subtree
+      result = yield
+      @open.pop
+      unless @spans[subtree]
+        @spans[subtree] = start...@output.size
+        @parents[subtree] = @open.last
       end
+      result
+    end
+  end
+  private_constant :DeparseSpans
+
+  # Returns the possible truncations, and the deparsed query their spans refer to
+  def find_possible_truncations
+    candidates = []
 
-      output = deparse(tree)
-      return output if output.size <= max_length
+    treewalker! tree do |_expr, k, v, walker|
+      next unless TRUNCATABLE_FIELDS.include?(k) && (v.is_a?(Hash) || v.is_a?(Array))
+      candidates << [walker.location, k, v]
     end
 
-    # We couldn't do a proper smart truncation, so we need a hard cut-off
-    output[0..max_length - 4] + '...'
+    deparsed = DeparseSpans.new(tree, candidates.map(&:last))
+
+    truncations = {}.compare_by_identity
+    candidates.each do |location, k, v|
+      span = deparsed.span(v)
+      next unless span
+
+      # The where clause counts with its 'WHERE ' keyword
+      length = k == 'whereClause' ? span.size + 6 : span.size
+
+      truncations[v] = PossibleTruncation.new(location, k, length, span)
+    end
+    truncations.each { |v, truncation| truncation.parent = truncations[deparsed.parent(v)] }
+
+    # Truncate the deepest possible truncation that is the longest first
+    truncations = truncations.values.sort_by.with_index { |t, i| [-t.location.size, -t.length, i] }
+
+    # Locations are relative to each statement, so a truncation applies to
+    # all statements with a truncatable part at the same location
+    [truncations.group_by(&:location).values, deparsed.output]
   end
 
-  private
+  # Returns the possible truncations from the spans of the query text the
+  # parser finds for them, and the query text as a binary String (as the spans
+  # are byte offsets)
+  def find_source_truncations
+    spans = PgQuery._truncation_spans(@query)
 
-  def find_possible_truncations
-    truncations = []
-
-    treewalker! @tree do |_expr, k, v, location|
-      case k
-      when TARGET_LIST_FIELD
-        length = deparse([{ SELECT_STMT => { k => v } }]).size - 7 # 'SELECT '.size
-
-        truncations << PossibleTruncation.new(location, TARGET_LIST_FIELD, length, true)
-      when 'whereClause'
-        length = deparse([{ SELECT_STMT => { k => v } }]).size
-
-        truncations << PossibleTruncation.new(location, 'whereClause', length, false)
-      when 'ctequery'
-        truncations << PossibleTruncation.new(location, 'ctequery', deparse([v]).size, false)
-      when 'cols'
-        truncations << PossibleTruncation.new(location, 'cols', deparse(v).size, true)
+    truncations = spans.map do |type, _depth, location, length|
+      node_type = type.to_s
+      span = location...location + length
+      # The where clause counts with its 'WHERE ' keyword, like when deparsing
+      length += 6 if node_type == 'whereClause'
+
+      PossibleTruncation.new(nil, node_type, length, span)
+    end
+
+    # Spans of parts within each other are nested, the outer one starting first
+    enclosing = []
+    truncations.sort_by { |t| [t.span.begin, -t.span.end] }.each do |truncation|
+      enclosing.pop while enclosing.any? && enclosing.last.span.end <= truncation.span.begin
+      truncation.parent = enclosing.last
+      enclosing << truncation
+    end
+
+    # Deepest first, like for the tree
+    truncations = truncations.each_with_index.sort_by { |t, i| [-spans[i][1], -t.length, i] }.map(&:first)
+
+    [truncations.map { |t| [t] }, @query.b]
+  end
+
+  # Returns the truncations to apply, from groups of possible truncations in
+  # the order they should be tried in, so that the output gets shorter by at
+  # least excess characters - or all of them if that's not possible
+  def choose_truncations(groups, excess)
+    applied = []
+    saved = 0
+    # How much the truncations applied within each one save, which it replaces
+    # when applied itself (they are deeper in the tree, so applied first)
+    saved_within = Hash.new(0).compare_by_identity
+    groups.each do |group|
+      # Members of a group are ordered by length
+      next if group.first.length < 3
+
+      group.each do |t|
+        saving = t.span.size - 3 - saved_within[t]
+        saved += saving
+        parent = t.parent
+        while parent
+          saved_within[parent] += saving
+          parent = parent.parent
+        end
+        applied << t
       end
+
+      break if saved >= excess
     end
+    applied
+  end
 
-    truncations
+  # Replaces the span of each truncation with '...', except for those within
+  # another one
+  def apply_truncations(output, truncations)
+    applied = {}.compare_by_identity
+    truncations.each { |truncation| applied[truncation] = true }
+
+    truncated = ''
+    position = 0
+    truncations.sort_by { |t| t.span.begin }.each do |truncation|
+      parent = truncation.parent
+      parent = parent.parent until parent.nil? || applied[parent]
+      next if parent
+
+      truncated << output[position...truncation.span.begin] << '...'
+      position = truncation.span.end
+    end
+    truncated << output[position..-1]
   end
 end
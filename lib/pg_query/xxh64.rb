@@ -0,0 +1,78 @@
+class PgQuery
+  # XXH64 (https://github.com/Cyan4973/xxHash) in pure Ruby, for version 3
+  # fingerprints of trees the extension can't handle. Produces the same hashes
+  # as ext/pg_query/pg_query_ruby_xxh64.c, with the same update/digest
+  # interface as the Digest classes (but #digest returns an unsigned Integer).
+  class XXH64
+    PRIME1 = 0x9E3779B185EBCA87
+    PRIME2 = 0xC2B2AE3D27D4EB4F
+    PRIME3 = 0x165667B19E3779F9
+    PRIME4 = 0x85EBCA77C2B2AE63
+    PRIME5 = 0x27D4EB2F165667C5
+    MASK = 0xFFFFFFFFFFFFFFFF
+
+    def initialize(seed = 0)
+      @seed = seed
+      @v = [(seed + PRIME1 + PRIME2) & MASK, (seed + PRIME2) & MASK, seed, (seed - PRIME1) & MASK]
+      @length = 0
+      @buffer = ''.b
+    end
+
+    def update(data)
+      @length += data.bytesize
+      @buffer << data.b
+
+      stripes = @buffer.bytesize / 32
+      return self if stripes.zero?
+
+      @buffer.unpack("Q<#{stripes * 4}").each_slice(4) do |lanes|
+        4.times { |i| @v[i] = round(@v[i], lanes[i]) }
+      end
+      @buffer = @buffer.byteslice(stripes * 32..-1)
+
+      self
+    end
+
+    def digest
+      if @length >= 32
+        hash = (rotl(@v[0], 1) + rotl(@v[1], 7) + rotl(@v[2], 12) + rotl(@v[3], 18)) & MASK
+        @v.each { |v| hash = ((hash ^ round(0, v)) * PRIME1 + PRIME4) & MASK }
+      else
+        hash = (@seed + PRIME5) & MASK
+      end
+
+      hash = (hash + @length) & MASK
+
+      rest = @buffer
+      rest.byteslice(0, rest.bytesize / 8 * 8).unpack('Q<*').each do |lane|
+        hash = (rotl(hash ^ round(0, lane), 27) * PRIME1 + PRIME4) & MASK
+      end
+      rest = rest.byteslice(rest.bytesize / 8 * 8..-1)
+
+      if rest.bytesize >= 4
+        hash = (rotl(hash ^ ((rest.unpack('L<')[0] * PRIME1) & MASK), 23) * PRIME2 + PRIME3) & MASK
+        rest = rest.byteslice(4..-1)
+      end
+
+      rest.each_byte do |byte|
+        hash = (rotl(hash ^ ((byte * PRIME5) & MASK), 11) * PRIME1) & MASK
+      end
+
+      hash ^= hash >> 33
+      hash = (hash * PRIME2) & MASK
+      hash ^= hash >> 29
+      hash = (hash * PRIME3) & MASK
+      hash ^ (hash >> 32)
+    end
+
+    private
+
+    def round(acc, lane)
+      (rotl((acc + lane * PRIME2) & MASK, 31) * PRIME1) & MASK
+    end
+
+    def rotl(value, bits)
+      ((value << bits) | (value >> (64 - bits))) & MASK
+    end
+  end
+end
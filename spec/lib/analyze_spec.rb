@@ -0,0 +1,48 @@
+require 'spec_helper'
+
+describe PgQuery, '.analyze' do
+  queries = [
+    'SELECT 1',
+    "SELECT a, b FROM x JOIN public.y AS z ON x.id = z.id WHERE x.c = 'foo' ORDER BY a",
+    'WITH cte AS (SELECT * FROM a) SELECT * FROM cte, b WHERE b.id IN (SELECT id FROM c)',
+    'INSERT INTO users (name) SELECT name FROM old_users WHERE id = $1',
+    "UPDATE t SET x = 1 WHERE y = ?::text AND z < now() - INTERVAL ?",
+    'DROP TABLE abc.foo, bar; CREATE TABLE baz (id int); TRUNCATE qux',
+    'SELECT * FROM a WHERE x = $1 AND y = $12 AND z = $255',
+    "SET statement_timeout = 0; COPY (SELECT 1) TO STDOUT; EXPLAIN SELECT * FROM e"
+  ]
+
+  queries.each do |query|
+    it "returns the same results as the individual methods for #{query}" do
+      parsed = described_class.parse(query)
+      analysis = described_class.analyze(query)
+
+      expect(analysis.query).to eq query
+      expect(analysis.normalized).to eq described_class.normalize(query)
+      expect(analysis.fingerprint).to eq parsed.fingerprint
+      expect(analysis.statement_types).to eq(parsed.tree.map { |stmt| stmt['RawStmt']['stmt'].keys[0] })
+      expect(analysis.tables_with_types).to eq parsed.tables_with_types
+      expect(analysis.cte_names).to eq parsed.cte_names
+      expect(analysis.aliases).to eq parsed.aliases
+      expect(analysis.param_refs).to eq parsed.param_refs
+      expect(analysis.warnings).to eq parsed.warnings
+    end
+  end
+
+  it "returns tables by type" do
+    analysis = described_class.analyze('INSERT INTO a SELECT * FROM b; CREATE INDEX ON c (d)')
+    expect(analysis.statement_types).to eq %w[InsertStmt IndexStmt]
+    expect(analysis.tables).to eq %w[a b c]
+    expect(analysis.select_tables).to eq ['b']
+    expect(analysis.dml_tables).to eq ['a']
+    expect(analysis.ddl_tables).to eq ['c']
+  end
+
+  it "raises parse errors" do
+    expect { described_class.analyze("SELECT 'ERR") }.to(raise_error do |error|
+      expect(error).to be_a(PgQuery::ParseError)
+      expect(error.message).to eq "unterminated quoted string at or near \"'ERR\" (scan.l:1121)"
+      expect(error.location).to eq 8
+    end)
+  end
+end
@@ -0,0 +1,68 @@
+require 'spec_helper'
+
+describe PgQuery, '.parse_many' do
+  let(:queries) { ['SELECT 1', 'SELECT * FROM x WHERE y = $1', "SELECT 'ERR", 'DELETE FROM users'] }
+
+  it "returns the same results as parse, in input order" do
+    results = described_class.parse_many(queries, threads: 2)
+    expect(results.size).to eq 4
+    expect(results[0].tree).to eq described_class.parse('SELECT 1').tree
+    expect(results[1].query).to eq 'SELECT * FROM x WHERE y = $1'
+    expect(results[3].tables).to eq ['users']
+  end
+
+  it "returns parse errors in place instead of raising" do
+    results = described_class.parse_many(queries, threads: 2)
+    expect(results[2]).to be_a(PgQuery::ParseError)
+    expect(results[2].message).to eq "unterminated quoted string at or near \"'ERR\" (scan.l:1121)"
+    expect(results[2].location).to eq 8
+  end
+
+  it "works with a single thread and an empty list" do
+    expect(described_class.parse_many(queries, threads: 1).map(&:class)).to eq [PgQuery, PgQuery, PgQuery::ParseError, PgQuery]
+    expect(described_class.parse_many([])).to eq []
+  end
+
+  it "raises on non-String elements" do
+    expect { described_class.parse_many(['SELECT 1', 1]) }.to raise_error(TypeError)
+  end
+end
+
+describe PgQuery, '.normalize_many' do
+  it "returns the same results as normalize" do
+    queries = ['SELECT 1', "SELECT * FROM x WHERE y = 'z'"] * 20
+    expect(described_class.normalize_many(queries, threads: 4)).to eq(queries.map { |q| described_class.normalize(q) })
+  end
+
+  it "returns parse errors in place instead of raising" do
+    results = described_class.normalize_many(['SELECT 1', "SELECT 'ERR"])
+    expect(results[0]).to eq 'SELECT $1'
+    expect(results[1]).to be_a(PgQuery::ParseError)
+  end
+end
+
+describe PgQuery, '.fingerprint_many' do
+  it "returns the same results as fingerprint" do
+    queries = ['SELECT 1', 'SELECT 2', 'SELECT * FROM x WHERE a IN (1, 2)'] * 20
+    expect(described_class.fingerprint_many(queries, threads: 4)).to eq(queries.map { |q| described_class.fingerprint(q) })
+  end
+
+  it "returns parse errors in place instead of raising" do
+    results = described_class.fingerprint_many(["SELECT 'ERR"])
+    expect(results[0]).to be_a(PgQuery::ParseError)
+  end
+end
+
+describe PgQuery, '.fingerprint_parallel' do
+  it "returns the same results as fingerprint, in input order" do
+    queries = ['SELECT 1', 'SELECT 2', 'SELECT * FROM x WHERE a IN (1, 2)'] * 20
+    expect(described_class.fingerprint_parallel(queries, ractors: 4)).to eq(queries.map { |q| described_class.fingerprint(q) })
+    expect(described_class.fingerprint_parallel([])).to eq []
+  end
+
+  it "returns parse errors in place instead of raising" do
+    results = described_class.fingerprint_parallel(['SELECT 1', "SELECT 'ERR"], ractors: 2)
+    expect(results[0]).to eq described_class.fingerprint('SELECT 1')
+    expect(results[1]).to be_a(PgQuery::ParseError)
+  end
+end
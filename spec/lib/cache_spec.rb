@@ -0,0 +1,66 @@
+require 'spec_helper'
+
+describe PgQuery::Cache do
+  let(:cache) { described_class.new(max_bytes: 1024 * 1024, shards: 4) }
+
+  before { PgQuery.cache = cache }
+  after { PgQuery.cache = nil }
+
+  it "returns the same results as without a cache" do
+    query = "SELECT * FROM x WHERE y = $1 AND z = 'foo'"
+    expected = [PgQuery.parse(query).tree, PgQuery.normalize(query), PgQuery.fingerprint(query)]
+
+    2.times do
+      expect([PgQuery.parse(query).tree, PgQuery.normalize(query), PgQuery.fingerprint(query)]).to eq expected
+    end
+  end
+
+  it "counts hits and misses" do
+    PgQuery.parse('SELECT 1')
+    PgQuery.parse('SELECT 1')
+    PgQuery.normalize('SELECT 1')
+    PgQuery.parse('SELECT 2')
+
+    expect(cache.stats).to include(hits: 1, misses: 3, evictions: 0, entries: 2)
+  end
+
+  it "returns a new PgQuery object with a shared, frozen tree" do
+    a = PgQuery.parse('SELECT * FROM x WHERE y = ?::text')
+    b = PgQuery.parse('SELECT * FROM x WHERE y = ?::text')
+
+    expect(a).not_to equal b
+    expect(a.tree).to equal b.tree
+    expect(a.tree[0]['RawStmt']['stmt']['SelectStmt']).to be_frozen
+    expect { a.tree << {} }.to raise_error(RuntimeError)
+    expect(a.param_refs).to eq [{ 'location' => 26, 'length' => 1, 'typename' => [{ 'String' => { 'str' => 'text' } }] }]
+    expect(b.param_refs).to eq a.param_refs
+    expect(b.deparse).to eq 'SELECT * FROM "x" WHERE "y" = ?::text'
+  end
+
+  it "evicts the least recently used entries to stay within its byte budget" do
+    small_cache = described_class.new(max_bytes: 20_000, shards: 1)
+    PgQuery.cache = small_cache
+
+    PgQuery.parse('SELECT 1')
+    100.times { |i| PgQuery.parse("SELECT #{i + 2}") && PgQuery.parse('SELECT 1') }
+
+    expect(small_cache.stats[:evictions]).to be > 0
+    expect(small_cache.stats[:bytes]).to be <= 20_000
+    expect(small_cache.stats[:hits]).to eq 100
+  end
+
+  it "doesn't cache parse errors" do
+    2.times { expect { PgQuery.parse("SELECT 'ERR") }.to raise_error(PgQuery::ParseError) }
+    expect(cache.stats[:entries]).to eq 0
+  end
+
+  it "can be cleared" do
+    PgQuery.parse('SELECT 1')
+    cache.clear
+    expect(cache.stats).to include(entries: 0, bytes: 0)
+  end
+
+  it "requires the number of shards to be a power of two" do
+    expect { described_class.new(max_bytes: 1024, shards: 3) }.to raise_error(ArgumentError)
+  end
+end
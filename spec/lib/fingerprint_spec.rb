@@ -34,6 +34,10 @@ describe PgQuery, "#fingerprint" do
       expect(fingerprint(testdef['input'])).to eq(testdef['expectedHash'])
     end
 
+    it format("returns the expected hash for the query text '%s'", testdef['input']) do
+      expect(PgQuery.fingerprint(testdef['input'])).to eq(testdef['expectedHash'])
+    end
+
     it format("returns expected hash parts for '%s'", testdef['input']) do
       expect(fingerprint_parts(testdef['input'])).to eq(testdef['expectedParts'])
     end
@@ -108,3 +112,125 @@ describe PgQuery, "#fingerprint" do
     expect(fingerprint(q1)).to eq fingerprint(q2)
   end
 end
+
+describe PgQuery, "#fingerprint (native implementation)" do
+  def ruby_fingerprint(query)
+    query.send(:ruby_fingerprint)
+  end
+
+  fingerprint_defs.each do |testdef|
+    it format("matches the Ruby implementation for '%s'", testdef['input']) do
+      q = PgQuery.parse(testdef['input'])
+      expect(PgQuery._fingerprint_tree(q.tree)).to eq ruby_fingerprint(q)
+    end
+  end
+
+  it "matches the Ruby implementation for modified trees" do
+    q = PgQuery.parse("SELECT a, b FROM x WHERE y = 1 AND z IN (SELECT 1)")
+    select = q.tree[0][PgQuery::RAW_STMT][PgQuery::STMT_FIELD][PgQuery::SELECT_STMT]
+    select[PgQuery::TARGET_LIST_FIELD] << select[PgQuery::TARGET_LIST_FIELD][0]
+    select['limitCount'] = { 'A_Const' => { 'val' => { 'Integer' => { 'ival' => 10 } } } }
+    select['extra'] = [1.5, 1301947207891893.8, 1e15, 2**70, true, false, nil, '', 'text', []]
+
+    expect(PgQuery._fingerprint_tree(q.tree)).to eq ruby_fingerprint(q)
+    expect(q.fingerprint).to eq ruby_fingerprint(q)
+  end
+
+  it "falls back to the Ruby implementation for values that aren't part of a parse tree" do
+    q = PgQuery.parse("SELECT a FROM x")
+    q.tree[0][PgQuery::RAW_STMT]['extra'] = :symbol
+
+    expect(PgQuery._fingerprint_tree(q.tree)).to be_nil
+    expect(q.fingerprint).to eq ruby_fingerprint(q)
+  end
+end
+
+describe PgQuery, "#fingerprint (version 3)" do
+  fingerprint_defs.each do |testdef|
+    it format("returns the same fingerprint on all paths for '%s'", testdef['input']) do
+      q = PgQuery.parse(testdef['input'])
+      fingerprint = PgQuery.fingerprint(testdef['input'], version: 3)
+
+      expect(fingerprint).to be_a Integer
+      expect(q.fingerprint(version: 3)).to eq fingerprint
+      expect(q.send(:ruby_fingerprint, 3)).to eq fingerprint
+      expect(PgQuery.parse(testdef['input'], lazy: true).fingerprint(version: 3)).to eq fingerprint
+    end
+  end
+
+  it "is the XXH64 hash of the same parts as version 2, as a signed 64-bit integer" do
+    hash = PgQuery::XXH64.new
+    fingerprint_parts('SELECT a FROM x WHERE y = 1').each { |part| hash.update(part) }
+    digest = hash.digest
+
+    expect(PgQuery.fingerprint('SELECT a FROM x WHERE y = 1', version: 3)).to eq(digest >= 2**63 ? digest - 2**64 : digest)
+  end
+
+  it "treats the same queries as equal as version 2" do
+    expect(PgQuery.fingerprint('SELECT a, b FROM x WHERE y IN (1, 2)', version: 3))
+      .to eq PgQuery.fingerprint('SELECT b, a FROM x WHERE y IN ($1)', version: 3)
+    expect(PgQuery.fingerprint('SELECT a FROM x', version: 3)).not_to eq PgQuery.fingerprint('SELECT a FROM y', version: 3)
+  end
+
+  it "matches the Ruby implementation for modified trees" do
+    q = PgQuery.parse("SELECT a, b FROM x WHERE y = 1")
+    q.tree[0][PgQuery::RAW_STMT][PgQuery::STMT_FIELD][PgQuery::SELECT_STMT]['extra'] = [1.5, 2**70, true, 'text']
+
+    expect(PgQuery._fingerprint_tree(q.tree, 3)).to eq q.send(:ruby_fingerprint, 3)
+  end
+
+  it "raises for unsupported versions" do
+    expect { PgQuery.fingerprint('SELECT 1', version: 4) }.to raise_error(ArgumentError)
+    expect { PgQuery.parse('SELECT 1').fingerprint(version: 1) }.to raise_error(ArgumentError)
+  end
+end
+
+describe PgQuery::XXH64 do
+  it "returns the reference hashes" do
+    expect(described_class.new.digest).to eq 0xEF46DB3751D8E999
+    expect(described_class.new.update('abc').digest).to eq 0x44BC2CF5AD770999
+    expect(described_class.new.update('a' * 20).update('b' * 20).digest).to eq described_class.new.update('a' * 20 + 'b' * 20).digest
+  end
+
+  # Longer than one (32 byte) stripe, and than two stripes, so the lanes and
+  # the buffering across updates are used (reference values from xxHash 0.8.3)
+  {
+    'Nobody inspects the spammish repetition' => 0xFBCEA83C8A378BF1,
+    'The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog.' => 0x5282B0966CCDB49D
+  }.each do |input, reference|
+    it "returns the reference hash for #{input.bytesize} bytes" do
+      expect(described_class.new.update(input).digest).to eq reference
+
+      hash = described_class.new
+      input.scan(/.{1,7}/m).each { |part| hash.update(part) }
+      expect(hash.digest).to eq reference
+
+      expect(described_class.new.update(input[0, 31]).update(input[31, 2]).update(input[33..-1]).digest).to eq reference
+    end
+  end
+end
+
+describe PgQuery, ".fingerprint_int" do
+  it "returns the first 64 bits of the version 2 fingerprint" do
+    hex = PgQuery.fingerprint('SELECT a FROM x WHERE y = $1')
+    expect(PgQuery.fingerprint_int('SELECT a FROM x WHERE y = $1')).to eq [hex[2, 16]].pack('H*').unpack('q>')[0]
+  end
+
+  it "returns the version 3 fingerprint" do
+    expect(PgQuery.fingerprint_int('SELECT a FROM x', version: 3)).to eq PgQuery.fingerprint('SELECT a FROM x', version: 3)
+  end
+
+  it "raises parse errors" do
+    expect { PgQuery.fingerprint_int('SELECT FROM FROM') }.to raise_error(PgQuery::ParseError)
+  end
+end
+
+describe PgQuery, ".fingerprint_binary" do
+  it "returns the packed version 2 fingerprint" do
+    binary = PgQuery.fingerprint_binary('SELECT a FROM x WHERE y = $1')
+
+    expect(binary).to eq [PgQuery.fingerprint('SELECT a FROM x WHERE y = $1')].pack('H*')
+    expect(binary.bytesize).to eq 21
+    expect(binary.encoding).to eq Encoding::BINARY
+  end
+end
@@ -0,0 +1,68 @@
+require 'spec_helper'
+
+describe PgQuery, '.instrument' do
+  let(:query) { 'SELECT * FROM users WHERE id = 1' }
+  let(:events) { [] }
+
+  before do
+    described_class.reset_stats
+    described_class.instrument { |event| events << event }
+  end
+
+  after do
+    described_class.uninstrument
+    described_class.reset_stats
+  end
+
+  it "is disabled by default" do
+    described_class.uninstrument
+    expect(described_class.instrumenting?).to eq false
+
+    described_class.parse(query)
+    expect(described_class.stats).to eq({})
+  end
+
+  it "reports the phases and sizes of a parse" do
+    result = described_class.parse(query)
+    expect(result.tree).to eq described_class.parse(query).tree
+
+    event = events.first
+    expect(event.operation).to eq :parse
+    expect(event.phases.keys).to contain_exactly(:parse, :output, :tree, :ruby)
+    expect(event.phases.values.inject(:+)).to be <= event.duration + 1e-6
+    expect(event.bytes_in).to eq query.bytesize
+    expect(event.bytes_out).to be > 0
+    expect(event.native_memory).to be > 0
+    expect(event.allocations).to be > 0
+  end
+
+  it "reports the other operations" do
+    parsed = described_class.parse(query)
+    described_class.normalize(query)
+    described_class.fingerprint(query)
+    described_class.analyze(query)
+    parsed.tables
+    parsed.filter_columns
+    parsed.param_refs
+    parsed.deparse
+
+    expect(events.map(&:operation)).to eq %i[parse normalize fingerprint analyze tables filter_columns param_refs deparse]
+    expect(events[2].phases.keys).to include(:fingerprint)
+  end
+
+  it "sums up the calls of the current thread" do
+    described_class.instrument
+    3.times { described_class.parse(query) }
+    expect { described_class.parse('SELECT FROM FROM') }.to raise_error(PgQuery::ParseError)
+
+    stats = described_class.stats[:parse]
+    expect(stats[:calls]).to eq 3
+    expect(stats[:bytes_in]).to eq 3 * query.bytesize
+    expect(stats[:phases][:parse]).to be > 0
+    expect(stats[:native_memory_peak]).to be > 0
+    expect(events).to be_empty
+
+    expect(Thread.new { described_class.normalize(query); described_class.stats }.value.keys).to eq [:normalize]
+    expect(described_class.stats.keys).to eq [:parse]
+  end
+end
@@ -664,4 +664,19 @@ $BODY$
             'location' => 7 } }],
        'op' => 0 } }]
   end
+
+  it 'leaves the tree unchanged' do
+    query = described_class.parse('SELECT a FROM x WHERE y = 1 AND z IN (SELECT 2)')
+    original = query.deep_dup(query.tree)
+    query.parsetree
+    expect(query.tree).to eq original
+  end
+
+  it 'works on frozen (cached) trees' do
+    query = described_class.parse('SELECT a FROM x WHERE y = 1')
+    expected = query.parsetree
+    query = described_class.parse(query.query)
+    PgQuery::Cache.deep_freeze(query.tree)
+    expect(query.parsetree).to eq expected
+  end
 end
@@ -0,0 +1,87 @@
+require 'spec_helper'
+require 'stringio'
+
+describe PgQuery::LogAggregator do
+  def entries(aggregator)
+    aggregator.map { |e| [e.query, e.count, e.total_ms, e.max_ms] }
+  end
+
+  let(:stderr_log) do
+    <<LOG
+2018-01-01 12:00:00.000 UTC [1] LOG:  duration: 1.500 ms  statement: SELECT * FROM x WHERE id = 1
+2018-01-01 12:00:00.000 UTC [1] LOG:  statement: SELECT 1
+2018-01-01 12:00:00.000 UTC [1] LOG:  duration: 10.250 ms  statement: SELECT a
+\tFROM y
+2018-01-01 12:00:00.000 UTC [1] ERROR:  syntax error at or near "SELEC" at character 1
+2018-01-01 12:00:00.000 UTC [1] LOG:  duration: 0.125 ms  parse <unnamed>: UPDATE z SET a = $1
+2018-01-01 12:00:00.000 UTC [1] LOG:  duration: 0.500 ms  execute <unnamed>: UPDATE z SET a = $1
+2018-01-01 12:00:00.000 UTC [1] DETAIL:  parameters: $1 = '1'
+2018-01-01 12:00:00.000 UTC [1] LOG:  duration: 3.000 ms  statement: SELECT * FROM x WHERE id = 2
+2018-01-01 12:00:00.000 UTC [1] LOG:  duration: 1.000 ms  statement: SELEC
+LOG
+  end
+
+  let(:csv_log) do
+    <<CSV
+2018-01-01 12:00:00.000 UTC,"u","db",1,"[local]",5a4a,1,"SELECT",2018-01-01 12:00:00 UTC,3/0,0,LOG,00000,"duration: 1.000 ms  statement: SELECT ""a,b"" FROM y",,,,,,,,,"psql"
+2018-01-01 12:00:00.000 UTC,"u","db",1,"[local]",5a4a,2,"SELECT",2018-01-01 12:00:00 UTC,3/0,0,LOG,00000,"duration: 4.000 ms  statement: SELECT a
+FROM y",,,,,,,,,"psql"
+2018-01-01 12:00:00.000 UTC,"u","db",1,"[local]",5a4a,3,"SELECT",2018-01-01 12:00:00 UTC,3/0,0,ERROR,42601,"syntax error at or near ""SELEC""",,,,,,"SELEC",1,,"psql"
+2018-01-01 12:00:00.000 UTC,"u","db",1,"[local]",5a4a,4,"SELECT",2018-01-01 12:00:00 UTC,3/0,0,LOG,00000,"duration: 2.000 ms  statement: SELECT ""a,b"" FROM y",,,,,,,,,"psql"
+CSV
+  end
+
+  it "aggregates statements in stderr logs by fingerprint" do
+    aggregator = PgQuery.aggregate_log(StringIO.new(stderr_log))
+
+    expect(entries(aggregator)).to eq [
+      ['SELECT * FROM x WHERE id = 1', 2, 4.5, 3.0],
+      ["SELECT a\nFROM y", 1, 10.25, 10.25],
+      ['UPDATE z SET a = $1', 1, 0.5, 0.5]
+    ]
+    expect(aggregator.first.fingerprint).to eq PgQuery.fingerprint('SELECT * FROM x WHERE id = 1')
+    expect(aggregator.first.mean_ms).to eq 2.25
+    expect(aggregator.stats).to eq(records: 9, statements: 5, errors: 1, dropped: 0)
+  end
+
+  it "aggregates statements in csvlog logs by fingerprint" do
+    aggregator = PgQuery.aggregate_log(StringIO.new(csv_log), format: :csvlog)
+
+    expect(entries(aggregator)).to eq [['SELECT "a,b" FROM y', 2, 3.0, 2.0], ["SELECT a\nFROM y", 1, 4.0, 4.0]]
+    expect(aggregator.stats).to eq(records: 4, statements: 3, errors: 0, dropped: 0)
+  end
+
+  it "returns the same results regardless of how the log is split into chunks" do
+    [[stderr_log, :stderr], [csv_log, :csvlog]].each do |log, format|
+      expected = entries(PgQuery.aggregate_log(StringIO.new(log), format: format))
+
+      [1, 7, 64].each do |size|
+        aggregator = described_class.new(format: format)
+        log.chars.each_slice(size) { |chunk| aggregator << chunk.join }
+        aggregator.flush
+
+        expect(entries(aggregator)).to eq expected
+      end
+    end
+  end
+
+  it "keeps the last record until it is complete or flushed" do
+    aggregator = described_class.new
+    aggregator << '2018-01-01 LOG:  duration: 1.000 ms  statement: SELECT 1'
+    expect(aggregator.size).to eq 0
+
+    aggregator.flush
+    expect(aggregator.size).to eq 1
+  end
+
+  it "bounds the number of fingerprints and the length of queries" do
+    aggregator = PgQuery.aggregate_log(StringIO.new(stderr_log), max_fingerprints: 1, max_query_length: 8)
+
+    expect(entries(aggregator)).to eq [['SELECT *', 2, 4.5, 3.0]]
+    expect(aggregator.stats).to eq(records: 9, statements: 5, errors: 1, dropped: 2)
+  end
+
+  it "raises for unknown formats" do
+    expect { described_class.new(format: :jsonlog) }.to raise_error(ArgumentError)
+  end
+end
@@ -0,0 +1,51 @@
+require 'spec_helper'
+
+describe PgQuery, '.parse with lazy: true' do
+  let(:query) { 'WITH c AS (SELECT * FROM a) SELECT x.id FROM c, public.b x JOIN d ON d.id = x.id WHERE x.y = $1; SELECT 1' }
+  let(:eager) { described_class.parse(query) }
+  let(:lazy) { described_class.parse(query, lazy: true) }
+
+  it "returns the same results as a regular parse" do
+    expect(lazy.tables_with_types).to eq eager.tables_with_types
+    expect(lazy.cte_names).to eq eager.cte_names
+    expect(lazy.aliases).to eq eager.aliases
+    expect(lazy.fingerprint).to eq eager.fingerprint
+    expect(lazy.param_refs).to eq eager.param_refs
+    expect(lazy.tree).to eq eager.tree
+  end
+
+  it "only builds the tree when it is asked for" do
+    lazy.tables
+    lazy.fingerprint
+    expect(lazy.instance_variable_get(:@tree)).to be_nil
+
+    # Once built, the tree may be modified like any other
+    lazy.tree[1]['RawStmt']['stmt']['SelectStmt']['targetList'][0]['ResTarget']['val'] = { 'ColumnRef' => { 'fields' => [{ 'String' => { 'str' => 'z' } }] } }
+    expect(lazy.fingerprint).not_to eq eager.fingerprint
+    expect(lazy.fingerprint).to eq lazy.send(:ruby_fingerprint)
+  end
+
+  it "raises parse errors" do
+    expect { described_class.parse("SELECT 'ERR", lazy: true) }.to raise_error(PgQuery::ParseError)
+  end
+end
+
+describe PgQuery::NativeTree do
+  subject(:native_tree) { PgQuery._raw_parse_native('SELECT a FROM b; SELECT 1')[0] }
+
+  let(:tree) { PgQuery.parse('SELECT a FROM b; SELECT 1').tree }
+
+  it "builds Ruby objects for the requested parts of the tree" do
+    expect(native_tree.size).to eq 2
+    expect(native_tree[1]).to eq tree[1]
+    expect(native_tree.dig(0, 'RawStmt', 'stmt', 'SelectStmt', 'fromClause', 0)).to eq tree[0]['RawStmt']['stmt']['SelectStmt']['fromClause'][0]
+    expect(native_tree.dig(0, 'RawStmt', 'missing')).to be_nil
+    expect(native_tree.to_a).to eq tree
+  end
+
+  it "reports its memory usage" do
+    require 'objspace'
+    expect(native_tree.memsize).to be > 0
+    expect(ObjectSpace.memsize_of(native_tree)).to be >= native_tree.memsize
+  end
+end
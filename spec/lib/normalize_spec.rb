@@ -71,3 +71,37 @@ describe PgQuery, '#normalize' do
     expect(q).to eq 'DECLARE cursor_b CURSOR FOR SELECT * FROM databases WHERE id = $1'
   end
 end
+
+describe PgQuery, '.normalize_with_constants' do
+  it "returns the replaced constants" do
+    query = "SELECT 1 FROM x WHERE y = 12561 AND z = '124' AND b = -1.5 AND c = B'101' AND d = NULL"
+    normalized, constants = described_class.normalize_with_constants(query)
+
+    expect(normalized).to eq described_class.normalize(query)
+    expect(constants.map(&:to_a)).to eq [
+      ['1', 7, 1, 1, :integer],
+      ['12561', 26, 5, 2, :integer],
+      ["'124'", 40, 5, 3, :string],
+      ['-1.5', 54, 4, 4, :float],
+      ["B'101'", 67, 6, 5, :bitstring],
+      ['NULL', 82, 4, 6, :null]
+    ]
+  end
+
+  it "numbers constants after existing params" do
+    normalized, constants = described_class.normalize_with_constants('SELECT $1, 2')
+    expect(normalized).to eq 'SELECT $1, $2'
+    expect(constants.map { |c| [c.text, c.param] }).to eq [['2', 2]]
+  end
+
+  it "returns byte offsets" do
+    query = "SELECT 'ü', 'x'"
+    _, constants = described_class.normalize_with_constants(query)
+    expect(constants.map { |c| query.byteslice(c.location, c.length) }).to eq ["'ü'", "'x'"]
+    expect(constants.map(&:text)).to eq ["'ü'", "'x'"]
+  end
+
+  it "raises parse errors" do
+    expect { described_class.normalize_with_constants("SELECT 'ERR") }.to raise_error(PgQuery::ParseError)
+  end
+end
@@ -27,4 +27,19 @@ describe PgQuery, '#param_refs' do
                          {"location"=>49, "length"=>4}]
     end
   end
+
+  context 'param refs in a list' do
+    let(:query) { 'SELECT * FROM x WHERE y IN ($1, $2)' }
+
+    it { is_expected.to eq [{"location"=>28, "length"=>2}, {"location"=>32, "length"=>2}] }
+  end
+
+  context 'large VALUES list' do
+    let(:query) { "INSERT INTO x (a, b) VALUES #{(1..10_000).map { |i| "(#{i}, $#{i})" }.join(', ')}" }
+
+    it 'finds all param refs' do
+      expect(subject.size).to eq 10_000
+      expect(subject.last).to eq("location"=>query.rindex('$'), "length"=>6)
+    end
+  end
 end
@@ -22,6 +22,26 @@ describe PgQuery, '.parse' do
     end)
   end
 
+  it 'builds the same tree as the JSON output of libpg_query' do
+    [
+      "SELECT 1",
+      "SELECT 'a\"b\\c', E'\\n\\t', 'ü' FROM x WHERE y IN (1.5, -2, $1) AND z IS NOT NULL",
+      "SELECT DISTINCT a FROM b",
+      "CREATE TABLE test (id bigint PRIMARY KEY, data jsonb DEFAULT '{}')",
+      "-- nothing"
+    ].each do |query|
+      tree, = described_class._raw_parse_tree(query)
+      json, = described_class._raw_parse(query)
+      expect(tree).to eq JSON.parse(json, max_nesting: 1000)
+    end
+  end
+
+  it 'returns frozen node and field names' do
+    query = described_class.parse("SELECT 1")
+    expect(query.tree[0].keys[0]).to be_frozen
+    expect(query.tree[0][described_class::RAW_STMT].keys[0]).to be_frozen
+  end
+
   it "parses real queries" do
     query = described_class.parse("SELECT memory_total_bytes, memory_free_bytes, memory_pagecache_bytes, memory_buffers_bytes, memory_applications_bytes, (memory_swap_total_bytes - memory_swap_free_bytes) AS swap, date_part($0, s.collected_at) AS collected_at FROM snapshots s JOIN system_snapshots ON (snapshot_id = s.id) WHERE s.database_id = $0 AND s.collected_at BETWEEN $0 AND $0 ORDER BY collected_at")
     expect(query.tree).not_to be_nil
@@ -36,6 +56,11 @@ describe PgQuery, '.parse' do
     expect(query.warnings).to be_empty
   end
 
+  it "returns the parser's warnings" do
+    query = described_class.parse("CREATE GLOBAL TEMPORARY TABLE x (y int)")
+    expect(query.warnings).to eq ["WARNING:  GLOBAL is deprecated in temporary table creation"]
+  end
+
   it "parses floats with leading dot" do
     q = described_class.parse("SELECT .1")
     expr = q.tree[0][described_class::RAW_STMT][described_class::STMT_FIELD][described_class::SELECT_STMT][described_class::TARGET_LIST_FIELD][0][described_class::RES_TARGET]["val"]
@@ -932,3 +957,48 @@ $BODY$
              'location' => 44 } }] } }}}]
   end
 end
+
+describe PgQuery, '.collect_warnings' do
+  after { described_class.collect_warnings = true }
+
+  it "is enabled by default" do
+    expect(described_class.collect_warnings).to eq true
+  end
+
+  # The parser warns about this while parsing (standard_conforming_strings is
+  # always on in libpg_query, so strings don't cause warnings)
+  let(:query) { "CREATE GLOBAL TEMPORARY TABLE x (y int)" }
+  let(:warning) { "WARNING:  GLOBAL is deprecated in temporary table creation" }
+
+  it "returns the parser's warnings" do
+    expect(described_class.parse(query).warnings).to eq [warning]
+    expect(described_class.parse(query, lazy: true).warnings).to eq [warning]
+    expect(described_class.analyze(query).warnings).to eq [warning]
+  end
+
+  it "returns no warnings when disabled" do
+    described_class.collect_warnings = false
+
+    expect(described_class.parse(query).warnings).to eq []
+    expect(described_class.parse(query, lazy: true).warnings).to eq []
+    expect(described_class.analyze(query).warnings).to eq []
+    expect(described_class.parse(query).tree.size).to eq 1
+  end
+
+  it "leaves stderr alone when parsing from multiple threads" do
+    before = STDERR.stat
+
+    threads = Array.new(4) do
+      Thread.new do
+        100.times do
+          described_class.parse("SELECT 'a' FROM x")
+          described_class.fingerprint("SELECT 'a' FROM x")
+        end
+      end
+    end
+    threads.each(&:join)
+
+    after = STDERR.stat
+    expect([after.dev, after.ino]).to eq [before.dev, before.ino]
+  end
+end
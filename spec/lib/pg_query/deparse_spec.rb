@@ -7,6 +7,11 @@ describe PgQuery::Deparse do
   describe '.from' do
     subject { described_class.from(parsetree.first) }
 
+    # Every statement round-trips through the native deparser as well
+    after do
+      expect(PgQuery._deparse_tree([parsetree.first])).to eq described_class.from(parsetree.first)
+    end
+
     context 'SELECT' do
       context 'basic statement' do
         let(:query) { 'SELECT "a" AS b FROM "x" WHERE "y" = 5 AND "z" = "y"' }
@@ -1634,6 +1639,54 @@ describe PgQuery::Deparse do
 
       it { is_expected.to eq oneline_query }
     end
+
+    context 'for a lazily parsed query' do
+      let(:query) { 'SELECT "a", count(*) AS total FROM "x" WHERE "y" IN (1, 2) GROUP BY "a"; DELETE FROM "x"' }
+
+      it 'deparses the native tree the same way' do
+        expect(PgQuery.parse(query, lazy: true).deparse).to eq PgQuery.parse(query).deparse
+      end
+    end
+
+    context 'with keywords as identifiers' do
+      let(:query) { PgQuery::Deparse::KEYWORDS.map { |keyword| format('SELECT 1 AS "%s"', keyword.downcase) }.join('; ') }
+
+      it 'quotes them the same way as the Ruby implementation' do
+        parsed = PgQuery.parse(query)
+        expect(PgQuery._deparse_tree(parsed.tree)).to eq parsed.send(:ruby_deparse, parsed.tree)
+      end
+    end
+
+    context 'for a large query' do
+      let(:query) { format('SELECT "a" FROM "x" WHERE "y" IN (%s); DELETE FROM "x"', (1..10_000).to_a.join(', ')) }
+
+      it 'deparses it the same way with the Ruby implementation' do
+        parsed = PgQuery.parse(query)
+        expect(described_class.from_tree(parsed.tree)).to eq query
+        expect(parsed.deparse).to eq query
+      end
+    end
+
+    context 'with a node type the deparser doesn\'t support' do
+      let(:query) { 'CREATE TRIGGER "t" BEFORE INSERT ON "x" FOR EACH ROW EXECUTE PROCEDURE f()' }
+
+      it 'raises the same error' do
+        expect(PgQuery._deparse_tree(PgQuery.parse(query).tree)).to be_nil
+        expect { PgQuery.parse(query, lazy: true).deparse }.to raise_error(RuntimeError, /Can't deparse: CreateTrigStmt/)
+      end
+    end
+
+    context 'with values that aren\'t part of a regular parse tree' do
+      let(:query) { 'SELECT "a" FROM "x"' }
+
+      it 'falls back to the Ruby implementation' do
+        tree = PgQuery.parse(query).tree
+        tree[0]['RawStmt']['stmt']['SelectStmt']['targetList'][0]['ResTarget']['name'] = :b
+
+        expect(PgQuery._deparse_tree(tree)).to be_nil
+        expect(PgQuery.parse(query).deparse(tree)).to eq 'SELECT "a" AS b FROM "x"'
+      end
+    end
   end
 
   describe PgQuery::Deparse::Interval do
@@ -0,0 +1,93 @@
+require 'spec_helper'
+
+describe PgQuery, 'with Ractors' do
+  before do
+    skip 'Ractors are not supported by this Ruby' unless defined?(Ractor)
+  end
+
+  def ractor_result(ractor)
+    ractor.respond_to?(:value) ? ractor.value : ractor.take
+  end
+
+  def unshareable_constants(mod, seen = {})
+    return [] if seen[mod]
+    seen[mod] = true
+
+    mod.constants(false).flat_map do |name|
+      value = mod.const_get(name, false)
+      found = Ractor.shareable?(value) ? [] : ["#{mod}::#{name}"]
+      found += unshareable_constants(value, seen) if value.is_a?(Module) && value.name.to_s.start_with?('PgQuery')
+      found
+    end
+  end
+
+  it "only has shareable constants" do
+    expect(unshareable_constants(PgQuery)).to eq []
+  end
+
+  it "parses, fingerprints and deparses in a Ractor" do
+    query = "SELECT * FROM x WHERE y = 'a' AND z = INTERVAL '1' YEAR TO MONTH"
+    ractor = Ractor.new(query) do |q|
+      parsed = PgQuery.parse(q)
+      [parsed.fingerprint, parsed.tables, parsed.deparse, PgQuery.normalize(q)]
+    end
+
+    parsed = described_class.parse(query)
+    expect(ractor_result(ractor)).to eq [parsed.fingerprint, parsed.tables, parsed.deparse, described_class.normalize(query)]
+  end
+
+  it "raises parse errors in a Ractor" do
+    ractor = Ractor.new do
+      begin
+        PgQuery.parse("SELECT 'ERR")
+      rescue PgQuery::ParseError => e
+        e.location
+      end
+    end
+
+    expect(ractor_result(ractor)).to eq 8
+  end
+
+  it "doesn't use the cache outside of the main Ractor" do
+    described_class.cache = PgQuery::Cache.new(max_bytes: 1024 * 1024)
+    ractor = Ractor.new { PgQuery.fingerprint('SELECT 1') }
+
+    expect(ractor_result(ractor)).to eq described_class.fingerprint('SELECT 1')
+    expect(described_class.cache.stats[:entries]).to eq 1
+  ensure
+    described_class.cache = nil
+  end
+
+  it "parses and fingerprints many queries in a Ractor" do
+    queries = ['SELECT 1', 'SELECT * FROM x WHERE y = 2']
+    ractor = Ractor.new(queries) do |q|
+      [PgQuery.parse_many(q).map(&:tables), PgQuery.fingerprint_many(q)]
+    end
+
+    expect(ractor_result(ractor)).to eq [queries.map { |q| described_class.parse(q).tables }, queries.map { |q| described_class.fingerprint(q) }]
+  end
+
+  it "only changes the batch threads from the main Ractor" do
+    ractor = Ractor.new do
+      begin
+        PgQuery.batch_threads = 1
+      rescue Ractor::UnsafeError => e
+        [e.message, PgQuery.batch_threads]
+      end
+    end
+
+    expect(ractor_result(ractor)).to eq ['PgQuery.batch_threads can only be changed from the main Ractor', described_class.batch_threads]
+  end
+
+  it "only changes settings from the main Ractor" do
+    ractor = Ractor.new do
+      begin
+        PgQuery.collect_warnings = false
+      rescue Ractor::UnsafeError => e
+        [e.message, PgQuery.collect_warnings]
+      end
+    end
+
+    expect(ractor_result(ractor)).to eq ['PgQuery.collect_warnings can only be changed from the main Ractor', true]
+  end
+end
@@ -0,0 +1,48 @@
+require 'spec_helper'
+
+describe PgQuery, '.scan' do
+  it "returns tokens with their byte positions" do
+    query = "SELECT a, 'b' FROM c -- x\nWHERE d = $1 /* y */"
+
+    expect(described_class.scan(query)).to eq [
+      [:SELECT, :reserved_keyword, 0, 6],
+      [:IDENT, nil, 7, 8],
+      [:",", nil, 8, 9],
+      [:SCONST, nil, 10, 13],
+      [:FROM, :reserved_keyword, 14, 18],
+      [:IDENT, nil, 19, 20],
+      [:SQL_COMMENT, nil, 21, 25],
+      [:WHERE, :reserved_keyword, 26, 31],
+      [:IDENT, nil, 32, 33],
+      [:"=", nil, 34, 35],
+      [:PARAM, nil, 36, 38],
+      [:C_COMMENT, nil, 39, 46]
+    ]
+  end
+
+  it "returns keyword kinds" do
+    tokens = described_class.scan('SELECT name::int FROM t LEFT JOIN u ON true')
+    expect(tokens.map { |t| t[0..1] }).to eq [
+      [:SELECT, :reserved_keyword], [:NAME, :unreserved_keyword], [:TYPECAST, nil], [:INT, :col_name_keyword],
+      [:FROM, :reserved_keyword], [:IDENT, nil], [:LEFT, :type_func_name_keyword], [:JOIN, :type_func_name_keyword],
+      [:IDENT, nil], [:ON, :reserved_keyword], [:TRUE, :reserved_keyword]
+    ]
+  end
+
+  it "returns byte offsets for multibyte text" do
+    query = "SELECT 'ü' || x"
+    tokens = described_class.scan(query)
+    expect(tokens.map { |_, _, start, stop| query.byteslice(start...stop) }).to eq ["SELECT", "'ü'", '||', 'x']
+  end
+
+  it "scans queries that don't parse" do
+    expect(described_class.scan('SELECT FROM FROM').map(&:first)).to eq %i[SELECT FROM FROM]
+  end
+
+  it "raises on invalid tokens" do
+    expect { described_class.scan("SELECT 'ERR") }.to(raise_error do |error|
+      expect(error).to be_a(PgQuery::ParseError)
+      expect(error.location).to eq 8
+    end)
+  end
+end
@@ -0,0 +1,36 @@
+require 'spec_helper'
+
+describe PgQuery, '.statements' do
+  let(:query) { "SELECT * FROM x WHERE y = 1; UPDATE x SET y = 'a' WHERE id = $1;\n-- comment\nDELETE FROM x" }
+
+  it "returns the location and type of each statement" do
+    statements = described_class.statements(query)
+
+    expect(statements.map(&:type)).to eq %w[SelectStmt UpdateStmt DeleteStmt]
+    expect(statements.map { |s| query.byteslice(s.location, s.length) }).to eq [
+      'SELECT * FROM x WHERE y = 1',
+      " UPDATE x SET y = 'a' WHERE id = $1",
+      "\n-- comment\nDELETE FROM x"
+    ]
+  end
+
+  it "returns the same fingerprint and normalized text as for each statement by itself" do
+    described_class.statements(query).each do |statement|
+      text = query.byteslice(statement.location, statement.length)
+      expect(statement.fingerprint).to eq described_class.fingerprint(text)
+      expect(statement.normalized).to eq described_class.normalize(text)
+    end
+  end
+
+  it "numbers constants from $1 in each statement" do
+    expect(described_class.statements('SELECT 1; SELECT 2, $1').map(&:normalized)).to eq ['SELECT $1', ' SELECT $2, $1']
+  end
+
+  it "returns no statements for empty queries" do
+    expect(described_class.statements('')).to eq []
+  end
+
+  it "raises parse errors" do
+    expect { described_class.statements('SELECT 1; SELECT FROM FROM') }.to raise_error(PgQuery::ParseError)
+  end
+end
@@ -0,0 +1,62 @@
+require 'spec_helper'
+
+describe PgQuery, '.thread_arenas' do
+  let(:queries) { ['SELECT 1', "SELECT * FROM x WHERE y = 'z' AND a IN (1, 2)", 'SELECT $1; DELETE FROM t'] }
+
+  after { described_class.thread_arenas = false }
+
+  def results(query)
+    analysis = described_class.analyze(query)
+    [described_class._raw_parse(query), described_class.parse(query).tree, described_class.normalize(query),
+     [analysis.normalized, analysis.fingerprint, analysis.tables_with_types, analysis.param_refs],
+     described_class.scan(query), described_class.parse(query, lazy: true).tree]
+  end
+
+  it "is disabled by default" do
+    expect(described_class.thread_arenas).to eq false
+  end
+
+  it "returns the same results as without arenas" do
+    expected = queries.map { |query| results(query) }
+
+    described_class.thread_arenas = true
+    expect(described_class.thread_arenas).to eq true
+
+    3.times do
+      expect(queries.map { |query| results(query) }).to eq expected
+    end
+  end
+
+  it "raises the same errors" do
+    described_class.thread_arenas = true
+
+    2.times do
+      expect { described_class.parse('SELECT FROM FROM') }.to raise_error(PgQuery::ParseError, /syntax error at or near "FROM"/)
+      expect { described_class.normalize('SELECT * FROM') }.to raise_error(PgQuery::ParseError)
+      expect(described_class.parse('SELECT 1').tree.size).to eq 1
+    end
+  end
+
+  it "works with results of different sizes" do
+    described_class.thread_arenas = true
+
+    large = 'SELECT ' + (1..5000).map { |i| "col_#{i}" }.join(', ')
+    [large, 'SELECT 1', large, 'SELECT 2'].each do |query|
+      expect(described_class.normalize(query)).to eq query
+    end
+  end
+
+  it "works from multiple threads" do
+    expected = queries.map { |query| described_class.normalize(query) }
+    described_class.thread_arenas = true
+
+    threads = Array.new(4) do
+      Thread.new { Array.new(100) { |i| described_class.normalize(queries[i % queries.size]) } }
+    end
+
+    threads.each do |thread|
+      expect(thread.value).to eq Array.new(100) { |i| expected[i % queries.size] }
+    end
+    expect(described_class.parse_many(queries).map(&:tree)).to eq queries.map { |query| described_class.parse(query).tree }
+  end
+end
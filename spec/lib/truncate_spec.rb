@@ -30,4 +30,45 @@ describe PgQuery, '#truncate' do
     query = 'SELECT CASE WHEN $2.typtype = ? THEN $2.typtypmod ELSE $1.atttypmod END'
     expect(described_class.parse(query).truncate(50)).to eq 'SELECT ...'
   end
+
+  it 'omits the longest part of a large query' do
+    columns = (1..1000).map { |i| "col_#{i}" }.join(', ')
+    query = "SELECT #{columns} FROM x WHERE a = b"
+    expect(described_class.parse(query).truncate(40)).to eq 'SELECT ... FROM "x" WHERE "a" = "b"'
+  end
+
+  it 'leaves the tree unchanged' do
+    query = described_class.parse('SELECT a, b, c, d, e, f FROM xyz WHERE a = b')
+    original = query.deep_dup(query.tree)
+    expect(query.truncate(40)).to eq 'SELECT ... FROM "xyz" WHERE "a" = "b"'
+    expect(query.tree).to eq original
+  end
+
+  it 'works on frozen (cached) trees' do
+    query = described_class.parse('WITH x AS (SELECT * FROM y) SELECT * FROM x')
+    PgQuery::Cache.deep_freeze(query.tree)
+    expect(query.truncate(40)).to eq 'WITH x AS (...) SELECT * FROM "x"'
+  end
+
+  context 'with source: true' do
+    it 'omits parts of the original query text' do
+      query = 'SELECT a, b, c, d, e, f FROM xyz WHERE a = b'
+      expect(described_class.parse(query).truncate(40, source: true)).to eq 'SELECT ... FROM xyz WHERE a = b'
+    end
+
+    it 'keeps the formatting of the query' do
+      query = "WITH x AS (\n  SELECT * FROM y\n) SELECT * FROM x"
+      expect(described_class.parse(query).truncate(40, source: true)).to eq "WITH x AS (\n  ...\n) SELECT * FROM x"
+    end
+
+    it 'works for queries the deparser does not support' do
+      query = 'SELECT GREATEST(a, b), c, d FROM t WHERE e = 1'
+      expect(described_class.parse(query).truncate(40, source: true)).to eq 'SELECT ... FROM t WHERE e = 1'
+    end
+
+    it 'performs a simple truncation if necessary' do
+      query = 'SELECT * FROM t'
+      expect(described_class.parse(query).truncate(10, source: true)).to eq 'SELECT ...'
+    end
+  end
 end
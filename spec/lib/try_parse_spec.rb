@@ -0,0 +1,71 @@
+require 'spec_helper'
+
+describe PgQuery, '.try_parse' do
+  let(:query) { "SELECT * FROM x WHERE y = 'z'" }
+  let(:invalid) { 'SELECT * FROM x WHERE' }
+
+  it "returns the parsed query" do
+    result = described_class.try_parse(query)
+    expect(result.ok?).to eq true
+    expect(result.error?).to eq false
+    expect(result.error).to be_nil
+    expect(result.value.tree).to eq described_class.parse(query).tree
+    expect(result.value!.tables).to eq ['x']
+  end
+
+  it "returns the parsed query lazily" do
+    expect(described_class.try_parse(query, lazy: true).value.tree).to eq described_class.parse(query).tree
+  end
+
+  it "returns errors instead of raising them" do
+    result = described_class.try_parse(invalid)
+    expect(result.ok?).to eq false
+    expect(result.value).to be_nil
+    expect(result.message).to eq 'syntax error at end of input'
+    expect(result.cursorpos).to eq 22
+    expect(described_class.try_parse(invalid, lazy: true).message).to eq result.message
+  end
+
+  it "returns the same error PgQuery.parse raises" do
+    result = described_class.try_parse(invalid)
+    expect(result.error).to be_a PgQuery::ParseError
+    expect { described_class.parse(invalid) }.to raise_error(PgQuery::ParseError, result.error.message)
+    expect(result.error.location).to eq 22
+    expect { result.value! }.to raise_error(PgQuery::ParseError, result.error.message)
+  end
+
+  it "caches successful results only" do
+    described_class.cache = PgQuery::Cache.new(max_bytes: 1024 * 1024)
+    described_class.try_parse(invalid)
+    described_class.try_parse(query)
+    described_class.try_parse(query)
+    expect(described_class.cache.stats).to include(hits: 1, entries: 1)
+  ensure
+    described_class.cache = nil
+  end
+end
+
+describe PgQuery, '.try_normalize' do
+  it "returns the normalized query" do
+    expect(described_class.try_normalize("SELECT 'a'").value).to eq 'SELECT $1'
+  end
+
+  it "returns errors instead of raising them" do
+    result = described_class.try_normalize("SELECT 'ERR")
+    expect(result.error?).to eq true
+    expect(result.message).to eq "unterminated quoted string at or near \"'ERR\""
+    expect(result.cursorpos).to eq 8
+  end
+end
+
+describe PgQuery, '.try_fingerprint' do
+  it "returns the fingerprint" do
+    expect(described_class.try_fingerprint('SELECT 1').value).to eq described_class.fingerprint('SELECT 1')
+  end
+
+  it "returns errors instead of raising them" do
+    result = described_class.try_fingerprint('SELECT 1 FROM')
+    expect(result.error?).to eq true
+    expect { described_class.fingerprint('SELECT 1 FROM') }.to raise_error(PgQuery::ParseError, result.error.message)
+  end
+end